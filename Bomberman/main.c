@@ -7,8 +7,25 @@
 #include <allegro5/allegro_acodec.h>     
 #include <stdio.h>
 #include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
 #include <time.h>
 #include <math.h> 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /**
  * @file main.c
@@ -19,14 +36,22 @@
  */
 
  // --- Definicje globalne ---
- /** @def MAP_WIDTH Szerokość mapy w kafelkach. */
+ /** @def MAP_WIDTH Domyślna szerokość mapy w kafelkach. */
 #define MAP_WIDTH 15            
-/** @def MAP_HEIGHT Wysokość mapy w kafelkach. */
+/** @def MAP_HEIGHT Domyślna wysokość mapy w kafelkach. */
 #define MAP_HEIGHT 13           
 /** @def TILE_SIZE Rozmiar pojedynczego kafelka na mapie w pikselach. */
 #define TILE_SIZE 32            
 /** @def HUD_HEIGHT Wysokość paska interfejsu użytkownika (HUD) w pikselach. */
 #define HUD_HEIGHT (TILE_SIZE * 2) 
+/** @def VIEW_WIDTH Szerokość widocznego obszaru mapy w kafelkach. Większą mapę przewija kamera. */
+#define VIEW_WIDTH 15
+/** @def VIEW_HEIGHT Wysokość widocznego obszaru mapy w kafelkach. */
+#define VIEW_HEIGHT 13
+/** @def TICK_RATE Częstotliwość klatek symulacji (Hz). */
+#define TICK_RATE 60
+/** @def BACKGROUND_TICK_RATE Częstotliwość klatek, gdy okno gry nie ma fokusu (Hz). */
+#define BACKGROUND_TICK_RATE 10
 
 // --- Globalne wskaźniki na zasoby Allegro ---
 /** @var font_main Główna czcionka używana w grze. */
@@ -53,10 +78,8 @@ ALLEGRO_BITMAP* sparks_sprite = NULL;
 ALLEGRO_BITMAP* exit_sprite = NULL;
 
 // Zasoby audio
-/** @var background_music_sample Wskaźnik do załadowanego pliku muzyki tła. */
-ALLEGRO_SAMPLE* background_music_sample = NULL;
-/** @var background_music_instance Wskaźnik do instancji muzyki tła, używanej do odtwarzania. */
-ALLEGRO_SAMPLE_INSTANCE* background_music_instance = NULL;
+/** @var background_music_stream Strumień muzyki tła, dekodowany z dysku kawałkami podczas odtwarzania. */
+ALLEGRO_AUDIO_STREAM* background_music_stream = NULL;
 
 // --- Typy wyliczeniowe (enumy) ---
 
@@ -91,10 +114,122 @@ typedef enum {
     DESTRUCTIBLE_WALL, ///< Zniszczalna ściana (pudełko), którą można zniszczyć bombą.
 } TILE_TYPE;
 
-/** @var game_map Dwuwymiarowa tablica reprezentująca mapę gry.
- * Przechowuje typ każdego kafelka na mapie.
+// --- Definicje dla mapy podzielonej na fragmenty ---
+/** @def CHUNK_SHIFT Logarytm (o podstawie 2) boku fragmentu mapy w kafelkach. */
+#define CHUNK_SHIFT 5
+/** @def CHUNK_SIZE Bok kwadratowego fragmentu mapy w kafelkach (32). */
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+/** @def CHUNK_TILES Liczba kafelków w jednym fragmencie. */
+#define CHUNK_TILES (CHUNK_SIZE * CHUNK_SIZE)
+/** @def CHUNK_PACKED_BYTES Rozmiar fragmentu zapisanego na dysku (2 bity na kafelek). */
+#define CHUNK_PACKED_BYTES (CHUNK_TILES / 4)
+/** @def MAP_MAX_RESIDENT_CHUNKS Maksymalna liczba fragmentów trzymanych w pamięci; pozostałe trafiają do pliku wymiany. */
+#define MAP_MAX_RESIDENT_CHUNKS 64
+/** @def MAP_HOT_RADIUS Promień (we fragmentach) obszaru wokół gracza i aktywnych bomb, który jest zawsze w pamięci. */
+#define MAP_HOT_RADIUS 1
+/** @def MAP_JOURNAL_CAPACITY Początkowa pojemność dziennika zmian kafelków (potęga dwójki); dziennik rośnie, gdy zmiany od najstarszej potrzebnej pozycji się nie mieszczą. */
+#define MAP_JOURNAL_CAPACITY 4096
+/** @def MAP_REPORT_INTERVAL Co ile klatek wypisywane są statystyki stronicowania mapy. */
+#define MAP_REPORT_INTERVAL 600
+/** @def MAP_SWAP_FILE Plik wymiany dla fragmentów wyrzuconych z pamięci. */
+#define MAP_SWAP_FILE "bomberman_world.swap"
+/** @def ENDURANCE_MAP_WIDTH Szerokość mapy trybu wytrzymałościowego (--endurance). */
+#define ENDURANCE_MAP_WIDTH 4097
+/** @def ENDURANCE_MAP_HEIGHT Wysokość mapy trybu wytrzymałościowego (--endurance). */
+#define ENDURANCE_MAP_HEIGHT 4097
+
+/** @enum BLAST_DIRECTION
+ * @brief Kierunki promieni eksplozji (indeksy `MapChunk::stop`, `Bomb::blast_len`, `blast_dx`, `blast_dy`).
  */
-int game_map[MAP_HEIGHT][MAP_WIDTH];
+typedef enum {
+    BLAST_UP,    ///< Promień w górę.
+    BLAST_DOWN,  ///< Promień w dół.
+    BLAST_LEFT,  ///< Promień w lewo.
+    BLAST_RIGHT, ///< Promień w prawo.
+    BLAST_DIRECTIONS ///< Liczba promieni.
+} BLAST_DIRECTION;
+
+/** @var blast_dx Przesunięcie X kolejnych pól promienia, indeksowane BLAST_DIRECTION. */
+static const int blast_dx[BLAST_DIRECTIONS] = { 0, 0, -1, 1 };
+/** @var blast_dy Przesunięcie Y kolejnych pól promienia, indeksowane BLAST_DIRECTION. */
+static const int blast_dy[BLAST_DIRECTIONS] = { -1, 1, 0, 0 };
+
+/**
+ * @struct MapChunk
+ * @brief Fragment mapy CHUNK_SIZE x CHUNK_SIZE kafelków, załadowany do jednego ze slotów pamięci.
+ * * Razem z kafelkami fragment przechowuje indeks przeszkód: dla każdego kafelka i kierunku odległość
+ * do najbliższej ściany (zniszczalnej lub nie) w obrębie fragmentu, a gdy takiej nie ma - do pierwszego
+ * kafelka za krawędzią fragmentu. Indeks jest liczony przy ładowaniu fragmentu, a po zmianie kafelka
+ * poprawiany tylko w jego wierszu i kolumnie.
+ */
+typedef struct {
+    unsigned char tiles[CHUNK_TILES]; ///< Typy kafelków (TILE_TYPE), wierszami.
+    unsigned char stop[BLAST_DIRECTIONS][CHUNK_TILES]; ///< Indeks przeszkód (1..CHUNK_SIZE), indeksowany BLAST_DIRECTION i kafelkiem.
+    int chunk;                        ///< Indeks fragmentu w katalogu mapy (-1 oznacza wolny slot).
+    bool modified;                    ///< Czy fragment różni się od kopii na dysku lub od wygenerowanego.
+    unsigned last_use;                ///< Znacznik ostatniego dostępu (do wyboru fragmentu do wyrzucenia).
+    unsigned pinned;                  ///< Numer klatki, w której fragment był w gorącym obszarze.
+} MapChunk;
+
+/**
+ * @struct MapChunkEntry
+ * @brief Wpis katalogu fragmentów: gdzie aktualnie znajduje się dany fragment mapy.
+ */
+typedef struct {
+    short slot;   ///< Slot w pamięci (-1 - fragment nie jest załadowany).
+    bool on_disk; ///< Czy zmodyfikowana kopia fragmentu leży w pliku wymiany (inaczej jest generowany od nowa).
+} MapChunkEntry;
+
+/**
+ * @struct MapJournalEntry
+ * @brief Pojedyncza zmiana kafelka zapisana w dzienniku mapy.
+ */
+typedef struct {
+    int x, y;               ///< Współrzędne zmienionego kafelka.
+    unsigned char old_type; ///< Typ kafelka przed zmianą.
+} MapJournalEntry;
+
+/**
+ * @struct WorldMap
+ * @brief Mapa gry podzielona na fragmenty, ładowane leniwie przy pierwszym dostępie.
+ * * Niezmieniony fragment jest w całości wyznaczony przez ziarno mapy, więc przy pierwszym dostępie
+ * jest generowany, a przy wyrzuceniu z pamięci po prostu porzucany. Fragmenty zmienione (zniszczone
+ * ściany) są przy wyrzuceniu pakowane do 2 bitów na kafelek i zapisywane w pliku wymiany.
+ * Do kafelków należy się odwoływać wyłącznie przez mapa_kafelek i ustaw_kafelek.
+ */
+typedef struct {
+    int width, height;         ///< Rozmiar mapy w kafelkach.
+    int chunks_x, chunks_y;    ///< Rozmiar mapy we fragmentach.
+    uint32_t seed;             ///< Ziarno generatora kafelków.
+    MapChunkEntry* directory;  ///< Katalog wszystkich fragmentów (chunks_x * chunks_y wpisów).
+    MapChunk* slots;           ///< Fragmenty załadowane do pamięci.
+    int slot_count;            ///< Liczba slotów: tyle, ile mapa ma fragmentów, najwyżej MAP_MAX_RESIDENT_CHUNKS.
+    unsigned use_clock;        ///< Licznik dostępów (źródło znaczników last_use).
+    unsigned pin_clock;        ///< Numer bieżącej klatki dla znaczników pinned.
+    ALLEGRO_FILE* swap;        ///< Plik wymiany (NULL, gdy cała mapa mieści się w pamięci).
+    MapJournalEntry* journal;  ///< Bufor pierścieniowy ostatnich zmian kafelków.
+    uint32_t journal_capacity; ///< Pojemność dziennika (potęga dwójki).
+    uint32_t journal_head;     ///< Liczba wszystkich zapisanych zmian (pozycja następnego wpisu).
+    uint32_t journal_floor;    ///< Najstarsza pozycja, do której można jeszcze cofnąć mapę (mapa_przytnij_dziennik).
+    uint64_t hash;             ///< Skrót Zobrista kafelków, poprawiany przy każdej zmianie kafelka (mapa_zapisz_kafelek).
+    const unsigned char* level_chunks; ///< Spakowane fragmenty poziomu z paczki (NULL - kafelki z generatora).
+    int walls;                 ///< Liczba pudełek, poprawiana przy każdej zmianie kafelka (-1 - mapa zbyt duża, by policzyć ją na starcie).
+
+    int stat_generated;        ///< Liczba wygenerowanych fragmentów od ostatniego raportu.
+    int stat_page_ins;         ///< Liczba fragmentów wczytanych z pliku wymiany.
+    int stat_page_outs;        ///< Liczba fragmentów zapisanych do pliku wymiany.
+    int stat_dropped;          ///< Liczba niezmienionych fragmentów porzuconych bez zapisu.
+} WorldMap;
+
+/** @var main_map Mapa gry prowadzonej w oknie. */
+WorldMap main_map;
+/** @var game_map Mapa, na której działa symulacja: `main_map` albo mapa aktywnego środowiska treningowego. */
+WorldMap* game_map = &main_map;
+
+/** @var world_width Szerokość mapy tworzonej dla nowej gry (--map=WxH, --endurance). */
+int world_width = MAP_WIDTH;
+/** @var world_height Wysokość mapy tworzonej dla nowej gry. */
+int world_height = MAP_HEIGHT;
 
 // --- Zmienne związane z wyjściem z poziomu ---
 /** @var exit_x Współrzędna X ukrytego wyjścia na mapie. */
@@ -104,12 +239,284 @@ int exit_y = -1;
 /** @var exit_revealed Flaga wskazująca, czy wyjście zostało odkryte przez gracza. */
 bool exit_revealed = false;
 
-// --- Definicje dla gracza ---
-/** @def PLAYER_MAX_LIVES Maksymalna liczba żyć, jaką może posiadać gracz. */
-#define PLAYER_MAX_LIVES 3       
-/** @def INVINCIBILITY_DURATION Czas trwania nietykalności gracza po otrzymaniu obrażeń, w klatkach. */
-#define INVINCIBILITY_DURATION 120 
+// --- Definicje dla losowania pól startowych ---
+/** @def SPAWN_SAMPLE_ATTEMPTS Limit losowań pola danego typu (gracz, wrogowie, wyjście) przed uznaniem, że go nie ma. */
+#define SPAWN_SAMPLE_ATTEMPTS 4096
+/** @def ENEMY_SPAWN_MIN_DISTANCE Najmniejsza odległość (w każdej osi) wroga od gracza na starcie gry. */
+#define ENEMY_SPAWN_MIN_DISTANCE 3
+
+/**
+ * @struct CellSet
+ * @brief Zbiór zajętych pól mapy (tablica z haszowaniem otwartym), z dodawaniem i sprawdzaniem w O(1).
+ * * Rozmiar zależy od liczby obiektów na starcie gry, a nie od rozmiaru mapy.
+ */
+typedef struct {
+    uint64_t* keys; ///< Klucze pól ((y + 1) << 32 | x); 0 oznacza wolną przegródkę.
+    int capacity;   ///< Liczba przegródek (potęga dwójki).
+    int count;      ///< Liczba pól w zbiorze.
+} CellSet;
+
+/** @var spawn_taken Pola zajęte przez gracza, wyjście i rozstawionych już wrogów. */
+CellSet spawn_taken;
+
+// --- Definicje dla zestawów reguł gry ---
+/** @def MAX_BOMB_RADIUS Górna granica reguły max-radius (promienie eksplozji są zapisywane jako liczby 16-bitowe). */
+#define MAX_BOMB_RADIUS 1024
+
+/** @def RULES_INLINE Wymusza wklejenie funkcji symulacji, które dostają zestaw reguł jako parametr.
+ * Dzięki temu wywołanie ze stałym zestawem (krok_symulacji) daje osobną, wyspecjalizowaną kopię
+ * symulacji, w której wszystkie reguły są stałymi kompilacji.
+ */
+#if defined(_MSC_VER)
+#define RULES_INLINE static __forceinline
+#else
+#define RULES_INLINE static inline __attribute__((always_inline))
+#endif
+
+/** @enum RULESET
+ * @brief Zestawy reguł gry. Zestawy wbudowane mają wyspecjalizowane kopie symulacji,
+ * RULESET_CUSTOM (reguły z wiersza poleceń) korzysta z wersji czytającej reguły w czasie działania.
+ */
+typedef enum {
+    RULESET_CLASSIC,     ///< Klasyczne reguły.
+    RULESET_LARGE_ARENA, ///< Reguły dla dużych map: dłuższy lont i nietykalność, więcej żyć.
+    RULESET_CHAOS,       ///< Szybkie bomby i wrogowie, power-up z każdego wroga.
+    RULESET_CUSTOM,      ///< Reguły eksperymentalne ustawione argumentami --rule.
+    RULESET_COUNT        ///< Liczba zestawów reguł.
+} RULESET;
+
+/**
+ * @struct GameRules
+ * @brief Zestaw reguł gry. Wszystkie czasy są w klatkach symulacji.
+ */
+typedef struct {
+    RULESET id;               ///< Identyfikator zestawu (wybiera wyspecjalizowaną kopię symulacji).
+    const char* name;         ///< Nazwa zestawu (--rules=NAZWA).
+    int bomb_fuse_ticks;      ///< Czas od podłożenia bomby do jej wybuchu.
+    int explosion_ticks;      ///< Czas trwania efektu eksplozji.
+    int enemy_move_delay;     ///< Minimalne opóźnienie między próbami ruchu wroga (losowo do 1.5x).
+    int powerup_drop_chance;  ///< Szansa na power-up z pokonanego wroga (1 do N).
+    int invincibility_ticks;  ///< Czas nietykalności gracza po otrzymaniu obrażeń.
+    int max_bomb_radius;      ///< Największy promień rażenia osiągalny power-upami (co najwyżej MAX_BOMB_RADIUS).
+    int max_lives;            ///< Liczba żyć na starcie i ich górny limit.
+    int points_per_enemy;     ///< Punkty za pokonanie wroga.
+    int points_per_wall;      ///< Punkty za zniszczenie ściany.
+} GameRules;
+
+/** @var rules_classic Reguły klasyczne (stałe, więc kompilator wkleja ich wartości w wyspecjalizowaną symulację). */
+static const GameRules rules_classic = { RULESET_CLASSIC, "classic", 120, 30, 30, 3, 120, 7, 3, 100, 10 };
+/** @var rules_large_arena Reguły dla dużych map. */
+static const GameRules rules_large_arena = { RULESET_LARGE_ARENA, "large-arena", 150, 30, 24, 2, 180, 7, 5, 100, 10 };
+/** @var rules_chaos Reguły trybu chaosu. */
+static const GameRules rules_chaos = { RULESET_CHAOS, "chaos", 60, 20, 12, 1, 60, 7, 3, 200, 20 };
+
+/** @var shipped_rules Wbudowane zestawy reguł, indeksowane RULESET. */
+const GameRules* const shipped_rules[RULESET_CUSTOM] = { &rules_classic, &rules_large_arena, &rules_chaos };
+
+/** @var rules_custom Reguły eksperymentalne budowane z argumentów --rule=KLUCZ=WARTOŚĆ. */
+GameRules rules_custom;
+/** @var rules_override Zestaw reguł wybrany w wierszu poleceń (NULL - domyślny dla trybu gry). */
+const GameRules* rules_override = NULL;
+/** @var active_rules Reguły bieżącej gry. */
+const GameRules* active_rules = &rules_classic;
+
+/**
+ * @struct RuleField
+ * @brief Opis pola GameRules ustawianego argumentem --rule=KLUCZ=WARTOŚĆ.
+ */
+typedef struct {
+    const char* key; ///< Klucz w wierszu poleceń.
+    size_t offset;   ///< Położenie pola int w GameRules.
+    int min, max;    ///< Dopuszczalny zakres wartości.
+} RuleField;
+
+/** @def RULE_FIELD_COUNT Liczba pól reguł ustawianych z wiersza poleceń (i zapisywanych w paczce poziomów). */
+#define RULE_FIELD_COUNT 9
+
+/** @var rule_fields Pola reguł, które można zmienić z wiersza poleceń. */
+const RuleField rule_fields[RULE_FIELD_COUNT] = {
+    { "fuse",          offsetof(GameRules, bomb_fuse_ticks),     1, 100000 },
+    { "explosion",     offsetof(GameRules, explosion_ticks),     1, 100000 },
+    { "enemy-delay",   offsetof(GameRules, enemy_move_delay),    2, 100000 },
+    { "drop-chance",   offsetof(GameRules, powerup_drop_chance), 1, 1000 },
+    { "invincibility", offsetof(GameRules, invincibility_ticks), 1, 100000 },
+    { "max-radius",    offsetof(GameRules, max_bomb_radius),     1, MAX_BOMB_RADIUS },
+    { "lives",         offsetof(GameRules, max_lives),           1, 99 },
+    { "enemy-points",  offsetof(GameRules, points_per_enemy),    0, 100000 },
+    { "wall-points",   offsetof(GameRules, points_per_wall),     0, 100000 }
+};
+
+// --- Definicje dla pul obiektów ---
+/** @def POOL_INDEX_BITS Liczba bitów indeksu slotu w uchwycie obiektu; pozostałe bity to generacja slotu. */
+#define POOL_INDEX_BITS 20
+/** @def POOL_INDEX_MASK Maska indeksu slotu w uchwycie. */
+#define POOL_INDEX_MASK ((1u << POOL_INDEX_BITS) - 1)
+/** @def POOL_GENERATION_MASK Maska generacji slotu (12 bitów). */
+#define POOL_GENERATION_MASK ((1u << (32 - POOL_INDEX_BITS)) - 1)
+/** @def POOL_MAX_CAPACITY Największa pojemność puli, jaką da się zaadresować uchwytem. */
+#define POOL_MAX_CAPACITY (1 << POOL_INDEX_BITS)
+/** @def HANDLE_NONE Uchwyt niewskazujący żadnego obiektu (generacja 0 nigdy nie jest przydzielana). */
+#define HANDLE_NONE 0u
+
+/** @typedef EntityHandle Uchwyt obiektu w puli: generacja slotu (12 bitów) i indeks slotu (20 bitów). */
+typedef uint32_t EntityHandle;
+
+/**
+ * @struct EntityPool
+ * @brief Pula obiektów jednego typu w ciągłej tablicy z listą wolnych slotów.
+ * Przydział i zwolnienie kosztują O(1). Zwolnienie zmienia generację slotu, więc stary uchwyt
+ * do zwolnionego obiektu jest rozpoznawany jako nieaktualny. Pula rośnie (podwaja się) tylko,
+ * gdy zabraknie w niej miejsca - w stanie ustalonym nie przydziela pamięci.
+ */
+typedef struct {
+    const char* name;          ///< Nazwa puli w statystykach.
+    unsigned char* items;      ///< Elementy puli (po item_size bajtów).
+    uint16_t* generations;     ///< Generacja każdego slotu.
+    int* next_free;            ///< Następny slot na liście wolnych (-1 - koniec).
+    unsigned char* live;       ///< Czy slot jest zajęty.
+    int item_size;             ///< Rozmiar elementu w bajtach.
+    int capacity;              ///< Liczba slotów z przydzieloną pamięcią.
+    int used;                  ///< Liczba slotów użytych od resetu; pętle po obiektach kończą się na niej.
+    int count;                 ///< Liczba zajętych slotów.
+    int free_head;             ///< Pierwszy zwolniony slot poniżej `used` (-1 - brak, bierze się slot `used`).
+    int stat_peak;             ///< Największa liczba zajętych slotów.
+    int stat_grows;            ///< Ile razy pula musiała urosnąć.
+    int stat_stale;            ///< Liczba odrzuconych nieaktualnych uchwytów.
+} EntityPool;
+
+/**
+ * @struct PoolImage
+ * @brief Kopia zajętej części puli w migawce rollbacku. Bufory rosną razem z pulą
+ * i są używane ponownie przy kolejnych zapisach.
+ */
+typedef struct {
+    unsigned char* items;      ///< Kopia elementów [0, used).
+    uint16_t* generations;     ///< Kopia generacji slotów.
+    int* next_free;            ///< Kopia listy wolnych slotów.
+    unsigned char* live;       ///< Kopia flag zajętości.
+    int capacity;              ///< Liczba slotów, na które starcza buforów.
+    int used;                  ///< Wartość `used` puli.
+    int count;                 ///< Wartość `count` puli.
+    int free_head;             ///< Wartość `free_head` puli.
+} PoolImage;
+
+/** @enum GAME_MODE
+ * @brief Tryby gry; każdy ma własny rozmiar mapy, liczbę wrogów i pojemności pul.
+ */
+typedef enum {
+    GAME_MODE_CLASSIC,   ///< Klasyczna plansza 15 x 13.
+    GAME_MODE_ENDURANCE, ///< Tryb wytrzymałościowy na ogromnej mapie (--endurance).
+    GAME_MODE_COUNT      ///< Liczba trybów.
+} GAME_MODE;
+
+/**
+ * @struct GameModeConfig
+ * @brief Parametry trybu gry. Pojemności to początkowe rozmiary pul - pule mogą urosnąć,
+ * ale przy pojemności dobranej do trybu nie przydzielają pamięci w trakcie gry.
+ */
+typedef struct {
+    const char* name;       ///< Nazwa trybu.
+    int map_width;          ///< Domyślna szerokość mapy.
+    int map_height;         ///< Domyślna wysokość mapy.
+    int enemy_count;        ///< Liczba wrogów na starcie gry.
+    int player_bomb_limit;  ///< Limit jednoczesnych bomb gracza osiągalny power-upami.
+    int enemy_capacity;     ///< Pojemność puli wrogów.
+    int bomb_capacity;      ///< Pojemność puli bomb.
+    int powerup_capacity;   ///< Pojemność puli power-upów.
+    RULESET ruleset;        ///< Domyślny zestaw reguł trybu.
+} GameModeConfig;
+
+/** @var game_modes Konfiguracje trybów gry, indeksowane GAME_MODE. */
+const GameModeConfig game_modes[GAME_MODE_COUNT] = {
+    { "classic",   MAP_WIDTH,           MAP_HEIGHT,           5,  5, 8,  8, 8,  RULESET_CLASSIC },
+    { "endurance", ENDURANCE_MAP_WIDTH, ENDURANCE_MAP_HEIGHT, 32, 5, 32, 8, 32, RULESET_LARGE_ARENA }
+};
+
+/** @var game_mode Tryb bieżącej gry. */
+const GameModeConfig* game_mode = &game_modes[GAME_MODE_CLASSIC];
+
+// --- Definicje dla paczek poziomów (--level-pack) ---
+/** @def LEVEL_PACK_MAGIC Znacznik na początku pliku paczki poziomów. */
+#define LEVEL_PACK_MAGIC "BMLP"
+/** @def LEVEL_PACK_VERSION Wersja formatu paczki poziomów. */
+#define LEVEL_PACK_VERSION 1
+/** @def LEVEL_MAX_SIZE Największy bok poziomu w kafelkach; cały poziom mieści się w MAP_MAX_RESIDENT_CHUNKS fragmentach. */
+#define LEVEL_MAX_SIZE 256
+/** @def LEVEL_MAX_ENEMIES Największa liczba wrogów rozstawionych w poziomie. */
+#define LEVEL_MAX_ENEMIES 64
+
+/**
+ * @struct LevelPackHeader
+ * @brief Nagłówek pliku paczki poziomów. Za nim leży tablica `level_count` wpisów LevelPackEntry,
+ * a dalej rekordy poziomów. Wszystkie liczby są zapisane w porządku bajtów maszyny.
+ */
+typedef struct {
+    char magic[4];        ///< LEVEL_PACK_MAGIC.
+    uint32_t version;     ///< LEVEL_PACK_VERSION.
+    uint32_t level_count; ///< Liczba poziomów w paczce.
+    uint32_t reserved;    ///< Zero (wyrównuje tablicę wpisów do 8 bajtów).
+} LevelPackHeader;
+
+/**
+ * @struct LevelPackEntry
+ * @brief Wpis tablicy indeksu paczki: położenie rekordu poziomu w pliku.
+ */
+typedef struct {
+    uint32_t offset; ///< Przesunięcie rekordu LevelRecord od początku pliku (wielokrotność 8).
+    uint32_t size;   ///< Rozmiar rekordu razem z terenem.
+} LevelPackEntry;
+
+/**
+ * @struct LevelEnemy
+ * @brief Wróg rozstawiony w poziomie z paczki.
+ */
+typedef struct {
+    uint16_t x, y;       ///< Pozycja startowa wroga.
+    uint8_t script;      ///< Skrypt zachowania (ENEMY_SCRIPT).
+    uint8_t reserved[3]; ///< Zera.
+} LevelEnemy;
+
+/**
+ * @struct LevelRecord
+ * @brief Rekord poziomu w paczce. Bezpośrednio za nim leży teren: chunks_x * chunks_y fragmentów
+ * spakowanych do CHUNK_PACKED_BYTES bajtów, w tym samym formacie co w pliku wymiany mapy.
+ * * Przełączenie poziomu to skopiowanie tego rekordu do `level_active`; teren jest czytany
+ * wprost ze zmapowanego pliku przy ładowaniu fragmentów.
+ */
+typedef struct {
+    uint16_t width, height;             ///< Rozmiar poziomu w kafelkach.
+    uint16_t player_x, player_y;        ///< Pole startowe gracza.
+    int16_t exit_x, exit_y;             ///< Wyjście pod pudełkiem (-1 - wyjście jest losowane jak w poziomach generowanych).
+    uint16_t enemy_count;               ///< Liczba wpisów w `enemies`.
+    uint8_t ruleset;                    ///< Zestaw reguł (RULESET); RULESET_CUSTOM oznacza wartości z `rules`.
+    uint8_t reserved;                   ///< Zero.
+    uint32_t seed;                      ///< Skrót zawartości poziomu, używany jako ziarno mapy (i skrótu Zobrista).
+    int32_t rules[RULE_FIELD_COUNT];    ///< Wartości pól reguł w kolejności `rule_fields`.
+    LevelEnemy enemies[LEVEL_MAX_ENEMIES]; ///< Rozstawienie wrogów.
+} LevelRecord;
+
+/**
+ * @struct LevelPack
+ * @brief Otwarta paczka poziomów, zmapowana w pamięci w całości.
+ */
+typedef struct {
+    const unsigned char* data;   ///< Zmapowany plik (NULL - brak paczki, poziomy są generowane).
+    size_t size;                 ///< Rozmiar pliku w bajtach.
+    const LevelPackEntry* index; ///< Tablica indeksu w zmapowanym pliku.
+    int count;                   ///< Liczba poziomów.
+    int current;                 ///< Poziom następnej gry (--level=N); po wygranej przechodzi do kolejnego.
+} LevelPack;
+
+/** @var level_pack Paczka poziomów otwarta argumentem --level-pack=PLIK. */
+LevelPack level_pack;
+/** @var level_active Kopia rekordu poziomu bieżącej gry. */
+LevelRecord level_active;
+/** @var level_terrain Teren poziomu bieżącej gry w zmapowanej paczce (NULL - mapa generowana z ziarna). */
+const unsigned char* level_terrain = NULL;
+/** @var level_rules Reguły poziomu zapisanego z zestawem RULESET_CUSTOM. */
+GameRules level_rules;
 
+// --- Definicje dla gracza ---
 /**
  * @struct Player
  * @brief Struktura przechowująca wszystkie informacje dotyczące gracza.
@@ -120,7 +527,7 @@ typedef struct {
     int score;                    ///< Aktualny wynik punktowy gracza.
     bool is_alive;                ///< Flaga wskazująca, czy gracz żyje.
     bool invincible;              ///< Flaga wskazująca, czy gracz jest aktualnie nietykalny.
-    int invincibility_timer;      ///< Licznik pozostałego czasu nietykalności.
+    uint32_t invincible_until;    ///< Klatka symulacji, w której kończy się nietykalność.
     int current_max_bombs;        ///< Maksymalna liczba bomb, które gracz może jednocześnie podłożyć.
     int current_bomb_radius;      ///< Aktualny promień rażenia bomb gracza.
     PLAYER_DIRECTION direction;   ///< Kierunek, w którym gracz jest obecnie zwrócony.
@@ -130,15 +537,6 @@ typedef struct {
 Player player;
 
 // --- Definicje dla wrogów ---
-/** @def MAX_ENEMIES Maksymalna liczba wrogów na planszy. */
-#define MAX_ENEMIES 5             
-/** @def ENEMY_MOVE_DELAY Opóźnienie między kolejnymi próbami ruchu wroga, w klatkach. */
-#define ENEMY_MOVE_DELAY 30       
-/** @def POINTS_PER_ENEMY Liczba punktów przyznawana za pokonanie jednego wroga. */
-#define POINTS_PER_ENEMY 100      
-/** @def POINTS_PER_WALL Liczba punktów przyznawana za zniszczenie jednej zniszczalnej ściany. */
-#define POINTS_PER_WALL 10        
-
 /** @enum ENEMY_DIRECTION
  * @brief Kierunki, w których mogą poruszać się wrogowie.
  */
@@ -150,6 +548,42 @@ typedef enum {
     DIR_COUNT  ///< Liczba możliwych kierunków (używane do losowania).
 } ENEMY_DIRECTION;
 
+/** @var enemy_dx Przesunięcie X kroku wroga, indeksowane ENEMY_DIRECTION. */
+static const int enemy_dx[DIR_COUNT] = { 0, 0, -1, 1 };
+/** @var enemy_dy Przesunięcie Y kroku wroga, indeksowane ENEMY_DIRECTION. */
+static const int enemy_dy[DIR_COUNT] = { -1, 1, 0, 0 };
+
+/** @enum ENEMY_SCRIPT
+ * @brief Skrypty zachowania wrogów, wznawiane przez koło czasowe (wrog_wznow_skrypt).
+ */
+typedef enum {
+    SCRIPT_WANDER,     ///< Błądzenie: idzie prosto, a przy przeszkodzie zmienia kierunek.
+    SCRIPT_PATROL,     ///< Patrol: chodzi tam i z powrotem po odcinku, czekając, aż zajęte pole się zwolni.
+    SCRIPT_CHASE,      ///< Pościg: idzie w stronę gracza, gdy ten jest blisko; w przeciwnym razie błądzi.
+    SCRIPT_LURK_FLEE,  ///< Czajenie się: stoi, dopóki gracz nie podejdzie, a potem ucieka od niego kilka kroków.
+    SCRIPT_COUNT       ///< Liczba skryptów.
+} ENEMY_SCRIPT;
+
+/** @def ENEMY_PATROL_LENGTH Liczba kroków patrolu w jedną stronę. */
+#define ENEMY_PATROL_LENGTH 4
+/** @def ENEMY_PATROL_PAUSE_TICKS Postój patrolu na końcu odcinka, w klatkach. */
+#define ENEMY_PATROL_PAUSE_TICKS 30
+/** @def ENEMY_WAIT_POLL_TICKS Co ile klatek czekający skrypt ponownie sprawdza swój warunek. */
+#define ENEMY_WAIT_POLL_TICKS 8
+/** @def ENEMY_WAIT_MAX_TICKS Najdłuższe czekanie na zwolnienie pola; potem skrypt się poddaje. */
+#define ENEMY_WAIT_MAX_TICKS 90
+/** @def ENEMY_CHASE_RANGE Odległość (w kafelkach, metryka miejska), z której wróg goniący zauważa gracza. */
+#define ENEMY_CHASE_RANGE 6
+/** @def ENEMY_LURK_RANGE Odległość, na jaką gracz musi podejść, by czający się wróg zaczął uciekać. */
+#define ENEMY_LURK_RANGE 3
+/** @def ENEMY_FLEE_STEPS Liczba kroków ucieczki czającego się wroga. */
+#define ENEMY_FLEE_STEPS 5
+
+/** @var enemy_script_rgb Kolor wroga dla każdego skryptu (ENEMY_SCRIPT), aby zachowania były rozróżnialne. */
+static const unsigned char enemy_script_rgb[SCRIPT_COUNT][3] = {
+    { 255, 100, 100 }, { 255, 170, 60 }, { 220, 60, 200 }, { 100, 200, 255 }
+};
+
 /**
  * @struct Enemy
  * @brief Struktura przechowująca informacje o pojedynczym wrogu.
@@ -159,18 +593,47 @@ typedef struct {
     bool is_alive;             ///< Flaga wskazująca, czy wróg żyje.
     ALLEGRO_COLOR color;       ///< Kolor wroga (używany, jeśli brakuje dedykowanego sprite'a).
     ENEMY_DIRECTION direction; ///< Aktualny kierunek ruchu wroga.
-    int move_timer;            ///< Licznik czasu do następnej próby ruchu wroga.
+    uint32_t next_move_tick;   ///< Klatka symulacji następnego wznowienia skryptu wroga.
+    ENEMY_SCRIPT script;       ///< Skrypt zachowania.
+    int script_pc;             ///< Miejsce wznowienia skryptu (0 - początek).
+    int script_counter;        ///< Licznik skryptu zachowany między wznowieniami (np. kroki patrolu).
+    int wait_x, wait_y;        ///< Pole, na którego zwolnienie czeka skrypt.
+    uint32_t wait_deadline;    ///< Klatka, po której skrypt przestaje czekać na pole.
 } Enemy;
 
-/** @var enemies Tablica przechowująca instancje wszystkich wrogów w grze. */
-Enemy enemies[MAX_ENEMIES];
+/** @def SKRYPT_POCZATEK Otwiera ciało skryptu wroga i skacze do miejsca, w którym skrypt się ostatnio zawiesił.
+ * * Skrypty są współprogramami bez stosu (jak protowątki): zawieszenie to powrót z funkcji z liczbą klatek
+ * do wznowienia, a wznowienie - wywołanie przez koło czasowe. Stan między wznowieniami leży wyłącznie
+ * w polach wroga (jest więc w puli i w migawkach rollbacku); zmienne lokalne nie przetrwają zawieszenia.
+ */
+#define SKRYPT_POCZATEK(e) switch ((e)->script_pc) { case 0:
+/** @def SKRYPT_PRZEJSCIE Jawne przejście do etykiety wznowienia (bez ostrzeżenia -Wimplicit-fallthrough). */
+#if defined(__GNUC__)
+#define SKRYPT_PRZEJSCIE __attribute__((fallthrough))
+#else
+#define SKRYPT_PRZEJSCIE ((void)0)
+#endif
+/** @def SKRYPT_CZEKAJ Zawiesza skrypt na `ticks` klatek. */
+#define SKRYPT_CZEKAJ(e, ticks) do { (e)->script_pc = __LINE__; return (ticks); case __LINE__:; } while (0)
+/** @def SKRYPT_CZEKAJ_NA_POLE Zawiesza skrypt, dopóki wróg `i` nie może wejść na pole (px, py), najwyżej
+ * przez `limit` klatek. Warunek jest sprawdzany co ENEMY_WAIT_POLL_TICKS klatek; po powrocie skrypt
+ * musi sprawdzić, czy pole rzeczywiście jest wolne.
+ */
+#define SKRYPT_CZEKAJ_NA_POLE(e, i, px, py, limit) do { \
+        (e)->wait_x = (px); (e)->wait_y = (py); (e)->wait_deadline = timers.now + (limit); \
+        (e)->script_pc = __LINE__; SKRYPT_PRZEJSCIE; case __LINE__: \
+        if (!wrog_moze_wejsc(enemies, (i), bombs, game_map, exit_revealed, exit_x, exit_y, (e)->wait_x, (e)->wait_y) && \
+            (int32_t)((e)->wait_deadline - timers.now) > 0) return ENEMY_WAIT_POLL_TICKS; \
+    } while (0)
+/** @def SKRYPT_KONIEC Zamyka ciało skryptu; skrypt, który dojdzie do końca, po `ticks` klatkach zaczyna od początku. */
+#define SKRYPT_KONIEC(e, ticks) } (e)->script_pc = 0; return (ticks)
+
+/** @var enemy_pool Pula wrogów. */
+EntityPool enemy_pool;
+/** @var enemies Wrogowie - elementy puli `enemy_pool` (odświeżane, gdy pula urośnie). */
+Enemy* enemies = NULL;
 
 // --- Definicje dla power-upów ---
-/** @def MAX_POWERUPS Maksymalna liczba power-upów, które mogą pojawić się na mapie. */
-#define MAX_POWERUPS (MAX_ENEMIES) 
-/** @def POWERUP_DROP_CHANCE Szansa na wypadnięcie power-upa po pokonaniu wroga (1 do POWERUP_DROP_CHANCE). */
-#define POWERUP_DROP_CHANCE 3      
-
 /** @enum POWERUP_TYPE
  * @brief Typy dostępnych power-upów w grze.
  */
@@ -192,1133 +655,6832 @@ typedef struct {
     ALLEGRO_COLOR color;  ///< Kolor power-upa (używany do rysowania).
 } Powerup;
 
-/** @var powerups Tablica przechowująca instancje wszystkich power-upów na mapie. */
-Powerup powerups[MAX_POWERUPS];
+/** @var powerup_pool Pula power-upów. */
+EntityPool powerup_pool;
+/** @var powerups Power-upy - elementy puli `powerup_pool` (odświeżane, gdy pula urośnie). */
+Powerup* powerups = NULL;
 
 // --- Definicje dla bomb ---
-/** @def MAX_BOMBS Maksymalna liczba bomb, które mogą istnieć jednocześnie na planszy (globalny limit systemu). */
-#define MAX_BOMBS 5                   
-/** @def EXPLOSION_DURATION Czas trwania efektu eksplozji bomby, w klatkach. */
-#define EXPLOSION_DURATION 30         
-/** @def BOMB_TIMER_DURATION Czas od podłożenia bomby do jej wybuchu, w klatkach. */
-#define BOMB_TIMER_DURATION 120       
-/** @def MAX_EXPLOSION_CELLS Maksymalna liczba kafelków, które mogą zostać objęte pojedynczą eksplozją. */
-#define MAX_EXPLOSION_CELLS (1 + 4 * 7) 
-
 /**
  * @struct Bomb
  * @brief Struktura przechowująca informacje o pojedynczej bombie.
  */
 typedef struct {
     int x, y;                     ///< Pozycja bomby na mapie (współrzędne kafelków).
-    int timer;                    ///< Licznik czasu pozostałego do wybuchu bomby.
+    uint32_t fuse_tick;           ///< Klatka symulacji, w której bomba wybuchnie.
+    uint32_t explosion_end_tick;  ///< Klatka symulacji, w której kończy się efekt eksplozji.
     int radius;                   ///< Promień rażenia eksplozji bomby.
     bool active;                  ///< Flaga wskazująca, czy bomba jest aktywna (tyka lub wybucha).
     bool exploding;               ///< Flaga wskazująca, czy bomba aktualnie wybucha.
-    int explosion_timer;          ///< Licznik czasu pozostałego do zakończenia efektu eksplozji.
-    int affected_explosion_cells_x[MAX_EXPLOSION_CELLS]; ///< Tablica współrzędnych X kafelków objętych eksplozją.
-    int affected_explosion_cells_y[MAX_EXPLOSION_CELLS]; ///< Tablica współrzędnych Y kafelków objętych eksplozją.
-    int num_affected_explosion_cells; ///< Liczba kafelków faktycznie objętych daną eksplozją.
+    bool blast_centre;            ///< Czy eksplozja obejmuje pole samej bomby.
+    uint16_t blast_len[BLAST_DIRECTIONS]; ///< Długości promieni eksplozji w kafelkach (bez ściany niezniszczalnej, która je zatrzymała).
 } Bomb;
 
-/** @var bombs Tablica przechowująca instancje wszystkich bomb na mapie. */
-Bomb bombs[MAX_BOMBS];
+/** @var bomb_pool Pula bomb. */
+EntityPool bomb_pool;
+/** @var bombs Bomby - elementy puli `bomb_pool` (odświeżane, gdy pula urośnie). */
+Bomb* bombs = NULL;
+
+// --- Definicje dla równoległego wyznaczania zasięgu eksplozji ---
+/** @def BLAST_MAX_WORKERS Największa liczba wątków pomocniczych wyznaczających zasięg eksplozji. */
+#define BLAST_MAX_WORKERS 7
+/** @def BLAST_PARALLEL_MIN Od tylu bomb wybuchających w jednej klatce promienie są liczone równolegle. */
+#define BLAST_PARALLEL_MIN 64
+
+/**
+ * @struct BlastRays
+ * @brief Wstępnie wyznaczony zasięg eksplozji jednej bomby.
+ */
+typedef struct {
+    uint16_t open[BLAST_DIRECTIONS]; ///< Liczba pustych pól promienia w mapie sprzed wybuchów tej klatki.
+    bool ready;            ///< Czy wynik czeka na użycie przez zdetonuj_bombe.
+} BlastRays;
+
+/**
+ * @struct BlastSystem
+ * @brief Dwufazowa detonacja bomb wybuchających w tej samej klatce.
+ * * Faza 1 (wybuchy_przygotuj) wyznacza dla każdej bomby długość pustych odcinków jej czterech
+ * promieni, tylko czytając mapę - przy wielu bombach równolegle na wątkach pomocniczych. Faza 2
+ * (zdetonuj_bombe, w stałej kolejności zdarzeń) pomija te odcinki, a końce promieni sprawdza już
+ * na bieżącej mapie, więc ściana zniszczona przez wcześniejszą bombę z tej klatki przepuszcza
+ * promień dalej - wynik jest identyczny z wyznaczaniem promieni po kolei.
+ */
+typedef struct {
+    BlastRays* rays;        ///< Wyniki fazy 1, indeksowane numerem bomby w puli.
+    int* batch;             ///< Indeksy bomb wybuchających w bieżącej klatce.
+    int capacity;           ///< Pojemność tablic `rays` i `batch`.
+    int batch_count;        ///< Liczba bomb w `batch`.
+    const WorldMap* map;    ///< Mapa, dla której liczona jest bieżąca porcja.
+
+    ALLEGRO_THREAD* threads[BLAST_MAX_WORKERS]; ///< Wątki pomocnicze.
+    int workers;            ///< Liczba uruchomionych wątków pomocniczych.
+    ALLEGRO_MUTEX* mutex;   ///< Chroni pola poniżej.
+    ALLEGRO_COND* start_cond; ///< Sygnał nowej porcji pracy.
+    ALLEGRO_COND* done_cond;  ///< Sygnał zakończenia porcji przez wszystkie wątki.
+    unsigned int generation;  ///< Numer bieżącej porcji pracy.
+    int pending;            ///< Liczba wątków, które jeszcze nie skończyły porcji.
+    bool quit;              ///< Prośba o zakończenie wątków.
+} BlastSystem;
+
+/** @var blasts Globalny system wyznaczania zasięgu eksplozji. */
+BlastSystem blasts;
+
+// --- Definicje dla koła czasowego (zdarzenia symulacji) ---
+/** @def TIMER_WHEEL_BITS Logarytm (o podstawie 2) liczby przegródek na jednym poziomie koła czasowego. */
+#define TIMER_WHEEL_BITS 8
+/** @def TIMER_WHEEL_SLOTS Liczba przegródek na poziomie; poziom 0 obejmuje 256 najbliższych klatek. */
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+/** @def TIMER_WHEEL_LEVELS Liczba poziomów koła; trzy poziomy sięgają 2^24 klatek (ponad 77 godzin gry). */
+#define TIMER_WHEEL_LEVELS 3
+/** @def TIMER_WHEEL_SPAN Najdalszy termin zdarzenia (w klatkach od bieżącej), jaki mieści się w kole. */
+#define TIMER_WHEEL_SPAN ((1u << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+/** @def TIMER_CAPACITY Maksymalna liczba jednocześnie zaplanowanych zdarzeń. */
+#define TIMER_CAPACITY 16384
+
+/** @enum TIMER_KIND
+ * @brief Rodzaje zdarzeń planowanych w kole czasowym. Zdarzenia z tej samej klatki
+ * są obsługiwane w kolejności rodzaju, a w ramach rodzaju - indeksu obiektu, tak jak
+ * robiły to dawne pętle aktualizacji (nietykalność, bomby, wrogowie).
+ */
+typedef enum {
+    TIMER_INVINCIBILITY_END, ///< Koniec nietykalności gracza.
+    TIMER_BOMB,              ///< Wybuch bomby albo koniec jej eksplozji (cel: uchwyt bomby).
+    TIMER_ENEMY_MOVE,        ///< Kolejna próba ruchu wroga (cel: uchwyt wroga).
+    TIMER_KIND_COUNT         ///< Liczba rodzajów zdarzeń.
+} TIMER_KIND;
+
+/**
+ * @struct TimerEvent
+ * @brief Zaplanowane zdarzenie: węzeł listy jednokierunkowej w przegródce koła.
+ */
+typedef struct {
+    uint32_t due; ///< Klatka symulacji, w której zdarzenie ma nastąpić.
+    int kind;     ///< Rodzaj zdarzenia (TIMER_KIND).
+    EntityHandle target; ///< Uchwyt obiektu, którego dotyczy zdarzenie.
+    int next;     ///< Następne zdarzenie w tej samej przegródce lub na liście wolnych (-1 - koniec).
+} TimerEvent;
+
+/**
+ * @struct TimingWheel
+ * @brief Hierarchiczne koło czasowe. Obiekty zapisują u siebie bezwzględną klatkę terminu
+ * i planują zdarzenie, więc klatka symulacji kosztuje O(liczby zdarzeń wypadających w niej),
+ * a nie O(liczby obiektów). Zdarzenia z poziomu 1 i 2 są przenoszone niżej raz na
+ * 256 (65536) klatek. Zdarzeń się nie odwołuje - obsługa sprawdza, czy termin zapisany
+ * w obiekcie nadal się zgadza (a uchwyt - że obiekt wciąż istnieje), a nieaktualne zdarzenie po prostu znika.
+ */
+typedef struct {
+    TimerEvent events[TIMER_CAPACITY];                 ///< Pula węzłów zdarzeń.
+    int slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  ///< Pierwsze zdarzenie każdej przegródki (-1 - pusta).
+    uint64_t occupied[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS / 64]; ///< Bit na każdą niepustą przegródkę.
+    int free_head;                                     ///< Pierwszy wolny węzeł puli (-1 - brak).
+    int live;                                          ///< Liczba zaplanowanych zdarzeń.
+    uint32_t now;                                      ///< Bieżąca klatka symulacji (ostatnia obsłużona).
+    uint64_t due_keys[TIMER_CAPACITY];                 ///< Zdarzenia bieżącej klatki jako klucze (rodzaj, indeks slotu, uchwyt), sortowane przed obsługą.
+    bool initialized;                                  ///< Czy pula i przegródki zostały przygotowane.
+} TimingWheel;
+
+/** @var timers Globalne koło czasowe symulacji. Jego klatka `now` jest zegarem symulacji. */
+TimingWheel timers;
+
+// --- Definicje dla systemu cząsteczek (iskry eksplozji) ---
+/** @def PARTICLE_CAPACITY Maksymalna liczba jednocześnie żyjących cząsteczek. */
+#define PARTICLE_CAPACITY 32768
+/** @def PARTICLES_PER_CELL Liczba iskier emitowanych z każdego kafelka objętego eksplozją. */
+#define PARTICLES_PER_CELL 12
+/** @def PARTICLE_SIZE Rozmiar (bok kwadratu) świeżej iskry w pikselach. */
+#define PARTICLE_SIZE (TILE_SIZE * 0.45f)
+/** @def PARTICLE_DRAG Współczynnik wytracania prędkości iskry w każdej klatce. */
+#define PARTICLE_DRAG 0.92f
+
+/**
+ * @struct ParticlePool
+ * @brief Pula cząsteczek o stałej pojemności w układzie SoA (osobna tablica dla każdego pola).
+ * Żywe cząsteczki zajmują zawsze indeksy [0, count), więc aktualizacja to proste pętle
+ * po ciągłych tablicach float, które kompilator może zwektoryzować.
+ */
+typedef struct {
+    float x[PARTICLE_CAPACITY];        ///< Pozycja X środka iskry (piksele świata, bez HUD).
+    float y[PARTICLE_CAPACITY];        ///< Pozycja Y środka iskry (piksele świata, bez HUD).
+    float vx[PARTICLE_CAPACITY];       ///< Prędkość X w pikselach na klatkę.
+    float vy[PARTICLE_CAPACITY];       ///< Prędkość Y w pikselach na klatkę.
+    float life[PARTICLE_CAPACITY];     ///< Pozostały czas życia jako ułamek [0, 1].
+    float decay[PARTICLE_CAPACITY];    ///< Ubytek czasu życia na klatkę.
+    float r[PARTICLE_CAPACITY];        ///< Składowa czerwona koloru [0, 1].
+    float g[PARTICLE_CAPACITY];        ///< Składowa zielona koloru [0, 1].
+    float b[PARTICLE_CAPACITY];        ///< Składowa niebieska koloru [0, 1].
+    int count;                         ///< Liczba żywych cząsteczek.
+} ParticlePool;
+
+/** @var particles Globalna pula iskier eksplozji. */
+ParticlePool particles;
+/** @var particle_vertices Bufor wierzchołków (4 na cząsteczkę) wysyłany jednym wywołaniem al_draw_indexed_prim. */
+ALLEGRO_VERTEX particle_vertices[PARTICLE_CAPACITY * 4];
+/** @var particle_indices Stałe indeksy dwóch trójkątów na cząsteczkę, wypełniane raz przy starcie. */
+int particle_indices[PARTICLE_CAPACITY * 6];
+
+// --- Definicje dla dźwięku (strumień muzyki i pula głosów efektów) ---
+/** @def MUSIC_STREAM_BUFFERS Liczba buforów strumienia muzyki. */
+#define MUSIC_STREAM_BUFFERS 4
+/** @def MUSIC_STREAM_FRAGMENT Liczba próbek w jednym buforze strumienia muzyki. */
+#define MUSIC_STREAM_FRAGMENT 2048
+/** @def MUSIC_GAIN Głośność muzyki tła. */
+#define MUSIC_GAIN 0.05f
+/** @def SFX_FREQUENCY Częstotliwość próbkowania syntetyzowanych efektów dźwiękowych (Hz). */
+#define SFX_FREQUENCY 22050
+/** @def SFX_MAX_VOICES Największy limit głosów jednego rodzaju efektu. */
+#define SFX_MAX_VOICES 8
+
+/** @enum SFX_KIND
+ * @brief Rodzaje efektów dźwiękowych. Każdy ma własną pulę głosów.
+ */
+typedef enum {
+    SFX_PLANT,       ///< Podłożenie bomby.
+    SFX_EXPLODE,     ///< Wybuch bomby.
+    SFX_PICKUP,      ///< Podniesienie power-upa.
+    SFX_HIT,         ///< Gracz traci życie.
+    SFX_ENEMY_DEATH, ///< Pokonanie wroga.
+    SFX_COUNT        ///< Liczba rodzajów efektów.
+} SFX_KIND;
+
+/**
+ * @struct SfxKindConfig
+ * @brief Ustawienia jednego rodzaju efektu dźwiękowego.
+ */
+typedef struct {
+    const char* name;   ///< Nazwa do raportów.
+    const char* file;   ///< Opcjonalny plik z efektem; gdy go brak, efekt jest syntetyzowany.
+    int voices;         ///< Limit jednocześnie brzmiących głosów (co najwyżej SFX_MAX_VOICES).
+    float duration;     ///< Długość syntetyzowanego efektu w sekundach.
+    float gain;         ///< Głośność pojedynczego efektu.
+} SfxKindConfig;
+
+/** @var sfx_kinds Ustawienia efektów, indeksowane SFX_KIND. */
+const SfxKindConfig sfx_kinds[SFX_COUNT] = {
+    { "plant",       "sfx_plant.wav",       3, 0.08f, 0.35f },
+    { "explode",     "sfx_explode.wav",     6, 0.60f, 0.50f },
+    { "pickup",      "sfx_pickup.wav",      2, 0.18f, 0.35f },
+    { "hit",         "sfx_hit.wav",         2, 0.25f, 0.45f },
+    { "enemy-death", "sfx_enemy_death.wav", 3, 0.30f, 0.35f }
+};
+
+/**
+ * @struct SfxSystem
+ * @brief Zdekodowane efekty i wstępnie przydzielona pula głosów.
+ * Symulacja tylko zlicza zgłoszenia w `requested` (bez alokacji i blokad). Po każdej klatce
+ * zgłoszenia są zamieniane na dźwięk: zgłoszenia tego samego rodzaju z jednej klatki dają jeden
+ * głos, głośniejszy przy większej ich liczbie. Gdy wszystkie głosy danego rodzaju brzmią,
+ * zabierany jest najdawniej uruchomiony.
+ */
+typedef struct {
+    ALLEGRO_SAMPLE* samples[SFX_COUNT];                          ///< Efekty zdekodowane do PCM przy starcie.
+    ALLEGRO_SAMPLE_INSTANCE* voices[SFX_COUNT][SFX_MAX_VOICES];  ///< Głosy, przypięte na stałe do miksera.
+    unsigned int started[SFX_COUNT][SFX_MAX_VOICES];             ///< Numer uruchomienia głosu (najmniejszy = najstarszy).
+    int requested[SFX_COUNT];                                    ///< Zgłoszenia z bieżącej klatki.
+    unsigned int sequence;                                       ///< Licznik uruchomień głosów.
+    bool ready;                                                  ///< Czy pula głosów jest gotowa.
+    int stat_played;                                             ///< Uruchomione głosy od ostatniego raportu.
+    int stat_stolen;                                             ///< Głosy zabrane wcześniejszym efektom.
+    int stat_merged;                                             ///< Zgłoszenia połączone z innym z tej samej klatki.
+} SfxSystem;
+
+/** @var sfx Globalny system efektów dźwiękowych. */
+SfxSystem sfx;
+
+// --- Definicje dla kamery i renderowania terenu ---
+/** @def TERRAIN_DIRTY_CAPACITY Liczba zmienionych kafelków buforowanych do aktualizacji; po przepełnieniu teren jest przebudowywany w całości. */
+#define TERRAIN_DIRTY_CAPACITY 256
+
+/**
+ * @struct Camera
+ * @brief Kamera przewijająca widok za graczem. Przechowuje lewy górny róg widoku w pikselach mapy.
+ */
+typedef struct {
+    float x; ///< Przesunięcie widoku w poziomie (piksele).
+    float y; ///< Przesunięcie widoku w pionie (piksele).
+} Camera;
+
+/** @var camera Globalna kamera. */
+Camera camera;
+
+/**
+ * @struct TileRange
+ * @brief Prostokątny zakres kafelków [x0, x1) x [y0, y1).
+ */
+typedef struct {
+    int x0, y0; ///< Pierwszy kafelek zakresu (włącznie).
+    int x1, y1; ///< Koniec zakresu (wyłącznie).
+} TileRange;
+
+/** @var view_range Zakres kafelków widocznych w bieżącej klatce; funkcje rysuj_* pomijają obiekty spoza niego. */
+TileRange view_range;
+
+/** @def TERRAIN_MESH_CACHE Liczba fragmentów mapy, których siatki są trzymane na GPU (widok obejmuje najwyżej 2 x 2 fragmenty). */
+#define TERRAIN_MESH_CACHE 9
+/** @def EXIT_PULSE_FRAMES Liczba klatek jednego okresu pulsowania wyjścia wypiekanych do atlasu. */
+#define EXIT_PULSE_FRAMES 16
+/** @def ATLAS_COLUMNS Szerokość atlasu w kafelkach: mieści najdłuższy wiersz (SCRIPT_COUNT * DIR_COUNT wrogów, EXIT_PULSE_FRAMES klatek wyjścia). */
+#define ATLAS_COLUMNS 16
+/** @def ATLAS_ROW_ENEMIES Wiersz atlasu z wrogami: kolumna skrypt * DIR_COUNT + kierunek. */
+#define ATLAS_ROW_ENEMIES 1
+/** @def ATLAS_ROW_EXIT Pierwszy wiersz atlasu z klatkami wyjścia: z iskrą w środku, a wiersz niżej - bez niej. */
+#define ATLAS_ROW_EXIT 2
+/** @def ATLAS_ROWS Wysokość atlasu w kafelkach. */
+#define ATLAS_ROWS 4
+
+/**
+ * @struct TerrainMesh
+ * @brief Siatka terenu jednego fragmentu mapy: bufor wierzchołków (4 na kafelek) z teksturą z atlasu.
+ */
+typedef struct {
+    ALLEGRO_VERTEX_BUFFER* vertices; ///< Wierzchołki wszystkich kafelków fragmentu.
+    int chunk;                       ///< Indeks fragmentu mapy zapisanego w buforze (-1 - siatka nieużywana).
+    unsigned last_used;              ///< Numer klatki, w której siatka była ostatnio rysowana.
+} TerrainMesh;
+
+/**
+ * @struct TerrainRenderer
+ * @brief Teren mapy w buforach GPU: siatki widocznych fragmentów mapy z teksturą z atlasu,
+ * rysowane jednym wywołaniem na fragment ze wspólnym, stałym buforem indeksów.
+ */
+typedef struct {
+    ALLEGRO_BITMAP* atlas;               ///< Atlas TILE_SIZE x TILE_SIZE: wiersz 0 [puste | ściana | pudełko], dalej wrogowie i klatki wyjścia.
+    ALLEGRO_INDEX_BUFFER* indices;       ///< Indeksy trójkątów wszystkich kafelków fragmentu (NULL - rysowanie zapasowe).
+    TerrainMesh meshes[TERRAIN_MESH_CACHE]; ///< Siatki ostatnio widocznych fragmentów.
+    unsigned frame;                      ///< Licznik rysowanych klatek.
+    int dirty_x[TERRAIN_DIRTY_CAPACITY]; ///< Współrzędne X kafelków zmienionych od ostatniego rysowania.
+    int dirty_y[TERRAIN_DIRTY_CAPACITY]; ///< Współrzędne Y kafelków zmienionych od ostatniego rysowania.
+    int dirty_count;                     ///< Liczba zmienionych kafelków.
+    bool full_rebuild;                   ///< Czy trzeba przebudować wszystkie siatki.
+} TerrainRenderer;
+
+/** @var terrain Globalny renderer terenu. */
+TerrainRenderer terrain;
+
+// --- Definicje dla wejścia gracza ---
+
+/** @enum GAME_INPUT
+ * @brief Bity wejścia gracza zbierane w ciągu jednej klatki symulacji.
+ * Symulacja konsumuje wejście jako maskę bitową, dzięki czemu można je zapisywać,
+ * przesyłać przez sieć i odtwarzać przy ponownej symulacji.
+ */
+typedef enum {
+    INPUT_NONE = 0,       ///< Brak akcji.
+    INPUT_UP = 1 << 0,    ///< Ruch w górę.
+    INPUT_DOWN = 1 << 1,  ///< Ruch w dół.
+    INPUT_LEFT = 1 << 2,  ///< Ruch w lewo.
+    INPUT_RIGHT = 1 << 3, ///< Ruch w prawo.
+    INPUT_BOMB = 1 << 4   ///< Podłożenie bomby.
+} GAME_INPUT;
+
+/** @def INPUT_DIRECTIONS Maska wszystkich bitów kierunku ruchu. */
+#define INPUT_DIRECTIONS (INPUT_UP | INPUT_DOWN | INPUT_LEFT | INPUT_RIGHT)
+
+/** @var pending_input Wejście lokalnego gracza zebrane od ostatniej klatki symulacji. */
+unsigned char pending_input = INPUT_NONE;
+
+/** @var rng_state Stan generatora liczb pseudolosowych symulacji (xorshift32). */
+uint32_t rng_state = 2463534242u;
+
+// --- Definicje dla rollbacku (netcode w stylu GGPO) ---
+/** @def ROLLBACK_MAX_TICKS Maksymalna głębokość cofnięcia symulacji, w klatkach. */
+#define ROLLBACK_MAX_TICKS 8
+/** @def ROLLBACK_RING_SIZE Rozmiar bufora pierścieniowego migawek (głębokość cofnięcia + bieżąca klatka). */
+#define ROLLBACK_RING_SIZE (ROLLBACK_MAX_TICKS + 1)
+/** @def ROLLBACK_REPORT_INTERVAL Co ile klatek wypisywane są statystyki rollbacku. */
+#define ROLLBACK_REPORT_INTERVAL 300
+
+/**
+ * @struct GameSnapshot
+ * @brief Kompletna migawka stanu symulacji, z której można wznowić grę.
+ * Pule obiektów są kopiowane do buforów migawki, które rosną tylko razem z pulami,
+ * więc zapis i odczyt to zwykłe kopiowanie pamięci bez przydziałów.
+ * Mapa nie jest kopiowana (może być dowolnie duża) - migawka pamięta tylko pozycję dziennika zmian.
+ */
+typedef struct {
+    uint32_t map_journal;                ///< Pozycja dziennika mapy; mapę przywraca się cofając późniejsze zmiany.
+    uint32_t sim_tick;                   ///< Klatka symulacji; koło czasowe odbudowuje się z terminów zapisanych w obiektach.
+    Player player;                     ///< Kopia stanu gracza.
+    PoolImage enemies;                   ///< Kopia puli wrogów.
+    PoolImage bombs;                     ///< Kopia puli bomb (łącznie z polami eksplozji).
+    PoolImage powerups;                  ///< Kopia puli power-upów.
+    int exit_x, exit_y;                  ///< Pozycja wyjścia.
+    bool exit_revealed;                  ///< Flaga odkrycia wyjścia.
+    uint32_t rng_state;                  ///< Stan generatora liczb pseudolosowych.
+    GAME_STATE game_state;               ///< Stan gry (rozgrywka może się zakończyć w trakcie cofniętych klatek).
+    uint64_t hash;                       ///< Skrót stanu z chwili zapisu (stan_skrot).
+} GameSnapshot;
+
+/**
+ * @struct RollbackSession
+ * @brief Stan sesji rollbacku: bufor migawek, historia wejść i statystyki.
+ * Migawka o indeksie `tick % ROLLBACK_RING_SIZE` przechowuje stan z początku klatki `tick`,
+ * a `inputs` pod tym samym indeksem - wejście użyte do jej zasymulowania.
+ */
+typedef struct {
+    GameSnapshot snapshots[ROLLBACK_RING_SIZE];    ///< Migawki stanu z początku kolejnych klatek.
+    unsigned char inputs[ROLLBACK_RING_SIZE];      ///< Wejście użyte w danej klatce (potwierdzone lub przewidziane).
+    bool confirmed[ROLLBACK_RING_SIZE];            ///< Czy wejście danej klatki zostało potwierdzone.
+    unsigned char delayed_inputs[ROLLBACK_RING_SIZE]; ///< Kolejka opóźnionych wejść trybu testowego.
+    int tick;                  ///< Numer następnej klatki do zasymulowania.
+    int oldest_tick;           ///< Najstarsza klatka, do której można się jeszcze cofnąć.
+    int rollback_to;           ///< Najwcześniejsza klatka wymagająca ponownej symulacji (-1 oznacza brak).
+    bool remote_player;        ///< Czy wejście gracza pochodzi od zdalnego peera i musi być przewidywane.
+    int loopback_delay;        ///< Opóźnienie pętli testowej w klatkach (tryb --rollback-test).
+
+    int stat_rollbacks;        ///< Liczba wykonanych cofnięć od ostatniego raportu.
+    int stat_total_depth;      ///< Suma głębokości cofnięć od ostatniego raportu.
+    int stat_max_depth;        ///< Największa głębokość cofnięcia od ostatniego raportu.
+    double stat_total_cost;    ///< Łączny czas cofnięć i ponownych symulacji (s).
+    double stat_max_cost;      ///< Najdłuższe pojedyncze cofnięcie (s).
+    int stat_saves;            ///< Liczba zapisanych migawek od ostatniego raportu.
+    double stat_save_time;     ///< Łączny czas zapisu migawek (s).
+    int stat_restores;         ///< Liczba przywróconych migawek od ostatniego raportu.
+    double stat_restore_time;  ///< Łączny czas przywracania migawek (s).
+    int stat_late_inputs;      ///< Liczba wejść, które przyszły za późno, by się do nich cofnąć.
+    int stat_hash_mismatches;  ///< Liczba przywróconych migawek, których skrót nie zgadzał się z zapisanym.
+    int stat_refused;          ///< Liczba cofnięć odrzuconych, bo dziennik mapy nie sięgał już migawki.
+} RollbackSession;
+
+/** @var rollback Globalna sesja rollbacku. */
+RollbackSession rollback;
+
+/** @var rollback_resymulacja Flaga ustawiana na czas ponownej symulacji cofniętych klatek
+ * oraz kroków środowisk treningowych. Wycisza efekty uboczne (komunikaty, dźwięki, iskry, metryki).
+ */
+bool rollback_resymulacja = false;
+
+/** @def LOG_SYM Komunikat diagnostyczny symulacji, pomijany podczas ponownej symulacji po rollbacku. */
+#define LOG_SYM(...) do { if (!rollback_resymulacja) printf(__VA_ARGS__); } while (0)
+
+// --- Definicje dla skrótu stanu gry (Zobrist) ---
+/** @enum ZOBRIST_KIND
+ * @brief Rodzaje składników stanu gry; każdy ma własną przestrzeń kluczy Zobrista.
+ */
+typedef enum {
+    ZOBRIST_MAP,      ///< Ziarno i rozmiar mapy (początkowa wartość skrótu kafelków).
+    ZOBRIST_TILE,     ///< Typ kafelka na danym polu.
+    ZOBRIST_PLAYER,   ///< Stan gracza.
+    ZOBRIST_ENEMY,    ///< Zajęty slot puli wrogów.
+    ZOBRIST_BOMB,     ///< Zajęty slot puli bomb.
+    ZOBRIST_POWERUP,  ///< Zajęty slot puli power-upów.
+    ZOBRIST_GLOBAL    ///< Wyjście, generator liczb losowych, klatka, stan gry i stan pul.
+} ZOBRIST_KIND;
+
+/** @var hash_log Plik, do którego dopisywane są skróty stanu kolejnych klatek (--hash-log=PLIK); NULL - brak. */
+FILE* hash_log = NULL;
+/** @var seed_override Ziarno generatora symulacji z --seed=N (0 - ziarno z zegara). */
+uint32_t seed_override = 0;
+
+// --- Definicje dla trybu niskich opóźnień wejścia ---
+/** @def KEY_REPEAT_TICKS Domyślny odstęp (w klatkach) między ruchami przy przytrzymanym klawiszu kierunku. */
+#define KEY_REPEAT_TICKS 8
+/** @def LATENCY_REPORT_INTERVAL Co ile wyrenderowanych klatek wypisywane są pomiary opóźnienia wejścia. */
+#define LATENCY_REPORT_INTERVAL 300
+
+/**
+ * @struct InputLatency
+ * @brief Konfiguracja trybu niskich opóźnień oraz pomiar opóźnienia od klawisza do obrazu.
+ * Pomiar obejmuje czas od znacznika zdarzenia klawiatury do zakończenia al_flip_display
+ * dla klatki, która jako pierwsza pokazuje efekt tego klawisza.
+ */
+typedef struct {
+    bool enabled;          ///< Tryb niskich opóźnień (--low-latency): próbkowanie klawiatury i renderowanie tylko najnowszej klatki.
+    bool vsync_off;        ///< Wyłączenie synchronizacji pionowej (--no-vsync).
+    int repeat_ticks;      ///< Co ile klatek powtarzany jest ruch przy przytrzymanym klawiszu (--repeat=N).
+    int held_ticks;        ///< Liczba klatek od ostatniego ruchu z przytrzymanego klawisza.
+    double probe_ts;       ///< Znacznik czasu klawisza oczekującego na najbliższą klatkę symulacji (< 0 oznacza brak).
+    double in_flight_ts;   ///< Znacznik czasu klawisza, którego efekt trafi do najbliższego al_flip_display (< 0 oznacza brak).
+    int samples;           ///< Liczba pomiarów od ostatniego raportu.
+    double total;          ///< Suma zmierzonych opóźnień (s).
+    double min;            ///< Najmniejsze zmierzone opóźnienie (s).
+    double max;            ///< Największe zmierzone opóźnienie (s).
+    int frames;            ///< Liczba wyrenderowanych klatek od ostatniego raportu.
+} InputLatency;
+
+/** @var latency Globalna konfiguracja i statystyki opóźnienia wejścia. */
+InputLatency latency = { false, false, KEY_REPEAT_TICKS, 0, -1.0, -1.0, 0, 0.0, 0.0, 0.0, 0 };
+
+// --- Definicje dla telemetrii (--metrics=PLIK) ---
+/** @def METRICS_EXPORT_INTERVAL Odstęp między eksportami metryk, w sekundach. */
+#define METRICS_EXPORT_INTERVAL 10.0
+/** @def METRICS_BUCKETS Liczba przedziałów histogramu czasu (górne granice 16 us * 2^k, ostatni bez granicy). */
+#define METRICS_BUCKETS 12
+/** @def METRICS_MAX_THREADS Liczba wątków z własnymi licznikami: główny i pomocnicze wątki eksplozji. */
+#define METRICS_MAX_THREADS (1 + BLAST_MAX_WORKERS)
+/** @def METRICS_PATH_MAX Największa długość ścieżki pliku metryk. */
+#define METRICS_PATH_MAX 512
+
+/**
+ * @struct MetricsHistogram
+ * @brief Histogram czasu trwania (liczony od startu programu, jak histogramy Prometheusa).
+ */
+typedef struct {
+    uint64_t buckets[METRICS_BUCKETS]; ///< Liczba pomiarów w każdym przedziale (nieskumulowana).
+    uint64_t count;                    ///< Liczba pomiarów.
+    double sum;                        ///< Suma pomiarów w sekundach.
+    double interval_max;               ///< Najdłuższy pomiar od ostatniego eksportu.
+} MetricsHistogram;
+
+/**
+ * @struct ThreadCounters
+ * @brief Liczniki jednego wątku. Każdy wątek zwiększa wyłącznie swoje liczniki, bez blokad;
+ * wątek główny odczytuje je przy eksporcie, gdy wątki pomocnicze czekają na pracę.
+ */
+typedef struct {
+    uint64_t bombs_planted;   ///< Podłożone bomby.
+    uint64_t bombs_detonated; ///< Zdetonowane bomby.
+    uint64_t blast_rays;      ///< Bomby, dla których ten wątek wyznaczył promienie eksplozji.
+    char padding[64 - 3 * sizeof(uint64_t)]; ///< Dopełnienie do linii pamięci podręcznej (bez fałszywego współdzielenia).
+} ThreadCounters;
+
+/**
+ * @struct Metrics
+ * @brief Telemetria dla długo działających instancji, eksportowana co METRICS_EXPORT_INTERVAL sekund
+ * jako linia JSON dopisywana do pliku oraz jako tekst w formacie Prometheusa (plik z dopiskiem ".prom").
+ */
+typedef struct {
+    bool enabled;                   ///< Czy telemetria jest włączona.
+    char path[METRICS_PATH_MAX];    ///< Plik z liniami JSON.
+    char prom_path[METRICS_PATH_MAX + 8]; ///< Plik w formacie Prometheusa (nadpisywany przy każdym eksporcie).
+    double start_time;              ///< Czas włączenia telemetrii.
+    double last_export;             ///< Czas ostatniego eksportu.
+
+    MetricsHistogram tick_time;     ///< Czas klatki symulacji (z ewentualnym rollbackiem).
+    MetricsHistogram frame_time;    ///< Czas rysowania klatki razem z al_flip_display.
+    ThreadCounters threads[METRICS_MAX_THREADS]; ///< Liczniki wątków (0 - wątek główny).
+    uint64_t last_planted;          ///< Podłożone bomby przy ostatnim eksporcie.
+    uint64_t last_detonated;        ///< Zdetonowane bomby przy ostatnim eksporcie.
+
+    int queue_run;                  ///< Zdarzenia obsłużone od ostatniego opróżnienia kolejki.
+    int queue_depth_max;            ///< Najdłuższa seria zdarzeń czekających w kolejce od ostatniego eksportu.
+    uint64_t queue_depth_sum;       ///< Suma długości serii od ostatniego eksportu.
+    uint64_t queue_wakes;           ///< Liczba serii od ostatniego eksportu.
+} Metrics;
+
+/** @var metrics Globalna telemetria. */
+Metrics metrics;
+
+/** @def METRYKA_DODAJ Zwiększa licznik wątku `thread`, gdy telemetria jest włączona. */
+#define METRYKA_DODAJ(thread, field, n) do { if (metrics.enabled) metrics.threads[thread].field += (n); } while (0)
+
+// --- Definicje dla warstwy interfejsu (HUD i ekrany menu) ---
+/** @def UI_TEXT_MAX Maksymalna długość tekstu pojedynczej kontrolki. */
+#define UI_TEXT_MAX 50
+
+/** @enum HUD_WIDGET
+ * @brief Kontrolki paska HUD.
+ */
+typedef enum {
+    HUD_LIVES,       ///< Liczba żyć.
+    HUD_SCORE,       ///< Wynik.
+    HUD_ENEMIES,     ///< Liczba żywych wrogów.
+    HUD_BOMBS,       ///< Limit bomb.
+    HUD_POWER,       ///< Promień eksplozji.
+    HUD_WIDGET_COUNT ///< Liczba kontrolek.
+} HUD_WIDGET;
+
+/**
+ * @struct UiWidget
+ * @brief Kontrolka tekstowa powiązana z jedną wartością liczbową.
+ * Tekst jest renderowany do własnej bitmapy tylko wtedy, gdy wartość się zmieni.
+ */
+typedef struct {
+    const char* format;     ///< Format tekstu z jedną liczbą, np. "Lives: %d".
+    int value;              ///< Wartość, której odpowiada bitmapa.
+    bool valid;             ///< Czy bitmapa jest aktualna.
+    float x, y;             ///< Punkt zaczepienia tekstu na pasku HUD.
+    int align;              ///< Wyrównanie tekstu względem punktu zaczepienia (ALLEGRO_ALIGN_*).
+    ALLEGRO_BITMAP* bitmap; ///< Wyrenderowany tekst (przezroczyste tło).
+} UiWidget;
+
+/**
+ * @struct UiLayer
+ * @brief Warstwa interfejsu w trybie zachowanym: układ liczony raz na rozmiar ekranu,
+ * kontrolki HUD złożone w jedną bitmapę oraz gotowe bitmapy ekranów startowego i końca gry.
+ */
+typedef struct {
+    int width, height;               ///< Rozmiar ekranu, dla którego policzono układ (0 - brak układu).
+    float line_height;               ///< Wysokość wiersza czcionki.
+    UiWidget hud[HUD_WIDGET_COUNT];  ///< Kontrolki HUD.
+    ALLEGRO_BITMAP* hud_layer;       ///< Pasek HUD złożony z kontrolek, rysowany jednym blitem.
+    bool hud_valid;                  ///< Czy pasek HUD odpowiada kontrolkom.
+    ALLEGRO_BITMAP* start_layer;     ///< Ekran startowy.
+    bool start_valid;                ///< Czy ekran startowy jest wyrenderowany.
+    ALLEGRO_BITMAP* game_over_layer; ///< Nakładka końca gry.
+    bool game_over_valid;            ///< Czy nakładka odpowiada polom poniżej.
+    bool game_over_victory;          ///< Czy nakładka pokazuje wygraną.
+    int game_over_score;             ///< Wynik pokazany na nakładce.
+} UiLayer;
+
+/** @var ui Globalna warstwa interfejsu. */
+UiLayer ui = {
+    0, 0, 0.0f,
+    {
+        { "Lives: %d",   0, false, 0, 0, ALLEGRO_ALIGN_LEFT,   NULL },
+        { "Score: %d",   0, false, 0, 0, ALLEGRO_ALIGN_CENTER, NULL },
+        { "Enemies: %d", 0, false, 0, 0, ALLEGRO_ALIGN_RIGHT,  NULL },
+        { "Bombs: %d",   0, false, 0, 0, ALLEGRO_ALIGN_LEFT,   NULL },
+        { "Power: %d",   0, false, 0, 0, ALLEGRO_ALIGN_RIGHT,  NULL }
+    },
+    NULL, false, NULL, false, NULL, false, false, 0
+};
+
+// --- Definicje dla prezentacji klatki (stały bufor skalowany do okna) ---
+/** @def FRAME_WIDTH Szerokość bufora klatki w pikselach; gra zawsze rysuje w tej rozdzielczości. */
+#define FRAME_WIDTH (VIEW_WIDTH * TILE_SIZE)
+/** @def FRAME_HEIGHT Wysokość bufora klatki w pikselach (widok mapy i pasek HUD). */
+#define FRAME_HEIGHT (VIEW_HEIGHT * TILE_SIZE + HUD_HEIGHT)
+
+/** @enum PRESENT_MODE
+ * @brief Sposób przeskalowania bufora klatki do okna.
+ */
+typedef enum {
+    PRESENT_INTEGER, ///< Całkowita wielokrotność bez filtrowania (piksele pozostają ostre); okno mniejsze od klatki - dopasowanie.
+    PRESENT_FIT      ///< Dopasowanie do okna z zachowaniem proporcji i filtrowaniem liniowym (--smooth).
+} PRESENT_MODE;
+
+/**
+ * @struct Presenter
+ * @brief Bufor klatki o stałej rozdzielczości i jego położenie w oknie.
+ * * Koszt rysowania gry zależy tylko od FRAME_WIDTH x FRAME_HEIGHT; rozmiar okna
+ * (w tym pełny ekran w 4K) wpływa jedynie na jeden przeskalowany blit na klatkę.
+ */
+typedef struct {
+    ALLEGRO_BITMAP* frame; ///< Bufor klatki (NULL - rysowanie wprost do bufora okna).
+    PRESENT_MODE mode;     ///< Sposób skalowania.
+    bool fullscreen;       ///< Okno pełnoekranowe (--fullscreen).
+    int window_scale;      ///< Początkowy rozmiar okna jako wielokrotność klatki (--window-scale=N).
+    float x, y;            ///< Lewy górny róg klatki w oknie.
+    float w, h;            ///< Rozmiar klatki w oknie po przeskalowaniu.
+} Presenter;
+
+/** @var presenter Globalny stan prezentacji klatki. */
+Presenter presenter = { NULL, PRESENT_INTEGER, false, 1, 0.0f, 0.0f, (float)FRAME_WIDTH, (float)FRAME_HEIGHT };
+
+// --- Definicje dla testu wydajności rysowania (--render-bench) ---
+/** @def RENDER_BENCH_FRAMES Domyślna liczba klatek rysowanych dla każdej sceny. */
+#define RENDER_BENCH_FRAMES 300
+/** @def RENDER_BENCH_SEED Ziarno obu generatorów liczb losowych przy budowaniu sceny. */
+#define RENDER_BENCH_SEED 12345u
+/** @def RENDER_BENCH_TOLERANCE Największa dopuszczalna różnica składowej koloru względem wzorca. */
+#define RENDER_BENCH_TOLERANCE 2
+/** @def RENDER_BENCH_PATH_MAX Największa długość ścieżki obrazu wzorcowego. */
+#define RENDER_BENCH_PATH_MAX 512
+
+/** @enum RENDER_SCENE
+ * @brief Sceny odtwarzane przez test wydajności rysowania.
+ */
+typedef enum {
+    RENDER_SCENE_FULL_MAP,       ///< Początek gry: cała klasyczna mapa, gracz i wrogowie.
+    RENDER_SCENE_MAX_EXPLOSIONS, ///< Bomby o największym zasięgu na wszystkich pustych polach, zdetonowane naraz.
+    RENDER_SCENE_ALL_ENTITIES,   ///< Odkryte wyjście, power-upy i tykające bomby na przemian na pustych polach.
+    RENDER_SCENE_GAME_OVER,      ///< Nakładka końca gry nad odkrytym wyjściem.
+    RENDER_SCENE_COUNT           ///< Liczba scen.
+} RENDER_SCENE;
+
+/** @var render_scene_names Nazwy scen (i plików obrazów wzorcowych). */
+static const char* const render_scene_names[RENDER_SCENE_COUNT] = { "full-map", "max-explosions", "all-entities", "game-over" };
+
+/**
+ * @struct RenderBench
+ * @brief Konfiguracja testu wydajności rysowania i licznik wywołań rysujących.
+ * * Test rysuje sceny do bitmapy poza ekranem: bitmapy w pamięci (bez ekranu) albo bitmapy
+ * karty graficznej (--render-bench-gpu, wymaga ekranu, ale nigdy nie rysuje do bufora okna).
+ */
+typedef struct {
+    bool enabled;                      ///< Czy program uruchomiono w trybie testu (bez pętli gry).
+    bool gpu;                          ///< Czy rysować do bitmapy karty graficznej zamiast do pamięci.
+    int frames;                        ///< Liczba klatek na scenę.
+    char golden_dir[RENDER_BENCH_PATH_MAX]; ///< Katalog obrazów wzorcowych.
+    bool fixed_clock;                  ///< Czy animacje używają `clock` zamiast al_get_time.
+    double clock;                      ///< Czas animacji w trybie testu, w sekundach.
+    uint64_t draw_calls;               ///< Wywołania rysujące Allegro zgłoszone przez rysuj_licz w trybie testu.
+} RenderBench;
+
+/** @var render_bench Globalna konfiguracja testu wydajności rysowania. */
+RenderBench render_bench = { false, false, RENDER_BENCH_FRAMES, "golden", false, 0.0, 0 };
+
+// --- Definicje dla powtórek (--record, --replay) ---
+/** @def REPLAY_MAGIC Znacznik na początku pliku powtórki. */
+#define REPLAY_MAGIC "BMRP"
+/** @def REPLAY_VERSION Wersja formatu pliku powtórki. */
+#define REPLAY_VERSION 1
+/** @def REPLAY_PATH_MAX Największa długość ścieżki powtórki i katalogu eksportu. */
+#define REPLAY_PATH_MAX 512
+/** @def EXPORT_MAX_WORKERS Największa liczba wątków kodujących klatki eksportu. */
+#define EXPORT_MAX_WORKERS 16
+/** @def EXPORT_FRAMES_PER_WORKER Liczba buforów klatek na wątek kodujący (kolejka między rysowaniem a kodowaniem). */
+#define EXPORT_FRAMES_PER_WORKER 2
+/** @def EXPORT_REPORT_INTERVAL Co ile klatek eksport wypisuje postęp. */
+#define EXPORT_REPORT_INTERVAL 3600
+
+/**
+ * @struct ReplayHeader
+ * @brief Nagłówek pliku powtórki. Za nim leży `tick_count` bajtów wejścia (maski GAME_INPUT)
+ * kolejnych klatek. Symulacja jest deterministyczna, więc stan generatora sprzed setup_new_game,
+ * konfiguracja gry i wejścia wystarczą, by odtworzyć każdą klatkę. Liczby są w porządku bajtów maszyny.
+ */
+typedef struct {
+    char magic[4];                   ///< REPLAY_MAGIC.
+    uint32_t version;                ///< REPLAY_VERSION.
+    uint32_t rng_state;              ///< Stan generatora symulacji tuż przed setup_new_game.
+    uint32_t tick_count;             ///< Liczba zapisanych klatek.
+    uint32_t width, height;          ///< Rozmiar mapy generowanej (world_width, world_height).
+    uint8_t game_mode;               ///< Tryb gry (GAME_MODE).
+    uint8_t ruleset;                 ///< Zestaw reguł (RULESET); RULESET_CUSTOM oznacza wartości z `rules`.
+    int16_t level;                   ///< Poziom z paczki (od 0); -1 - mapa generowana.
+    int32_t rules[RULE_FIELD_COUNT]; ///< Wartości pól reguł w kolejności `rule_fields`.
+    uint64_t final_hash;             ///< Skrót stanu (stan_skrot) po ostatniej klatce.
+} ReplayHeader;
+
+/**
+ * @struct ReplayRecorder
+ * @brief Nagrywanie powtórki gry w oknie (--record=PLIK).
+ * * Wejście klatki jest dopisywane, gdy wypada z okna rollbacku (jest już ostateczne), a reszta
+ * okna - na końcu gry. Każda nowa gra zaczyna nagranie od nowa, więc plik zawiera ostatnią grę.
+ */
+typedef struct {
+    char path[REPLAY_PATH_MAX]; ///< Plik powtórki; pusty - nagrywanie wyłączone.
+    bool active;                ///< Czy trwa nagrywanie gry.
+    ReplayHeader header;        ///< Nagłówek nagrywanej gry.
+    unsigned char* inputs;      ///< Wejścia kolejnych klatek.
+    int count;                  ///< Liczba zapisanych wejść.
+    int capacity;               ///< Pojemność bufora wejść.
+} ReplayRecorder;
+
+/** @var replay_recorder Globalny stan nagrywania powtórki. */
+ReplayRecorder replay_recorder;
+
+/**
+ * @struct ReplayExport
+ * @brief Eksport powtórki do klatek bez okna (--replay=PLIK z --export-png=KATALOG albo --export-raw=PLIK).
+ * * Symulacja i rysowanie (funkcje rysuj_*) czytają globalny stan gry, więc klatki powstają kolejno
+ * na wątku głównym w bitmapach w pamięci. Kodowanie (kompresja PNG albo zapis surowych pikseli RGBA)
+ * odbywa się na wątkach pomocniczych, które pobierają gotowe klatki z pierścienia buforów, więc
+ * rysowanie kolejnych klatek nie czeka na kodowanie poprzednich.
+ */
+typedef struct {
+    char replay_path[REPLAY_PATH_MAX]; ///< Plik powtórki do odtworzenia; pusty - eksport wyłączony.
+    char png_dir[REPLAY_PATH_MAX];     ///< Katalog sekwencji PNG (pusty - zapis surowy).
+    FILE* raw;                         ///< Plik (lub potok nazwany) surowych klatek RGBA.
+    int workers;                       ///< Żądana liczba wątków kodujących (0 - liczba rdzeni bez jednego).
+
+    ALLEGRO_BITMAP* frames[EXPORT_MAX_WORKERS * EXPORT_FRAMES_PER_WORKER]; ///< Pierścień buforów klatek.
+    int frame_number[EXPORT_MAX_WORKERS * EXPORT_FRAMES_PER_WORKER];       ///< Numer klatki w buforze (-1 - bufor wolny).
+    bool taken[EXPORT_MAX_WORKERS * EXPORT_FRAMES_PER_WORKER];             ///< Czy klatkę z bufora koduje już wątek.
+    int slots;                         ///< Liczba buforów w pierścieniu.
+    int next_encode;                   ///< Bufor następnej klatki do zakodowania.
+    ALLEGRO_THREAD* threads[EXPORT_MAX_WORKERS]; ///< Wątki kodujące.
+    int thread_count;                  ///< Liczba uruchomionych wątków kodujących.
+    ALLEGRO_MUTEX* mutex;              ///< Chroni pierścień buforów.
+    ALLEGRO_COND* ready_cond;          ///< Sygnał: w pierścieniu jest klatka do zakodowania (albo koniec).
+    ALLEGRO_COND* free_cond;           ///< Sygnał: bufor został zwolniony.
+    bool quit;                         ///< Koniec eksportu - wątki kończą po zakodowaniu zaległych klatek.
+    int failures;                      ///< Liczba klatek, których nie udało się zapisać.
+} ReplayExport;
+
+/** @var replay_export Globalna konfiguracja i stan eksportu powtórki. */
+ReplayExport replay_export;
+
+// --- Definicje dla środowisk treningowych (API wsadowe) ---
+/** @def TRAIN_API Eksportuje funkcje środowisk treningowych. Plik zbudowany z BOMBERMAN_LIBRARY
+ * (bez funkcji main) jako biblioteka współdzielona może być wczytany np. przez ctypes w trenerze.
+ */
+#if defined(_MSC_VER)
+#define TRAIN_API __declspec(dllexport)
+#else
+#define TRAIN_API __attribute__((visibility("default")))
+#endif
+/** @def TRAIN_MAX_EPISODE_TICKS Po tylu klatkach epizod jest przerywany i środowisko zaczyna nową grę. */
+#define TRAIN_MAX_EPISODE_TICKS 3000
+/** @def TRAIN_REWARD_PER_POINT Nagroda za każdy punkt wyniku gracza. */
+#define TRAIN_REWARD_PER_POINT 0.01f
+/** @def TRAIN_REWARD_LIFE_LOST Nagroda (kara) za każde stracone życie. */
+#define TRAIN_REWARD_LIFE_LOST -1.0f
+/** @def TRAIN_REWARD_WIN Nagroda za ukończenie planszy. */
+#define TRAIN_REWARD_WIN 1.0f
+/** @def TRAIN_BENCH_ENVS Domyślna liczba środowisk testu wydajności (--train-bench). */
+#define TRAIN_BENCH_ENVS 256
+/** @def TRAIN_BENCH_STEPS Liczba kroków wsadowych testu wydajności. */
+#define TRAIN_BENCH_STEPS 2000
+/** @def TRAIN_BENCH_SEED Ziarno środowisk testu wydajności (gdy nie podano --seed). */
+#define TRAIN_BENCH_SEED 2024u
+
+/** @enum TRAIN_PLANE
+ * @brief Płaszczyzny cech obserwacji; każda to mapa width x height liczb float, wierszami.
+ */
+typedef enum {
+    TRAIN_PLANE_SOLID,    ///< 1 - ściana niezniszczalna.
+    TRAIN_PLANE_BOX,      ///< 1 - ściana zniszczalna.
+    TRAIN_PLANE_BOMB,     ///< Tykająca bomba: pozostała część lontu (0, 1].
+    TRAIN_PLANE_BLAST,    ///< 1 - pole objęte eksplozją.
+    TRAIN_PLANE_ENEMY,    ///< Liczba wrogów na polu.
+    TRAIN_PLANE_POWERUP,  ///< Power-up: (typ + 1) / POWERUP_TYPE_COUNT.
+    TRAIN_PLANE_PLAYER,   ///< 1 - żywy gracz.
+    TRAIN_PLANE_EXIT,     ///< 1 - odkryte wyjście.
+    TRAIN_PLANES          ///< Liczba płaszczyzn.
+} TRAIN_PLANE;
+
+/**
+ * @struct TrainingEnv
+ * @brief Niezależna gra środowiska treningowego.
+ * * Symulacja działa na stanie globalnym, więc środowisko trzyma własną mapę (na czas kroku wskazywaną
+ * przez `game_map`) i migawkę pozostałego stanu, przywracaną przed krokiem i zapisywaną po nim -
+ * tak samo jak przy rollbacku.
+ */
+typedef struct {
+    WorldMap map;          ///< Mapa środowiska.
+    GameSnapshot state;    ///< Stan symulacji środowiska między krokami.
+    int episode_ticks;     ///< Liczba klatek bieżącego epizodu.
+} TrainingEnv;
 
 /**
- * @struct DestructibleWallCoord
- * @brief Struktura pomocnicza do przechowywania współrzędnych zniszczalnych ścian.
- * Używana podczas losowego umieszczania ukrytego wyjścia.
+ * @struct TrainingBatch
+ * @brief Zestaw środowisk krokowanych jednym wywołaniem trening_krok.
+ * * Bufory wejścia i wyjścia należą do wywołującego i są ciągłymi tablicami bez wskaźników
+ * (obserwacje: [środowisko][TRAIN_PLANE][y][x] float, nagrody: float, końce epizodów: unsigned char),
+ * więc mogą leżeć w pamięci współdzielonej i być czytane przez trenera bez kopiowania.
  */
 typedef struct {
-    int x; ///< Współrzędna X zniszczalnej ściany.
-    int y; ///< Współrzędna Y zniszczalnej ściany.
-} DestructibleWallCoord;
+    TrainingEnv* envs;     ///< Środowiska.
+    int count;             ///< Liczba środowisk.
+    int width, height;     ///< Rozmiar map (i płaszczyzn obserwacji) w kafelkach.
+    WorldMap* saved_map;   ///< Mapa gry sprzed wejścia w środowiska.
+    int saved_width, saved_height; ///< Rozmiar nowej mapy gry sprzed wejścia w środowiska.
+    bool saved_quiet;      ///< Wartość rollback_resymulacja sprzed wejścia w środowiska.
+    uint64_t stat_steps;   ///< Liczba kroków środowisk od utworzenia.
+    uint64_t stat_episodes; ///< Liczba zakończonych epizodów od utworzenia.
+} TrainingBatch;
+
+/** @var train_bench_envs Liczba środowisk testu wydajności z --train-bench[=N] (0 - test wyłączony). */
+int train_bench_envs = 0;
 
 // --- Deklaracje funkcji ---
 
 // Funkcje inicjalizacyjne
+int losuj();
+bool pula_utworz(EntityPool* pool, const char* name, int item_size, int capacity);
+bool pula_rezerwuj(EntityPool* pool, int capacity);
+void pula_resetuj(EntityPool* pool);
+void pula_zwolnij_pamiec(EntityPool* pool);
+int pula_przydziel(EntityPool* pool);
+void pula_zwolnij(EntityPool* pool, int index);
+EntityHandle pula_uchwyt(const EntityPool* pool, int index);
+void* pula_pobierz(EntityPool* pool, EntityHandle handle);
+void pula_zapisz(const EntityPool* pool, PoolImage* img);
+void pula_przywroc(EntityPool* pool, const PoolImage* img);
+void pula_raport(EntityPool* pool);
+void pule_przygotuj(const GameModeConfig* mode);
+void pule_odswiez_wskazniki();
+void pule_zwolnij();
+void upusc_powerup(int x, int y);
 void initialize_map();
 void hide_exit_randomly();
-void initialize_enemies(int map[MAP_HEIGHT][MAP_WIDTH], Player* p_player);
-void find_and_set_player_spawn(Player* p_player, int map[MAP_HEIGHT][MAP_WIDTH]);
-void try_plant_bomb(Player* p);
+void initialize_enemies(WorldMap* map, Player* p_player);
+void find_and_set_player_spawn(Player* p_player, WorldMap* map);
+RULES_INLINE void try_plant_bomb(const GameRules* r, Player* p);
+const RuleField* reguly_pole(const char* assignment, int* value);
+bool reguly_ustaw_pole(const char* assignment);
 void setup_new_game();
 
+// Funkcje paczek poziomów
+bool paczka_otworz(const char* path);
+bool paczka_sprawdz(const unsigned char* data, size_t size);
+void paczka_zamknij();
+const LevelRecord* paczka_poziom(int index);
+const GameRules* poziom_reguly(const LevelRecord* level);
+bool paczka_koduj_poziom(char (*rows)[LEVEL_MAX_SIZE + 1], int height, RULESET ruleset, const int32_t* rules, LevelRecord* rec, unsigned char* packed_terrain, const char* path, int first_line);
+int paczka_zbuduj(const char* source_path, const char* pack_path);
+
 // Funkcje obsługi logiki gry
 void obsluz_wejscie(ALLEGRO_EVENT event, Player* p, GAME_STATE* current_state);
-void aktualizuj_gre(Player* p, Bomb bombs_arr[], Enemy enemies_arr[], Powerup powerups_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH], GAME_STATE* current_state, bool* exit_rev, int ex_x, int ex_y);
-void aktualizuj_nietykalnosc_gracza(Player* p);
-void aktualizuj_bomby(Bomb bombs_arr[], Player* p, Enemy enemies_arr[], Powerup powerups_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH], GAME_STATE* current_state, bool* exit_rev, int ex_x, int ex_y);
-void aktualizuj_wrogow(Enemy enemies_arr[], Player* p, Bomb bombs_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH], bool exit_rev, int ex_x, int ex_y);
-void sprawdz_kolizje_gracz_wrog(Player* p, Enemy enemies_arr[], GAME_STATE* current_state);
-void sprawdz_warunek_wygranej(Player* p, Enemy enemies_arr[], bool exit_rev, int ex_x, int ex_y, GAME_STATE* current_state);
+RULES_INLINE void zastosuj_wejscie_gracza(const GameRules* r, Player* p, unsigned char input);
+void krok_symulacji(unsigned char input);
+RULES_INLINE void krok_symulacji_regul(const GameRules* r, unsigned char input);
+RULES_INLINE void aktualizuj_gre(const GameRules* r, Player* p, Bomb bombs_arr[], Enemy enemies_arr[], WorldMap* game_map_arr, GAME_STATE* current_state, bool* exit_rev, int ex_x, int ex_y);
+RULES_INLINE void nadaj_nietykalnosc(const GameRules* r, Player* p);
+RULES_INLINE void zdetonuj_bombe(const GameRules* r, Bomb* b, Player* p, Enemy enemies_arr[], WorldMap* game_map_arr, GAME_STATE* current_state, bool* exit_rev, int ex_x, int ex_y);
+RULES_INLINE void przesun_wroga(Enemy enemies_arr[], int i, Bomb bombs_arr[], WorldMap* game_map_arr, bool exit_rev, int ex_x, int ex_y);
+bool wrog_sciana(WorldMap* m, int x, int y);
+bool wrog_moze_wejsc(Enemy enemies_arr[], int i, Bomb bombs_arr[], WorldMap* m, bool exit_rev, int ex_x, int ex_y, int x, int y);
+bool wrog_idz(int i, ENEMY_DIRECTION dir);
+void wrog_uciekaj(int i);
+RULES_INLINE int wrog_opoznienie(const GameRules* r);
+RULES_INLINE int skrypt_bladzenie(const GameRules* r, int i);
+RULES_INLINE int skrypt_patrol(const GameRules* r, int i);
+RULES_INLINE int skrypt_poscig(const GameRules* r, int i);
+RULES_INLINE int skrypt_czajenie(const GameRules* r, int i);
+RULES_INLINE int wrog_wznow_skrypt(const GameRules* r, int i);
+RULES_INLINE void sprawdz_kolizje_gracz_wrog(const GameRules* r, Player* p, Enemy enemies_arr[], GAME_STATE* current_state);
+bool wybuch_obejmuje(const Bomb* b, int x, int y);
+void sprawdz_warunek_wygranej(Player* p, bool exit_rev, int ex_x, int ex_y, GAME_STATE* current_state);
+
+// Funkcje koła czasowego
+int najnizszy_bit(uint64_t bits);
+void zegar_resetuj(TimingWheel* w, uint32_t now);
+bool zegar_zaplanuj(TimingWheel* w, uint32_t due, int kind, EntityHandle target);
+void zegar_wstaw(TimingWheel* w, int id);
+void zegar_kaskaduj(TimingWheel* w, int level);
+int zegar_krok(TimingWheel* w);
+void zegar_odbuduj(TimingWheel* w, uint32_t now);
+void zdarzenie_koniec_nietykalnosci(EntityHandle target);
+RULES_INLINE void zdarzenie_bomby(const GameRules* r, EntityHandle target);
+RULES_INLINE void zdarzenie_ruchu_wroga(const GameRules* r, EntityHandle target);
+
+// Funkcje rollbacku
+void zapisz_stan_gry(GameSnapshot* snap);
+bool przywroc_stan_gry(const GameSnapshot* snap);
+void rollback_reset();
+unsigned char rollback_przewiduj_wejscie(unsigned char last_input);
+void rollback_potwierdz_wejscie(int tick, unsigned char input);
+void rollback_wykonaj();
+void rollback_krok(unsigned char local_input);
+void rollback_raport();
+
+// Funkcje skrótu stanu gry
+uint64_t zobrist_klucz(uint64_t a, uint64_t b);
+uint64_t zobrist_kafelek(int x, int y, int type);
+uint64_t zobrist_skladnik(ZOBRIST_KIND kind, uint64_t id, const uint32_t* fields, int count);
+uint64_t stan_skrot();
+void skrot_zapisz_klatke(int tick, uint64_t hash);
+
+// Funkcje mapy
+void mapa_utworz(WorldMap* m, int width, int height, uint32_t seed);
+void mapa_zwolnij(WorldMap* m);
+int mapa_generuj_kafelek(const WorldMap* m, int x, int y);
+void mapa_spakuj_fragment(const unsigned char* tiles, unsigned char* packed);
+void mapa_rozpakuj_fragment(unsigned char* tiles, const unsigned char* packed);
+MapChunk* mapa_fragment(WorldMap* m, int cx, int cy);
+int mapa_wczytaj_fragment(WorldMap* m, int chunk);
+void mapa_wyrzuc_fragment(WorldMap* m, int slot);
+int mapa_kafelek(WorldMap* m, int x, int y);
+void mapa_indeksuj_wiersz(MapChunk* c, int ty);
+void mapa_indeksuj_kolumne(MapChunk* c, int tx);
+void mapa_indeksuj_fragment(MapChunk* c);
+int mapa_odleglosc_sciany(WorldMap* m, int x, int y, int dir, int limit);
+int mapa_odleglosc_sciany_odczyt(const WorldMap* m, int x, int y, int dir, int limit);
+void mapa_zapisz_kafelek(WorldMap* m, int x, int y, int type);
+void ustaw_kafelek(WorldMap* m, int x, int y, int type);
+bool mapa_cofnij_do(WorldMap* m, uint32_t journal_pos);
+void mapa_przytnij_dziennik(WorldMap* m, uint32_t journal_pos);
+void mapa_utrzymuj_aktywne(WorldMap* m, Player* p, Bomb bombs_arr[]);
+void mapa_raport(WorldMap* m);
+int mapa_policz_sciany(const WorldMap* m);
+void liczniki_sprawdz();
+int mapa_kafelek_bez_ladowania(WorldMap* m, int x, int y);
+bool mapa_losuj_pole(WorldMap* m, int type, const CellSet* taken, int avoid_x, int avoid_y, int min_dist, int* out_x, int* out_y);
+void zajete_wyczysc(CellSet* set, int expected);
+bool zajete_zawiera(const CellSet* set, int x, int y);
+void zajete_dodaj(CellSet* set, int x, int y);
+void zajete_zwolnij(CellSet* set);
+
+// Funkcje kamery i terenu
+void teren_oznacz_kafelek(int x, int y);
+void teren_oznacz_wszystko();
+bool teren_init();
+void teren_zwolnij();
+void teren_zwolnij_bufory();
+void teren_wierzcholki_kafelka(ALLEGRO_VERTEX* v, int x, int y, int type);
+void teren_wypiecz_sprite();
+void teren_synchronizuj(WorldMap* game_map_arr);
+TerrainMesh* teren_siatka_fragmentu(WorldMap* m, int chunk);
+void aktualizuj_kamere(Player* p);
+bool kafelek_widoczny(int x, int y);
+
+// Funkcje systemu cząsteczek
+void czasteczki_init();
+void czasteczki_emituj_eksplozje(Bomb* b);
+void czasteczki_emituj_pole(int cx, int cy);
+void czasteczki_aktualizuj();
+
+// Funkcje wyznaczania zasięgu eksplozji
+void wybuch_promienie(const WorldMap* m, const Bomb* b, BlastRays* out);
+void wybuchy_fragment(const WorldMap* m, int part, int parts);
+void* wybuchy_watek(ALLEGRO_THREAD* thread, void* arg);
+void wybuchy_init(int workers);
+void wybuchy_przygotuj(WorldMap* m, int due_count);
+void wybuchy_zwolnij();
+
+// Funkcje telemetrii
+FILE* plik_otworz(const char* path, const char* mode);
+bool metryki_init(const char* path);
+void metryki_histogram_dodaj(MetricsHistogram* h, double seconds);
+void metryki_zdarzenie(ALLEGRO_EVENT_QUEUE* queue);
+size_t metryki_pamiec_puli(const EntityPool* pool);
+void metryki_histogram_json(FILE* f, const char* name, const MetricsHistogram* h);
+void metryki_histogram_prom(FILE* f, const char* name, const char* help, const MetricsHistogram* h);
+void metryki_eksportuj();
+
+// Funkcje dźwięku
+bool muzyka_zaladuj(ALLEGRO_MIXER* mixer);
+void muzyka_odtwarzaj(bool playing);
+ALLEGRO_SAMPLE* dzwiek_syntezuj(SFX_KIND kind);
+bool dzwieki_init(ALLEGRO_MIXER* mixer);
+void dzwiek_zglos(SFX_KIND kind);
+void dzwieki_odtworz_zgloszone();
+void dzwieki_raport();
+void dzwieki_zwolnij();
+
+// Funkcje wejścia o niskim opóźnieniu
+void probkuj_klawiature(unsigned char* input);
+void opoznienie_po_flipie();
+
+// Funkcje warstwy interfejsu
+void ui_uklad(int width, int height);
+void ui_zwolnij();
+void ui_ustaw(UiWidget* w, int value);
+float ui_zaczepienie(const UiWidget* w);
+void ui_renderuj_kontrolke(UiWidget* w);
+void ui_tresc_ekranu_startowego();
+void ui_tresc_konca_gry(bool victory, int score);
+
+// Funkcje prezentacji klatki
+bool prezentacja_init(ALLEGRO_DISPLAY* display);
+void prezentacja_uklad(int window_width, int window_height);
+void prezentacja_pokaz(ALLEGRO_DISPLAY* display);
+void prezentacja_zwolnij();
+
+// Funkcje pętli gry
+bool scena_animowana();
+void dostosuj_zegar(ALLEGRO_TIMER* timer);
+void narysuj_klatke(ALLEGRO_DISPLAY* display);
 
 // Funkcje rysowania
-void rysuj_gre(ALLEGRO_DISPLAY* display, Player* p, Bomb bombs_arr[], Enemy enemies_arr[], Powerup powerups_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH], GAME_STATE current_s, bool exit_rev, int ex_x, int ex_y);
-void rysuj_ekran_startowy(ALLEGRO_DISPLAY* display);
-void rysuj_ekran_konca_gry(ALLEGRO_DISPLAY* display, Player* p, Enemy enemies_arr[], bool exit_rev, int ex_x, int ex_y);
+void rysuj_gre(ALLEGRO_BITMAP* target, Player* p, Bomb bombs_arr[], Enemy enemies_arr[], Powerup powerups_arr[], WorldMap* game_map_arr, GAME_STATE current_s, bool exit_rev, int ex_x, int ex_y);
+void rysuj_ekran_startowy();
+void rysuj_ekran_konca_gry(Player* p, bool exit_rev, int ex_x, int ex_y);
 void rysuj_hud(Player* p);
-void rysuj_mape(int game_map_arr[MAP_HEIGHT][MAP_WIDTH]);
+void rysuj_mape(WorldMap* game_map_arr);
 void rysuj_wyjscie(bool exit_rev, int ex_x, int ex_y);
 void rysuj_powerupy(Powerup powerups_arr[]);
-void rysuj_bomby_i_eksplozje(Bomb bombs_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH]);
+void rysuj_bomby_i_eksplozje(Bomb bombs_arr[]);
+void rysuj_czasteczki();
 void rysuj_wrogow(Enemy enemies_arr[]);
+void rysuj_sprite_wroga(float x, float y, ALLEGRO_COLOR color, ENEMY_DIRECTION direction);
+void rysuj_sprite_wyjscia(float x, float y, float pulse_factor, bool spark);
 void rysuj_gracza(Player* p);
+double czas_animacji();
+
+// Funkcje testu wydajności rysowania
+void rysuj_licz();
+void test_rysowania_scena(RENDER_SCENE scene);
+bool test_rysowania_porownaj(ALLEGRO_BITMAP* frame, const char* name);
+int test_rysowania_uruchom();
+
+// Funkcje powtórek
+void powtorka_nagrywaj(uint32_t start_rng);
+void powtorka_dopisz(int tick, unsigned char input);
+void powtorka_zakoncz();
+bool powtorka_wczytaj(const char* path, ReplayHeader* header, unsigned char** inputs);
+void* eksport_watek(ALLEGRO_THREAD* thread, void* arg);
+bool eksport_koduj(ALLEGRO_BITMAP* frame, int number);
+int powtorka_eksportuj();
+
+// Funkcje środowisk treningowych
+void migawka_zwolnij(GameSnapshot* snap);
+void trening_wejdz(TrainingBatch* batch);
+void trening_wyjdz(TrainingBatch* batch);
+void trening_nowa_gra(TrainingEnv* env);
+void trening_obserwuj(const TrainingBatch* batch, float* out);
+TRAIN_API TrainingBatch* trening_utworz(int count, int width, int height, uint32_t seed);
+TRAIN_API int trening_rozmiar_obserwacji(const TrainingBatch* batch);
+TRAIN_API void trening_obserwacje(TrainingBatch* batch, float* obs);
+TRAIN_API void trening_krok(TrainingBatch* batch, const unsigned char* actions, float* obs, float* rewards, unsigned char* dones);
+TRAIN_API void trening_zwolnij(TrainingBatch* batch);
+int trening_test(int count);
 
 
 // --- Implementacje funkcji ---
 
 /**
- * @brief Ukrywa wyjście pod losowo wybraną zniszczalną ścianą na mapie.
- * * Funkcja przeszukuje mapę w poszukiwaniu wszystkich kafelków typu DESTRUCTIBLE_WALL.
- * Następnie, jeśli takie kafelki istnieją, losowo wybiera jeden z nich
- * i ustawia globalne zmienne `exit_x` oraz `exit_y` na jego współrzędne.
- * Flaga `exit_revealed` jest ustawiana na `false`.
+ * @brief Zwraca kolejną nieujemną liczbę pseudolosową dla logiki gry.
+ * * Symulacja używa własnego generatora (xorshift32) zamiast rand(), ponieważ jego stan
+ * musi być zapisywany i przywracany razem z resztą stanu gry (rollback).
+ * Losowość czysto wizualna (np. rysowanie iskier) nadal korzysta z rand().
+ * @return Liczba z zakresu [0, INT_MAX].
  */
-void hide_exit_randomly() {
-    DestructibleWallCoord possible_exits[MAP_WIDTH * MAP_HEIGHT];
-    int num_possible_exits = 0;
+int losuj() {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return (int)(x >> 1);
+}
 
-    for (int y_coord = 0; y_coord < MAP_HEIGHT; y_coord++) {
-        for (int x_coord = 0; x_coord < MAP_WIDTH; x_coord++) {
-            if (game_map[y_coord][x_coord] == DESTRUCTIBLE_WALL) {
-                if (num_possible_exits < MAP_WIDTH * MAP_HEIGHT) {
-                    possible_exits[num_possible_exits].x = x_coord;
-                    possible_exits[num_possible_exits].y = y_coord;
-                    num_possible_exits++;
-                }
-            }
-        }
-    }
+// --- Funkcje pul obiektów ---
+
+/**
+ * @brief Tworzy pustą pulę o podanej pojemności.
+ * @param pool Wskaźnik do puli.
+ * @param name Nazwa puli w statystykach.
+ * @param item_size Rozmiar elementu w bajtach.
+ * @param capacity Początkowa liczba slotów.
+ * @return true w przypadku powodzenia; false, gdy zabrakło pamięci.
+ */
+bool pula_utworz(EntityPool* pool, const char* name, int item_size, int capacity) {
+    memset(pool, 0, sizeof(*pool));
+    pool->name = name;
+    pool->item_size = item_size;
+    pool->free_head = -1;
+    return pula_rezerwuj(pool, capacity);
+}
 
-    if (num_possible_exits > 0) {
-        int random_index = rand() % num_possible_exits;
-        exit_x = possible_exits[random_index].x;
-        exit_y = possible_exits[random_index].y;
-        printf("Exit hidden under a box at (%d, %d)\n", exit_x, exit_y);
+/**
+ * @brief Powiększa pulę tak, aby mieściła co najmniej `capacity` slotów.
+ * * Przydział pamięci następuje tylko tutaj - przy tworzeniu puli i gdy zabraknie w niej miejsca.
+ * Po powiększeniu wskaźniki na elementy (enemies, bombs, powerups) trzeba odświeżyć.
+ * @param pool Wskaźnik do puli.
+ * @param capacity Wymagana liczba slotów.
+ * @return true, jeśli pula ma wymaganą pojemność.
+ */
+bool pula_rezerwuj(EntityPool* pool, int capacity) {
+    if (capacity <= pool->capacity) return true;
+    if (capacity > POOL_MAX_CAPACITY) {
+        fprintf(stderr, "Pool %s: capacity %d exceeds handle range (%d)!\n", pool->name, capacity, POOL_MAX_CAPACITY);
+        return false;
     }
-    else {
-        printf("WARNING: No destructible walls found to hide the exit! Exit will not be placed.\n");
-        exit_x = -1;
-        exit_y = -1;
+    unsigned char* items = realloc(pool->items, (size_t)capacity * pool->item_size);
+    if (items) pool->items = items;
+    uint16_t* generations = realloc(pool->generations, (size_t)capacity * sizeof(uint16_t));
+    if (generations) pool->generations = generations;
+    int* next_free = realloc(pool->next_free, (size_t)capacity * sizeof(int));
+    if (next_free) pool->next_free = next_free;
+    unsigned char* live = realloc(pool->live, (size_t)capacity);
+    if (live) pool->live = live;
+    if (!items || !generations || !next_free || !live) {
+        fprintf(stderr, "Pool %s: out of memory growing to %d slots!\n", pool->name, capacity);
+        return false;
     }
-    exit_revealed = false;
+    for (int i = pool->capacity; i < capacity; i++) {
+        pool->generations[i] = 1;
+        pool->live[i] = 0;
+    }
+    pool->capacity = capacity;
+    return true;
 }
 
 /**
- * @brief Inicjalizuje mapę gry, rozmieszczając na niej ściany (stałe i zniszczalne) oraz puste pola.
- * * Tworzy obramowanie z niezniszczalnych ścian, rozmieszcza niezniszczalne bloki
- * wewnątrz mapy (wzorzec szachownicy) oraz losowo umieszcza zniszczalne ściany
- * i puste pola. Gwarantuje również puste miejsca dla startu gracza.
+ * @brief Zwalnia wszystkie obiekty puli (nowa gra). Pamięć zostaje do ponownego użycia.
+ * * Generacje wracają do 1, więc każda gra zaczyna od identycznego stanu puli (powtórki
+ * i rollback są deterministyczne). Wszystkie uchwyty i tak znikają razem z kołem czasowym.
+ * @param pool Wskaźnik do puli.
  */
-void initialize_map() {
-    for (int y = 0; y < MAP_HEIGHT; y++) {
-        for (int x = 0; x < MAP_WIDTH; x++) {
-            if (y == 0 || y == MAP_HEIGHT - 1 || x == 0 || x == MAP_WIDTH - 1) {
-                game_map[y][x] = SOLID_WALL;
-            }
-            else if (x % 2 == 0 && y % 2 == 0) {
-                game_map[y][x] = SOLID_WALL;
-            }
-            else if ((x == 1 && y == 1) || (x == 1 && y == 2) || (x == 2 && y == 1) || (x == MAP_WIDTH - 2 && y == 1)) {
-                game_map[y][x] = EMPTY;
-            }
-            else if (rand() % 2 == 0) {
-                game_map[y][x] = DESTRUCTIBLE_WALL;
-            }
-            else {
-                game_map[y][x] = EMPTY;
-            }
-        }
+void pula_resetuj(EntityPool* pool) {
+    for (int i = 0; i < pool->used; i++) {
+        pool->generations[i] = 1;
+        pool->live[i] = 0;
     }
+    pool->used = 0;
+    pool->count = 0;
+    pool->free_head = -1;
+    pool->stat_peak = 0;
 }
 
 /**
- * @brief Inicjalizuje wrogów, rozmieszczając ich na mapie.
- * * Dla każdego wroga losuje pozycję na pustym polu, upewniając się, że nie jest to
- * miejsce startowe gracza, ukryte wyjście, ani pozycja innego, już umieszczonego wroga.
- * Wrogowie nie powinni również pojawiać się zbyt blisko gracza na starcie.
- * @param map Tablica reprezentująca mapę gry.
- * @param p_player Wskaźnik do struktury gracza.
+ * @brief Zwalnia pamięć puli.
+ * @param pool Wskaźnik do puli.
  */
-void initialize_enemies(int map[MAP_HEIGHT][MAP_WIDTH], Player* p_player) {
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        enemies[i].is_alive = true;
-        enemies[i].color = al_map_rgb(255, 100, 100);
-        enemies[i].move_timer = rand() % ENEMY_MOVE_DELAY;
-        enemies[i].direction = (ENEMY_DIRECTION)(rand() % DIR_COUNT);
-
-        bool spot_found = false;
-        int attempts = 0;
-        while (!spot_found && attempts < MAP_WIDTH * MAP_HEIGHT) {
-            int ex = rand() % MAP_WIDTH;
-            int ey = rand() % MAP_HEIGHT;
-
-            if (map[ey][ex] == EMPTY && (ex != p_player->x || ey != p_player->y) && (ex != exit_x || ey != exit_y)) {
-                bool too_close_to_player = (abs(ex - p_player->x) < 3 && abs(ey - p_player->y) < 3);
-                bool occupied_by_other_enemy = false;
-                for (int j = 0; j < i; j++) {
-                    if (enemies[j].is_alive && enemies[j].x == ex && enemies[j].y == ey) {
-                        occupied_by_other_enemy = true;
-                        break;
-                    }
-                }
-                if (!occupied_by_other_enemy && !too_close_to_player) {
-                    enemies[i].x = ex;
-                    enemies[i].y = ey;
-                    spot_found = true;
-                    printf("Enemy %d spawned at (%d, %d)\n", i, ex, ey);
-                }
-            }
-            attempts++;
-        }
-        if (!spot_found) {
-            enemies[i].is_alive = false;
-            printf("Could not find a spot for enemy %d\n", i);
+void pula_zwolnij_pamiec(EntityPool* pool) {
+    free(pool->items);
+    free(pool->generations);
+    free(pool->next_free);
+    free(pool->live);
+    pool->items = NULL; pool->generations = NULL; pool->next_free = NULL; pool->live = NULL;
+    pool->capacity = 0; pool->used = 0; pool->count = 0; pool->free_head = -1;
+}
+
+/**
+ * @brief Przydziela slot w puli w czasie O(1). Element jest wyzerowany.
+ * * Najpierw używa ostatnio zwolnionego slotu, potem kolejnego nieużytego (z generacją 1, także
+ * gdy rollback cofnął `used`, więc ponowna symulacja daje te same uchwyty); gdy pula jest pełna,
+ * podwaja jej pojemność (wtedy trzeba odświeżyć wskaźniki przez pule_odswiez_wskazniki).
+ * @param pool Wskaźnik do puli.
+ * @return Indeks slotu lub -1, jeśli zabrakło pamięci.
+ */
+int pula_przydziel(EntityPool* pool) {
+    int index;
+    if (pool->free_head >= 0) {
+        index = pool->free_head;
+        pool->free_head = pool->next_free[index];
+    }
+    else {
+        if (pool->used == pool->capacity) {
+            if (!pula_rezerwuj(pool, pool->capacity > 0 ? pool->capacity * 2 : 4)) return -1;
+            pool->stat_grows++;
         }
+        index = pool->used++;
+        pool->generations[index] = 1;
     }
+    pool->live[index] = 1;
+    pool->count++;
+    if (pool->count > pool->stat_peak) pool->stat_peak = pool->count;
+    memset(pool->items + (size_t)index * pool->item_size, 0, pool->item_size);
+    return index;
 }
 
 /**
- * @brief Znajduje i ustawia bezpieczne miejsce startowe dla gracza na mapie.
- * * Funkcja najpierw próbuje umieścić gracza w jednym z preferowanych rogów mapy,
- * upewniając się, że sąsiednie pola są puste. Jeśli to się nie uda, szuka
- * dowolnego pustego pola z dwoma wolnymi sąsiadami. W ostateczności wybiera
- * dowolne puste pole lub wymusza puste pole na (1,1).
- * @param p_player Wskaźnik do struktury gracza.
- * @param map Tablica reprezentująca mapę gry.
+ * @brief Zwalnia slot puli w czasie O(1) i unieważnia uchwyty do niego.
+ * @param pool Wskaźnik do puli.
+ * @param index Indeks zajętego slotu.
  */
-void find_and_set_player_spawn(Player* p_player, int map[MAP_HEIGHT][MAP_WIDTH]) {
-    bool found_spawn = false;
-    int spawn_candidates_x[] = { 1, 1, MAP_WIDTH - 2, MAP_WIDTH - 2 };
-    int spawn_candidates_y[] = { 1, MAP_HEIGHT - 2, 1, MAP_HEIGHT - 2 };
+void pula_zwolnij(EntityPool* pool, int index) {
+    if (!pool->live[index]) return;
+    pool->live[index] = 0;
+    pool->generations[index] = (uint16_t)((pool->generations[index] + 1) & POOL_GENERATION_MASK);
+    if (pool->generations[index] == 0) pool->generations[index] = 1;
+    pool->next_free[index] = pool->free_head;
+    pool->free_head = index;
+    pool->count--;
+}
+
+/**
+ * @brief Zwraca uchwyt do zajętego slotu.
+ * @param pool Wskaźnik do puli.
+ * @param index Indeks slotu.
+ * @return Uchwyt (generacja i indeks).
+ */
+EntityHandle pula_uchwyt(const EntityPool* pool, int index) {
+    return ((EntityHandle)pool->generations[index] << POOL_INDEX_BITS) | (EntityHandle)index;
+}
+
+/**
+ * @brief Zamienia uchwyt na wskaźnik do obiektu, odrzucając uchwyty nieaktualne.
+ * @param pool Wskaźnik do puli.
+ * @param handle Uchwyt obiektu.
+ * @return Wskaźnik do elementu lub NULL, jeśli obiekt został już zwolniony.
+ */
+void* pula_pobierz(EntityPool* pool, EntityHandle handle) {
+    int index = (int)(handle & POOL_INDEX_MASK);
+    if (handle == HANDLE_NONE || index >= pool->used || !pool->live[index] ||
+        pool->generations[index] != (handle >> POOL_INDEX_BITS)) {
+        pool->stat_stale++;
+        return NULL;
+    }
+    return pool->items + (size_t)index * pool->item_size;
+}
+
+/**
+ * @brief Kopiuje zajętą część puli do obrazu w migawce.
+ * @param pool Wskaźnik do puli.
+ * @param img Wskaźnik do obrazu docelowego (bufory rosną, gdy pula urosła).
+ */
+void pula_zapisz(const EntityPool* pool, PoolImage* img) {
+    if (img->capacity < pool->capacity) {
+        unsigned char* items = realloc(img->items, (size_t)pool->capacity * pool->item_size);
+        if (items) img->items = items;
+        uint16_t* generations = realloc(img->generations, (size_t)pool->capacity * sizeof(uint16_t));
+        if (generations) img->generations = generations;
+        int* next_free = realloc(img->next_free, (size_t)pool->capacity * sizeof(int));
+        if (next_free) img->next_free = next_free;
+        unsigned char* live = realloc(img->live, (size_t)pool->capacity);
+        if (live) img->live = live;
+        if (!items || !generations || !next_free || !live) {
+            fprintf(stderr, "Pool %s: out of memory for rollback snapshot!\n", pool->name);
+            img->used = 0;
+            return;
+        }
+        img->capacity = pool->capacity;
+    }
+    int n = pool->used;
+    memcpy(img->items, pool->items, (size_t)n * pool->item_size);
+    memcpy(img->generations, pool->generations, (size_t)n * sizeof(uint16_t));
+    memcpy(img->next_free, pool->next_free, (size_t)n * sizeof(int));
+    memcpy(img->live, pool->live, (size_t)n);
+    img->used = n;
+    img->count = pool->count;
+    img->free_head = pool->free_head;
+}
+
+/**
+ * @brief Przywraca pulę z obrazu w migawce. Pojemność puli nigdy nie maleje, więc obraz zawsze się mieści.
+ * @param pool Wskaźnik do puli.
+ * @param img Wskaźnik do obrazu źródłowego.
+ */
+void pula_przywroc(EntityPool* pool, const PoolImage* img) {
+    int n = img->used;
+    for (int i = n; i < pool->used; i++) {
+        pool->live[i] = 0;
+    }
+    memcpy(pool->items, img->items, (size_t)n * pool->item_size);
+    memcpy(pool->generations, img->generations, (size_t)n * sizeof(uint16_t));
+    memcpy(pool->next_free, img->next_free, (size_t)n * sizeof(int));
+    memcpy(pool->live, img->live, (size_t)n);
+    pool->used = n;
+    pool->count = img->count;
+    pool->free_head = img->free_head;
+}
+
+/**
+ * @brief Wypisuje statystyki puli.
+ * @param pool Wskaźnik do puli.
+ */
+void pula_raport(EntityPool* pool) {
+    printf("Pool %s: %d live (peak %d), capacity %d, grown %d times, %d stale handles rejected\n",
+        pool->name, pool->count, pool->stat_peak, pool->capacity, pool->stat_grows, pool->stat_stale);
+}
+
+/**
+ * @brief Przygotowuje pule obiektów na nową grę w podanym trybie.
+ * * Przy pierwszym wywołaniu tworzy pule, później tylko je czyści i w razie potrzeby
+ * powiększa do pojemności trybu.
+ * @param mode Konfiguracja trybu gry.
+ */
+void pule_przygotuj(const GameModeConfig* mode) {
+    if (!enemy_pool.items) {
+        pula_utworz(&enemy_pool, "enemies", sizeof(Enemy), mode->enemy_capacity);
+        pula_utworz(&bomb_pool, "bombs", sizeof(Bomb), mode->bomb_capacity);
+        pula_utworz(&powerup_pool, "powerups", sizeof(Powerup), mode->powerup_capacity);
+    }
+    else {
+        pula_rezerwuj(&enemy_pool, mode->enemy_capacity);
+        pula_rezerwuj(&bomb_pool, mode->bomb_capacity);
+        pula_rezerwuj(&powerup_pool, mode->powerup_capacity);
+    }
+    pula_resetuj(&enemy_pool);
+    pula_resetuj(&bomb_pool);
+    pula_resetuj(&powerup_pool);
+    pule_odswiez_wskazniki();
+}
+
+/**
+ * @brief Odświeża globalne wskaźniki na elementy pul po ich (ewentualnym) powiększeniu.
+ */
+void pule_odswiez_wskazniki() {
+    enemies = (Enemy*)enemy_pool.items;
+    bombs = (Bomb*)bomb_pool.items;
+    powerups = (Powerup*)powerup_pool.items;
+}
+
+/**
+ * @brief Zwalnia pamięć pul oraz ich kopii w migawkach rollbacku.
+ */
+void pule_zwolnij() {
+    for (int i = 0; i < ROLLBACK_RING_SIZE; i++) {
+        migawka_zwolnij(&rollback.snapshots[i]);
+    }
+    pula_zwolnij_pamiec(&enemy_pool);
+    pula_zwolnij_pamiec(&bomb_pool);
+    pula_zwolnij_pamiec(&powerup_pool);
+    pule_odswiez_wskazniki();
+}
+
+// --- Funkcje mapy ---
+
+/**
+ * @brief Tworzy pustą mapę o podanym rozmiarze; fragmenty są generowane dopiero przy pierwszym dostępie.
+ * * Mapa większa niż MAP_MAX_RESIDENT_CHUNKS fragmentów wymaga pliku wymiany. Jeśli nie da się
+ * go otworzyć, tworzona jest mapa o domyślnym rozmiarze MAP_WIDTH x MAP_HEIGHT.
+ * @param m Wskaźnik do mapy.
+ * @param width Szerokość mapy w kafelkach.
+ * @param height Wysokość mapy w kafelkach.
+ * @param seed Ziarno generatora kafelków.
+ */
+void mapa_utworz(WorldMap* m, int width, int height, uint32_t seed) {
+    int chunks_x = (width + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    int chunks_y = (height + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+
+    if (chunks_x * chunks_y > MAP_MAX_RESIDENT_CHUNKS && !m->swap) {
+        m->swap = al_fopen(MAP_SWAP_FILE, "w+b");
+        if (!m->swap) {
+            fprintf(stderr, "Failed to open map swap file %s! Using a %dx%d map.\n", MAP_SWAP_FILE, MAP_WIDTH, MAP_HEIGHT);
+            width = MAP_WIDTH;
+            height = MAP_HEIGHT;
+            chunks_x = (width + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+            chunks_y = (height + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+        }
+    }
+
+    if (!m->directory || m->chunks_x * m->chunks_y != chunks_x * chunks_y) {
+        free(m->directory);
+        m->directory = (MapChunkEntry*)malloc(sizeof(MapChunkEntry) * chunks_x * chunks_y);
+    }
+    int slot_count = (chunks_x * chunks_y < MAP_MAX_RESIDENT_CHUNKS) ? chunks_x * chunks_y : MAP_MAX_RESIDENT_CHUNKS;
+    if (!m->slots || m->slot_count != slot_count) {
+        free(m->slots);
+        m->slots = (MapChunk*)malloc(sizeof(MapChunk) * slot_count);
+        m->slot_count = slot_count;
+    }
+    m->width = width;
+    m->height = height;
+    m->chunks_x = chunks_x;
+    m->chunks_y = chunks_y;
+    m->seed = seed;
+    m->level_chunks = NULL;
+    m->walls = -1;
+    m->hash = zobrist_klucz(((uint64_t)ZOBRIST_MAP << 56) | seed, ((uint64_t)(uint32_t)height << 32) | (uint32_t)width);
+    for (int i = 0; i < chunks_x * chunks_y; i++) {
+        m->directory[i].slot = -1;
+        m->directory[i].on_disk = false;
+    }
+    for (int i = 0; i < m->slot_count; i++) {
+        m->slots[i].chunk = -1;
+        m->slots[i].modified = false;
+        m->slots[i].last_use = 0;
+        m->slots[i].pinned = 0;
+    }
+    m->use_clock = 0;
+    m->pin_clock = 1;
+    if (!m->journal) {
+        m->journal = (MapJournalEntry*)malloc(sizeof(MapJournalEntry) * MAP_JOURNAL_CAPACITY);
+        m->journal_capacity = m->journal ? MAP_JOURNAL_CAPACITY : 0;
+    }
+    m->journal_head = 0;
+    m->journal_floor = 0;
+    m->stat_generated = 0; m->stat_page_ins = 0; m->stat_page_outs = 0; m->stat_dropped = 0;
+}
+
+/**
+ * @brief Zwalnia katalog i sloty fragmentów oraz usuwa plik wymiany.
+ * @param m Wskaźnik do mapy.
+ */
+void mapa_zwolnij(WorldMap* m) {
+    free(m->directory);
+    m->directory = NULL;
+    free(m->slots);
+    m->slots = NULL;
+    m->slot_count = 0;
+    free(m->journal);
+    m->journal = NULL;
+    m->journal_capacity = 0;
+    if (m->swap) {
+        al_fclose(m->swap);
+        m->swap = NULL;
+        al_remove_filename(MAP_SWAP_FILE);
+    }
+}
+
+/**
+ * @brief Wyznacza początkowy typ kafelka na podstawie ziarna mapy (albo odczytuje go z terenu poziomu z paczki).
+ * * Obramowanie i co drugi kafelek (wzorzec szachownicy) to niezniszczalne ściany, pola startowe
+ * gracza w rogach są puste, a pozostałe pola z prawdopodobieństwem 1/2 zawierają zniszczalną ścianę.
+ * Wynik zależy tylko od ziarna i współrzędnych, więc fragment można wygenerować w dowolnej kolejności.
+ * @param m Wskaźnik do mapy.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ * @return Typ kafelka (TILE_TYPE).
+ */
+int mapa_generuj_kafelek(const WorldMap* m, int x, int y) {
+    if (m->level_chunks) {
+        int t = ((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1));
+        const unsigned char* packed = m->level_chunks + (size_t)((y >> CHUNK_SHIFT) * m->chunks_x + (x >> CHUNK_SHIFT)) * CHUNK_PACKED_BYTES;
+        return (packed[t >> 2] >> ((t & 3) * 2)) & 3;
+    }
+    if (y == 0 || y == m->height - 1 || x == 0 || x == m->width - 1) {
+        return SOLID_WALL;
+    }
+    if (x % 2 == 0 && y % 2 == 0) {
+        return SOLID_WALL;
+    }
+    if ((x == 1 && y == 1) || (x == 1 && y == 2) || (x == 2 && y == 1) || (x == m->width - 2 && y == 1)) {
+        return EMPTY;
+    }
+
+    uint32_t h = m->seed ^ ((uint32_t)x * 0x9E3779B1u) ^ ((uint32_t)y * 0x85EBCA77u);
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return (h & 1u) ? DESTRUCTIBLE_WALL : EMPTY;
+}
+
+/**
+ * @brief Pakuje kafelki fragmentu do 2 bitów na kafelek (format pliku wymiany i paczki poziomów).
+ * @param tiles CHUNK_TILES kafelków fragmentu.
+ * @param packed Bufor na CHUNK_PACKED_BYTES bajtów.
+ */
+void mapa_spakuj_fragment(const unsigned char* tiles, unsigned char* packed) {
+    for (int i = 0; i < CHUNK_PACKED_BYTES; i++) {
+        packed[i] = (unsigned char)(tiles[i * 4] | (tiles[i * 4 + 1] << 2) | (tiles[i * 4 + 2] << 4) | (tiles[i * 4 + 3] << 6));
+    }
+}
+
+/**
+ * @brief Rozpakowuje fragment zapisany przez mapa_spakuj_fragment.
+ * @param tiles Bufor na CHUNK_TILES kafelków.
+ * @param packed CHUNK_PACKED_BYTES bajtów spakowanego fragmentu.
+ */
+void mapa_rozpakuj_fragment(unsigned char* tiles, const unsigned char* packed) {
+    for (int i = 0; i < CHUNK_PACKED_BYTES; i++) {
+        tiles[i * 4] = packed[i] & 3;
+        tiles[i * 4 + 1] = (packed[i] >> 2) & 3;
+        tiles[i * 4 + 2] = (packed[i] >> 4) & 3;
+        tiles[i * 4 + 3] = (packed[i] >> 6) & 3;
+    }
+}
+
+/**
+ * @brief Zwalnia slot pamięci, zapisując zmodyfikowany fragment do pliku wymiany.
+ * * Fragment jest pakowany do 2 bitów na kafelek i zapisywany pod stałym przesunięciem
+ * wynikającym z jego indeksu. Niezmieniony fragment jest porzucany - zostanie wygenerowany ponownie.
+ * @param m Wskaźnik do mapy.
+ * @param slot Indeks slotu do zwolnienia.
+ */
+void mapa_wyrzuc_fragment(WorldMap* m, int slot) {
+    MapChunk* c = &m->slots[slot];
+    if (c->chunk < 0) return;
+
+    if (c->modified) {
+        unsigned char packed[CHUNK_PACKED_BYTES];
+        mapa_spakuj_fragment(c->tiles, packed);
+        if (!al_fseek(m->swap, (int64_t)c->chunk * CHUNK_PACKED_BYTES, ALLEGRO_SEEK_SET) ||
+            al_fwrite(m->swap, packed, CHUNK_PACKED_BYTES) != CHUNK_PACKED_BYTES) {
+            fprintf(stderr, "Failed to write map chunk %d to the swap file!\n", c->chunk);
+        }
+        m->directory[c->chunk].on_disk = true;
+        m->stat_page_outs++;
+    }
+    else {
+        m->stat_dropped++;
+    }
+    m->directory[c->chunk].slot = -1;
+    c->chunk = -1;
+    c->modified = false;
+}
+
+/**
+ * @brief Ładuje fragment do pamięci: z pliku wymiany, jeśli był zmieniony, albo od nowa z terenu poziomu lub z generatora.
+ * * Jeśli brak wolnego slotu, wyrzuca najdawniej używany fragment spoza gorącego obszaru
+ * (a gdy cały budżet jest gorący - najdawniej używany w ogóle).
+ * @param m Wskaźnik do mapy.
+ * @param chunk Indeks fragmentu w katalogu.
+ * @return Indeks slotu z załadowanym fragmentem.
+ */
+int mapa_wczytaj_fragment(WorldMap* m, int chunk) {
+    int slot = -1;
+    int coldest = -1;
+    for (int i = 0; i < m->slot_count; i++) {
+        if (m->slots[i].chunk < 0) { slot = i; break; }
+        if (m->slots[i].pinned == m->pin_clock) continue;
+        if (coldest < 0 || m->slots[i].last_use < m->slots[coldest].last_use) coldest = i;
+    }
+    if (slot < 0) {
+        if (coldest < 0) {
+            coldest = 0;
+            for (int i = 1; i < m->slot_count; i++) {
+                if (m->slots[i].last_use < m->slots[coldest].last_use) coldest = i;
+            }
+        }
+        mapa_wyrzuc_fragment(m, coldest);
+        slot = coldest;
+    }
+
+    MapChunk* c = &m->slots[slot];
+    int cx = chunk % m->chunks_x;
+    int cy = chunk / m->chunks_x;
+
+    if (m->directory[chunk].on_disk) {
+        unsigned char packed[CHUNK_PACKED_BYTES];
+        if (!al_fseek(m->swap, (int64_t)chunk * CHUNK_PACKED_BYTES, ALLEGRO_SEEK_SET) ||
+            al_fread(m->swap, packed, CHUNK_PACKED_BYTES) != CHUNK_PACKED_BYTES) {
+            fprintf(stderr, "Failed to read map chunk %d from the swap file!\n", chunk);
+            memset(packed, 0, sizeof(packed));
+        }
+        mapa_rozpakuj_fragment(c->tiles, packed);
+        m->stat_page_ins++;
+    }
+    else if (m->level_chunks) {
+        mapa_rozpakuj_fragment(c->tiles, m->level_chunks + (size_t)chunk * CHUNK_PACKED_BYTES);
+        m->stat_generated++;
+    }
+    else {
+        for (int ty = 0; ty < CHUNK_SIZE; ty++) {
+            int y = (cy << CHUNK_SHIFT) + ty;
+            for (int tx = 0; tx < CHUNK_SIZE; tx++) {
+                int x = (cx << CHUNK_SHIFT) + tx;
+                c->tiles[(ty << CHUNK_SHIFT) + tx] = (x < m->width && y < m->height) ? (unsigned char)mapa_generuj_kafelek(m, x, y) : SOLID_WALL;
+            }
+        }
+        m->stat_generated++;
+    }
+    mapa_indeksuj_fragment(c);
+
+    c->chunk = chunk;
+    c->modified = false;
+    c->pinned = 0;
+    m->directory[chunk].slot = (short)slot;
+    return slot;
+}
+
+/**
+ * @brief Zwraca fragment mapy o podanych współrzędnych, w razie potrzeby ładując go do pamięci.
+ * @param m Wskaźnik do mapy.
+ * @param cx Współrzędna X fragmentu.
+ * @param cy Współrzędna Y fragmentu.
+ * @return Wskaźnik do załadowanego fragmentu (ważny do następnego ładowania innego fragmentu).
+ */
+MapChunk* mapa_fragment(WorldMap* m, int cx, int cy) {
+    int chunk = cy * m->chunks_x + cx;
+    int slot = m->directory[chunk].slot;
+    if (slot < 0) slot = mapa_wczytaj_fragment(m, chunk);
+    m->slots[slot].last_use = ++m->use_clock;
+    return &m->slots[slot];
+}
+
+/**
+ * @brief Zwraca typ kafelka mapy.
+ * @param m Wskaźnik do mapy.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ * @return Typ kafelka (TILE_TYPE); poza mapą SOLID_WALL.
+ */
+int mapa_kafelek(WorldMap* m, int x, int y) {
+    if (x < 0 || y < 0 || x >= m->width || y >= m->height) return SOLID_WALL;
+    MapChunk* c = mapa_fragment(m, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    return c->tiles[((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1))];
+}
+
+/**
+ * @brief Przelicza indeks przeszkód w lewo i w prawo dla jednego wiersza fragmentu.
+ * @param c Wskaźnik do fragmentu.
+ * @param ty Numer wiersza we fragmencie.
+ */
+void mapa_indeksuj_wiersz(MapChunk* c, int ty) {
+    const unsigned char* row = &c->tiles[ty << CHUNK_SHIFT];
+    unsigned char* left = &c->stop[BLAST_LEFT][ty << CHUNK_SHIFT];
+    unsigned char* right = &c->stop[BLAST_RIGHT][ty << CHUNK_SHIFT];
+    left[0] = 1;
+    for (int tx = 1; tx < CHUNK_SIZE; tx++) {
+        left[tx] = (row[tx - 1] != EMPTY) ? 1 : (unsigned char)(left[tx - 1] + 1);
+    }
+    right[CHUNK_SIZE - 1] = 1;
+    for (int tx = CHUNK_SIZE - 2; tx >= 0; tx--) {
+        right[tx] = (row[tx + 1] != EMPTY) ? 1 : (unsigned char)(right[tx + 1] + 1);
+    }
+}
+
+/**
+ * @brief Przelicza indeks przeszkód w górę i w dół dla jednej kolumny fragmentu.
+ * @param c Wskaźnik do fragmentu.
+ * @param tx Numer kolumny we fragmencie.
+ */
+void mapa_indeksuj_kolumne(MapChunk* c, int tx) {
+    c->stop[BLAST_UP][tx] = 1;
+    for (int ty = 1; ty < CHUNK_SIZE; ty++) {
+        int i = (ty << CHUNK_SHIFT) + tx;
+        c->stop[BLAST_UP][i] = (c->tiles[i - CHUNK_SIZE] != EMPTY) ? 1 : (unsigned char)(c->stop[BLAST_UP][i - CHUNK_SIZE] + 1);
+    }
+    c->stop[BLAST_DOWN][((CHUNK_SIZE - 1) << CHUNK_SHIFT) + tx] = 1;
+    for (int ty = CHUNK_SIZE - 2; ty >= 0; ty--) {
+        int i = (ty << CHUNK_SHIFT) + tx;
+        c->stop[BLAST_DOWN][i] = (c->tiles[i + CHUNK_SIZE] != EMPTY) ? 1 : (unsigned char)(c->stop[BLAST_DOWN][i + CHUNK_SIZE] + 1);
+    }
+}
+
+/**
+ * @brief Buduje indeks przeszkód całego fragmentu (po wygenerowaniu lub wczytaniu z pliku wymiany).
+ * @param c Wskaźnik do fragmentu.
+ */
+void mapa_indeksuj_fragment(MapChunk* c) {
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        mapa_indeksuj_wiersz(c, i);
+        mapa_indeksuj_kolumne(c, i);
+    }
+}
+
+/**
+ * @brief Zwraca odległość od kafelka do najbliższej ściany (zniszczalnej lub nie) w danym kierunku.
+ * * Korzysta z indeksu przeszkód, więc koszt zależy od liczby przekroczonych fragmentów
+ * (jedno odczytanie na fragment), a nie od odległości. W razie potrzeby ładuje fragmenty.
+ * @param m Wskaźnik do mapy.
+ * @param x Współrzędna X kafelka początkowego (na mapie).
+ * @param y Współrzędna Y kafelka początkowego (na mapie).
+ * @param dir Kierunek (BLAST_DIRECTION).
+ * @param limit Największa interesująca odległość.
+ * @return Odległość w kafelkach; krawędź mapy liczy się jak ściana. Wynik większy niż `limit` oznacza,
+ * że na odcinku `limit` kafelków nie ma ściany.
+ */
+int mapa_odleglosc_sciany(WorldMap* m, int x, int y, int dir, int limit) {
+    int dist = 0;
+    for (;;) {
+        int cx = x >> CHUNK_SHIFT;
+        int cy = y >> CHUNK_SHIFT;
+        MapChunk* c = mapa_fragment(m, cx, cy);
+        int local = ((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1));
+        if (dist > 0 && c->tiles[local] != EMPTY) return dist;
+
+        int step = c->stop[dir][local];
+        dist += step;
+        x += blast_dx[dir] * step;
+        y += blast_dy[dir] * step;
+        if (dist > limit || x < 0 || y < 0 || x >= m->width || y >= m->height) return dist;
+        if ((x >> CHUNK_SHIFT) == cx && (y >> CHUNK_SHIFT) == cy) return dist;
+    }
+}
+
+/**
+ * @brief Jak mapa_odleglosc_sciany, ale bez ładowania fragmentów i bez znacznika dostępu.
+ * * Nie zmienia mapy, więc może być wywoływana z wielu wątków naraz, dopóki nikt mapy nie zmienia.
+ * Na fragmencie spoza pamięci zatrzymuje się jak na ścianie.
+ * @param m Wskaźnik do mapy.
+ * @param x Współrzędna X kafelka początkowego (na mapie).
+ * @param y Współrzędna Y kafelka początkowego (na mapie).
+ * @param dir Kierunek (BLAST_DIRECTION).
+ * @param limit Największa interesująca odległość.
+ * @return Odległość `d` taka, że kafelki 1..d-1 są puste (wynik większy niż `limit` - brak przeszkody w zasięgu).
+ */
+int mapa_odleglosc_sciany_odczyt(const WorldMap* m, int x, int y, int dir, int limit) {
+    int dist = 0;
+    for (;;) {
+        int cx = x >> CHUNK_SHIFT;
+        int cy = y >> CHUNK_SHIFT;
+        int slot = m->directory[cy * m->chunks_x + cx].slot;
+        if (slot < 0) return dist > 0 ? dist : 1;
+        const MapChunk* c = &m->slots[slot];
+        int local = ((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1));
+        if (dist > 0 && c->tiles[local] != EMPTY) return dist;
+
+        int step = c->stop[dir][local];
+        dist += step;
+        x += blast_dx[dir] * step;
+        y += blast_dy[dir] * step;
+        if (dist > limit || x < 0 || y < 0 || x >= m->width || y >= m->height) return dist;
+        if ((x >> CHUNK_SHIFT) == cx && (y >> CHUNK_SHIFT) == cy) return dist;
+    }
+}
+
+/**
+ * @brief Zapisuje typ kafelka bez wpisu do dziennika (używane przy cofaniu zmian) i poprawia indeks przeszkód
+ * oraz skrót Zobrista mapy.
+ * @param m Wskaźnik do mapy.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ * @param type Nowy typ kafelka (TILE_TYPE).
+ */
+void mapa_zapisz_kafelek(WorldMap* m, int x, int y, int type) {
+    MapChunk* c = mapa_fragment(m, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    unsigned char* tile = &c->tiles[((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1))];
+    m->hash ^= zobrist_kafelek(x, y, *tile) ^ zobrist_kafelek(x, y, type);
+    if (m->walls >= 0) m->walls += (type == DESTRUCTIBLE_WALL) - (*tile == DESTRUCTIBLE_WALL);
+    *tile = (unsigned char)type;
+    c->modified = true;
+    mapa_indeksuj_wiersz(c, y & (CHUNK_SIZE - 1));
+    mapa_indeksuj_kolumne(c, x & (CHUNK_SIZE - 1));
+    teren_oznacz_kafelek(x, y);
+}
+
+/**
+ * @brief Zmienia typ pojedynczego kafelka mapy.
+ * * Wszystkie zmiany mapy w trakcie gry przechodzą przez tę funkcję, aby struktury
+ * pochodne (np. bufor terenu na GPU) mogły być aktualizowane przyrostowo. Poprzedni typ
+ * kafelka trafia do dziennika mapy, z którego rollback cofa zmiany. Gdy dziennik jest pełny
+ * zmian nowszych niż `journal_floor`, jego pojemność jest podwajana; jeśli zabraknie pamięci,
+ * najstarsza zmiana jest nadpisywana, a mapa_cofnij_do odmówi cofnięcia sprzed niej.
+ * @param m Wskaźnik do mapy.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ * @param type Nowy typ kafelka (TILE_TYPE).
+ */
+void ustaw_kafelek(WorldMap* m, int x, int y, int type) {
+    if (x < 0 || y < 0 || x >= m->width || y >= m->height) return;
+    int old_type = mapa_kafelek(m, x, y);
+    if (old_type != type) {
+        if (m->journal_head - m->journal_floor >= m->journal_capacity) {
+            uint32_t capacity = m->journal_capacity ? m->journal_capacity * 2 : MAP_JOURNAL_CAPACITY;
+            MapJournalEntry* journal = (MapJournalEntry*)malloc(sizeof(MapJournalEntry) * capacity);
+            if (journal) {
+                for (uint32_t pos = m->journal_floor; pos != m->journal_head; pos++) {
+                    journal[pos & (capacity - 1)] = m->journal[pos & (m->journal_capacity - 1)];
+                }
+                free(m->journal);
+                m->journal = journal;
+                m->journal_capacity = capacity;
+            }
+            else if (m->journal_capacity > 0) {
+                m->journal_floor++;
+            }
+        }
+        if (m->journal_capacity == 0) {
+            // Bez dziennika tej zmiany nie da się cofnąć.
+            m->journal_floor = ++m->journal_head;
+            mapa_zapisz_kafelek(m, x, y, type);
+            return;
+        }
+        MapJournalEntry* e = &m->journal[m->journal_head & (m->journal_capacity - 1)];
+        e->x = x;
+        e->y = y;
+        e->old_type = (unsigned char)old_type;
+        m->journal_head++;
+        mapa_zapisz_kafelek(m, x, y, type);
+    }
+}
+
+/**
+ * @brief Cofa zmiany kafelków zapisane w dzienniku po podanej pozycji.
+ * * Cofnięcie jest wykonywane w całości albo wcale: jeśli część zmian wypadła już z dziennika
+ * (pozycja starsza niż `journal_floor`), mapa pozostaje nietknięta.
+ * @param m Wskaźnik do mapy.
+ * @param journal_pos Pozycja dziennika, do której należy wrócić.
+ * @return false, jeśli mapy nie da się przywrócić do podanej pozycji.
+ */
+bool mapa_cofnij_do(WorldMap* m, uint32_t journal_pos) {
+    if (m->journal_head - journal_pos > m->journal_head - m->journal_floor) return false;
+    while (m->journal_head != journal_pos) {
+        m->journal_head--;
+        const MapJournalEntry* e = &m->journal[m->journal_head & (m->journal_capacity - 1)];
+        mapa_zapisz_kafelek(m, e->x, e->y, e->old_type);
+    }
+    return true;
+}
+
+/**
+ * @brief Zwalnia w dzienniku zmiany starsze niż podana pozycja - mapa nie będzie już do nich cofana.
+ * * Właściciel migawek (rollback, środowiska treningowe, eksport powtórki) wywołuje ją z pozycją
+ * najstarszej migawki, którą może jeszcze przywrócić, więc dziennik trzyma tylko potrzebne zmiany.
+ * @param m Wskaźnik do mapy.
+ * @param journal_pos Pozycja najstarszej migawki w użyciu.
+ */
+void mapa_przytnij_dziennik(WorldMap* m, uint32_t journal_pos) {
+    if (journal_pos - m->journal_floor <= m->journal_head - m->journal_floor) {
+        m->journal_floor = journal_pos;
+    }
+}
+
+/**
+ * @brief Utrzymuje w pamięci fragmenty wokół gracza i aktywnych bomb.
+ * * Wywoływana raz na klatkę symulacji. Fragmenty w promieniu MAP_HOT_RADIUS są ładowane
+ * z wyprzedzeniem i oznaczane jako gorące, więc nie zostaną wyrzucone w tej klatce. Koszt
+ * zależy od liczby aktywnych obiektów, a nie od rozmiaru mapy.
+ * @param m Wskaźnik do mapy.
+ * @param p Wskaźnik do struktury gracza.
+ * @param bombs_arr Tablica bomb.
+ */
+void mapa_utrzymuj_aktywne(WorldMap* m, Player* p, Bomb bombs_arr[]) {
+    m->pin_clock++;
+    for (int i = -1; i < bomb_pool.used; i++) {
+        int x, y;
+        if (i < 0) { x = p->x; y = p->y; }
+        else if (bombs_arr[i].active) { x = bombs_arr[i].x; y = bombs_arr[i].y; }
+        else continue;
+
+        int cx0 = (x >> CHUNK_SHIFT) - MAP_HOT_RADIUS, cx1 = (x >> CHUNK_SHIFT) + MAP_HOT_RADIUS;
+        int cy0 = (y >> CHUNK_SHIFT) - MAP_HOT_RADIUS, cy1 = (y >> CHUNK_SHIFT) + MAP_HOT_RADIUS;
+        if (cx0 < 0) cx0 = 0;
+        if (cy0 < 0) cy0 = 0;
+        if (cx1 >= m->chunks_x) cx1 = m->chunks_x - 1;
+        if (cy1 >= m->chunks_y) cy1 = m->chunks_y - 1;
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                mapa_fragment(m, cx, cy)->pinned = m->pin_clock;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Wypisuje statystyki stronicowania mapy i je zeruje.
+ * * Raport jest pomijany, jeśli od ostatniego raportu żaden fragment nie był ładowany ani wyrzucany.
+ * @param m Wskaźnik do mapy.
+ */
+void mapa_raport(WorldMap* m) {
+    if (m->stat_generated > 0 || m->stat_page_ins > 0 || m->stat_page_outs > 0 || m->stat_dropped > 0) {
+        int resident = 0;
+        for (int i = 0; i < m->slot_count; i++) {
+            if (m->slots[i].chunk >= 0) resident++;
+        }
+        printf("Map %dx%d: %d/%d chunks resident (of %d), generated %d, paged in %d, paged out %d, dropped %d\n",
+            m->width, m->height, resident, m->slot_count, m->chunks_x * m->chunks_y,
+            m->stat_generated, m->stat_page_ins, m->stat_page_outs, m->stat_dropped);
+    }
+    m->stat_generated = 0; m->stat_page_ins = 0; m->stat_page_outs = 0; m->stat_dropped = 0;
+}
+
+/**
+ * @brief Liczy pudełka na świeżo utworzonej mapie (z generatora lub terenu poziomu, bez ładowania fragmentów).
+ * * Dalej licznik `WorldMap::walls` jest poprawiany przy każdej zmianie kafelka, także przy cofaniu
+ * dziennika, więc to liczenie odbywa się raz na grę. Mapy większe niż MAP_MAX_RESIDENT_CHUNKS
+ * fragmentów nie są liczone (-1).
+ * @param m Wskaźnik do mapy.
+ * @return Liczba zniszczalnych ścian albo -1.
+ */
+int mapa_policz_sciany(const WorldMap* m) {
+    if (m->chunks_x * m->chunks_y > MAP_MAX_RESIDENT_CHUNKS) return -1;
+    int walls = 0;
+    for (int y = 1; y < m->height - 1; y++) {
+        for (int x = 1; x < m->width - 1; x++) {
+            if (mapa_generuj_kafelek(m, x, y) == DESTRUCTIBLE_WALL) walls++;
+        }
+    }
+    return walls;
+}
+
+/**
+ * @brief Zwraca typ kafelka bez ładowania niezmienionego fragmentu.
+ * * Fragment w pamięci jest czytany wprost, niezmieniony fragment spoza pamięci - z generatora
+ * (mapa_generuj_kafelek), a tylko fragment z pliku wymiany jest wczytywany. Dzięki temu losowanie
+ * pól na starcie gry nie generuje fragmentów całej mapy.
+ * @param m Wskaźnik do mapy.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ * @return Typ kafelka (TILE_TYPE); poza mapą SOLID_WALL.
+ */
+int mapa_kafelek_bez_ladowania(WorldMap* m, int x, int y) {
+    if (x < 0 || y < 0 || x >= m->width || y >= m->height) return SOLID_WALL;
+    const MapChunkEntry* e = &m->directory[(y >> CHUNK_SHIFT) * m->chunks_x + (x >> CHUNK_SHIFT)];
+    if (e->slot >= 0) return m->slots[e->slot].tiles[((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1))];
+    if (e->on_disk) return mapa_kafelek(m, x, y);
+    return mapa_generuj_kafelek(m, x, y);
+}
+
+/**
+ * @brief Losuje pole danego typu, jednakowo spośród wszystkich takich pól spoza zbioru zajętych.
+ * * Losuje pola wnętrza mapy aż do trafienia. Pola każdego typu zajmują stałą część mapy
+ * (mapa_generuj_kafelek), więc oczekiwana liczba prób nie zależy od rozmiaru mapy.
+ * @param m Wskaźnik do mapy.
+ * @param type Szukany typ kafelka (TILE_TYPE).
+ * @param taken Pola wykluczone (może być NULL).
+ * @param avoid_x Współrzędna X pola, od którego wynik ma być oddalony.
+ * @param avoid_y Współrzędna Y pola, od którego wynik ma być oddalony.
+ * @param min_dist Najmniejsza odległość od (avoid_x, avoid_y) w którejkolwiek osi (0 - bez ograniczenia).
+ * @param out_x Wylosowana współrzędna X.
+ * @param out_y Wylosowana współrzędna Y.
+ * @return false, jeśli SPAWN_SAMPLE_ATTEMPTS prób nie trafiło w pasujące pole.
+ */
+bool mapa_losuj_pole(WorldMap* m, int type, const CellSet* taken, int avoid_x, int avoid_y, int min_dist, int* out_x, int* out_y) {
+    if (m->width < 3 || m->height < 3) return false;
+    for (int attempt = 0; attempt < SPAWN_SAMPLE_ATTEMPTS; attempt++) {
+        int x = 1 + losuj() % (m->width - 2);
+        int y = 1 + losuj() % (m->height - 2);
+        if (abs(x - avoid_x) < min_dist && abs(y - avoid_y) < min_dist) continue;
+        if (mapa_kafelek_bez_ladowania(m, x, y) != type) continue;
+        if (taken && zajete_zawiera(taken, x, y)) continue;
+        *out_x = x;
+        *out_y = y;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Opróżnia zbiór zajętych pól i przygotowuje go na `expected` pól.
+ * * Koszt jest proporcjonalny do pojemności zbioru, czyli do liczby obiektów, a nie do rozmiaru mapy.
+ * @param set Wskaźnik do zbioru.
+ * @param expected Spodziewana liczba pól.
+ */
+void zajete_wyczysc(CellSet* set, int expected) {
+    int capacity = 16;
+    while (capacity < expected * 2) capacity *= 2;
+    if (capacity > set->capacity) {
+        uint64_t* keys = (uint64_t*)realloc(set->keys, sizeof(uint64_t) * capacity);
+        if (keys) {
+            set->keys = keys;
+            set->capacity = capacity;
+        }
+    }
+    if (set->keys) memset(set->keys, 0, sizeof(uint64_t) * set->capacity);
+    set->count = 0;
+}
+
+/**
+ * @brief Zwraca przegródkę pola w zbiorze: tę z jego kluczem albo pierwszą wolną na ścieżce sondowania.
+ * @param set Wskaźnik do zbioru (z niepustą tablicą kluczy).
+ * @param key Klucz pola.
+ * @return Indeks przegródki.
+ */
+static int zajete_przegrodka(const CellSet* set, uint64_t key) {
+    uint64_t h = key * 0x9E3779B97F4A7C15ull;
+    int mask = set->capacity - 1;
+    int i = (int)(h >> 32) & mask;
+    while (set->keys[i] != 0 && set->keys[i] != key) i = (i + 1) & mask;
+    return i;
+}
+
+/**
+ * @brief Sprawdza, czy pole należy do zbioru.
+ * @param set Wskaźnik do zbioru.
+ * @param x Współrzędna X pola.
+ * @param y Współrzędna Y pola.
+ * @return true, jeśli pole jest zajęte.
+ */
+bool zajete_zawiera(const CellSet* set, int x, int y) {
+    if (!set->keys) return false;
+    uint64_t key = ((uint64_t)(uint32_t)(y + 1) << 32) | (uint32_t)x;
+    return set->keys[zajete_przegrodka(set, key)] == key;
+}
+
+/**
+ * @brief Dodaje pole do zbioru; zbiór rośnie dwukrotnie, gdy jest zapełniony w połowie.
+ * @param set Wskaźnik do zbioru.
+ * @param x Współrzędna X pola.
+ * @param y Współrzędna Y pola.
+ */
+void zajete_dodaj(CellSet* set, int x, int y) {
+    if (!set->keys || (set->count + 1) * 2 > set->capacity) {
+        CellSet grown = { NULL, 0, 0 };
+        zajete_wyczysc(&grown, set->count + 1);
+        if (!grown.keys) return;
+        for (int i = 0; i < set->capacity; i++) {
+            if (set->keys[i] != 0) grown.keys[zajete_przegrodka(&grown, set->keys[i])] = set->keys[i];
+        }
+        grown.count = set->count;
+        free(set->keys);
+        *set = grown;
+    }
+    uint64_t key = ((uint64_t)(uint32_t)(y + 1) << 32) | (uint32_t)x;
+    int i = zajete_przegrodka(set, key);
+    if (set->keys[i] != key) {
+        set->keys[i] = key;
+        set->count++;
+    }
+}
+
+/**
+ * @brief Zwalnia pamięć zbioru zajętych pól.
+ * @param set Wskaźnik do zbioru.
+ */
+void zajete_zwolnij(CellSet* set) {
+    free(set->keys);
+    set->keys = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
+
+/**
+ * @brief Ukrywa wyjście pod losowo wybraną zniszczalną ścianą na mapie.
+ * * Funkcja losuje pudełko przez mapa_losuj_pole (każde pudełko ma tę samą szansę wyboru),
+ * dzięki czemu na dużej mapie nie trzeba ładować ani generować fragmentów.
+ * Dopiero gdy losowanie zawiedzie (mapa prawie bez pudełek), przeszukuje całą mapę.
+ * Ustawia globalne zmienne `exit_x` oraz `exit_y` na współrzędne wybranego kafelka.
+ * Flaga `exit_revealed` jest ustawiana na `false`.
+ */
+void hide_exit_randomly() {
+    int num_possible_exits = 0;
+    exit_x = -1;
+    exit_y = -1;
+
+    if (!mapa_losuj_pole(game_map, DESTRUCTIBLE_WALL, NULL, -1, -1, 0, &exit_x, &exit_y)) {
+        for (int y_coord = 0; y_coord < game_map->height; y_coord++) {
+            for (int x_coord = 0; x_coord < game_map->width; x_coord++) {
+                if (mapa_kafelek(game_map, x_coord, y_coord) == DESTRUCTIBLE_WALL) {
+                    num_possible_exits++;
+                    if (losuj() % num_possible_exits == 0) {
+                        exit_x = x_coord;
+                        exit_y = y_coord;
+                    }
+                }
+            }
+        }
+    }
+
+    if (exit_x >= 0) {
+        LOG_SYM("Exit hidden under a box at (%d, %d)\n", exit_x, exit_y);
+    }
+    else {
+        printf("WARNING: No destructible walls found to hide the exit! Exit will not be placed.\n");
+    }
+    exit_revealed = false;
+}
+
+/**
+ * @brief Inicjalizuje mapę gry o rozmiarze `world_width` x `world_height`.
+ * * Tworzy obramowanie z niezniszczalnych ścian, rozmieszcza niezniszczalne bloki
+ * wewnątrz mapy (wzorzec szachownicy) oraz losowo umieszcza zniszczalne ściany
+ * i puste pola. Gwarantuje również puste miejsca dla startu gracza.
+ * Kafelki są wyznaczane przez mapa_generuj_kafelek dopiero przy pierwszym dostępie do fragmentu,
+ * więc koszt nie zależy od rozmiaru mapy. Poziom z paczki (`level_terrain`) zamiast generatora
+ * podaje gotowy teren, rozpakowywany ze zmapowanego pliku tak samo leniwie.
+ */
+void initialize_map() {
+    teren_oznacz_wszystko();
+    if (level_terrain) {
+        mapa_utworz(game_map, level_active.width, level_active.height, level_active.seed);
+        game_map->level_chunks = level_terrain;
+    }
+    else {
+        mapa_utworz(game_map, world_width, world_height, (uint32_t)losuj());
+    }
+    game_map->walls = mapa_policz_sciany(game_map);
+}
+
+/**
+ * @brief Inicjalizuje wrogów, rozmieszczając ich na mapie.
+ * * Tworzy w puli `game_mode->enemy_count` wrogów ze skryptami zachowania przydzielanymi po kolei (ENEMY_SCRIPT)
+ * i dla każdego losuje (mapa_losuj_pole) pozycję na pustym polu,
+ * które nie jest miejscem startowym gracza, ukrytym wyjściem ani pozycją innego, już umieszczonego wroga
+ * (zbiór `spawn_taken`) i leży co najmniej ENEMY_SPAWN_MIN_DISTANCE od gracza. Koszt zależy od liczby wrogów,
+ * a nie od rozmiaru mapy. W poziomie z paczki liczba, pozycje i skrypty wrogów pochodzą z `level_active`.
+ * @param map Wskaźnik do mapy gry.
+ * @param p_player Wskaźnik do struktury gracza.
+ */
+void initialize_enemies(WorldMap* map, Player* p_player) {
+    int enemy_count = level_terrain ? level_active.enemy_count : game_mode->enemy_count;
+    zajete_wyczysc(&spawn_taken, enemy_count + 2);
+    zajete_dodaj(&spawn_taken, p_player->x, p_player->y);
+    if (exit_x >= 0) zajete_dodaj(&spawn_taken, exit_x, exit_y);
+
+    for (int n = 0; n < enemy_count; n++) {
+        int i = pula_przydziel(&enemy_pool);
+        if (i < 0) break;
+        pule_odswiez_wskazniki();
+        enemies[i].is_alive = true;
+        enemies[i].script = level_terrain ? (ENEMY_SCRIPT)level_active.enemies[n].script : (ENEMY_SCRIPT)(n % SCRIPT_COUNT);
+        enemies[i].script_pc = 0;
+        enemies[i].script_counter = 0;
+        enemies[i].wait_x = -1;
+        enemies[i].wait_y = -1;
+        enemies[i].wait_deadline = 0;
+        const unsigned char* rgb = enemy_script_rgb[enemies[i].script];
+        enemies[i].color = al_map_rgb(rgb[0], rgb[1], rgb[2]);
+        enemies[i].next_move_tick = timers.now + 1 + losuj() % active_rules->enemy_move_delay;
+        enemies[i].direction = (ENEMY_DIRECTION)(losuj() % DIR_COUNT);
+
+        int ex = level_terrain ? level_active.enemies[n].x : -1;
+        int ey = level_terrain ? level_active.enemies[n].y : -1;
+        if (level_terrain || mapa_losuj_pole(map, EMPTY, &spawn_taken, p_player->x, p_player->y, ENEMY_SPAWN_MIN_DISTANCE, &ex, &ey)) {
+            enemies[i].x = ex;
+            enemies[i].y = ey;
+            zajete_dodaj(&spawn_taken, ex, ey);
+            LOG_SYM("Enemy %d spawned at (%d, %d)\n", i, ex, ey);
+            zegar_zaplanuj(&timers, enemies[i].next_move_tick, TIMER_ENEMY_MOVE, pula_uchwyt(&enemy_pool, i));
+        }
+        else {
+            enemies[i].is_alive = false;
+            pula_zwolnij(&enemy_pool, i);
+            printf("Could not find a spot for enemy %d\n", i);
+        }
+    }
+}
+
+/**
+ * @brief Znajduje i ustawia bezpieczne miejsce startowe dla gracza na mapie.
+ * * Funkcja najpierw próbuje umieścić gracza w jednym z preferowanych rogów mapy,
+ * upewniając się, że sąsiednie pola są puste. Jeśli to się nie uda, losuje
+ * puste pole z dwoma wolnymi sąsiadami (mapa_losuj_pole, bez przeszukiwania mapy).
+ * W ostateczności wybiera dowolne puste pole lub wymusza puste pole na (1,1).
+ * @param p_player Wskaźnik do struktury gracza.
+ * @param map Wskaźnik do mapy gry.
+ */
+void find_and_set_player_spawn(Player* p_player, WorldMap* map) {
+    bool found_spawn = false;
+    int spawn_candidates_x[] = { 1, 1, map->width - 2, map->width - 2 };
+    int spawn_candidates_y[] = { 1, map->height - 2, 1, map->height - 2 };
+
+    for (int i = 0; i < 4 && !found_spawn; ++i) {
+        int sx = spawn_candidates_x[i];
+        int sy = spawn_candidates_y[i];
+        if (mapa_kafelek_bez_ladowania(map, sx, sy) == EMPTY) {
+            bool clear_around = true;
+            if (sx + 1 < map->width && mapa_kafelek_bez_ladowania(map, sx + 1, sy) != EMPTY) clear_around = false;
+            if (sy + 1 < map->height && mapa_kafelek_bez_ladowania(map, sx, sy + 1) != EMPTY) clear_around = false;
+
+            if (clear_around) {
+                p_player->x = sx; p_player->y = sy; found_spawn = true;
+            }
+        }
+    }
+
+    for (int attempt = 0; attempt < SPAWN_SAMPLE_ATTEMPTS && !found_spawn; attempt++) {
+        int x, y;
+        if (!mapa_losuj_pole(map, EMPTY, NULL, -1, -1, 0, &x, &y)) break;
+        if (mapa_kafelek_bez_ladowania(map, x + 1, y) == EMPTY && mapa_kafelek_bez_ladowania(map, x, y + 1) == EMPTY) {
+            p_player->x = x; p_player->y = y; found_spawn = true;
+        }
+    }
+
+    if (!found_spawn) {
+        printf("Warning: Ideal spawn point not found. Searching for any empty cell...\n");
+        found_spawn = mapa_losuj_pole(map, EMPTY, NULL, -1, -1, 0, &p_player->x, &p_player->y);
+    }
+
+    if (!found_spawn) {
+        p_player->x = 1;
+        p_player->y = 1;
+        ustaw_kafelek(map, 1, 1, EMPTY);
+        if (mapa_kafelek(map, 2, 1) == SOLID_WALL) ustaw_kafelek(map, 2, 1, EMPTY);
+        if (mapa_kafelek(map, 1, 2) == SOLID_WALL) ustaw_kafelek(map, 1, 2, EMPTY);
+        printf("CRITICAL: No empty spawn point found. Defaulting to (1,1) and forcing empty.\n");
+    }
+    ustaw_kafelek(map, p_player->x, p_player->y, EMPTY);
+    LOG_SYM("Player spawned at (%d, %d)\n", p_player->x, p_player->y);
+}
+
+/**
+ * @brief Umożliwia graczowi podłożenie bomby.
+ * * Sprawdza, czy gracz nie przekroczył swojego limitu aktywnych bomb
+ * oraz czy na danym polu nie znajduje się już inna bomba. Jeśli warunki są spełnione,
+ * nowa bomba jest przydzielana z puli na pozycji gracza.
+ * @param r Zestaw reguł gry.
+ * @param p Wskaźnik do struktury gracza.
+ */
+RULES_INLINE void try_plant_bomb(const GameRules* r, Player* p) {
+    if (bomb_pool.count >= p->current_max_bombs) {
+        LOG_SYM("Bomb limit reached (%d)!\n", p->current_max_bombs);
+        return;
+    }
+
+    for (int j = 0; j < bomb_pool.used; j++) {
+        if (bombs[j].active && bombs[j].x == p->x && bombs[j].y == p->y) {
+            LOG_SYM("Another bomb is already here!\n");
+            return;
+        }
+    }
+
+    int i = pula_przydziel(&bomb_pool);
+    if (i < 0) return;
+    pule_odswiez_wskazniki();
+    bombs[i].active = true;
+    bombs[i].x = p->x;
+    bombs[i].y = p->y;
+    bombs[i].fuse_tick = timers.now + r->bomb_fuse_ticks;
+    bombs[i].radius = p->current_bomb_radius;
+    bombs[i].exploding = false;
+    bombs[i].explosion_end_tick = 0;
+    bombs[i].blast_centre = false;
+    memset(bombs[i].blast_len, 0, sizeof(bombs[i].blast_len));
+    zegar_zaplanuj(&timers, bombs[i].fuse_tick, TIMER_BOMB, pula_uchwyt(&bomb_pool, i));
+    dzwiek_zglos(SFX_PLANT);
+    if (!rollback_resymulacja) METRYKA_DODAJ(0, bombs_planted, 1);
+    LOG_SYM("Bomb (radius %d) planted at (%d, %d)!\n", bombs[i].radius, bombs[i].x, bombs[i].y);
+}
+
+/**
+ * @brief Rozpoznaje przypisanie `KLUCZ=WARTOŚĆ` do pola reguł.
+ * @param assignment Tekst `KLUCZ=WARTOŚĆ`, np. `fuse=90`.
+ * @param value Odczytana wartość.
+ * @return Opis pola albo NULL, jeśli klucz jest nieznany lub wartość wykracza poza dopuszczalny zakres.
+ */
+const RuleField* reguly_pole(const char* assignment, int* value) {
+    const char* eq = strchr(assignment, '=');
+    if (!eq) return NULL;
+    for (int i = 0; i < RULE_FIELD_COUNT; i++) {
+        const RuleField* f = &rule_fields[i];
+        if (strlen(f->key) != (size_t)(eq - assignment) || strncmp(assignment, f->key, eq - assignment) != 0) continue;
+        *value = atoi(eq + 1);
+        return (*value < f->min || *value > f->max) ? NULL : f;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Ustawia jedno pole reguł eksperymentalnych z argumentu `KLUCZ=WARTOŚĆ` (--rule=...).
+ * * Przy pierwszym użyciu reguły eksperymentalne startują od kopii zestawu wybranego przez --rules
+ * (lub klasycznego) i od tej chwili gra korzysta z symulacji czytającej reguły w czasie działania.
+ * @param assignment Tekst `KLUCZ=WARTOŚĆ`, np. `fuse=90`.
+ * @return true, jeśli klucz jest znany, a wartość mieści się w dopuszczalnym zakresie.
+ */
+bool reguly_ustaw_pole(const char* assignment) {
+    int value;
+    const RuleField* f = reguly_pole(assignment, &value);
+    if (!f) return false;
+    if (rules_override != &rules_custom) {
+        rules_custom = rules_override ? *rules_override : rules_classic;
+        rules_custom.id = RULESET_CUSTOM;
+        rules_custom.name = "custom";
+        rules_override = &rules_custom;
+    }
+    *(int*)((char*)&rules_custom + f->offset) = value;
+    return true;
+}
+
+/**
+ * @brief Przygotowuje nową grę, resetując stan wszystkich elementów gry.
+ * * Wybiera zestaw reguł (z wiersza poleceń, z poziomu albo domyślny dla trybu gry), czyści pule obiektów
+ * (bomby i power-upy znikają razem z nimi), wywołuje funkcje
+ * inicjalizujące mapę, wyjście, gracza i wrogów oraz uruchamia muzykę w tle.
+ * Przy otwartej paczce poziomów gra w oknie przełącza się na poziom `level_pack.current`
+ * jednym skopiowaniem rekordu (środowiska treningowe mają własny rozmiar mapy i zawsze ją generują).
+ * Przy --record=PLIK zaczyna nagrywanie powtórki nowej gry.
+ */
+void setup_new_game() {
+    uint32_t start_rng = rng_state;
+    level_terrain = NULL;
+    if (level_pack.data && game_map == &main_map) {
+        const LevelRecord* level = paczka_poziom(level_pack.current);
+        level_active = *level;
+        level_terrain = (const unsigned char*)(level + 1);
+    }
+    active_rules = rules_override ? rules_override : level_terrain ? poziom_reguly(&level_active) : shipped_rules[game_mode->ruleset];
+    LOG_SYM("Game mode %s, rules %s\n", game_mode->name, active_rules->name);
+    if (level_terrain) {
+        LOG_SYM("Level %d of %d (%dx%d)\n", level_pack.current + 1, level_pack.count, level_active.width, level_active.height);
+    }
+    zegar_resetuj(&timers, 0);
+    pule_przygotuj(game_mode);
+    initialize_map();
+
+    exit_x = -1;
+    exit_y = -1;
+    exit_revealed = false;
+    if (level_terrain && level_active.exit_x >= 0) {
+        exit_x = level_active.exit_x;
+        exit_y = level_active.exit_y;
+    }
+    else {
+        hide_exit_randomly();
+    }
+
+    if (level_terrain) {
+        player.x = level_active.player_x;
+        player.y = level_active.player_y;
+    }
+    else {
+        find_and_set_player_spawn(&player, game_map);
+    }
+
+    player.lives = active_rules->max_lives;
+    player.score = 0;
+    player.is_alive = true;
+    player.invincible = false;
+    player.invincible_until = 0;
+    player.current_max_bombs = 1;
+    player.current_bomb_radius = 1;
+    player.direction = PLAYER_DIR_DOWN;
+
+    initialize_enemies(game_map, &player);
+
+    if (background_music_stream) {
+        al_rewind_audio_stream(background_music_stream);
+        muzyka_odtwarzaj(true);
+        printf("Background music started.\n");
+    }
+
+    current_game_state = PLAYING;
+    particles.count = 0;
+    pending_input = INPUT_NONE;
+    rollback_reset();
+    powtorka_nagrywaj(start_rng);
+    LOG_SYM("New game started!\n");
+}
+
+// --- Funkcje paczek poziomów ---
+
+/**
+ * @brief Mapuje plik paczki poziomów do pamięci (mmap, a w Windows MapViewOfFile) i sprawdza jego zawartość.
+ * * Cała walidacja odbywa się tutaj, raz na paczkę; przełączenie poziomu w setup_new_game
+ * niczego już nie sprawdza ani nie parsuje.
+ * @param path Ścieżka do pliku paczki.
+ * @return true, jeśli paczka jest otwarta i poprawna.
+ */
+bool paczka_otworz(const char* path) {
+    paczka_zamknij();
+
+    const unsigned char* data = NULL;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER file_size;
+        if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping) {
+                data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                size = (size_t)file_size.QuadPart;
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data = (const unsigned char*)mapped;
+                size = (size_t)st.st_size;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if (!data) {
+        fprintf(stderr, "Failed to map level pack %s\n", path);
+        return false;
+    }
+
+    level_pack.data = data;
+    level_pack.size = size;
+    if (!paczka_sprawdz(data, size)) {
+        fprintf(stderr, "Invalid level pack %s\n", path);
+        paczka_zamknij();
+        return false;
+    }
+    level_pack.index = (const LevelPackEntry*)(data + sizeof(LevelPackHeader));
+    level_pack.count = (int)((const LevelPackHeader*)data)->level_count;
+    level_pack.current = 0;
+    printf("Level pack %s: %d levels, %zu bytes mapped\n", path, level_pack.count, size);
+    return true;
+}
+
+/**
+ * @brief Sprawdza nagłówek, indeks i wszystkie rekordy paczki poziomów.
+ * @param data Początek zmapowanego pliku.
+ * @param size Rozmiar pliku.
+ * @return true, jeśli każdy poziom da się uruchomić bez dalszych sprawdzeń.
+ */
+bool paczka_sprawdz(const unsigned char* data, size_t size) {
+    const LevelPackHeader* header = (const LevelPackHeader*)data;
+    if (size < sizeof(LevelPackHeader) || memcmp(header->magic, LEVEL_PACK_MAGIC, 4) != 0) {
+        fprintf(stderr, "  not a level pack\n");
+        return false;
+    }
+    if (header->version != LEVEL_PACK_VERSION) {
+        fprintf(stderr, "  unsupported version %u (expected %d)\n", header->version, LEVEL_PACK_VERSION);
+        return false;
+    }
+    if (header->level_count == 0 || header->level_count > (size - sizeof(LevelPackHeader)) / sizeof(LevelPackEntry)) {
+        fprintf(stderr, "  bad level count %u\n", header->level_count);
+        return false;
+    }
+
+    const LevelPackEntry* index = (const LevelPackEntry*)(data + sizeof(LevelPackHeader));
+    for (uint32_t n = 0; n < header->level_count; n++) {
+        const LevelPackEntry* e = &index[n];
+        if (e->offset % 8 != 0 || e->size < sizeof(LevelRecord) || e->offset > size || e->size > size - e->offset) {
+            fprintf(stderr, "  level %u: record out of file bounds\n", n + 1);
+            return false;
+        }
+        const LevelRecord* rec = (const LevelRecord*)(data + e->offset);
+        int chunks = ((rec->width + CHUNK_SIZE - 1) >> CHUNK_SHIFT) * ((rec->height + CHUNK_SIZE - 1) >> CHUNK_SHIFT);
+        bool ok = rec->width >= 5 && rec->width <= LEVEL_MAX_SIZE && rec->height >= 5 && rec->height <= LEVEL_MAX_SIZE &&
+            e->size >= sizeof(LevelRecord) + (size_t)chunks * CHUNK_PACKED_BYTES &&
+            rec->player_x < rec->width && rec->player_y < rec->height &&
+            rec->exit_x < rec->width && rec->exit_y < rec->height && (rec->exit_x >= 0) == (rec->exit_y >= 0) &&
+            rec->enemy_count <= LEVEL_MAX_ENEMIES && rec->ruleset <= RULESET_CUSTOM;
+        for (int k = 0; ok && k < rec->enemy_count; k++) {
+            ok = rec->enemies[k].x < rec->width && rec->enemies[k].y < rec->height && rec->enemies[k].script < SCRIPT_COUNT;
+        }
+        for (int k = 0; ok && rec->ruleset == RULESET_CUSTOM && k < RULE_FIELD_COUNT; k++) {
+            ok = rec->rules[k] >= rule_fields[k].min && rec->rules[k] <= rule_fields[k].max;
+        }
+        if (!ok) {
+            fprintf(stderr, "  level %u: invalid record\n", n + 1);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Zwalnia mapowanie paczki poziomów (bez paczki nic nie robi).
+ */
+void paczka_zamknij() {
+    if (!level_pack.data) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(level_pack.data);
+#else
+    munmap((void*)level_pack.data, level_pack.size);
+#endif
+    level_pack.data = NULL;
+    level_pack.size = 0;
+    level_pack.index = NULL;
+    level_pack.count = 0;
+    level_pack.current = 0;
+    level_terrain = NULL;
+}
+
+/**
+ * @brief Zwraca rekord poziomu w zmapowanej paczce.
+ * @param index Numer poziomu (0 .. level_pack.count - 1).
+ * @return Wskaźnik do rekordu; teren leży bezpośrednio za nim.
+ */
+const LevelRecord* paczka_poziom(int index) {
+    return (const LevelRecord*)(level_pack.data + level_pack.index[index].offset);
+}
+
+/**
+ * @brief Zwraca reguły poziomu: wbudowany zestaw albo `level_rules` wypełnione wartościami z rekordu.
+ * @param level Rekord poziomu.
+ * @return Zestaw reguł dla setup_new_game.
+ */
+const GameRules* poziom_reguly(const LevelRecord* level) {
+    if (level->ruleset < RULESET_CUSTOM) return shipped_rules[level->ruleset];
+    level_rules = rules_classic;
+    level_rules.id = RULESET_CUSTOM;
+    level_rules.name = "level";
+    for (int k = 0; k < RULE_FIELD_COUNT; k++) {
+        *(int*)((char*)&level_rules + rule_fields[k].offset) = level->rules[k];
+    }
+    return &level_rules;
+}
+
+/**
+ * @brief Koduje poziom zapisany tekstem do rekordu paczki i spakowanego terenu.
+ * * Znaki: `#` ściana, `+` pudełko, `.` lub spacja puste pole, `P` gracz, `X` wyjście pod pudełkiem,
+ * `0`-`3` wróg ze skryptem ENEMY_SCRIPT. Krótsze wiersze są dopełniane ścianami, a obramowanie
+ * poziomu zawsze jest ścianą.
+ * @param rows Wiersze poziomu.
+ * @param height Liczba wierszy.
+ * @param ruleset Zestaw reguł poziomu.
+ * @param rules Wartości pól reguł (używane przy RULESET_CUSTOM).
+ * @param rec Rekord do wypełnienia.
+ * @param packed_terrain Bufor na spakowane fragmenty (co najwyżej (LEVEL_MAX_SIZE / CHUNK_SIZE)^2 * CHUNK_PACKED_BYTES bajtów).
+ * @param path Nazwa pliku źródłowego (do komunikatów o błędach).
+ * @param first_line Numer pierwszego wiersza poziomu w pliku.
+ * @return false, jeśli poziom jest niepoprawny (błąd został wypisany).
+ */
+bool paczka_koduj_poziom(char (*rows)[LEVEL_MAX_SIZE + 1], int height, RULESET ruleset, const int32_t* rules, LevelRecord* rec, unsigned char* packed_terrain, const char* path, int first_line) {
+    int width = 0;
+    for (int y = 0; y < height; y++) {
+        int len = (int)strlen(rows[y]);
+        if (len > width) width = len;
+    }
+    if (width < 5 || height < 5) {
+        fprintf(stderr, "%s:%d: level is smaller than 5x5\n", path, first_line);
+        return false;
+    }
+
+    memset(rec, 0, sizeof(*rec));
+    rec->width = (uint16_t)width;
+    rec->height = (uint16_t)height;
+    rec->exit_x = -1;
+    rec->exit_y = -1;
+    rec->ruleset = (uint8_t)ruleset;
+    memcpy(rec->rules, rules, sizeof(rec->rules));
+
+    int players = 0;
+    int chunks_x = (width + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    int chunks_y = (height + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    for (int cy = 0; cy < chunks_y; cy++) {
+        for (int cx = 0; cx < chunks_x; cx++) {
+            unsigned char tiles[CHUNK_TILES];
+            for (int ty = 0; ty < CHUNK_SIZE; ty++) {
+                for (int tx = 0; tx < CHUNK_SIZE; tx++) {
+                    int x = (cx << CHUNK_SHIFT) + tx;
+                    int y = (cy << CHUNK_SHIFT) + ty;
+                    unsigned char* tile = &tiles[(ty << CHUNK_SHIFT) + tx];
+                    *tile = SOLID_WALL;
+                    if (x >= width || y >= height) continue;
+
+                    char ch = (x < (int)strlen(rows[y])) ? rows[y][x] : '#';
+                    bool border = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+                    if (border && ch != '#' && ch != '+' && ch != '.' && ch != ' ') {
+                        fprintf(stderr, "%s:%d: '%c' on the level border\n", path, first_line + y, ch);
+                        return false;
+                    }
+                    if (border || ch == '#') continue;
+
+                    if (ch == '+' || ch == 'X') {
+                        *tile = DESTRUCTIBLE_WALL;
+                        if (ch == 'X') {
+                            if (rec->exit_x >= 0) {
+                                fprintf(stderr, "%s:%d: more than one exit\n", path, first_line + y);
+                                return false;
+                            }
+                            rec->exit_x = (int16_t)x;
+                            rec->exit_y = (int16_t)y;
+                        }
+                    }
+                    else if (ch == '.' || ch == ' ' || ch == 'P' || (ch >= '0' && ch < '0' + SCRIPT_COUNT)) {
+                        *tile = EMPTY;
+                        if (ch == 'P') {
+                            players++;
+                            rec->player_x = (uint16_t)x;
+                            rec->player_y = (uint16_t)y;
+                        }
+                        else if (ch != '.' && ch != ' ') {
+                            if (rec->enemy_count == LEVEL_MAX_ENEMIES) {
+                                fprintf(stderr, "%s:%d: more than %d enemies\n", path, first_line + y, LEVEL_MAX_ENEMIES);
+                                return false;
+                            }
+                            LevelEnemy* e = &rec->enemies[rec->enemy_count++];
+                            e->x = (uint16_t)x;
+                            e->y = (uint16_t)y;
+                            e->script = (uint8_t)(ch - '0');
+                        }
+                    }
+                    else {
+                        fprintf(stderr, "%s:%d: unknown tile '%c'\n", path, first_line + y, ch);
+                        return false;
+                    }
+                }
+            }
+            mapa_spakuj_fragment(tiles, packed_terrain + (size_t)(cy * chunks_x + cx) * CHUNK_PACKED_BYTES);
+        }
+    }
+    if (players != 1) {
+        fprintf(stderr, "%s:%d: level needs exactly one player start 'P' (found %d)\n", path, first_line, players);
+        return false;
+    }
+
+    // Ziarno mapy: skrót FNV-1a rekordu i terenu, więc różne poziomy mają różne skróty Zobrista.
+    uint32_t h = 2166136261u;
+    const unsigned char* bytes = (const unsigned char*)rec;
+    for (size_t i = 0; i < sizeof(*rec); i++) h = (h ^ bytes[i]) * 16777619u;
+    for (size_t i = 0; i < (size_t)chunks_x * chunks_y * CHUNK_PACKED_BYTES; i++) h = (h ^ packed_terrain[i]) * 16777619u;
+    rec->seed = h;
+    return true;
+}
+
+/**
+ * @brief Buduje paczkę poziomów z pliku tekstowego (--pack-build=ŹRÓDŁO,PACZKA).
+ * * Poziomy w pliku źródłowym są oddzielone pustymi wierszami, a wiersze zaczynające się od `;`
+ * to komentarze. Przed mapą poziomu mogą stać wiersze `rules=NAZWA` (zestaw wbudowany)
+ * i `KLUCZ=WARTOŚĆ` (klucze jak w --rule; poziom dostaje wtedy własne reguły).
+ * Znaki mapy opisuje paczka_koduj_poziom.
+ * @param source_path Ścieżka do pliku tekstowego z poziomami.
+ * @param pack_path Ścieżka tworzonej paczki.
+ * @return 0 po zapisaniu paczki, -1 przy błędzie.
+ */
+int paczka_zbuduj(const char* source_path, const char* pack_path) {
+    FILE* src = plik_otworz(source_path, "r");
+    if (!src) {
+        fprintf(stderr, "Failed to open level source %s\n", source_path);
+        return -1;
+    }
+
+    char (*rows)[LEVEL_MAX_SIZE + 1] = (char (*)[LEVEL_MAX_SIZE + 1])malloc(sizeof(*rows) * LEVEL_MAX_SIZE);
+    size_t max_terrain = (size_t)(LEVEL_MAX_SIZE / CHUNK_SIZE) * (LEVEL_MAX_SIZE / CHUNK_SIZE) * CHUNK_PACKED_BYTES;
+    unsigned char* body = NULL;
+    size_t body_size = 0;
+    LevelPackEntry* index = NULL;
+    int count = 0;
+    bool ok = rows != NULL;
+
+    int height = 0, first_line = 0, line_no = 0;
+    RULESET ruleset = RULESET_CLASSIC;
+    int32_t rules[RULE_FIELD_COUNT];
+    for (int k = 0; k < RULE_FIELD_COUNT; k++) rules[k] = *(const int*)((const char*)&rules_classic + rule_fields[k].offset);
+
+    char line[LEVEL_MAX_SIZE + 64];
+    bool eof = false;
+    while (ok && !eof) {
+        eof = !fgets(line, sizeof(line), src);
+        if (!eof) {
+            line_no++;
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == ';') continue;
+        }
+
+        if (eof || line[0] == '\0') {
+            if (height == 0) continue;
+            // Koniec poziomu: rekord i teren trafiają na koniec bufora paczki.
+            LevelPackEntry* grown_index = (LevelPackEntry*)realloc(index, sizeof(LevelPackEntry) * (count + 1));
+            unsigned char* grown_body = (unsigned char*)realloc(body, body_size + sizeof(LevelRecord) + max_terrain);
+            if (grown_index) index = grown_index;
+            if (grown_body) body = grown_body;
+            if (!grown_index || !grown_body) {
+                fprintf(stderr, "Out of memory while building level pack\n");
+                ok = false;
+                break;
+            }
+            LevelRecord* rec = (LevelRecord*)(body + body_size);
+            unsigned char* packed_terrain = body + body_size + sizeof(LevelRecord);
+            if (!paczka_koduj_poziom(rows, height, ruleset, rules, rec, packed_terrain, source_path, first_line)) {
+                ok = false;
+                break;
+            }
+            size_t record_size = sizeof(LevelRecord) + (size_t)((rec->width + CHUNK_SIZE - 1) >> CHUNK_SHIFT) * ((rec->height + CHUNK_SIZE - 1) >> CHUNK_SHIFT) * CHUNK_PACKED_BYTES;
+            index[count].offset = (uint32_t)body_size;
+            index[count].size = (uint32_t)record_size;
+            body_size += record_size;
+            count++;
+
+            height = 0;
+            ruleset = RULESET_CLASSIC;
+            for (int k = 0; k < RULE_FIELD_COUNT; k++) rules[k] = *(const int*)((const char*)&rules_classic + rule_fields[k].offset);
+            continue;
+        }
+
+        if (height == 0 && strchr(line, '=')) {
+            int value;
+            const RuleField* f = reguly_pole(line, &value);
+            if (strncmp(line, "rules=", 6) == 0) {
+                const GameRules* chosen = NULL;
+                for (int k = 0; k < RULESET_CUSTOM; k++) {
+                    if (strcmp(line + 6, shipped_rules[k]->name) == 0) chosen = shipped_rules[k];
+                }
+                if (!chosen) {
+                    fprintf(stderr, "%s:%d: unknown rule set %s\n", source_path, line_no, line + 6);
+                    ok = false;
+                    break;
+                }
+                ruleset = chosen->id;
+                for (int k = 0; k < RULE_FIELD_COUNT; k++) rules[k] = *(const int*)((const char*)chosen + rule_fields[k].offset);
+            }
+            else if (f) {
+                ruleset = RULESET_CUSTOM;
+                rules[f - rule_fields] = value;
+            }
+            else {
+                fprintf(stderr, "%s:%d: invalid rule %s\n", source_path, line_no, line);
+                ok = false;
+                break;
+            }
+            continue;
+        }
+
+        if (height == LEVEL_MAX_SIZE || strlen(line) > LEVEL_MAX_SIZE) {
+            fprintf(stderr, "%s:%d: level is larger than %dx%d\n", source_path, line_no, LEVEL_MAX_SIZE, LEVEL_MAX_SIZE);
+            ok = false;
+            break;
+        }
+        if (height == 0) first_line = line_no;
+        snprintf(rows[height++], LEVEL_MAX_SIZE + 1, "%s", line);
+    }
+    fclose(src);
+
+    if (ok && count == 0) {
+        fprintf(stderr, "%s: no levels found\n", source_path);
+        ok = false;
+    }
+    if (ok) {
+        FILE* out = plik_otworz(pack_path, "wb");
+        LevelPackHeader header;
+        memcpy(header.magic, LEVEL_PACK_MAGIC, 4);
+        header.version = LEVEL_PACK_VERSION;
+        header.level_count = (uint32_t)count;
+        header.reserved = 0;
+        uint32_t body_offset = (uint32_t)(sizeof(header) + sizeof(LevelPackEntry) * count);
+        for (int n = 0; n < count; n++) index[n].offset += body_offset;
+        ok = out && fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(index, sizeof(LevelPackEntry), count, out) == (size_t)count &&
+            fwrite(body, 1, body_size, out) == body_size;
+        if (out && fclose(out) != 0) ok = false;
+        if (ok) {
+            printf("Level pack %s: %d levels, %zu bytes\n", pack_path, count, (size_t)body_offset + body_size);
+        }
+        else {
+            fprintf(stderr, "Failed to write level pack %s\n", pack_path);
+        }
+    }
+
+    free(rows);
+    free(body);
+    free(index);
+    return ok ? 0 : -1;
+}
+
+// --- Funkcje obsługi logiki gry ---
+
+/**
+ * @brief Obsługuje wejście z klawiatury.
+ * * Reaguje na wciśnięcia klawiszy w zależności od aktualnego stanu gry (START_SCREEN, PLAYING, GAME_OVER).
+ * Umożliwia nawigację w menu. W trakcie rozgrywki nie zmienia stanu gry bezpośrednio,
+ * tylko zapisuje akcję w `pending_input`, którą symulacja zastosuje w najbliższej klatce.
+ * @param event Zdarzenie Allegro (oczekiwane jest zdarzenie klawiatury).
+ * @param p Wskaźnik do struktury gracza.
+ * @param current_s Wskaźnik do aktualnego stanu gry.
+ */
+void obsluz_wejscie(ALLEGRO_EVENT event, Player* p, GAME_STATE* current_s) {
+    if (event.type == ALLEGRO_EVENT_KEY_DOWN) {
+        if (*current_s == START_SCREEN) {
+            if (event.keyboard.keycode == ALLEGRO_KEY_ENTER) {
+                setup_new_game();
+            }
+        }
+        else if (*current_s == PLAYING && p->is_alive) {
+            unsigned char direction = INPUT_NONE;
+
+            if (event.keyboard.keycode == ALLEGRO_KEY_UP || event.keyboard.keycode == ALLEGRO_KEY_W) {
+                direction = INPUT_UP;
+            }
+            else if (event.keyboard.keycode == ALLEGRO_KEY_DOWN || event.keyboard.keycode == ALLEGRO_KEY_S) {
+                direction = INPUT_DOWN;
+            }
+            else if (event.keyboard.keycode == ALLEGRO_KEY_LEFT || event.keyboard.keycode == ALLEGRO_KEY_A) {
+                direction = INPUT_LEFT;
+            }
+            else if (event.keyboard.keycode == ALLEGRO_KEY_RIGHT || event.keyboard.keycode == ALLEGRO_KEY_D) {
+                direction = INPUT_RIGHT;
+            }
+            else if (event.keyboard.keycode == ALLEGRO_KEY_SPACE) {
+                pending_input |= INPUT_BOMB;
+                if (latency.probe_ts < 0) latency.probe_ts = event.any.timestamp;
+            }
+
+            if (direction != INPUT_NONE) {
+                pending_input = (unsigned char)((pending_input & ~INPUT_DIRECTIONS) | direction);
+                latency.held_ticks = 0;
+                if (latency.probe_ts < 0) latency.probe_ts = event.any.timestamp;
+            }
+        }
+        else if (*current_s == GAME_OVER) {
+            if (event.keyboard.keycode == ALLEGRO_KEY_ENTER) {
+                // Po wygranej paczka poziomów przechodzi do następnego poziomu, po przegranej poziom jest powtarzany.
+                if (level_pack.data && p->is_alive) level_pack.current = (level_pack.current + 1) % level_pack.count;
+                setup_new_game();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Stosuje wejście gracza z jednej klatki symulacji.
+ * * Najpierw obsługuje podłożenie bomby, następnie ruch o jeden kafelek w wybranym kierunku
+ * wraz z ewentualnym zebraniem power-upa. Funkcja jest deterministyczna, więc może być
+ * wywoływana ponownie podczas rollbacku.
+ * @param r Zestaw reguł gry.
+ * @param p Wskaźnik do struktury gracza.
+ * @param input Maska bitów GAME_INPUT.
+ */
+RULES_INLINE void zastosuj_wejscie_gracza(const GameRules* r, Player* p, unsigned char input) {
+    if (!p->is_alive) return;
+
+    if (input & INPUT_BOMB) {
+        try_plant_bomb(r, p);
+    }
+
+    int next_x = p->x;
+    int next_y = p->y;
+    bool moved = false;
+
+    if (input & INPUT_UP) {
+        next_y--; p->direction = PLAYER_DIR_UP; moved = true;
+    }
+    else if (input & INPUT_DOWN) {
+        next_y++; p->direction = PLAYER_DIR_DOWN; moved = true;
+    }
+    else if (input & INPUT_LEFT) {
+        next_x--; p->direction = PLAYER_DIR_LEFT; moved = true;
+    }
+    else if (input & INPUT_RIGHT) {
+        next_x++; p->direction = PLAYER_DIR_RIGHT; moved = true;
+    }
+
+    if (moved) {
+        int next_tile = mapa_kafelek(game_map, next_x, next_y);
+        if (next_x >= 0 && next_x < game_map->width &&
+            next_y >= 0 && next_y < game_map->height &&
+            next_tile != SOLID_WALL &&
+            next_tile != DESTRUCTIBLE_WALL) {
+            p->x = next_x;
+            p->y = next_y;
+
+            for (int i = 0; i < powerup_pool.used; i++) {
+                if (powerups[i].is_active && powerups[i].x == p->x && powerups[i].y == p->y) {
+                    POWERUP_TYPE type = powerups[i].type;
+                    dzwiek_zglos(SFX_PICKUP);
+                    LOG_SYM("Player picked up power-up type %d!\n", type);
+                    if (type == POWERUP_BOMB_CAP) {
+                        if (p->current_max_bombs < game_mode->player_bomb_limit) { p->current_max_bombs++; }
+                    }
+                    else if (type == POWERUP_RADIUS_INC) {
+                        if (p->current_bomb_radius < r->max_bomb_radius) { p->current_bomb_radius++; }
+                    }
+                    else if (type == POWERUP_EXTRA_LIFE) {
+                        if (p->lives < r->max_lives) { p->lives++; }
+                    }
+                    powerups[i].is_active = false;
+                    pula_zwolnij(&powerup_pool, i);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Czyni gracza nietykalnym na `r->invincibility_ticks` klatek i planuje koniec nietykalności.
+ * @param r Zestaw reguł gry.
+ * @param p Wskaźnik do struktury gracza.
+ */
+RULES_INLINE void nadaj_nietykalnosc(const GameRules* r, Player* p) {
+    p->invincible = true;
+    p->invincible_until = timers.now + r->invincibility_ticks;
+    zegar_zaplanuj(&timers, p->invincible_until, TIMER_INVINCIBILITY_END, HANDLE_NONE);
+}
+
+/**
+ * @brief Detonuje bombę i obsługuje skutki eksplozji.
+ * * Oblicza zasięg eksplozji jako długości czterech promieni - kilkoma odczytami indeksu przeszkód
+ * mapy zamiast przechodzenia kafelek po kafelku (korzystając z wyników wybuchy_przygotuj, jeśli
+ * są gotowe), niszczy zniszczalne ściany (przyznając punkty i potencjalnie
+ * odkrywając wyjście), zadaje obrażenia graczowi i wrogom oraz obsługuje wypadanie
+ * power-upów z pokonanych wrogów. Planuje też koniec efektu eksplozji.
+ * @param r Zestaw reguł gry.
+ * @param b Wskaźnik do wybuchającej bomby (element tablicy `bombs`).
+ * @param p Wskaźnik do struktury gracza.
+ * @param enemies_arr Tablica wrogów.
+ * @param game_map_arr Wskaźnik do mapy gry.
+ * @param current_s Wskaźnik do aktualnego stanu gry.
+ * @param exit_rev Wskaźnik do flagi odkrycia wyjścia.
+ * @param ex_x Współrzędna X wyjścia.
+ * @param ex_y Współrzędna Y wyjścia.
+ */
+RULES_INLINE void zdetonuj_bombe(const GameRules* r, Bomb* b, Player* p, Enemy enemies_arr[], WorldMap* game_map_arr, GAME_STATE* current_s, bool* exit_rev, int ex_x, int ex_y) {
+    b->exploding = true;
+    b->explosion_end_tick = timers.now + r->explosion_ticks;
+    zegar_zaplanuj(&timers, b->explosion_end_tick, TIMER_BOMB, pula_uchwyt(&bomb_pool, (int)(b - bombs)));
+
+    int bomb_tile = mapa_kafelek(game_map_arr, b->x, b->y);
+    b->blast_centre = bomb_tile != SOLID_WALL;
+    if (b->blast_centre) {
+        if (bomb_tile == DESTRUCTIBLE_WALL) {
+            ustaw_kafelek(game_map_arr, b->x, b->y, EMPTY);
+            p->score += r->points_per_wall;
+            if (b->x == ex_x && b->y == ex_y) {
+                *exit_rev = true;
+                LOG_SYM("Exit revealed at (%d, %d)!\n", ex_x, ex_y);
+            }
+        }
+    }
+
+    int index = (int)(b - bombs);
+    BlastRays local;
+    const BlastRays* rays = &local;
+    if (index < blasts.capacity && blasts.rays[index].ready) {
+        rays = &blasts.rays[index];
+        blasts.rays[index].ready = false;
+    }
+    else {
+        wybuch_promienie(game_map_arr, b, &local);
+    }
+
+    for (int dir = 0; dir < BLAST_DIRECTIONS; dir++) {
+        // Pola puste przed wybuchami tej klatki zostają puste - promień przechodzi przez nie bez sprawdzania mapy.
+        // Dalej sięga do najbliższej ściany według bieżącego indeksu przeszkód.
+        int len = rays->open[dir];
+        if (len < b->radius) {
+            int wall = len + mapa_odleglosc_sciany(game_map_arr, b->x + blast_dx[dir] * len, b->y + blast_dy[dir] * len, dir, b->radius - len);
+            if (wall > b->radius) {
+                len = b->radius;
+            }
+            else {
+                int cur_x = b->x + blast_dx[dir] * wall;
+                int cur_y = b->y + blast_dy[dir] * wall;
+                if (mapa_kafelek(game_map_arr, cur_x, cur_y) == DESTRUCTIBLE_WALL) {
+                    len = wall;
+                    ustaw_kafelek(game_map_arr, cur_x, cur_y, EMPTY);
+                    p->score += r->points_per_wall;
+                    if (cur_x == ex_x && cur_y == ex_y) {
+                        *exit_rev = true;
+                        LOG_SYM("Exit revealed at (%d, %d)!\n", ex_x, ex_y);
+                    }
+                }
+                else {
+                    len = wall - 1;
+                }
+            }
+        }
+        b->blast_len[dir] = (uint16_t)len;
+    }
+
+    if (!rollback_resymulacja) {
+        czasteczki_emituj_eksplozje(b);
+        METRYKA_DODAJ(0, bombs_detonated, 1);
+    }
+    dzwiek_zglos(SFX_EXPLODE);
+
+    if (p->is_alive && !p->invincible && wybuch_obejmuje(b, p->x, p->y)) {
+        p->lives--;
+        dzwiek_zglos(SFX_HIT);
+        LOG_SYM("Player hit by explosion! Lives left: %d\n", p->lives);
+        if (p->lives <= 0) {
+            p->is_alive = false; *current_s = GAME_OVER;
+        }
+        else {
+            nadaj_nietykalnosc(r, p);
+        }
+    }
+    for (int e_idx = 0; e_idx < enemy_pool.used; e_idx++) {
+        if (enemies_arr[e_idx].is_alive && wybuch_obejmuje(b, enemies_arr[e_idx].x, enemies_arr[e_idx].y)) {
+            enemies_arr[e_idx].is_alive = false;
+            pula_zwolnij(&enemy_pool, e_idx);
+            p->score += r->points_per_enemy;
+            dzwiek_zglos(SFX_ENEMY_DEATH);
+            LOG_SYM("Enemy %d at (%d, %d) destroyed by explosion! Player score: %d\n", e_idx, enemies_arr[e_idx].x, enemies_arr[e_idx].y, p->score);
+            if (losuj() % r->powerup_drop_chance == 0) {
+                upusc_powerup(enemies_arr[e_idx].x, enemies_arr[e_idx].y);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Sprawdza, czy pole leży w zasięgu eksplozji bomby.
+ * * Eksplozja to środek i cztery odcinki, więc wystarczy porównać współrzędne z długościami promieni.
+ * @param b Wskaźnik do wybuchającej bomby.
+ * @param x Współrzędna X pola.
+ * @param y Współrzędna Y pola.
+ * @return true, jeśli pole jest objęte eksplozją.
+ */
+bool wybuch_obejmuje(const Bomb* b, int x, int y) {
+    if (x == b->x) {
+        if (y == b->y) return b->blast_centre;
+        return y < b->y ? b->y - y <= b->blast_len[BLAST_UP] : y - b->y <= b->blast_len[BLAST_DOWN];
+    }
+    if (y == b->y) {
+        return x < b->x ? b->x - x <= b->blast_len[BLAST_LEFT] : x - b->x <= b->blast_len[BLAST_RIGHT];
+    }
+    return false;
+}
+
+/**
+ * @brief Tworzy w puli power-up losowego typu na podanym polu.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ */
+void upusc_powerup(int x, int y) {
+    int i = pula_przydziel(&powerup_pool);
+    if (i < 0) return;
+    pule_odswiez_wskazniki();
+    powerups[i].is_active = true;
+    powerups[i].x = x;
+    powerups[i].y = y;
+    powerups[i].type = (POWERUP_TYPE)(losuj() % POWERUP_TYPE_COUNT);
+    if (powerups[i].type == POWERUP_BOMB_CAP) powerups[i].color = al_map_rgb(0, 0, 255);
+    else if (powerups[i].type == POWERUP_RADIUS_INC) powerups[i].color = al_map_rgb(255, 165, 0);
+    else if (powerups[i].type == POWERUP_EXTRA_LIFE) powerups[i].color = al_map_rgb(255, 20, 147);
+    LOG_SYM("Enemy dropped power-up type %d at (%d,%d)!\n", powerups[i].type, powerups[i].x, powerups[i].y);
+}
+
+/**
+ * @brief Wykonuje jedną próbę ruchu błądzącego wroga (krok skryptu SCRIPT_WANDER).
+ * * Wróg próbuje się poruszyć w aktualnym kierunku. Jeśli ruch jest zablokowany
+ * (przez ścianę, bombę, innego wroga lub odkryte wyjście), wróg próbuje zmienić kierunek.
+ * @param enemies_arr Tablica wrogów.
+ * @param i Indeks poruszającego się wroga.
+ * @param bombs_arr Tablica bomb (do sprawdzania kolizji).
+ * @param game_map_arr Wskaźnik do mapy gry.
+ * @param exit_rev Flaga odkrycia wyjścia.
+ * @param ex_x Współrzędna X wyjścia.
+ * @param ex_y Współrzędna Y wyjścia.
+ */
+RULES_INLINE void przesun_wroga(Enemy enemies_arr[], int i, Bomb bombs_arr[], WorldMap* game_map_arr, bool exit_rev, int ex_x, int ex_y) {
+    int next_ex = enemies_arr[i].x;
+    int next_ey = enemies_arr[i].y;
+    ENEMY_DIRECTION original_direction = enemies_arr[i].direction;
+    int attempts_to_move = 0;
+    bool moved_this_turn = false;
+
+    while (attempts_to_move < DIR_COUNT * 2 && !moved_this_turn) {
+        next_ex = enemies_arr[i].x;
+        next_ey = enemies_arr[i].y;
+
+        if (attempts_to_move > 0 && attempts_to_move % DIR_COUNT == 0) {
+            enemies_arr[i].direction = (ENEMY_DIRECTION)(losuj() % DIR_COUNT);
+        }
+
+        if (enemies_arr[i].direction == DIR_UP) next_ey--;
+        else if (enemies_arr[i].direction == DIR_DOWN) next_ey++;
+        else if (enemies_arr[i].direction == DIR_LEFT) next_ex--;
+        else if (enemies_arr[i].direction == DIR_RIGHT) next_ex++;
+
+        if (wrog_moze_wejsc(enemies_arr, i, bombs_arr, game_map_arr, exit_rev, ex_x, ex_y, next_ex, next_ey)) {
+            enemies_arr[i].x = next_ex;
+            enemies_arr[i].y = next_ey;
+            moved_this_turn = true;
+        }
+        else {
+            if (attempts_to_move < DIR_COUNT) {
+                enemies_arr[i].direction = (ENEMY_DIRECTION)((original_direction + attempts_to_move + 1) % DIR_COUNT);
+            }
+            else {
+                enemies_arr[i].direction = (ENEMY_DIRECTION)(losuj() % DIR_COUNT);
+            }
+            attempts_to_move++;
+        }
+    }
+    if (!moved_this_turn) {
+        enemies_arr[i].direction = original_direction;
+    }
+}
+/**
+ * @brief Sprawdza, czy pole jest dla wrogów trwale zablokowane (krawędź mapy albo ściana).
+ * @param m Wskaźnik do mapy gry.
+ * @param x Współrzędna X pola.
+ * @param y Współrzędna Y pola.
+ * @return true dla pola na obramowaniu lub poza mapą i dla ścian obu rodzajów.
+ */
+bool wrog_sciana(WorldMap* m, int x, int y) {
+    if (x <= 0 || x >= m->width - 1 || y <= 0 || y >= m->height - 1) return true;
+    int tile = mapa_kafelek(m, x, y);
+    return tile == SOLID_WALL || tile == DESTRUCTIBLE_WALL;
+}
+
+/**
+ * @brief Sprawdza, czy wróg może wejść na pole: nie ma tam ściany, bomby, innego żywego wroga ani odkrytego wyjścia.
+ * @param enemies_arr Tablica wrogów.
+ * @param i Indeks wroga, który chce wejść na pole.
+ * @param bombs_arr Tablica bomb.
+ * @param m Wskaźnik do mapy gry.
+ * @param exit_rev Flaga odkrycia wyjścia.
+ * @param ex_x Współrzędna X wyjścia.
+ * @param ex_y Współrzędna Y wyjścia.
+ * @param x Współrzędna X pola.
+ * @param y Współrzędna Y pola.
+ * @return true, jeśli pole jest wolne.
+ */
+bool wrog_moze_wejsc(Enemy enemies_arr[], int i, Bomb bombs_arr[], WorldMap* m, bool exit_rev, int ex_x, int ex_y, int x, int y) {
+    if (wrog_sciana(m, x, y)) return false;
+    for (int b = 0; b < bomb_pool.used; b++) {
+        if (bombs_arr[b].active && bombs_arr[b].x == x && bombs_arr[b].y == y) return false;
+    }
+    for (int other = 0; other < enemy_pool.used; other++) {
+        if (other != i && enemies_arr[other].is_alive && enemies_arr[other].x == x && enemies_arr[other].y == y) return false;
+    }
+    return !(exit_rev && x == ex_x && y == ex_y);
+}
+
+/**
+ * @brief Przesuwa wroga o jedno pole w podanym kierunku, jeśli to pole jest wolne.
+ * @param i Indeks wroga.
+ * @param dir Kierunek kroku (staje się kierunkiem wroga także przy nieudanym kroku).
+ * @return true, jeśli wróg się przesunął.
+ */
+bool wrog_idz(int i, ENEMY_DIRECTION dir) {
+    Enemy* e = &enemies[i];
+    e->direction = dir;
+    int x = e->x + enemy_dx[dir];
+    int y = e->y + enemy_dy[dir];
+    if (!wrog_moze_wejsc(enemies, i, bombs, game_map, exit_revealed, exit_x, exit_y, x, y)) return false;
+    e->x = x;
+    e->y = y;
+    return true;
+}
+
+/**
+ * @brief Przesuwa wroga na wolne sąsiednie pole najdalsze od gracza, o ile oddala go to od gracza.
+ * @param i Indeks wroga.
+ */
+void wrog_uciekaj(int i) {
+    Enemy* e = &enemies[i];
+    int best_dir = -1;
+    int best_dist = abs(player.x - e->x) + abs(player.y - e->y);
+    for (int dir = 0; dir < DIR_COUNT; dir++) {
+        int x = e->x + enemy_dx[dir];
+        int y = e->y + enemy_dy[dir];
+        int dist = abs(player.x - x) + abs(player.y - y);
+        if (dist > best_dist && wrog_moze_wejsc(enemies, i, bombs, game_map, exit_revealed, exit_x, exit_y, x, y)) {
+            best_dir = dir;
+            best_dist = dist;
+        }
+    }
+    if (best_dir >= 0) wrog_idz(i, (ENEMY_DIRECTION)best_dir);
+}
+
+/**
+ * @brief Losuje odstęp między krokami wroga: od enemy_move_delay do 1.5 raza tej wartości.
+ * @param r Zestaw reguł gry.
+ * @return Liczba klatek do następnego kroku.
+ */
+RULES_INLINE int wrog_opoznienie(const GameRules* r) {
+    return r->enemy_move_delay + (int)(losuj() % (r->enemy_move_delay / 2));
+}
+
+/**
+ * @brief Skrypt SCRIPT_WANDER: jeden krok błądzenia (przesun_wroga) na wznowienie.
+ * @param r Zestaw reguł gry.
+ * @param i Indeks wroga.
+ * @return Liczba klatek do następnego wznowienia.
+ */
+RULES_INLINE int skrypt_bladzenie(const GameRules* r, int i) {
+    int delay = wrog_opoznienie(r);
+    przesun_wroga(enemies, i, bombs, game_map, exit_revealed, exit_x, exit_y);
+    return delay;
+}
+
+/**
+ * @brief Skrypt SCRIPT_PATROL: ENEMY_PATROL_LENGTH kroków w jedną stronę, postój i powrót.
+ * * Pole zajęte przez bombę lub innego wroga skrypt przeczekuje (SKRYPT_CZEKAJ_NA_POLE); ściana
+ * albo pole, które nie zwolniło się w ENEMY_WAIT_MAX_TICKS klatek, kończy odcinek wcześniej.
+ * @param r Zestaw reguł gry.
+ * @param i Indeks wroga.
+ * @return Liczba klatek do następnego wznowienia.
+ */
+RULES_INLINE int skrypt_patrol(const GameRules* r, int i) {
+    Enemy* e = &enemies[i];
+    SKRYPT_POCZATEK(e);
+    for (;;) {
+        // Odcinek zaczynający się od ściany zostaje obrócony na pierwszy kierunek, w którym da się iść.
+        for (int turn = 0; turn < DIR_COUNT && wrog_sciana(game_map, e->x + enemy_dx[e->direction], e->y + enemy_dy[e->direction]); turn++) {
+            e->direction = (ENEMY_DIRECTION)((e->direction + 1) % DIR_COUNT);
+        }
+        for (e->script_counter = 0; e->script_counter < ENEMY_PATROL_LENGTH; e->script_counter++) {
+            if (wrog_sciana(game_map, e->x + enemy_dx[e->direction], e->y + enemy_dy[e->direction])) break;
+            SKRYPT_CZEKAJ_NA_POLE(e, i, e->x + enemy_dx[e->direction], e->y + enemy_dy[e->direction], ENEMY_WAIT_MAX_TICKS);
+            if (!wrog_idz(i, e->direction)) break;
+            SKRYPT_CZEKAJ(e, wrog_opoznienie(r));
+        }
+        e->direction = (ENEMY_DIRECTION)(e->direction ^ 1);
+        SKRYPT_CZEKAJ(e, ENEMY_PATROL_PAUSE_TICKS);
+    }
+    SKRYPT_KONIEC(e, 1);
+}
+
+/**
+ * @brief Skrypt SCRIPT_CHASE: krok w stronę gracza, gdy jest w zasięgu ENEMY_CHASE_RANGE, a w przeciwnym razie błądzenie.
+ * * Wróg najpierw skraca większą z odległości (w poziomie lub w pionie), a gdy ta droga jest zablokowana - mniejszą.
+ * @param r Zestaw reguł gry.
+ * @param i Indeks wroga.
+ * @return Liczba klatek do następnego wznowienia.
+ */
+RULES_INLINE int skrypt_poscig(const GameRules* r, int i) {
+    Enemy* e = &enemies[i];
+    int dx = player.x - e->x;
+    int dy = player.y - e->y;
+    if (!player.is_alive || abs(dx) + abs(dy) > ENEMY_CHASE_RANGE) {
+        return skrypt_bladzenie(r, i);
+    }
+
+    int delay = wrog_opoznienie(r);
+    ENEMY_DIRECTION horizontal = (dx < 0) ? DIR_LEFT : DIR_RIGHT;
+    ENEMY_DIRECTION vertical = (dy < 0) ? DIR_UP : DIR_DOWN;
+    bool moved = false;
+    if (abs(dx) >= abs(dy)) {
+        if (dx != 0) moved = wrog_idz(i, horizontal);
+        if (!moved && dy != 0) wrog_idz(i, vertical);
+    }
+    else {
+        moved = wrog_idz(i, vertical);
+        if (!moved && dx != 0) wrog_idz(i, horizontal);
+    }
+    return delay;
+}
+
+/**
+ * @brief Skrypt SCRIPT_LURK_FLEE: stoi w miejscu, dopóki gracz nie podejdzie na ENEMY_LURK_RANGE,
+ * a potem wykonuje ENEMY_FLEE_STEPS szybkich kroków ucieczki.
+ * @param r Zestaw reguł gry.
+ * @param i Indeks wroga.
+ * @return Liczba klatek do następnego wznowienia.
+ */
+RULES_INLINE int skrypt_czajenie(const GameRules* r, int i) {
+    Enemy* e = &enemies[i];
+    SKRYPT_POCZATEK(e);
+    for (;;) {
+        while (!player.is_alive || abs(player.x - e->x) + abs(player.y - e->y) > ENEMY_LURK_RANGE) {
+            SKRYPT_CZEKAJ(e, ENEMY_WAIT_POLL_TICKS);
+        }
+        for (e->script_counter = 0; e->script_counter < ENEMY_FLEE_STEPS; e->script_counter++) {
+            wrog_uciekaj(i);
+            SKRYPT_CZEKAJ(e, r->enemy_move_delay / 2);
+        }
+    }
+    SKRYPT_KONIEC(e, 1);
+}
+
+/**
+ * @brief Wznawia skrypt wroga (centralny planista skryptów wywoływany przez koło czasowe).
+ * @param r Zestaw reguł gry.
+ * @param i Indeks wroga.
+ * @return Liczba klatek, po których skrypt chce zostać wznowiony ponownie.
+ */
+RULES_INLINE int wrog_wznow_skrypt(const GameRules* r, int i) {
+    switch (enemies[i].script) {
+    case SCRIPT_PATROL:    return skrypt_patrol(r, i);
+    case SCRIPT_CHASE:     return skrypt_poscig(r, i);
+    case SCRIPT_LURK_FLEE: return skrypt_czajenie(r, i);
+    default:               return skrypt_bladzenie(r, i);
+    }
+}
+
+
+/**
+ * @brief Sprawdza kolizję gracza z wrogami.
+ * * Jeśli gracz nie jest nietykalny i wejdzie na pole zajmowane przez żywego wroga,
+ * traci życie. Jeśli liczba żyć spadnie do zera, gra się kończy.
+ * Po kolizji gracz staje się na chwilę nietykalny.
+ * @param r Zestaw reguł gry.
+ * @param p Wskaźnik do struktury gracza.
+ * @param enemies_arr Tablica wrogów.
+ * @param current_s Wskaźnik do aktualnego stanu gry.
+ */
+RULES_INLINE void sprawdz_kolizje_gracz_wrog(const GameRules* r, Player* p, Enemy enemies_arr[], GAME_STATE* current_s) {
+    if (p->is_alive && !p->invincible) {
+        for (int i = 0; i < enemy_pool.used; i++) {
+            if (enemies_arr[i].is_alive && p->x == enemies_arr[i].x && p->y == enemies_arr[i].y) {
+                p->lives--;
+                dzwiek_zglos(SFX_HIT);
+                LOG_SYM("Player collided with enemy! Lives left: %d\n", p->lives);
+                if (p->lives <= 0) {
+                    p->is_alive = false; *current_s = GAME_OVER;
+                }
+                else {
+                    nadaj_nietykalnosc(r, p);
+                }
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Sprawdza, czy warunki zwycięstwa zostały spełnione.
+ * * Warunki zwycięstwa: gracz żyje, wszyscy wrogowie są pokonani, wyjście jest odkryte,
+ * a gracz znajduje się na polu wyjścia.
+ * @param p Wskaźnik do struktury gracza.
+ * @param exit_rev Flaga odkrycia wyjścia.
+ * @param ex_x Współrzędna X wyjścia.
+ * @param ex_y Współrzędna Y wyjścia.
+ * @param current_s Wskaźnik do aktualnego stanu gry.
+ */
+void sprawdz_warunek_wygranej(Player* p, bool exit_rev, int ex_x, int ex_y, GAME_STATE* current_s) {
+    if (p->is_alive && *current_s == PLAYING) {
+        bool all_enemies_defeated_now = enemy_pool.count == 0;
+        if (all_enemies_defeated_now && exit_rev && p->x == ex_x && p->y == ex_y) {
+            LOG_SYM("CONGRATULATIONS! LEVEL COMPLETED!\n");
+            *current_s = GAME_OVER;
+        }
+    }
+}
+
+/**
+ * @brief Główna funkcja aktualizująca logikę gry.
+ * * Wywoływana w każdej klatce gry (jeśli stan gry to PLAYING).
+ * Przesuwa koło czasowe o klatkę - to ono wywołuje koniec nietykalności gracza,
+ * wybuchy bomb i ruchy wrogów, których termin właśnie minął - a następnie
+ * sprawdza kolizje i warunki zwycięstwa.
+ * @param r Zestaw reguł gry.
+ * @param p Wskaźnik do struktury gracza.
+ * @param bombs_arr Tablica bomb.
+ * @param enemies_arr Tablica wrogów.
+ * @param game_map_arr Wskaźnik do mapy gry.
+ * @param current_s Wskaźnik do aktualnego stanu gry.
+ * @param exit_rev Wskaźnik do flagi odkrycia wyjścia.
+ * @param ex_x Współrzędna X wyjścia.
+ * @param ex_y Współrzędna Y wyjścia.
+ */
+RULES_INLINE void aktualizuj_gre(const GameRules* r, Player* p, Bomb bombs_arr[], Enemy enemies_arr[], WorldMap* game_map_arr, GAME_STATE* current_s, bool* exit_rev, int ex_x, int ex_y) {
+    if (*current_s == PLAYING) {
+        mapa_utrzymuj_aktywne(game_map_arr, p, bombs_arr);
+        int due_count = zegar_krok(&timers);
+        wybuchy_przygotuj(game_map_arr, due_count);
+        for (int i = 0; i < due_count; i++) {
+            EntityHandle target = (EntityHandle)timers.due_keys[i];
+            switch ((TIMER_KIND)(timers.due_keys[i] >> 56)) {
+            case TIMER_INVINCIBILITY_END: zdarzenie_koniec_nietykalnosci(target); break;
+            case TIMER_BOMB:              zdarzenie_bomby(r, target); break;
+            case TIMER_ENEMY_MOVE:        zdarzenie_ruchu_wroga(r, target); break;
+            default: break;
+            }
+        }
+        sprawdz_kolizje_gracz_wrog(r, p, enemies_arr, current_s);
+        sprawdz_warunek_wygranej(p, *exit_rev, ex_x, ex_y, current_s);
+    }
+}
+
+/**
+ * @brief Wykonuje jedną pełną klatkę symulacji dla podanego wejścia i zestawu reguł.
+ * * Stosuje wejście gracza, a następnie aktualizuje logikę gry na globalnym stanie.
+ * Wynik zależy wyłącznie od stanu gry i wejścia, co pozwala na ponowną symulację po rollbacku.
+ * @param r Zestaw reguł gry.
+ * @param input Maska bitów GAME_INPUT dla tej klatki.
+ */
+RULES_INLINE void krok_symulacji_regul(const GameRules* r, unsigned char input) {
+    if (current_game_state == PLAYING) {
+        zastosuj_wejscie_gracza(r, &player, input);
+    }
+    aktualizuj_gre(r, &player, bombs, enemies, game_map, &current_game_state, &exit_revealed, exit_x, exit_y);
+}
+
+/**
+ * @brief Wykonuje jedną pełną klatkę symulacji dla podanego wejścia.
+ * * Dla wbudowanych zestawów reguł wywołuje krok_symulacji_regul ze stałym zestawem - kompilator
+ * tworzy wtedy osobną kopię całej symulacji z regułami wklejonymi jako stałe. Reguły z wiersza
+ * poleceń (RULESET_CUSTOM) korzystają z kopii czytającej reguły w czasie działania.
+ * @param input Maska bitów GAME_INPUT dla tej klatki.
+ */
+void krok_symulacji(unsigned char input) {
+    switch (active_rules->id) {
+    case RULESET_CLASSIC:     krok_symulacji_regul(&rules_classic, input); break;
+    case RULESET_LARGE_ARENA: krok_symulacji_regul(&rules_large_arena, input); break;
+    case RULESET_CHAOS:       krok_symulacji_regul(&rules_chaos, input); break;
+    default:                  krok_symulacji_regul(active_rules, input); break;
+    }
+#if !defined(NDEBUG)
+    liczniki_sprawdz();
+#endif
+}
+
+/**
+ * @brief Sprawdza liczniki utrzymywane przyrostowo z pełnym przeliczeniem (w kompilacji debug po każdej klatce).
+ * * Liczby wrogów, bomb i power-upów to liczniki pul (pula_przydziel i pula_zwolnij w miejscach zmian),
+ * a liczba pudełek - `WorldMap::walls`; z nich korzystają sprawdzenia limitu bomb, zwycięstwa i HUD.
+ * Tutaj są porównywane z flagami obiektów i z kafelkami mapy.
+ */
+void liczniki_sprawdz() {
+    int enemies_alive = 0, bombs_active = 0, powerups_active = 0;
+    for (int i = 0; i < enemy_pool.used; i++) {
+        if (enemy_pool.live[i] && enemies[i].is_alive) enemies_alive++;
+    }
+    for (int i = 0; i < bomb_pool.used; i++) {
+        if (bomb_pool.live[i] && bombs[i].active) bombs_active++;
+    }
+    for (int i = 0; i < powerup_pool.used; i++) {
+        if (powerup_pool.live[i] && powerups[i].is_active) powerups_active++;
+    }
+    int walls = game_map->walls;
+    if (walls >= 0) {
+        walls = 0;
+        for (int y = 0; y < game_map->height; y++) {
+            for (int x = 0; x < game_map->width; x++) {
+                if (mapa_kafelek_bez_ladowania(game_map, x, y) == DESTRUCTIBLE_WALL) walls++;
+            }
+        }
+    }
+
+    bool ok = enemies_alive == enemy_pool.count && bombs_active == bomb_pool.count &&
+        powerups_active == powerup_pool.count && walls == game_map->walls;
+    if (!ok) {
+        fprintf(stderr, "Derived state mismatch at tick %u: enemies %d/%d, bombs %d/%d, powerups %d/%d, walls %d/%d (recount/counter)\n",
+            timers.now, enemies_alive, enemy_pool.count, bombs_active, bomb_pool.count,
+            powerups_active, powerup_pool.count, walls, game_map->walls);
+    }
+    assert(ok);
+}
+
+
+// --- Funkcje wyznaczania zasięgu eksplozji ---
+
+/**
+ * @brief Wyznacza długości pustych odcinków czterech promieni eksplozji bomby.
+ * * Tylko czyta indeks przeszkód mapy (mapa_odleglosc_sciany_odczyt). Promień kończy się przed
+ * pierwszą ścianą, krawędzią mapy, fragmentem spoza pamięci albo na promieniu rażenia; resztę
+ * sprawdza zdetonuj_bombe.
+ * @param m Wskaźnik do mapy.
+ * @param b Wskaźnik do bomby.
+ * @param out Wynik.
+ */
+void wybuch_promienie(const WorldMap* m, const Bomb* b, BlastRays* out) {
+    for (int dir = 0; dir < BLAST_DIRECTIONS; dir++) {
+        int wall = mapa_odleglosc_sciany_odczyt(m, b->x, b->y, dir, b->radius);
+        out->open[dir] = (uint16_t)(wall <= b->radius ? wall - 1 : b->radius);
+    }
+    out->ready = true;
+}
+
+/**
+ * @brief Wyznacza promienie dla co `parts`-tej bomby z bieżącej porcji, zaczynając od `part`.
+ * @param m Wskaźnik do mapy.
+ * @param part Numer części (0 - wątek główny, 1.. - wątki pomocnicze).
+ * @param parts Liczba części.
+ */
+void wybuchy_fragment(const WorldMap* m, int part, int parts) {
+    int done = 0;
+    for (int i = part; i < blasts.batch_count; i += parts) {
+        int index = blasts.batch[i];
+        wybuch_promienie(m, &bombs[index], &blasts.rays[index]);
+        done++;
+    }
+    METRYKA_DODAJ(part, blast_rays, done);
+}
+
+/**
+ * @brief Pętla wątku pomocniczego: czeka na porcję bomb, liczy swoją część i zgłasza koniec.
+ * @param thread Wątek Allegro.
+ * @param arg Numer części (1..workers) zapisany jako wskaźnik.
+ * @return Zawsze NULL.
+ */
+void* wybuchy_watek(ALLEGRO_THREAD* thread, void* arg) {
+    (void)thread;
+    int part = (int)(intptr_t)arg;
+    unsigned int seen = 0;
+    for (;;) {
+        al_lock_mutex(blasts.mutex);
+        while (!blasts.quit && blasts.generation == seen) {
+            al_wait_cond(blasts.start_cond, blasts.mutex);
+        }
+        bool quit = blasts.quit;
+        seen = blasts.generation;
+        al_unlock_mutex(blasts.mutex);
+        if (quit) break;
+
+        wybuchy_fragment(blasts.map, part, blasts.workers + 1);
+
+        al_lock_mutex(blasts.mutex);
+        if (--blasts.pending == 0) al_signal_cond(blasts.done_cond);
+        al_unlock_mutex(blasts.mutex);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Uruchamia wątki pomocnicze wyznaczania eksplozji.
+ * * Bez wątków (workers <= 0 albo błąd ich utworzenia) promienie są liczone na wątku głównym.
+ * @param workers Żądana liczba wątków pomocniczych (obcinana do BLAST_MAX_WORKERS).
+ */
+void wybuchy_init(int workers) {
+    if (workers > BLAST_MAX_WORKERS) workers = BLAST_MAX_WORKERS;
+    blasts.workers = 0;
+    blasts.quit = false;
+    if (workers <= 0) return;
+
+    blasts.mutex = al_create_mutex();
+    blasts.start_cond = al_create_cond();
+    blasts.done_cond = al_create_cond();
+    if (!blasts.mutex || !blasts.start_cond || !blasts.done_cond) {
+        fprintf(stderr, "Failed to create blast worker synchronisation, computing blasts serially.\n");
+        return;
+    }
+    for (int i = 0; i < workers; i++) {
+        blasts.threads[i] = al_create_thread(wybuchy_watek, (void*)(intptr_t)(i + 1));
+        if (!blasts.threads[i]) break;
+        blasts.workers++;
+    }
+    for (int i = 0; i < blasts.workers; i++) {
+        al_start_thread(blasts.threads[i]);
+    }
+    printf("Blast workers: %d\n", blasts.workers);
+}
+
+/**
+ * @brief Faza 1 detonacji: wyznacza promienie wszystkich bomb, które wybuchną w tej klatce.
+ * * Bomby są zbierane ze zdarzeń TIMER_BOMB w `timers.due_keys`. Od BLAST_PARALLEL_MIN bomb
+ * praca jest dzielona między wątek główny i wątki pomocnicze. Wątki tylko czytają mapę i bomby,
+ * a wątek główny czeka, aż skończą, zanim cokolwiek zmieni.
+ * @param m Wskaźnik do mapy.
+ * @param due_count Liczba zdarzeń w `timers.due_keys`.
+ */
+void wybuchy_przygotuj(WorldMap* m, int due_count) {
+    if (blasts.capacity < bomb_pool.capacity) {
+        BlastRays* rays = realloc(blasts.rays, bomb_pool.capacity * sizeof(BlastRays));
+        int* batch = realloc(blasts.batch, bomb_pool.capacity * sizeof(int));
+        if (rays) blasts.rays = rays;
+        if (batch) blasts.batch = batch;
+        if (!rays || !batch) return;
+        memset(blasts.rays + blasts.capacity, 0, (bomb_pool.capacity - blasts.capacity) * sizeof(BlastRays));
+        blasts.capacity = bomb_pool.capacity;
+    }
+
+    blasts.batch_count = 0;
+    for (int i = 0; i < due_count && blasts.batch_count < blasts.capacity; i++) {
+        if ((TIMER_KIND)(timers.due_keys[i] >> 56) != TIMER_BOMB) continue;
+        int index = (int)((EntityHandle)timers.due_keys[i] & POOL_INDEX_MASK);
+        if (index < bomb_pool.used && bombs[index].active && !bombs[index].exploding && bombs[index].fuse_tick == timers.now) {
+            blasts.batch[blasts.batch_count++] = index;
+        }
+    }
+    if (blasts.batch_count == 0) return;
+
+    if (blasts.workers == 0 || blasts.batch_count < BLAST_PARALLEL_MIN) {
+        wybuchy_fragment(m, 0, 1);
+        return;
+    }
+
+    al_lock_mutex(blasts.mutex);
+    blasts.map = m;
+    blasts.pending = blasts.workers;
+    blasts.generation++;
+    al_broadcast_cond(blasts.start_cond);
+    al_unlock_mutex(blasts.mutex);
+
+    wybuchy_fragment(m, 0, blasts.workers + 1);
+
+    al_lock_mutex(blasts.mutex);
+    while (blasts.pending > 0) {
+        al_wait_cond(blasts.done_cond, blasts.mutex);
+    }
+    al_unlock_mutex(blasts.mutex);
+}
+
+/**
+ * @brief Zatrzymuje wątki pomocnicze i zwalnia bufory wyznaczania eksplozji.
+ */
+void wybuchy_zwolnij() {
+    if (blasts.mutex) {
+        al_lock_mutex(blasts.mutex);
+        blasts.quit = true;
+        al_broadcast_cond(blasts.start_cond);
+        al_unlock_mutex(blasts.mutex);
+    }
+    for (int i = 0; i < blasts.workers; i++) {
+        al_join_thread(blasts.threads[i], NULL);
+        al_destroy_thread(blasts.threads[i]);
+    }
+    blasts.workers = 0;
+    if (blasts.done_cond) al_destroy_cond(blasts.done_cond);
+    if (blasts.start_cond) al_destroy_cond(blasts.start_cond);
+    if (blasts.mutex) al_destroy_mutex(blasts.mutex);
+    blasts.done_cond = NULL;
+    blasts.start_cond = NULL;
+    blasts.mutex = NULL;
+    free(blasts.rays);
+    free(blasts.batch);
+    blasts.rays = NULL;
+    blasts.batch = NULL;
+    blasts.capacity = 0;
+}
+
+// --- Funkcje koła czasowego ---
+
+/**
+ * @brief Zwraca indeks najmłodszego ustawionego bitu.
+ * @param bits Niezerowa maska bitowa.
+ * @return Indeks bitu (0..63).
+ */
+int najnizszy_bit(uint64_t bits) {
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#elif defined(_MSC_VER)
+    // Win32 nie ma _BitScanForward64 - szukamy osobno w młodszej i starszej połowie.
+    unsigned long index;
+    if (_BitScanForward(&index, (unsigned long)bits)) return (int)index;
+    _BitScanForward(&index, (unsigned long)(bits >> 32));
+    return (int)index + 32;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+/**
+ * @brief Usuwa wszystkie zaplanowane zdarzenia i ustawia zegar symulacji.
+ * * Przy pierwszym wywołaniu buduje listę wolnych węzłów; później tylko zwraca do niej
+ * węzły z niepustych przegródek (znalezionych w mapie bitowej `occupied`), więc koszt zależy
+ * od liczby zdarzeń, a nie od pojemności i liczby przegródek.
+ * @param w Wskaźnik do koła czasowego.
+ * @param now Nowa bieżąca klatka symulacji.
+ */
+void zegar_resetuj(TimingWheel* w, uint32_t now) {
+    if (!w->initialized) {
+        for (int i = 0; i < TIMER_CAPACITY; i++) {
+            w->events[i].next = (i + 1 < TIMER_CAPACITY) ? i + 1 : -1;
+        }
+        w->free_head = 0;
+        for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+                w->slots[level][slot] = -1;
+            }
+        }
+        w->initialized = true;
+    }
+    else {
+        for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            for (int word = 0; word < TIMER_WHEEL_SLOTS / 64; word++) {
+                uint64_t bits = w->occupied[level][word];
+                while (bits) {
+                    int slot = word * 64 + najnizszy_bit(bits);
+                    bits &= bits - 1;
+                    int id = w->slots[level][slot];
+                    while (id >= 0) {
+                        int next = w->events[id].next;
+                        w->events[id].next = w->free_head;
+                        w->free_head = id;
+                        id = next;
+                    }
+                    w->slots[level][slot] = -1;
+                }
+                w->occupied[level][word] = 0;
+            }
+        }
+    }
+    w->live = 0;
+    w->now = now;
+}
+
+/**
+ * @brief Wstawia węzeł zdarzenia do przegródki odpowiadającej jego terminowi.
+ * * Poziom wybiera odległość terminu od bieżącej klatki, a przegródkę - odpowiednie bity terminu.
+ * @param w Wskaźnik do koła czasowego.
+ * @param id Indeks węzła w puli `events`.
+ */
+void zegar_wstaw(TimingWheel* w, int id) {
+    TimerEvent* e = &w->events[id];
+    uint32_t delta = e->due - w->now;
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1u << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    int slot = (int)((e->due >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+    e->next = w->slots[level][slot];
+    w->slots[level][slot] = id;
+    w->occupied[level][slot >> 6] |= 1ull << (slot & 63);
+}
+
+/**
+ * @brief Planuje zdarzenie na bezwzględną klatkę symulacji.
+ * * Termin nie wcześniejszy niż następna klatka (bieżąca jest już obsługiwana) i nie dalszy
+ * niż TIMER_WHEEL_SPAN. Zdarzenia nie trzeba odwoływać - jego obsługa porównuje termin
+ * z polem obiektu i pomija zdarzenia nieaktualne.
+ * @param w Wskaźnik do koła czasowego.
+ * @param due Klatka symulacji, w której zdarzenie ma nastąpić.
+ * @param kind Rodzaj zdarzenia (TIMER_KIND).
+ * @param target Uchwyt obiektu, którego dotyczy zdarzenie.
+ * @return true, jeśli zdarzenie zaplanowano; false, gdy pula zdarzeń jest pełna.
+ */
+bool zegar_zaplanuj(TimingWheel* w, uint32_t due, int kind, EntityHandle target) {
+    if (w->free_head < 0) {
+        fprintf(stderr, "Timing wheel full (%d events), event %d for object %08x dropped!\n", TIMER_CAPACITY, kind, (unsigned)target);
+        return false;
+    }
+    uint32_t delta = due - w->now;
+    if (delta == 0 || delta > TIMER_WHEEL_SPAN) {
+        due = (delta == 0 || (int32_t)delta < 0) ? w->now + 1 : w->now + TIMER_WHEEL_SPAN;
+    }
+    int id = w->free_head;
+    w->free_head = w->events[id].next;
+    w->events[id].due = due;
+    w->events[id].kind = kind;
+    w->events[id].target = target;
+    zegar_wstaw(w, id);
+    w->live++;
+    return true;
+}
+
+/**
+ * @brief Przenosi zdarzenia z bieżącej przegródki wyższego poziomu na niższe poziomy.
+ * @param w Wskaźnik do koła czasowego.
+ * @param level Poziom, którego przegródka właśnie się rozpoczyna (1 lub więcej).
+ */
+void zegar_kaskaduj(TimingWheel* w, int level) {
+    int slot = (int)((w->now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+    int id = w->slots[level][slot];
+    w->slots[level][slot] = -1;
+    w->occupied[level][slot >> 6] &= ~(1ull << (slot & 63));
+    while (id >= 0) {
+        int next = w->events[id].next;
+        zegar_wstaw(w, id);
+        id = next;
+    }
+}
+
+/**
+ * @brief Porównuje klucze zdarzeń do qsort (rosnąco: rodzaj, potem indeks slotu obiektu).
+ * @param a Wskaźnik do pierwszego klucza.
+ * @param b Wskaźnik do drugiego klucza.
+ * @return Wynik porównania jak w strcmp.
+ */
+int zegar_porownaj_klucze(const void* a, const void* b) {
+    uint64_t ka = *(const uint64_t*)a;
+    uint64_t kb = *(const uint64_t*)b;
+    return (ka > kb) - (ka < kb);
+}
+
+/**
+ * @brief Przesuwa zegar symulacji o jedną klatkę i zbiera zdarzenia, których termin właśnie nadszedł.
+ * * Na granicy 256 (65536) klatek zdarzenia z wyższego poziomu są rozdzielane niżej. Zdarzenia
+ * bieżącej klatki trafiają do `due_keys` posortowane według rodzaju i indeksu obiektu, dzięki czemu
+ * kolejność ich obsługi (aktualizuj_gre) nie zależy od kolejności planowania - jest ta sama
+ * po ponownej symulacji i po odbudowie koła.
+ * @param w Wskaźnik do koła czasowego.
+ * @return Liczba zdarzeń w `due_keys`.
+ */
+int zegar_krok(TimingWheel* w) {
+    w->now++;
+    for (int level = TIMER_WHEEL_LEVELS - 1; level >= 1; level--) {
+        if ((w->now & ((1u << (TIMER_WHEEL_BITS * level)) - 1)) == 0) {
+            zegar_kaskaduj(w, level);
+        }
+    }
+
+    int slot = (int)(w->now & (TIMER_WHEEL_SLOTS - 1));
+    int id = w->slots[0][slot];
+    w->slots[0][slot] = -1;
+    w->occupied[0][slot >> 6] &= ~(1ull << (slot & 63));
+    int due_count = 0;
+    while (id >= 0) {
+        TimerEvent* e = &w->events[id];
+        int next = e->next;
+        if (e->due == w->now) {
+            w->due_keys[due_count++] = ((uint64_t)e->kind << 56) | ((uint64_t)(e->target & POOL_INDEX_MASK) << 32) | e->target;
+            e->next = w->free_head;
+            w->free_head = id;
+            w->live--;
+        }
+        else {
+            zegar_wstaw(w, id);
+        }
+        id = next;
+    }
+
+    if (due_count > 1) {
+        qsort(w->due_keys, due_count, sizeof(uint64_t), zegar_porownaj_klucze);
+    }
+    return due_count;
+}
+
+/**
+ * @brief Odbudowuje koło czasowe z terminów zapisanych w obiektach gry (po przywróceniu migawki).
+ * * Koło nie jest częścią migawki - każdy obiekt pamięta swój termin, więc wystarczy zaplanować
+ * po jednym zdarzeniu na żywy obiekt.
+ * @param w Wskaźnik do koła czasowego.
+ * @param now Klatka symulacji zapisana w migawce.
+ */
+void zegar_odbuduj(TimingWheel* w, uint32_t now) {
+    zegar_resetuj(w, now);
+    if (player.invincible) {
+        zegar_zaplanuj(w, player.invincible_until, TIMER_INVINCIBILITY_END, HANDLE_NONE);
+    }
+    for (int i = 0; i < bomb_pool.used; i++) {
+        if (bombs[i].active) {
+            zegar_zaplanuj(w, bombs[i].exploding ? bombs[i].explosion_end_tick : bombs[i].fuse_tick, TIMER_BOMB, pula_uchwyt(&bomb_pool, i));
+        }
+    }
+    for (int i = 0; i < enemy_pool.used; i++) {
+        if (enemies[i].is_alive) {
+            zegar_zaplanuj(w, enemies[i].next_move_tick, TIMER_ENEMY_MOVE, pula_uchwyt(&enemy_pool, i));
+        }
+    }
+}
+
+/**
+ * @brief Obsługa zdarzenia TIMER_INVINCIBILITY_END: kończy nietykalność gracza.
+ * @param target Nieużywany (jest jeden gracz).
+ */
+void zdarzenie_koniec_nietykalnosci(EntityHandle target) {
+    (void)target;
+    if (player.invincible && player.invincible_until == timers.now) {
+        player.invincible = false;
+    }
+}
+
+/**
+ * @brief Obsługa zdarzenia TIMER_BOMB: wybuch tykającej bomby albo koniec efektu eksplozji
+ * (wtedy bomba wraca do puli).
+ * @param r Zestaw reguł gry.
+ * @param target Uchwyt bomby.
+ */
+RULES_INLINE void zdarzenie_bomby(const GameRules* r, EntityHandle target) {
+    Bomb* b = pula_pobierz(&bomb_pool, target);
+    if (!b) return;
+    if (!b->exploding && b->fuse_tick == timers.now) {
+        zdetonuj_bombe(r, b, &player, enemies, game_map, &current_game_state, &exit_revealed, exit_x, exit_y);
+    }
+    else if (b->exploding && b->explosion_end_tick == timers.now) {
+        b->active = false;
+        b->exploding = false;
+        pula_zwolnij(&bomb_pool, (int)(target & POOL_INDEX_MASK));
+    }
+}
+
+/**
+ * @brief Obsługa zdarzenia TIMER_ENEMY_MOVE: wznawia skrypt wroga i planuje jego kolejne wznowienie.
+ * * Wróg czekający w skrypcie nie kosztuje nic w klatkach, w których nie jest wznawiany.
+ * @param r Zestaw reguł gry.
+ * @param target Uchwyt wroga.
+ */
+RULES_INLINE void zdarzenie_ruchu_wroga(const GameRules* r, EntityHandle target) {
+    Enemy* e = pula_pobierz(&enemy_pool, target);
+    if (e && e->next_move_tick == timers.now) {
+        int delay = wrog_wznow_skrypt(r, (int)(target & POOL_INDEX_MASK));
+        e->next_move_tick = timers.now + (uint32_t)(delay > 0 ? delay : 1);
+        zegar_zaplanuj(&timers, e->next_move_tick, TIMER_ENEMY_MOVE, target);
+    }
+}
+
+
+// --- Funkcje rollbacku ---
+
+/**
+ * @brief Zwalnia bufory kopii pul w migawce.
+ * @param snap Wskaźnik do migawki.
+ */
+void migawka_zwolnij(GameSnapshot* snap) {
+    PoolImage* images[3] = { &snap->enemies, &snap->bombs, &snap->powerups };
+    for (int k = 0; k < 3; k++) {
+        free(images[k]->items);
+        free(images[k]->generations);
+        free(images[k]->next_free);
+        free(images[k]->live);
+        memset(images[k], 0, sizeof(PoolImage));
+    }
+}
+
+/**
+ * @brief Zapisuje pełny stan symulacji do migawki.
+ * @param snap Wskaźnik do migawki docelowej.
+ */
+void zapisz_stan_gry(GameSnapshot* snap) {
+    snap->map_journal = game_map->journal_head;
+    snap->sim_tick = timers.now;
+    snap->player = player;
+    pula_zapisz(&enemy_pool, &snap->enemies);
+    pula_zapisz(&bomb_pool, &snap->bombs);
+    pula_zapisz(&powerup_pool, &snap->powerups);
+    snap->exit_x = exit_x;
+    snap->exit_y = exit_y;
+    snap->exit_revealed = exit_revealed;
+    snap->rng_state = rng_state;
+    snap->game_state = current_game_state;
+    snap->hash = stan_skrot();
+}
+
+/**
+ * @brief Przywraca pełny stan symulacji z migawki.
+ * @param snap Wskaźnik do migawki źródłowej.
+ * @return false, jeśli mapy nie dało się cofnąć do chwili migawki; stan gry pozostaje wtedy bez zmian.
+ */
+bool przywroc_stan_gry(const GameSnapshot* snap) {
+    if (!mapa_cofnij_do(game_map, snap->map_journal)) return false;
+    player = snap->player;
+    pula_przywroc(&enemy_pool, &snap->enemies);
+    pula_przywroc(&bomb_pool, &snap->bombs);
+    pula_przywroc(&powerup_pool, &snap->powerups);
+    exit_x = snap->exit_x;
+    exit_y = snap->exit_y;
+    exit_revealed = snap->exit_revealed;
+    rng_state = snap->rng_state;
+    current_game_state = snap->game_state;
+    zegar_odbuduj(&timers, snap->sim_tick);
+    return true;
+}
+
+/**
+ * @brief Rozpoczyna nową sesję rollbacku od bieżącego stanu gry.
+ * * Czyści historię wejść i migawek oraz statystyki. Konfiguracja sesji
+ * (`remote_player`, `loopback_delay`) pozostaje bez zmian.
+ */
+void rollback_reset() {
+    rollback.tick = 0;
+    rollback.oldest_tick = 0;
+    rollback.rollback_to = -1;
+    for (int i = 0; i < ROLLBACK_RING_SIZE; i++) {
+        rollback.inputs[i] = INPUT_NONE;
+        rollback.confirmed[i] = false;
+        rollback.delayed_inputs[i] = INPUT_NONE;
+    }
+    rollback.stat_rollbacks = 0; rollback.stat_total_depth = 0; rollback.stat_max_depth = 0;
+    rollback.stat_total_cost = 0.0; rollback.stat_max_cost = 0.0;
+    rollback.stat_saves = 0; rollback.stat_save_time = 0.0;
+    rollback.stat_restores = 0; rollback.stat_restore_time = 0.0;
+    rollback.stat_late_inputs = 0;
+    rollback.stat_hash_mismatches = 0;
+    rollback.stat_refused = 0;
+}
+
+/**
+ * @brief Przewiduje wejście zdalnego gracza dla klatki, której wejście jeszcze nie dotarło.
+ * * Wejście gry to pojedyncze wciśnięcia (jeden kafelek na naciśnięcie), więc powtarzanie
+ * ostatniej akcji dublowałoby ruchy. Najlepszą prognozą jest brak akcji.
+ * @param last_input Ostatnie znane wejście zdalnego gracza.
+ * @return Przewidywane wejście.
+ */
+unsigned char rollback_przewiduj_wejscie(unsigned char last_input) {
+    (void)last_input;
+    return INPUT_NONE;
+}
+
+/**
+ * @brief Przyjmuje potwierdzone (np. odebrane z sieci) wejście dla podanej klatki.
+ * * Jeśli klatka została już zasymulowana z innym, przewidzianym wejściem, zaznacza
+ * ją do ponownej symulacji. Wejścia starsze niż ROLLBACK_MAX_TICKS są odrzucane.
+ * @param tick Numer klatki, której dotyczy wejście.
+ * @param input Potwierdzone wejście.
+ */
+void rollback_potwierdz_wejscie(int tick, unsigned char input) {
+    if (tick > rollback.tick) {
+        LOG_SYM("Rollback: input for future tick %d ignored (current %d)\n", tick, rollback.tick);
+        return;
+    }
+    if (tick < rollback.oldest_tick) {
+        rollback.stat_late_inputs++;
+        LOG_SYM("Rollback: input for tick %d arrived too late (oldest %d)\n", tick, rollback.oldest_tick);
+        return;
+    }
+
+    int slot = tick % ROLLBACK_RING_SIZE;
+    if (tick < rollback.tick && rollback.inputs[slot] != input) {
+        if (rollback.rollback_to < 0 || tick < rollback.rollback_to) {
+            rollback.rollback_to = tick;
+        }
+    }
+    rollback.inputs[slot] = input;
+    rollback.confirmed[slot] = true;
+}
+
+/**
+ * @brief Cofa symulację do najwcześniejszej błędnie przewidzianej klatki i symuluje ją ponownie.
+ * * Przywraca migawkę z początku klatki `rollback_to`, po czym odtwarza wszystkie klatki
+ * aż do bieżącej, zapisując po drodze nowe migawki. Nie potwierdzone wejścia są
+ * przewidywane ponownie. Mierzy głębokość i koszt cofnięcia.
+ */
+void rollback_wykonaj() {
+    if (rollback.rollback_to < 0) return;
+
+    int from = rollback.rollback_to;
+    int depth = rollback.tick - from;
+    double start = al_get_time();
+
+    if (!przywroc_stan_gry(&rollback.snapshots[from % ROLLBACK_RING_SIZE])) {
+        // Mapy nie da się cofnąć: gra toczy się dalej od bieżącego stanu, a okno cofania zaczyna się od nowa.
+        rollback.stat_refused++;
+        fprintf(stderr, "Rollback: map journal no longer reaches tick %d, rollback refused.\n", from);
+        rollback.oldest_tick = rollback.tick;
+        rollback.rollback_to = -1;
+        mapa_przytnij_dziennik(game_map, game_map->journal_head);
+        return;
+    }
+    double restored = al_get_time();
+    rollback.stat_restores++;
+    rollback.stat_restore_time += restored - start;
+
+    // Przywrócony stan musi mieć ten sam skrót, co w chwili zapisu - inaczej migawka lub dziennik mapy coś zgubiły.
+    if (stan_skrot() != rollback.snapshots[from % ROLLBACK_RING_SIZE].hash) {
+        rollback.stat_hash_mismatches++;
+        fprintf(stderr, "Rollback: state hash mismatch after restoring tick %d!\n", from);
+    }
+
+    rollback_resymulacja = true;
+    unsigned char last_input = INPUT_NONE;
+    for (int t = from; t < rollback.tick; t++) {
+        int slot = t % ROLLBACK_RING_SIZE;
+        if (t != from) {
+            zapisz_stan_gry(&rollback.snapshots[slot]);
+        }
+        if (rollback.confirmed[slot]) {
+            last_input = rollback.inputs[slot];
+        }
+        else {
+            rollback.inputs[slot] = rollback_przewiduj_wejscie(last_input);
+        }
+        krok_symulacji(rollback.inputs[slot]);
+    }
+    rollback_resymulacja = false;
+
+    double cost = al_get_time() - start;
+    rollback.stat_rollbacks++;
+    rollback.stat_total_depth += depth;
+    if (depth > rollback.stat_max_depth) rollback.stat_max_depth = depth;
+    rollback.stat_total_cost += cost;
+    if (cost > rollback.stat_max_cost) rollback.stat_max_cost = cost;
+    rollback.rollback_to = -1;
+}
+
+/**
+ * @brief Symuluje kolejną klatkę gry w ramach sesji rollbacku.
+ * * Wejście lokalnego gracza jest stosowane natychmiast. Gdy gracz jest sterowany zdalnie,
+ * jego wejście jest przewidywane, a po nadejściu potwierdzenia (rollback_potwierdz_wejscie)
+ * błędne klatki są cofane i symulowane ponownie - wszystko w ramach jednej klatki obrazu.
+ * W trybie testowym (`loopback_delay` > 0) wejście z klawiatury trafia do gry jak od
+ * zdalnego peera, z opóźnieniem `loopback_delay` klatek.
+ * @param local_input Wejście zebrane z klawiatury od ostatniej klatki.
+ */
+void rollback_krok(unsigned char local_input) {
+    int tick = rollback.tick;
+    int slot = tick % ROLLBACK_RING_SIZE;
+
+    if (rollback.loopback_delay > 0) {
+        rollback.delayed_inputs[slot] = local_input;
+        int delivered = tick - rollback.loopback_delay;
+        if (delivered >= 0) {
+            rollback_potwierdz_wejscie(delivered, rollback.delayed_inputs[delivered % ROLLBACK_RING_SIZE]);
+        }
+    }
+
+    rollback_wykonaj();
+
+    if (!rollback.remote_player) {
+        rollback.inputs[slot] = local_input;
+        rollback.confirmed[slot] = true;
+    }
+    else if (!rollback.confirmed[slot]) {
+        int prev_slot = (tick + ROLLBACK_RING_SIZE - 1) % ROLLBACK_RING_SIZE;
+        rollback.inputs[slot] = rollback_przewiduj_wejscie(rollback.inputs[prev_slot]);
+        rollback.confirmed[slot] = false;
+    }
+
+    double start = al_get_time();
+    zapisz_stan_gry(&rollback.snapshots[slot]);
+    rollback.stat_save_time += al_get_time() - start;
+    rollback.stat_saves++;
+
+    krok_symulacji(rollback.inputs[slot]);
+
+    rollback.tick++;
+    if (rollback.tick - rollback.oldest_tick > ROLLBACK_MAX_TICKS) {
+        rollback.oldest_tick = rollback.tick - ROLLBACK_MAX_TICKS;
+    }
+    mapa_przytnij_dziennik(game_map, rollback.snapshots[rollback.oldest_tick % ROLLBACK_RING_SIZE].map_journal);
+
+    int next_slot = rollback.tick % ROLLBACK_RING_SIZE;
+    rollback.confirmed[next_slot] = false;
+
+    // Migawka najstarszej klatki w oknie cofania nie zostanie już nadpisana, więc jej skrót jest ostateczny.
+    int settled = rollback.tick - ROLLBACK_MAX_TICKS;
+    if (settled >= 0) {
+        skrot_zapisz_klatke(settled, rollback.snapshots[settled % ROLLBACK_RING_SIZE].hash);
+        powtorka_dopisz(settled, rollback.inputs[settled % ROLLBACK_RING_SIZE]);
+    }
+
+    if (rollback.tick % ROLLBACK_REPORT_INTERVAL == 0) {
+        rollback_raport();
+    }
+}
+
+/**
+ * @brief Wypisuje statystyki rollbacku (głębokość i koszt cofnięć, koszt migawek) i je zeruje.
+ * * Raport jest pomijany, jeśli od ostatniego raportu nie było żadnego cofnięcia
+ * ani spóźnionego wejścia.
+ */
+void rollback_raport() {
+    if (rollback.stat_rollbacks > 0 || rollback.stat_late_inputs > 0 || rollback.stat_hash_mismatches > 0 || rollback.stat_refused > 0) {
+        double avg_depth = rollback.stat_rollbacks ? (double)rollback.stat_total_depth / rollback.stat_rollbacks : 0.0;
+        double avg_cost_us = rollback.stat_rollbacks ? rollback.stat_total_cost * 1e6 / rollback.stat_rollbacks : 0.0;
+        double save_ns = rollback.stat_saves ? rollback.stat_save_time * 1e9 / rollback.stat_saves : 0.0;
+        double restore_ns = rollback.stat_restores ? rollback.stat_restore_time * 1e9 / rollback.stat_restores : 0.0;
+        printf("Rollback @%d: %d rollbacks, depth avg %.2f max %d, cost avg %.1f us max %.1f us, "
+            "save %.0f ns, restore %.0f ns, snapshot %u B, late inputs %d, hash mismatches %d, refused %d\n",
+            rollback.tick, rollback.stat_rollbacks, avg_depth, rollback.stat_max_depth,
+            avg_cost_us, rollback.stat_max_cost * 1e6, save_ns, restore_ns,
+            (unsigned)sizeof(GameSnapshot), rollback.stat_late_inputs, rollback.stat_hash_mismatches, rollback.stat_refused);
+    }
+    rollback.stat_rollbacks = 0; rollback.stat_total_depth = 0; rollback.stat_max_depth = 0;
+    rollback.stat_total_cost = 0.0; rollback.stat_max_cost = 0.0;
+    rollback.stat_saves = 0; rollback.stat_save_time = 0.0;
+    rollback.stat_restores = 0; rollback.stat_restore_time = 0.0;
+    rollback.stat_late_inputs = 0;
+    rollback.stat_hash_mismatches = 0;
+    rollback.stat_refused = 0;
+}
+
+// --- Funkcje skrótu stanu gry ---
+
+/**
+ * @brief Wyznacza klucz Zobrista dla pary wartości.
+ * * Klucze nie są trzymane w tablicy (mapa może być dowolnie duża), tylko wyliczane funkcją
+ * mieszającą splitmix64 - ten sam składnik stanu zawsze dostaje ten sam pseudolosowy klucz.
+ * @param a Pierwsza wartość (zwykle rodzaj składnika i jego identyfikator).
+ * @param b Druga wartość.
+ * @return 64-bitowy klucz.
+ */
+uint64_t zobrist_klucz(uint64_t a, uint64_t b) {
+    uint64_t z = a + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    z += b + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Zwraca klucz Zobrista kafelka danego typu na danym polu.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ * @param type Typ kafelka (TILE_TYPE).
+ * @return Klucz kafelka.
+ */
+uint64_t zobrist_kafelek(int x, int y, int type) {
+    return zobrist_klucz(((uint64_t)ZOBRIST_TILE << 56) | (uint32_t)type, ((uint64_t)(uint32_t)y << 32) | (uint32_t)x);
+}
+
+/**
+ * @brief Zwraca klucz Zobrista składnika stanu opisanego listą pól.
+ * @param kind Rodzaj składnika.
+ * @param id Identyfikator składnika (np. generacja i indeks slotu puli).
+ * @param fields Wartości pól składnika.
+ * @param count Liczba pól.
+ * @return Klucz składnika.
+ */
+uint64_t zobrist_skladnik(ZOBRIST_KIND kind, uint64_t id, const uint32_t* fields, int count) {
+    // Pola są najpierw składane tanim skrótem FNV-1a, a dopiero wynik jest mieszany z identyfikatorem.
+    uint64_t v = 0xCBF29CE484222325ull;
+    for (int i = 0; i < count; i++) {
+        v = (v ^ fields[i]) * 0x100000001B3ull;
+    }
+    return zobrist_klucz(((uint64_t)kind << 56) | id, v);
+}
+
+/**
+ * @brief Wyznacza 64-bitowy skrót Zobrista pełnego stanu symulacji.
+ * * Skrót kafelków jest utrzymywany przyrostowo w `game_map->hash` (zmiana kafelka to dwa XOR-y),
+ * więc koszt nie zależy od rozmiaru mapy. Klucze gracza, zajętych slotów pul oraz stanu globalnego
+ * (wyjście, generator liczb losowych, klatka, stan gry) są łączone XOR-em w czasie O(liczba obiektów).
+ * Kolor wrogów i power-upów jest pomijany - wynika z typu obiektu i nie wpływa na symulację.
+ * @return Skrót stanu gry.
+ */
+uint64_t stan_skrot() {
+    uint64_t h = game_map->hash;
+    uint32_t f[BLAST_DIRECTIONS + 8];
+
+    f[0] = (uint32_t)player.x; f[1] = (uint32_t)player.y;
+    f[2] = (uint32_t)player.lives; f[3] = (uint32_t)player.score;
+    f[4] = player.is_alive | (player.invincible << 1) | ((uint32_t)player.direction << 2);
+    f[5] = player.invincible_until;
+    f[6] = (uint32_t)player.current_max_bombs; f[7] = (uint32_t)player.current_bomb_radius;
+    h ^= zobrist_skladnik(ZOBRIST_PLAYER, 0, f, 8);
+
+    for (int i = 0; i < enemy_pool.used; i++) {
+        if (!enemy_pool.live[i]) continue;
+        const Enemy* e = &enemies[i];
+        f[0] = (uint32_t)e->x; f[1] = (uint32_t)e->y;
+        f[2] = e->is_alive | ((uint32_t)e->direction << 1) | ((uint32_t)e->script << 3);
+        f[3] = e->next_move_tick;
+        f[4] = (uint32_t)e->script_pc; f[5] = (uint32_t)e->script_counter;
+        f[6] = (uint32_t)e->wait_x; f[7] = (uint32_t)e->wait_y; f[8] = e->wait_deadline;
+        h ^= zobrist_skladnik(ZOBRIST_ENEMY, ((uint64_t)enemy_pool.generations[i] << 32) | (uint32_t)i, f, 9);
+    }
+    for (int i = 0; i < bomb_pool.used; i++) {
+        if (!bomb_pool.live[i]) continue;
+        const Bomb* b = &bombs[i];
+        f[0] = (uint32_t)b->x; f[1] = (uint32_t)b->y;
+        f[2] = b->fuse_tick; f[3] = b->explosion_end_tick;
+        f[4] = (uint32_t)b->radius;
+        f[5] = b->active | (b->exploding << 1) | (b->blast_centre << 2);
+        for (int d = 0; d < BLAST_DIRECTIONS; d++) f[6 + d] = b->blast_len[d];
+        h ^= zobrist_skladnik(ZOBRIST_BOMB, ((uint64_t)bomb_pool.generations[i] << 32) | (uint32_t)i, f, 6 + BLAST_DIRECTIONS);
+    }
+    for (int i = 0; i < powerup_pool.used; i++) {
+        if (!powerup_pool.live[i]) continue;
+        const Powerup* pu = &powerups[i];
+        f[0] = (uint32_t)pu->x; f[1] = (uint32_t)pu->y;
+        f[2] = pu->is_active | ((uint32_t)pu->type << 1);
+        h ^= zobrist_skladnik(ZOBRIST_POWERUP, ((uint64_t)powerup_pool.generations[i] << 32) | (uint32_t)i, f, 3);
+    }
+
+    // Stan list wolnych slotów decyduje o tym, które sloty dostaną kolejne obiekty.
+    f[0] = (uint32_t)exit_x; f[1] = (uint32_t)exit_y;
+    f[2] = exit_revealed | ((uint32_t)current_game_state << 1);
+    f[3] = rng_state; f[4] = timers.now;
+    f[5] = (uint32_t)enemy_pool.free_head ^ ((uint32_t)enemy_pool.used << 16);
+    f[6] = (uint32_t)bomb_pool.free_head ^ ((uint32_t)bomb_pool.used << 16);
+    f[7] = (uint32_t)powerup_pool.free_head ^ ((uint32_t)powerup_pool.used << 16);
+    h ^= zobrist_skladnik(ZOBRIST_GLOBAL, 0, f, 8);
+    return h;
+}
+
+/**
+ * @brief Dopisuje skrót stanu z początku klatki do dziennika skrótów (--hash-log=PLIK).
+ * * Każda linia to numer klatki i skrót szesnastkowo. Dwa uruchomienia z tym samym ziarnem
+ * (--seed=N) i wejściem dają identyczne dzienniki, więc pierwsza różniąca się linia wskazuje
+ * pierwszą rozbieżną klatkę. Nowa gra zaczyna numerację od zera.
+ * @param tick Numer klatki.
+ * @param hash Skrót stanu z początku klatki.
+ */
+void skrot_zapisz_klatke(int tick, uint64_t hash) {
+    if (!hash_log) return;
+    fprintf(hash_log, "%d %016llx\n", tick, (unsigned long long)hash);
+}
+
+
+// --- Funkcje telemetrii ---
+
+/**
+ * @brief Otwiera plik biblioteki standardowej C.
+ * * Pod MSVC korzysta z fopen_s, bo przy /sdl zwykłe fopen jest błędem kompilacji (C4996).
+ * @param path Ścieżka do pliku.
+ * @param mode Tryb jak dla fopen.
+ * @return Otwarty plik albo NULL.
+ */
+FILE* plik_otworz(const char* path, const char* mode) {
+#if defined(_MSC_VER)
+    FILE* f = NULL;
+    if (fopen_s(&f, path, mode) != 0) return NULL;
+    return f;
+#else
+    return fopen(path, mode);
+#endif
+}
+
+/**
+ * @brief Włącza telemetrię z eksportem do podanego pliku.
+ * @param path Plik z liniami JSON; obok powstaje plik `path`.prom w formacie Prometheusa.
+ * @return false, jeśli ścieżka jest za długa.
+ */
+bool metryki_init(const char* path) {
+    if (strlen(path) >= METRICS_PATH_MAX) return false;
+    memset(&metrics, 0, sizeof(metrics));
+    snprintf(metrics.path, sizeof(metrics.path), "%s", path);
+    snprintf(metrics.prom_path, sizeof(metrics.prom_path), "%s.prom", path);
+    metrics.enabled = true;
+    metrics.start_time = al_get_time();
+    metrics.last_export = metrics.start_time;
+    return true;
+}
+
+/**
+ * @brief Dodaje pomiar czasu do histogramu.
+ * @param h Wskaźnik do histogramu.
+ * @param seconds Zmierzony czas w sekundach.
+ */
+void metryki_histogram_dodaj(MetricsHistogram* h, double seconds) {
+    int bucket = 0;
+    double bound = 16e-6;
+    while (bucket < METRICS_BUCKETS - 1 && seconds > bound) {
+        bucket++;
+        bound *= 2.0;
+    }
+    h->buckets[bucket]++;
+    h->count++;
+    h->sum += seconds;
+    if (seconds > h->interval_max) h->interval_max = seconds;
+}
+
+/**
+ * @brief Mierzy zaległość kolejki zdarzeń; wywoływana po obsłużeniu każdego zdarzenia.
+ * * Allegro nie podaje długości kolejki, więc liczona jest seria zdarzeń obsłużonych
+ * bez ponownego czekania w al_wait_for_event - tyle czekało w kolejce po przebudzeniu.
+ * @param queue Kolejka zdarzeń pętli głównej.
+ */
+void metryki_zdarzenie(ALLEGRO_EVENT_QUEUE* queue) {
+    if (!metrics.enabled) return;
+    metrics.queue_run++;
+    if (al_is_event_queue_empty(queue)) {
+        if (metrics.queue_run > metrics.queue_depth_max) metrics.queue_depth_max = metrics.queue_run;
+        metrics.queue_depth_sum += metrics.queue_run;
+        metrics.queue_wakes++;
+        metrics.queue_run = 0;
+    }
+}
+
+/**
+ * @brief Zwraca liczbę bajtów zajmowanych przez pulę obiektów.
+ * @param pool Wskaźnik do puli.
+ * @return Rozmiar elementów i tablic pomocniczych puli.
+ */
+size_t metryki_pamiec_puli(const EntityPool* pool) {
+    return (size_t)pool->capacity * (pool->item_size + sizeof(*pool->generations) + sizeof(*pool->next_free) + sizeof(*pool->live));
+}
+
+/**
+ * @brief Zapisuje histogram jako obiekt JSON (czasy w mikrosekundach).
+ * @param f Plik docelowy.
+ * @param name Nazwa pola.
+ * @param h Wskaźnik do histogramu.
+ */
+void metryki_histogram_json(FILE* f, const char* name, const MetricsHistogram* h) {
+    fprintf(f, "\"%s\":{\"count\":%llu,\"mean_us\":%.1f,\"max_us\":%.1f,\"buckets\":[", name,
+        (unsigned long long)h->count, h->count ? h->sum * 1e6 / h->count : 0.0, h->interval_max * 1e6);
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        fprintf(f, "%s%llu", i ? "," : "", (unsigned long long)h->buckets[i]);
+    }
+    fprintf(f, "]}");
+}
+
+/**
+ * @brief Zapisuje histogram w formacie tekstowym Prometheusa (przedziały skumulowane, czasy w sekundach).
+ * @param f Plik docelowy.
+ * @param name Nazwa metryki.
+ * @param help Opis metryki.
+ * @param h Wskaźnik do histogramu.
+ */
+void metryki_histogram_prom(FILE* f, const char* name, const char* help, const MetricsHistogram* h) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    uint64_t cumulative = 0;
+    double bound = 16e-6;
+    for (int i = 0; i < METRICS_BUCKETS - 1; i++, bound *= 2.0) {
+        cumulative += h->buckets[i];
+        fprintf(f, "%s_bucket{le=\"%g\"} %llu\n", name, bound, (unsigned long long)cumulative);
+    }
+    fprintf(f, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)h->count);
+    fprintf(f, "%s_sum %.9f\n%s_count %llu\n", name, h->sum, name, (unsigned long long)h->count);
+}
+
+/**
+ * @brief Eksportuje metryki: dopisuje linię JSON i podmienia plik Prometheusa.
+ * * Plik Prometheusa jest zapisywany do pliku tymczasowego i podmieniany, więc czytelnik
+ * (np. node_exporter z kolektorem textfile) nigdy nie widzi połowy pliku. Wartości "na minutę"
+ * i maksima dotyczą okresu od poprzedniego eksportu.
+ */
+void metryki_eksportuj() {
+    if (!metrics.enabled) return;
+    double now = al_get_time();
+    double minutes = (now - metrics.last_export) / 60.0;
+
+    uint64_t planted = 0, detonated = 0;
+    for (int t = 0; t < METRICS_MAX_THREADS; t++) {
+        planted += metrics.threads[t].bombs_planted;
+        detonated += metrics.threads[t].bombs_detonated;
+    }
+    double planted_rate = minutes > 0.0 ? (planted - metrics.last_planted) / minutes : 0.0;
+    double detonated_rate = minutes > 0.0 ? (detonated - metrics.last_detonated) / minutes : 0.0;
+    double queue_mean = metrics.queue_wakes ? (double)metrics.queue_depth_sum / metrics.queue_wakes : 0.0;
+
+    struct { const char* name; size_t bytes; } memory[] = {
+        { "enemies",   metryki_pamiec_puli(&enemy_pool) },
+        { "bombs",     metryki_pamiec_puli(&bomb_pool) },
+        { "powerups",  metryki_pamiec_puli(&powerup_pool) },
+        { "map",       sizeof(*game_map) + (size_t)game_map->slot_count * sizeof(MapChunk) + (size_t)game_map->chunks_x * game_map->chunks_y * sizeof(MapChunkEntry) },
+        { "particles", sizeof(particles) + sizeof(particle_vertices) + sizeof(particle_indices) },
+        { "rollback",  sizeof(rollback) },
+        { "timers",    sizeof(timers) },
+        { "blasts",    (size_t)blasts.capacity * (sizeof(BlastRays) + sizeof(int)) }
+    };
+    int memory_count = (int)(sizeof(memory) / sizeof(memory[0]));
+    size_t memory_total = 0;
+    for (int i = 0; i < memory_count; i++) memory_total += memory[i].bytes;
+
+    FILE* f = plik_otworz(metrics.path, "a");
+    if (f) {
+        fprintf(f, "{\"uptime_s\":%.1f,\"tick\":%d,", now - metrics.start_time, rollback.tick);
+        metryki_histogram_json(f, "tick_time", &metrics.tick_time);
+        fputc(',', f);
+        metryki_histogram_json(f, "frame_time", &metrics.frame_time);
+        fprintf(f, ",\"entities\":{\"enemies\":%d,\"bombs\":%d,\"powerups\":%d,\"particles\":%d,\"walls\":%d}",
+            enemy_pool.count, bomb_pool.count, powerup_pool.count, particles.count, game_map->walls);
+        fprintf(f, ",\"bombs_planted\":%llu,\"bombs_detonated\":%llu,\"bombs_planted_per_min\":%.1f,\"bombs_detonated_per_min\":%.1f",
+            (unsigned long long)planted, (unsigned long long)detonated, planted_rate, detonated_rate);
+        fprintf(f, ",\"event_queue_depth\":{\"max\":%d,\"mean\":%.2f}", metrics.queue_depth_max, queue_mean);
+        fprintf(f, ",\"memory_bytes\":{");
+        for (int i = 0; i < memory_count; i++) {
+            fprintf(f, "%s\"%s\":%zu", i ? "," : "", memory[i].name, memory[i].bytes);
+        }
+        fprintf(f, ",\"total\":%zu}}\n", memory_total);
+        fclose(f);
+    }
+
+    char tmp_path[METRICS_PATH_MAX + 16];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics.prom_path);
+    f = plik_otworz(tmp_path, "w");
+    if (f) {
+        metryki_histogram_prom(f, "bomberman_tick_seconds", "Simulation tick duration, including rollback re-simulation.", &metrics.tick_time);
+        metryki_histogram_prom(f, "bomberman_frame_seconds", "Frame render duration, including al_flip_display.", &metrics.frame_time);
+        fprintf(f, "# HELP bomberman_entities Live entities by type.\n# TYPE bomberman_entities gauge\n");
+        fprintf(f, "bomberman_entities{type=\"enemy\"} %d\n", enemy_pool.count);
+        fprintf(f, "bomberman_entities{type=\"bomb\"} %d\n", bomb_pool.count);
+        fprintf(f, "bomberman_entities{type=\"powerup\"} %d\n", powerup_pool.count);
+        fprintf(f, "bomberman_entities{type=\"particle\"} %d\n", particles.count);
+        if (game_map->walls >= 0) fprintf(f, "bomberman_entities{type=\"wall\"} %d\n", game_map->walls);
+        fprintf(f, "# HELP bomberman_bombs_planted_total Bombs planted.\n# TYPE bomberman_bombs_planted_total counter\n");
+        fprintf(f, "bomberman_bombs_planted_total %llu\n", (unsigned long long)planted);
+        fprintf(f, "# HELP bomberman_bombs_detonated_total Bombs detonated.\n# TYPE bomberman_bombs_detonated_total counter\n");
+        fprintf(f, "bomberman_bombs_detonated_total %llu\n", (unsigned long long)detonated);
+        fprintf(f, "# HELP bomberman_blast_rays_total Bombs whose blast rays were computed, by thread.\n# TYPE bomberman_blast_rays_total counter\n");
+        for (int t = 0; t <= blasts.workers && t < METRICS_MAX_THREADS; t++) {
+            fprintf(f, "bomberman_blast_rays_total{thread=\"%d\"} %llu\n", t, (unsigned long long)metrics.threads[t].blast_rays);
+        }
+        fprintf(f, "# HELP bomberman_event_queue_depth Events waiting in the main loop queue after a wake-up, since the last export.\n# TYPE bomberman_event_queue_depth gauge\n");
+        fprintf(f, "bomberman_event_queue_depth{stat=\"max\"} %d\n", metrics.queue_depth_max);
+        fprintf(f, "bomberman_event_queue_depth{stat=\"mean\"} %.2f\n", queue_mean);
+        fprintf(f, "# HELP bomberman_memory_bytes Memory held by game subsystems.\n# TYPE bomberman_memory_bytes gauge\n");
+        for (int i = 0; i < memory_count; i++) {
+            fprintf(f, "bomberman_memory_bytes{subsystem=\"%s\"} %zu\n", memory[i].name, memory[i].bytes);
+        }
+        fclose(f);
+        remove(metrics.prom_path);
+        rename(tmp_path, metrics.prom_path);
+    }
+
+    metrics.last_export = now;
+    metrics.last_planted = planted;
+    metrics.last_detonated = detonated;
+    metrics.tick_time.interval_max = 0.0;
+    metrics.frame_time.interval_max = 0.0;
+    metrics.queue_depth_max = 0;
+    metrics.queue_depth_sum = 0;
+    metrics.queue_wakes = 0;
+}
+
+// --- Funkcje dźwięku ---
+
+/**
+ * @brief Otwiera muzykę tła jako strumień odtwarzany w pętli.
+ * * W pamięci są tylko bufory strumienia; kolejne fragmenty pliku są dekodowane w trakcie
+ * odtwarzania, więc start gry nie czeka na zdekodowanie całego utworu.
+ * @param mixer Mikser, do którego zostanie przypięty strumień.
+ * @return true, jeśli strumień jest gotowy.
+ */
+bool muzyka_zaladuj(ALLEGRO_MIXER* mixer) {
+    background_music_stream = al_load_audio_stream("Background_Music.ogg", MUSIC_STREAM_BUFFERS, MUSIC_STREAM_FRAGMENT);
+    if (!background_music_stream) {
+        fprintf(stderr, "Failed to open Background_Music.ogg stream!\n");
+        return false;
+    }
+    al_set_audio_stream_playmode(background_music_stream, ALLEGRO_PLAYMODE_LOOP);
+    al_set_audio_stream_gain(background_music_stream, MUSIC_GAIN);
+    al_set_audio_stream_playing(background_music_stream, false);
+    if (!al_attach_audio_stream_to_mixer(background_music_stream, mixer)) {
+        fprintf(stderr, "Failed to attach background music stream!\n");
+        al_destroy_audio_stream(background_music_stream);
+        background_music_stream = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Wznawia lub wstrzymuje muzykę tła.
+ * @param playing true - odtwarzaj, false - wstrzymaj.
+ */
+void muzyka_odtwarzaj(bool playing) {
+    if (background_music_stream && al_get_audio_stream_playing(background_music_stream) != playing) {
+        al_set_audio_stream_playing(background_music_stream, playing);
+    }
+}
+
+/**
+ * @brief Syntetyzuje efekt dźwiękowy danego rodzaju do bufora PCM (16 bitów, mono).
+ * * Używane, gdy obok gry nie ma pliku z efektem. Szum wybuchu ma własny generator,
+ * dzięki czemu nie zmienia stanu losuj() używanego przez symulację.
+ * @param kind Rodzaj efektu.
+ * @return Próbka z własnym buforem lub NULL przy błędzie.
+ */
+ALLEGRO_SAMPLE* dzwiek_syntezuj(SFX_KIND kind) {
+    const float two_pi = 6.2831853f;
+    unsigned int length = (unsigned int)(sfx_kinds[kind].duration * SFX_FREQUENCY);
+    int16_t* pcm = malloc(length * sizeof(int16_t));
+    if (!pcm) return NULL;
+
+    uint32_t noise = 0x9E3779B9u;
+    float phase = 0.0f, low = 0.0f;
+    for (unsigned int i = 0; i < length; i++) {
+        float t = (float)i / SFX_FREQUENCY;
+        float progress = (float)i / length;
+        float v = 0.0f;
+        noise ^= noise << 13; noise ^= noise >> 17; noise ^= noise << 5;
+        float white = (float)(noise & 0xFFFF) / 32768.0f - 1.0f;
+        switch (kind) {
+        case SFX_PLANT:
+            phase += two_pi * (660.0f - 330.0f * progress) / SFX_FREQUENCY;
+            v = (sinf(phase) > 0.0f ? 1.0f : -1.0f) * (1.0f - progress);
+            break;
+        case SFX_EXPLODE:
+            low += (white - low) * (0.25f - 0.2f * progress);
+            v = (low * 2.0f + 0.6f * sinf(two_pi * 55.0f * t)) * expf(-6.0f * t);
+            break;
+        case SFX_PICKUP: {
+            static const float notes[3] = { 523.25f, 659.25f, 783.99f };
+            phase += two_pi * notes[(int)(progress * 3.0f) % 3] / SFX_FREQUENCY;
+            v = sinf(phase) * (1.0f - 0.5f * progress);
+            break;
+        }
+        case SFX_HIT:
+            phase += two_pi * (220.0f - 110.0f * progress) / SFX_FREQUENCY;
+            v = (fmodf(phase / two_pi, 1.0f) * 2.0f - 1.0f) * (1.0f - progress);
+            break;
+        case SFX_ENEMY_DEATH:
+            phase += two_pi * (440.0f - 330.0f * progress) / SFX_FREQUENCY;
+            v = (sinf(phase) > 0.0f ? 1.0f : -1.0f) * (0.6f + 0.4f * sinf(two_pi * 30.0f * t)) * (1.0f - progress);
+            break;
+        default:
+            break;
+        }
+        if (v > 1.0f) v = 1.0f;
+        if (v < -1.0f) v = -1.0f;
+        pcm[i] = (int16_t)(v * 32767.0f);
+    }
+
+    ALLEGRO_SAMPLE* sample = al_create_sample(pcm, length, SFX_FREQUENCY, ALLEGRO_AUDIO_DEPTH_INT16, ALLEGRO_CHANNEL_CONF_1, true);
+    if (!sample) free(pcm);
+    return sample;
+}
+
+/**
+ * @brief Dekoduje wszystkie efekty do pamięci i tworzy pulę głosów.
+ * * Efekt jest wczytywany z pliku (sfx_kinds[].file), a gdy go brak - syntetyzowany. Każdy głos
+ * ma na stałe przypisaną próbkę i jest przypięty do miksera, więc uruchomienie efektu w trakcie gry
+ * to tylko przewinięcie i włączenie istniejącego głosu.
+ * @param mixer Mikser, do którego trafią głosy.
+ * @return true, jeśli wszystkie efekty i głosy są gotowe.
+ */
+bool dzwieki_init(ALLEGRO_MIXER* mixer) {
+    memset(&sfx, 0, sizeof(sfx));
+    for (int k = 0; k < SFX_COUNT; k++) {
+        sfx.samples[k] = al_load_sample(sfx_kinds[k].file);
+        if (!sfx.samples[k]) sfx.samples[k] = dzwiek_syntezuj((SFX_KIND)k);
+        if (!sfx.samples[k]) {
+            fprintf(stderr, "Failed to prepare sound effect %s!\n", sfx_kinds[k].name);
+            return false;
+        }
+        for (int v = 0; v < sfx_kinds[k].voices && v < SFX_MAX_VOICES; v++) {
+            ALLEGRO_SAMPLE_INSTANCE* voice = al_create_sample_instance(sfx.samples[k]);
+            if (!voice) {
+                fprintf(stderr, "Failed to create sound effect voice!\n");
+                return false;
+            }
+            sfx.voices[k][v] = voice;
+            al_set_sample_instance_playmode(voice, ALLEGRO_PLAYMODE_ONCE);
+            if (!al_attach_sample_instance_to_mixer(voice, mixer)) {
+                fprintf(stderr, "Failed to attach sound effect voice!\n");
+                return false;
+            }
+        }
+    }
+    sfx.ready = true;
+    return true;
+}
+
+/**
+ * @brief Zgłasza efekt dźwiękowy z symulacji.
+ * * Tylko zwiększa licznik, więc jest bezpieczne w każdej ścieżce symulacji. Klatki powtarzane
+ * po rollbacku nie zgłaszają efektów ponownie.
+ * @param kind Rodzaj efektu.
+ */
+void dzwiek_zglos(SFX_KIND kind) {
+    if (!rollback_resymulacja) {
+        sfx.requested[kind]++;
+    }
+}
+
+/**
+ * @brief Zamienia zgłoszenia z ostatniej klatki na brzmiące głosy.
+ * * Dla każdego rodzaju uruchamiany jest jeden głos - wolny albo, gdy wszystkie brzmią,
+ * najdawniej uruchomiony. Kolejne zgłoszenia z tej samej klatki podnoszą jego głośność
+ * (do dwukrotności), zamiast nakładać identyczne, zsynchronizowane kopie dźwięku.
+ */
+void dzwieki_odtworz_zgloszone() {
+    for (int k = 0; k < SFX_COUNT; k++) {
+        int count = sfx.requested[k];
+        sfx.requested[k] = 0;
+        if (count == 0 || !sfx.ready) continue;
+
+        int pick = 0;
+        bool stolen = true;
+        for (int v = 0; v < sfx_kinds[k].voices; v++) {
+            if (!al_get_sample_instance_playing(sfx.voices[k][v])) {
+                pick = v;
+                stolen = false;
+                break;
+            }
+            if (sfx.started[k][v] < sfx.started[k][pick]) pick = v;
+        }
+
+        ALLEGRO_SAMPLE_INSTANCE* voice = sfx.voices[k][pick];
+        if (stolen) al_set_sample_instance_playing(voice, false);
+        al_set_sample_instance_position(voice, 0);
+        al_set_sample_instance_gain(voice, sfx_kinds[k].gain * fminf(2.0f, sqrtf((float)count)));
+        al_set_sample_instance_playing(voice, true);
+        sfx.started[k][pick] = ++sfx.sequence;
+
+        sfx.stat_played++;
+        sfx.stat_stolen += stolen;
+        sfx.stat_merged += count - 1;
+    }
+}
+
+/**
+ * @brief Wypisuje statystyki puli głosów i zeruje liczniki.
+ */
+void dzwieki_raport() {
+    if (!sfx.ready) return;
+    printf("Audio: %d voices started, %d stolen, %d requests merged\n", sfx.stat_played, sfx.stat_stolen, sfx.stat_merged);
+    sfx.stat_played = 0;
+    sfx.stat_stolen = 0;
+    sfx.stat_merged = 0;
+}
+
+/**
+ * @brief Zwalnia głosy i zdekodowane efekty.
+ */
+void dzwieki_zwolnij() {
+    for (int k = 0; k < SFX_COUNT; k++) {
+        for (int v = 0; v < SFX_MAX_VOICES; v++) {
+            if (sfx.voices[k][v]) al_destroy_sample_instance(sfx.voices[k][v]);
+            sfx.voices[k][v] = NULL;
+        }
+        if (sfx.samples[k]) al_destroy_sample(sfx.samples[k]);
+        sfx.samples[k] = NULL;
+    }
+    sfx.ready = false;
+}
+
+// --- Funkcje wejścia o niskim opóźnieniu ---
+
+/**
+ * @brief Próbkuje stan klawiatury tuż przed klatką symulacji (tryb niskich opóźnień).
+ * * Uzupełnia wejście zebrane ze zdarzeń o ruch z przytrzymanego klawisza kierunku,
+ * powtarzany co `latency.repeat_ticks` klatek. Krótkie stuknięcia między próbkami
+ * nadal obsługuje obsluz_wejscie, które zeruje licznik powtórzeń.
+ * @param input Wskaźnik do wejścia bieżącej klatki (modyfikowany).
+ */
+void probkuj_klawiature(unsigned char* input) {
+    ALLEGRO_KEYBOARD_STATE ks;
+    al_get_keyboard_state(&ks);
+
+    unsigned char held = INPUT_NONE;
+    if (al_key_down(&ks, ALLEGRO_KEY_UP) || al_key_down(&ks, ALLEGRO_KEY_W)) held = INPUT_UP;
+    else if (al_key_down(&ks, ALLEGRO_KEY_DOWN) || al_key_down(&ks, ALLEGRO_KEY_S)) held = INPUT_DOWN;
+    else if (al_key_down(&ks, ALLEGRO_KEY_LEFT) || al_key_down(&ks, ALLEGRO_KEY_A)) held = INPUT_LEFT;
+    else if (al_key_down(&ks, ALLEGRO_KEY_RIGHT) || al_key_down(&ks, ALLEGRO_KEY_D)) held = INPUT_RIGHT;
+
+    if (held == INPUT_NONE || (*input & INPUT_DIRECTIONS)) {
+        latency.held_ticks = 0;
+        return;
+    }
+
+    latency.held_ticks++;
+    if (latency.held_ticks >= latency.repeat_ticks) {
+        *input = (unsigned char)((*input & ~INPUT_DIRECTIONS) | held);
+        latency.held_ticks = 0;
+    }
+}
+
+/**
+ * @brief Rejestruje pomiar opóźnienia po zakończeniu al_flip_display.
+ * * Jeśli wyświetlona klatka zawiera efekt klawisza ze znacznikiem czasu `in_flight_ts`,
+ * dolicza czas od zdarzenia klawiatury do teraz. Co LATENCY_REPORT_INTERVAL klatek
+ * wypisuje średnie, minimalne i maksymalne opóźnienie.
+ */
+void opoznienie_po_flipie() {
+    if (latency.in_flight_ts >= 0) {
+        double sample = al_get_time() - latency.in_flight_ts;
+        if (latency.samples == 0 || sample < latency.min) latency.min = sample;
+        if (latency.samples == 0 || sample > latency.max) latency.max = sample;
+        latency.total += sample;
+        latency.samples++;
+        latency.in_flight_ts = -1.0;
+    }
+
+    latency.frames++;
+    if (latency.frames >= LATENCY_REPORT_INTERVAL) {
+        if (latency.samples > 0) {
+            printf("Input latency (%s, vsync %s): %d samples, avg %.2f ms, min %.2f ms, max %.2f ms\n",
+                latency.enabled ? "low-latency" : "default", latency.vsync_off ? "off" : "on",
+                latency.samples, latency.total * 1000.0 / latency.samples, latency.min * 1000.0, latency.max * 1000.0);
+        }
+        latency.samples = 0;
+        latency.total = 0.0;
+        latency.frames = 0;
+    }
+}
+
+
+// --- Funkcje systemu cząsteczek ---
+
+/**
+ * @brief Przygotowuje pulę cząsteczek i stałą tablicę indeksów trójkątów.
+ * * Każda cząsteczka to czworokąt z wierzchołków 4*i..4*i+3, rysowany jako dwa trójkąty.
+ */
+void czasteczki_init() {
+    particles.count = 0;
+    for (int i = 0; i < PARTICLE_CAPACITY; i++) {
+        particle_indices[i * 6 + 0] = i * 4 + 0;
+        particle_indices[i * 6 + 1] = i * 4 + 1;
+        particle_indices[i * 6 + 2] = i * 4 + 2;
+        particle_indices[i * 6 + 3] = i * 4 + 0;
+        particle_indices[i * 6 + 4] = i * 4 + 2;
+        particle_indices[i * 6 + 5] = i * 4 + 3;
+    }
+}
+
+/**
+ * @brief Emituje iskry ze wszystkich kafelków objętych eksplozją bomby.
+ * * Przechodzi po środku i czterech odcinkach eksplozji (promienie nie obejmują ścian
+ * niezniszczalnych, więc mapa nie jest sprawdzana).
+ * @param b Wskaźnik do wybuchającej bomby (z wyznaczonymi promieniami eksplozji).
+ */
+void czasteczki_emituj_eksplozje(Bomb* b) {
+    if (b->blast_centre) {
+        czasteczki_emituj_pole(b->x, b->y);
+    }
+    for (int dir = 0; dir < BLAST_DIRECTIONS; dir++) {
+        for (int dist = 1; dist <= b->blast_len[dir]; dist++) {
+            czasteczki_emituj_pole(b->x + blast_dx[dir] * dist, b->y + blast_dy[dir] * dist);
+        }
+    }
+}
+
+/**
+ * @brief Emituje iskry z jednego kafelka eksplozji.
+ * * Iskry mają losowy kierunek, prędkość i odcień (od żółtego do czerwonego) ustalane raz,
+ * przy emisji, więc eksplozja nie migocze z klatki na klatkę. Gdy pula jest pełna,
+ * nadmiarowe iskry są pomijane.
+ * @param cx Współrzędna X kafelka.
+ * @param cy Współrzędna Y kafelka.
+ */
+void czasteczki_emituj_pole(int cx, int cy) {
+    for (int n = 0; n < PARTICLES_PER_CELL && particles.count < PARTICLE_CAPACITY; n++) {
+        int i = particles.count++;
+        float angle = (float)(rand() % 360) * (float)ALLEGRO_PI / 180.0f;
+        float speed = 0.3f + (float)(rand() % 100) / 100.0f * 1.7f;
+        float heat = (float)(rand() % 100) / 100.0f;
+
+        particles.x[i] = cx * TILE_SIZE + TILE_SIZE / 2.0f + (float)(rand() % TILE_SIZE - TILE_SIZE / 2) * 0.5f;
+        particles.y[i] = cy * TILE_SIZE + TILE_SIZE / 2.0f + (float)(rand() % TILE_SIZE - TILE_SIZE / 2) * 0.5f;
+        particles.vx[i] = cosf(angle) * speed;
+        particles.vy[i] = sinf(angle) * speed;
+        particles.life[i] = 1.0f;
+        particles.decay[i] = 1.0f / (active_rules->explosion_ticks * (0.6f + 0.4f * heat));
+        particles.r[i] = 1.0f;
+        particles.g[i] = 0.35f + 0.6f * heat;
+        particles.b[i] = 0.1f * heat;
+    }
+}
+
+/**
+ * @brief Przesuwa iskry o jedną klatkę i usuwa wygasłe.
+ * * Pierwsza pętla nie zawiera rozgałęzień i działa na ciągłych tablicach, dzięki czemu
+ * kompilator może ją zwektoryzować. Druga usuwa martwe cząsteczki, przenosząc na ich
+ * miejsce ostatnią żywą (kolejność rysowania iskier nie ma znaczenia).
+ */
+void czasteczki_aktualizuj() {
+    int n = particles.count;
+    float* __restrict x = particles.x;
+    float* __restrict y = particles.y;
+    float* __restrict vx = particles.vx;
+    float* __restrict vy = particles.vy;
+    float* __restrict life = particles.life;
+    const float* __restrict decay = particles.decay;
+
+    for (int i = 0; i < n; i++) {
+        x[i] += vx[i];
+        y[i] += vy[i];
+        vx[i] *= PARTICLE_DRAG;
+        vy[i] *= PARTICLE_DRAG;
+        life[i] -= decay[i];
+    }
+
+    for (int i = 0; i < n; ) {
+        if (life[i] <= 0.0f) {
+            n--;
+            x[i] = x[n]; y[i] = y[n];
+            vx[i] = vx[n]; vy[i] = vy[n];
+            life[i] = life[n]; particles.decay[i] = particles.decay[n];
+            particles.r[i] = particles.r[n]; particles.g[i] = particles.g[n]; particles.b[i] = particles.b[n];
+        }
+        else {
+            i++;
+        }
+    }
+    particles.count = n;
+}
+
+
+// --- Funkcje kamery i terenu ---
+
+/**
+ * @brief Zaznacza kafelek do aktualizacji w buforze terenu przed najbliższym rysowaniem.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ */
+void teren_oznacz_kafelek(int x, int y) {
+    if (terrain.full_rebuild) return;
+    if (terrain.dirty_count >= TERRAIN_DIRTY_CAPACITY) {
+        terrain.full_rebuild = true;
+        return;
+    }
+    terrain.dirty_x[terrain.dirty_count] = x;
+    terrain.dirty_y[terrain.dirty_count] = y;
+    terrain.dirty_count++;
+}
+
+/**
+ * @brief Zaznacza cały teren do przebudowy (np. po wygenerowaniu nowej mapy).
+ */
+void teren_oznacz_wszystko() {
+    terrain.full_rebuild = true;
+    terrain.dirty_count = 0;
+}
+
+/**
+ * @brief Wypełnia cztery wierzchołki kafelka: stała pozycja na mapie i współrzędne tekstury z atlasu.
+ * @param v Wskaźnik do czterech kolejnych wierzchołków.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ * @param type Typ kafelka (wybiera kolumnę atlasu).
+ */
+void teren_wierzcholki_kafelka(ALLEGRO_VERTEX* v, int x, int y, int type) {
+    float x0 = (float)(x * TILE_SIZE);
+    float y0 = (float)(y * TILE_SIZE + HUD_HEIGHT);
+    float u0 = (float)(type * TILE_SIZE);
+    ALLEGRO_COLOR white = al_map_rgb(255, 255, 255);
+
+    v[0].x = x0;             v[0].y = y0;             v[0].z = 0; v[0].u = u0;             v[0].v = 0;         v[0].color = white;
+    v[1].x = x0 + TILE_SIZE; v[1].y = y0;             v[1].z = 0; v[1].u = u0 + TILE_SIZE; v[1].v = 0;         v[1].color = white;
+    v[2].x = x0 + TILE_SIZE; v[2].y = y0 + TILE_SIZE; v[2].z = 0; v[2].u = u0 + TILE_SIZE; v[2].v = TILE_SIZE; v[2].color = white;
+    v[3].x = x0;             v[3].y = y0 + TILE_SIZE; v[3].z = 0; v[3].u = u0;             v[3].v = TILE_SIZE; v[3].color = white;
+}
+
+/**
+ * @brief Wypieka do atlasu sprite'y rysowane dotąd prymitywami w każdej klatce.
+ * * Wiersz ATLAS_ROW_ENEMIES: wróg w kolorze każdego skryptu zwrócony w każdym kierunku.
+ * Wiersze ATLAS_ROW_EXIT i niżej: EXIT_PULSE_FRAMES faz pulsowania wyjścia z iskrą i bez niej
+ * (tylko bez sprite'a wyjścia). Cel rysowania musi być ustawiony na atlas.
+ */
+void teren_wypiecz_sprite() {
+    for (int s = 0; s < SCRIPT_COUNT; s++) {
+        ALLEGRO_COLOR color = al_map_rgb(enemy_script_rgb[s][0], enemy_script_rgb[s][1], enemy_script_rgb[s][2]);
+        for (int d = 0; d < DIR_COUNT; d++) {
+            rysuj_sprite_wroga((float)((s * DIR_COUNT + d) * TILE_SIZE), ATLAS_ROW_ENEMIES * TILE_SIZE, color, (ENEMY_DIRECTION)d);
+        }
+    }
+    if (exit_sprite) return;
+    for (int f = 0; f < EXIT_PULSE_FRAMES; f++) {
+        float pulse_factor = (sin(2.0 * ALLEGRO_PI * f / EXIT_PULSE_FRAMES) + 1.0) / 2.0;
+        rysuj_sprite_wyjscia((float)(f * TILE_SIZE), ATLAS_ROW_EXIT * TILE_SIZE, pulse_factor, true);
+        rysuj_sprite_wyjscia((float)(f * TILE_SIZE), (ATLAS_ROW_EXIT + 1) * TILE_SIZE, pulse_factor, false);
+    }
+}
+
+/**
+ * @brief Tworzy atlas kafelków i sprite'ów, siatki fragmentów i wspólny bufor indeksów terenu.
+ * * Jeśli karta graficzna nie obsługuje buforów wierzchołków, funkcja zwraca false,
+ * a rysuj_mape korzysta z rysowania zapasowego (tylko widoczne kafelki). Tak jest też bez ekranu
+ * (test wydajności rysowania do bitmap w pamięci). Bieżący cel rysowania jest przywracany po zbudowaniu atlasu.
+ * @return true, jeśli bufory GPU są dostępne.
+ */
+bool teren_init() {
+    terrain.atlas = al_create_bitmap(TILE_SIZE * ATLAS_COLUMNS, TILE_SIZE * ATLAS_ROWS);
+    if (!terrain.atlas) return false;
+
+    ALLEGRO_BITMAP* target = al_get_target_bitmap();
+    al_set_target_bitmap(terrain.atlas);
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    al_draw_filled_rectangle(EMPTY * TILE_SIZE, 0, EMPTY * TILE_SIZE + TILE_SIZE, TILE_SIZE, al_map_rgb(0, 0, 0));
+    al_draw_filled_rectangle(SOLID_WALL * TILE_SIZE, 0, SOLID_WALL * TILE_SIZE + TILE_SIZE, TILE_SIZE, al_map_rgb(80, 80, 80));
+    if (destructible_wall_sprite) {
+        al_draw_scaled_bitmap(destructible_wall_sprite, 0, 0,
+            al_get_bitmap_width(destructible_wall_sprite), al_get_bitmap_height(destructible_wall_sprite),
+            DESTRUCTIBLE_WALL * TILE_SIZE, 0, TILE_SIZE, TILE_SIZE, 0);
+    }
+    else {
+        al_draw_filled_rectangle(DESTRUCTIBLE_WALL * TILE_SIZE, 0, DESTRUCTIBLE_WALL * TILE_SIZE + TILE_SIZE, TILE_SIZE, al_map_rgb(150, 75, 0));
+    }
+    teren_wypiecz_sprite();
+    al_set_target_bitmap(target);
+    if (!al_get_current_display()) {
+        fprintf(stderr, "No display, using per-tile terrain drawing.\n");
+        return false;
+    }
+
+    int indices[CHUNK_TILES * 6];
+    for (int i = 0; i < CHUNK_TILES; i++) {
+        indices[i * 6 + 0] = i * 4 + 0; indices[i * 6 + 1] = i * 4 + 1; indices[i * 6 + 2] = i * 4 + 2;
+        indices[i * 6 + 3] = i * 4 + 0; indices[i * 6 + 4] = i * 4 + 2; indices[i * 6 + 5] = i * 4 + 3;
+    }
+    terrain.indices = al_create_index_buffer(sizeof(int), indices, CHUNK_TILES * 6, ALLEGRO_PRIM_BUFFER_STATIC);
+
+    bool ok = terrain.indices != NULL;
+    for (int i = 0; i < TERRAIN_MESH_CACHE; i++) {
+        terrain.meshes[i].vertices = ok ? al_create_vertex_buffer(NULL, NULL, CHUNK_TILES * 4, ALLEGRO_PRIM_BUFFER_DYNAMIC) : NULL;
+        terrain.meshes[i].chunk = -1;
+        terrain.meshes[i].last_used = 0;
+        if (!terrain.meshes[i].vertices) ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Vertex/index buffers unavailable, using per-tile terrain drawing.\n");
+        teren_zwolnij_bufory();
+        return false;
+    }
+    teren_oznacz_wszystko();
+    return true;
+}
+
+/**
+ * @brief Zwalnia siatki fragmentów i bufor indeksów terenu.
+ */
+void teren_zwolnij_bufory() {
+    for (int i = 0; i < TERRAIN_MESH_CACHE; i++) {
+        if (terrain.meshes[i].vertices) al_destroy_vertex_buffer(terrain.meshes[i].vertices);
+        terrain.meshes[i].vertices = NULL;
+        terrain.meshes[i].chunk = -1;
+    }
+    if (terrain.indices) al_destroy_index_buffer(terrain.indices);
+    terrain.indices = NULL;
+}
+
+/**
+ * @brief Zwalnia atlas i bufory terenu.
+ */
+void teren_zwolnij() {
+    teren_zwolnij_bufory();
+    if (terrain.atlas) al_destroy_bitmap(terrain.atlas);
+    terrain.atlas = NULL;
+}
+
+/**
+ * @brief Przenosi zmienione kafelki mapy do siatek fragmentów obecnych na GPU.
+ * * Kafelki fragmentów bez siatki są pomijane - siatka zostanie zbudowana w całości,
+ * gdy fragment pojawi się w widoku. Przebudowa całego terenu tylko unieważnia siatki.
+ * @param game_map_arr Wskaźnik do mapy gry.
+ */
+void teren_synchronizuj(WorldMap* game_map_arr) {
+    if (terrain.full_rebuild) {
+        for (int i = 0; i < TERRAIN_MESH_CACHE; i++) {
+            terrain.meshes[i].chunk = -1;
+        }
+    }
+    else {
+        for (int i = 0; i < terrain.dirty_count; i++) {
+            int x = terrain.dirty_x[i];
+            int y = terrain.dirty_y[i];
+            int chunk = (y >> CHUNK_SHIFT) * game_map_arr->chunks_x + (x >> CHUNK_SHIFT);
+            for (int m = 0; m < TERRAIN_MESH_CACHE; m++) {
+                if (terrain.meshes[m].chunk != chunk) continue;
+                int local = ((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1));
+                ALLEGRO_VERTEX* v = (ALLEGRO_VERTEX*)al_lock_vertex_buffer(terrain.meshes[m].vertices, local * 4, 4, ALLEGRO_LOCK_WRITEONLY);
+                if (!v) break;
+                teren_wierzcholki_kafelka(v, x, y, mapa_kafelek(game_map_arr, x, y));
+                al_unlock_vertex_buffer(terrain.meshes[m].vertices);
+                break;
+            }
+        }
+    }
+    terrain.full_rebuild = false;
+    terrain.dirty_count = 0;
+}
 
-    for (int i = 0; i < 4 && !found_spawn; ++i) {
-        int sx = spawn_candidates_x[i];
-        int sy = spawn_candidates_y[i];
-        if (map[sy][sx] == EMPTY) {
-            bool clear_around = true;
-            if (sx + 1 < MAP_WIDTH && map[sy][sx + 1] != EMPTY) clear_around = false;
-            if (sy + 1 < MAP_HEIGHT && map[sy + 1][sx] != EMPTY) clear_around = false;
+/**
+ * @brief Zwraca siatkę fragmentu mapy, budując ją w najdawniej używanym buforze, jeśli jej nie ma.
+ * @param m Wskaźnik do mapy gry.
+ * @param chunk Indeks fragmentu w katalogu mapy.
+ * @return Wskaźnik do siatki albo NULL, jeśli nie udało się zablokować bufora.
+ */
+TerrainMesh* teren_siatka_fragmentu(WorldMap* m, int chunk) {
+    TerrainMesh* mesh = &terrain.meshes[0];
+    for (int i = 0; i < TERRAIN_MESH_CACHE; i++) {
+        if (terrain.meshes[i].chunk == chunk) {
+            terrain.meshes[i].last_used = terrain.frame;
+            return &terrain.meshes[i];
+        }
+        if (terrain.meshes[i].last_used < mesh->last_used) mesh = &terrain.meshes[i];
+    }
 
-            if (clear_around) {
-                p_player->x = sx; p_player->y = sy; found_spawn = true;
+    ALLEGRO_VERTEX* v = (ALLEGRO_VERTEX*)al_lock_vertex_buffer(mesh->vertices, 0, CHUNK_TILES * 4, ALLEGRO_LOCK_WRITEONLY);
+    if (!v) return NULL;
+    int x0 = (chunk % m->chunks_x) << CHUNK_SHIFT;
+    int y0 = (chunk / m->chunks_x) << CHUNK_SHIFT;
+    for (int ty = 0; ty < CHUNK_SIZE; ty++) {
+        for (int tx = 0; tx < CHUNK_SIZE; tx++) {
+            ALLEGRO_VERTEX* quad = &v[((ty << CHUNK_SHIFT) + tx) * 4];
+            if (x0 + tx < m->width && y0 + ty < m->height) {
+                teren_wierzcholki_kafelka(quad, x0 + tx, y0 + ty, mapa_kafelek(m, x0 + tx, y0 + ty));
+            }
+            else {
+                memset(quad, 0, sizeof(ALLEGRO_VERTEX) * 4);
             }
         }
     }
+    al_unlock_vertex_buffer(mesh->vertices);
+    mesh->chunk = chunk;
+    mesh->last_used = terrain.frame;
+    return mesh;
+}
 
-    if (!found_spawn) {
-        for (int y = 0; y < MAP_HEIGHT && !found_spawn; y++) {
-            for (int x = 0; x < MAP_WIDTH && !found_spawn; x++) {
-                if (map[y][x] == EMPTY) {
-                    if (x + 1 < MAP_WIDTH && map[y][x + 1] == EMPTY && y + 1 < MAP_HEIGHT && map[y + 1][x] == EMPTY) {
-                        p_player->x = x; p_player->y = y; found_spawn = true;
-                    }
+/**
+ * @brief Ustawia kamerę tak, aby gracz był na środku widoku, nie wychodząc poza mapę,
+ * i wyznacza zakres widocznych kafelków.
+ * @param p Wskaźnik do struktury gracza.
+ */
+void aktualizuj_kamere(Player* p) {
+    float max_x = (float)((game_map->width - VIEW_WIDTH) * TILE_SIZE);
+    float max_y = (float)((game_map->height - VIEW_HEIGHT) * TILE_SIZE);
+
+    camera.x = p->x * TILE_SIZE + TILE_SIZE / 2.0f - VIEW_WIDTH * TILE_SIZE / 2.0f;
+    camera.y = p->y * TILE_SIZE + TILE_SIZE / 2.0f - VIEW_HEIGHT * TILE_SIZE / 2.0f;
+    if (camera.x > max_x) camera.x = max_x;
+    if (camera.y > max_y) camera.y = max_y;
+    if (camera.x < 0) camera.x = 0;
+    if (camera.y < 0) camera.y = 0;
+
+    view_range.x0 = (int)(camera.x / TILE_SIZE);
+    view_range.y0 = (int)(camera.y / TILE_SIZE);
+    view_range.x1 = (int)((camera.x + VIEW_WIDTH * TILE_SIZE + TILE_SIZE - 1) / TILE_SIZE);
+    view_range.y1 = (int)((camera.y + VIEW_HEIGHT * TILE_SIZE + TILE_SIZE - 1) / TILE_SIZE);
+    if (view_range.x1 > game_map->width) view_range.x1 = game_map->width;
+    if (view_range.y1 > game_map->height) view_range.y1 = game_map->height;
+}
+
+/**
+ * @brief Sprawdza, czy kafelek leży w widocznym obszarze.
+ * @param x Współrzędna X kafelka.
+ * @param y Współrzędna Y kafelka.
+ * @return true, jeśli kafelek jest widoczny w bieżącej klatce.
+ */
+bool kafelek_widoczny(int x, int y) {
+    return x >= view_range.x0 && x < view_range.x1 && y >= view_range.y0 && y < view_range.y1;
+}
+
+
+// --- Funkcje warstwy interfejsu ---
+
+/**
+ * @brief Liczy układ interfejsu dla rozmiaru bitmapy docelowej i tworzy bitmapy warstw.
+ * * Wywoływana raz przy starcie: gra rysuje do bufora klatki o stałym rozmiarze, więc zmiana
+ * rozmiaru okna nie zmienia układu. Wszystkie kontrolki
+ * i ekrany są oznaczane do ponownego wyrenderowania. Jeśli bitmap nie da się utworzyć,
+ * funkcje rysujące rysują tekst bezpośrednio, jak wcześniej.
+ * @param width Szerokość bitmapy docelowej (bufora klatki lub bitmapy testu wydajności) w pikselach.
+ * @param height Wysokość bitmapy docelowej w pikselach.
+ */
+void ui_uklad(int width, int height) {
+    ui_zwolnij();
+    ui.width = width;
+    ui.height = height;
+    if (!font_main) return;
+
+    ui.line_height = (float)al_get_font_line_height(font_main);
+    float second_line_y = 5 + ui.line_height + 2;
+    ui.hud[HUD_LIVES].x = 10;                ui.hud[HUD_LIVES].y = 5;
+    ui.hud[HUD_SCORE].x = ui.width / 2.0f;   ui.hud[HUD_SCORE].y = 5;
+    ui.hud[HUD_ENEMIES].x = ui.width - 10.0f; ui.hud[HUD_ENEMIES].y = 5;
+    ui.hud[HUD_BOMBS].x = 10;                ui.hud[HUD_BOMBS].y = second_line_y;
+    ui.hud[HUD_POWER].x = ui.width - 10.0f;  ui.hud[HUD_POWER].y = second_line_y;
+
+    bool ok = true;
+    for (int i = 0; i < HUD_WIDGET_COUNT; i++) {
+        ui.hud[i].bitmap = al_create_bitmap(ui.width / 2, (int)ui.line_height + 2);
+        if (!ui.hud[i].bitmap) ok = false;
+    }
+    ui.hud_layer = al_create_bitmap(ui.width, HUD_HEIGHT);
+    ui.start_layer = al_create_bitmap(ui.width, ui.height);
+    ui.game_over_layer = al_create_bitmap(ui.width, ui.height);
+    if (!ok || !ui.hud_layer || !ui.start_layer || !ui.game_over_layer) {
+        fprintf(stderr, "Failed to create UI bitmaps, drawing UI text every frame.\n");
+        ui_zwolnij();
+    }
+}
+
+/**
+ * @brief Zwalnia bitmapy warstwy interfejsu i unieważnia ich zawartość.
+ */
+void ui_zwolnij() {
+    for (int i = 0; i < HUD_WIDGET_COUNT; i++) {
+        if (ui.hud[i].bitmap) al_destroy_bitmap(ui.hud[i].bitmap);
+        ui.hud[i].bitmap = NULL;
+        ui.hud[i].valid = false;
+    }
+    if (ui.hud_layer) al_destroy_bitmap(ui.hud_layer);
+    if (ui.start_layer) al_destroy_bitmap(ui.start_layer);
+    if (ui.game_over_layer) al_destroy_bitmap(ui.game_over_layer);
+    ui.hud_layer = NULL;
+    ui.start_layer = NULL;
+    ui.game_over_layer = NULL;
+    ui.hud_valid = false;
+    ui.start_valid = false;
+    ui.game_over_valid = false;
+}
+
+/**
+ * @brief Przypisuje kontrolce wartość; kontrolka jest renderowana ponownie tylko przy zmianie.
+ * @param w Wskaźnik do kontrolki.
+ * @param value Nowa wartość.
+ */
+void ui_ustaw(UiWidget* w, int value) {
+    if (w->valid && w->value == value) return;
+    w->value = value;
+    w->valid = false;
+    ui.hud_valid = false;
+}
+
+/**
+ * @brief Zwraca położenie punktu zaczepienia tekstu wewnątrz bitmapy kontrolki.
+ * @param w Wskaźnik do kontrolki.
+ * @return Przesunięcie X w pikselach.
+ */
+float ui_zaczepienie(const UiWidget* w) {
+    float bw = (float)(ui.width / 2);
+    if (w->align == ALLEGRO_ALIGN_CENTER) return bw / 2.0f;
+    if (w->align == ALLEGRO_ALIGN_RIGHT) return bw;
+    return 0.0f;
+}
+
+/**
+ * @brief Renderuje tekst kontrolki do jej bitmapy.
+ * @param w Wskaźnik do kontrolki.
+ */
+void ui_renderuj_kontrolke(UiWidget* w) {
+    char text[UI_TEXT_MAX];
+    snprintf(text, sizeof(text), w->format, w->value);
+
+    ALLEGRO_BITMAP* target = al_get_target_bitmap();
+    al_set_target_bitmap(w->bitmap);
+    rysuj_licz();
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    rysuj_licz();
+    al_draw_text(font_main, al_map_rgb(255, 255, 255), ui_zaczepienie(w), 0, w->align, text);
+    al_set_target_bitmap(target);
+    w->valid = true;
+}
+
+/**
+ * @brief Rysuje napisy ekranu startowego na bieżącej bitmapie docelowej.
+ */
+void ui_tresc_ekranu_startowego() {
+    float display_w = (float)ui.width;
+    float display_h = (float)ui.height;
+    rysuj_licz();
+    al_draw_text(font_main, al_map_rgb(255, 255, 0), display_w / 2, display_h / 4, ALLEGRO_ALIGN_CENTER, "Bomberman");
+    rysuj_licz();
+    al_draw_text(font_main, al_map_rgb(200, 200, 200), display_w / 2, display_h / 2, ALLEGRO_ALIGN_CENTER, "Press ENTER to start");
+    rysuj_licz();
+    al_draw_text(font_main, al_map_rgb(150, 150, 150), display_w / 2, display_h / 2 + ui.line_height * 1.5f, ALLEGRO_ALIGN_CENTER, "ESC to exit");
+}
+
+/**
+ * @brief Rysuje przyciemnienie obszaru gry i napisy końca gry na bieżącej bitmapie docelowej.
+ * @param victory Czy gracz wygrał.
+ * @param score Wynik gracza.
+ */
+void ui_tresc_konca_gry(bool victory, int score) {
+    float display_w = (float)ui.width;
+    float display_h = (float)ui.height;
+    float game_area_h = display_h - HUD_HEIGHT;
+    float center_y_game_area = HUD_HEIGHT + game_area_h / 2;
+    char score_text[50];
+
+    rysuj_licz();
+    al_draw_filled_rectangle(0, HUD_HEIGHT, display_w, display_h, al_map_rgba(0, 0, 0, 150));
+
+    snprintf(score_text, sizeof(score_text), "Score: %d", score);
+    float score_y_offset = ui.line_height * 1.5f;
+
+    if (victory) {
+        rysuj_licz();
+        al_draw_text(font_main, al_map_rgb(0, 255, 0),
+            display_w / 2, center_y_game_area - (ui.line_height * 2),
+            ALLEGRO_ALIGN_CENTER, "VICTORY!");
+        rysuj_licz();
+        al_draw_text(font_main, al_map_rgb(255, 255, 0), display_w / 2, center_y_game_area - score_y_offset + ui.line_height, ALLEGRO_ALIGN_CENTER, score_text);
+    }
+    else {
+        rysuj_licz();
+        al_draw_text(font_main, al_map_rgb(255, 0, 0),
+            display_w / 2, center_y_game_area - (ui.line_height * 2),
+            ALLEGRO_ALIGN_CENTER, "GAME OVER");
+        rysuj_licz();
+        al_draw_text(font_main, al_map_rgb(255, 255, 255), display_w / 2, center_y_game_area - score_y_offset + ui.line_height, ALLEGRO_ALIGN_CENTER, score_text);
+    }
+    rysuj_licz();
+    al_draw_text(font_main, al_map_rgb(200, 200, 200),
+        display_w / 2, center_y_game_area + (ui.line_height * 1.5f),
+        ALLEGRO_ALIGN_CENTER, "Press ENTER to restart");
+}
+
+
+// --- Funkcje prezentacji klatki ---
+
+/**
+ * @brief Tworzy bufor klatki FRAME_WIDTH x FRAME_HEIGHT i liczy jego położenie w oknie.
+ * * W trybie PRESENT_FIT bufor ma filtrowanie liniowe, w trybie PRESENT_INTEGER - najbliższy piksel.
+ * Gdy bufora nie da się utworzyć, gra rysuje wprost do bufora okna, jak wcześniej.
+ * @param display Okno gry.
+ * @return true, jeśli bufor klatki został utworzony.
+ */
+bool prezentacja_init(ALLEGRO_DISPLAY* display) {
+    int flags = al_get_new_bitmap_flags();
+    if (presenter.mode == PRESENT_FIT) {
+        al_set_new_bitmap_flags(flags | ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR);
+    }
+    presenter.frame = al_create_bitmap(FRAME_WIDTH, FRAME_HEIGHT);
+    al_set_new_bitmap_flags(flags);
+    if (!presenter.frame) {
+        fprintf(stderr, "Failed to create the frame buffer, drawing straight to the window.\n");
+        return false;
+    }
+    prezentacja_uklad(al_get_display_width(display), al_get_display_height(display));
+    return true;
+}
+
+/**
+ * @brief Wyznacza skalę i położenie klatki dla rozmiaru okna; klatka jest wyśrodkowana z czarnymi pasami.
+ * @param window_width Szerokość okna w pikselach.
+ * @param window_height Wysokość okna w pikselach.
+ */
+void prezentacja_uklad(int window_width, int window_height) {
+    float fit = fminf((float)window_width / FRAME_WIDTH, (float)window_height / FRAME_HEIGHT);
+    float scale = fit;
+    if (presenter.mode == PRESENT_INTEGER && fit >= 1.0f) {
+        scale = floorf(fit);
+    }
+    presenter.w = FRAME_WIDTH * scale;
+    presenter.h = FRAME_HEIGHT * scale;
+    presenter.x = floorf((window_width - presenter.w) / 2.0f);
+    presenter.y = floorf((window_height - presenter.h) / 2.0f);
+}
+
+/**
+ * @brief Kopiuje bufor klatki do bufora okna jednym przeskalowanym blitem (bez al_flip_display).
+ * @param display Okno gry.
+ */
+void prezentacja_pokaz(ALLEGRO_DISPLAY* display) {
+    al_set_target_backbuffer(display);
+    al_clear_to_color(al_map_rgb(0, 0, 0));
+    al_draw_scaled_bitmap(presenter.frame, 0, 0, FRAME_WIDTH, FRAME_HEIGHT, presenter.x, presenter.y, presenter.w, presenter.h, 0);
+}
+
+/**
+ * @brief Zwalnia bufor klatki.
+ */
+void prezentacja_zwolnij() {
+    if (presenter.frame) al_destroy_bitmap(presenter.frame);
+    presenter.frame = NULL;
+}
+
+// --- Funkcje rysowania ---
+
+/**
+ * @brief Zwraca czas dla animacji niezależnych od symulacji (np. pulsowania wyjścia).
+ * * W teście wydajności rysowania jest to czas sceny ustawiany przez test, dzięki czemu
+ * klatki porównywane z obrazami wzorcowymi nie zależą od chwili uruchomienia.
+ * @return Czas w sekundach.
+ */
+double czas_animacji() {
+    return render_bench.fixed_clock ? render_bench.clock : al_get_time();
+}
+
+/**
+ * @brief Rysuje ekran startowy gry.
+ * * Napisy są renderowane do bitmapy raz na układ (ui_uklad), a potem tylko kopiowane.
+ */
+void rysuj_ekran_startowy() {
+    if (!font_main) return;
+    if (!ui.start_layer) {
+        ui_tresc_ekranu_startowego();
+        return;
+    }
+    if (!ui.start_valid) {
+        ALLEGRO_BITMAP* target = al_get_target_bitmap();
+        al_set_target_bitmap(ui.start_layer);
+        rysuj_licz();
+        al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+        ui_tresc_ekranu_startowego();
+        al_set_target_bitmap(target);
+        ui.start_valid = true;
+    }
+    rysuj_licz();
+    al_draw_bitmap(ui.start_layer, 0, 0, 0);
+}
+
+/**
+ * @brief Rysuje ekran końca gry (informację o wygranej lub przegranej oraz wynik).
+ * * Nakładka jest renderowana do bitmapy tylko wtedy, gdy zmieni się wynik lub rozstrzygnięcie.
+ * @param p Wskaźnik do struktury gracza.
+ * @param exit_rev Flaga odkrycia wyjścia.
+ * @param ex_x Współrzędna X wyjścia.
+ * @param ex_y Współrzędna Y wyjścia.
+ */
+void rysuj_ekran_konca_gry(Player* p, bool exit_rev, int ex_x, int ex_y) {
+    if (!font_main) return;
+
+    bool all_enemies_defeated_final_check = enemy_pool.count == 0;
+    bool victory = p->is_alive && all_enemies_defeated_final_check && exit_rev && p->x == ex_x && p->y == ex_y;
+
+    if (!ui.game_over_layer) {
+        ui_tresc_konca_gry(victory, p->score);
+        return;
+    }
+    if (!ui.game_over_valid || ui.game_over_victory != victory || ui.game_over_score != p->score) {
+        ALLEGRO_BITMAP* target = al_get_target_bitmap();
+        al_set_target_bitmap(ui.game_over_layer);
+        rysuj_licz();
+        al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+        ui_tresc_konca_gry(victory, p->score);
+        al_set_target_bitmap(target);
+        ui.game_over_victory = victory;
+        ui.game_over_score = p->score;
+        ui.game_over_valid = true;
+    }
+    rysuj_licz();
+    al_draw_bitmap(ui.game_over_layer, 0, 0, 0);
+}
+
+/**
+ * @brief Rysuje interfejs użytkownika (HUD) na górze ekranu.
+ * Wyświetla informacje takie jak liczba żyć, wynik, liczba pozostałych wrogów,
+ * aktualna liczba bomb i moc eksplozji. Kontrolka jest renderowana ponownie tylko po zmianie
+ * jej wartości, a cały pasek trafia na ekran jednym al_draw_bitmap.
+ * @param p Wskaźnik do struktury gracza.
+ */
+void rysuj_hud(Player* p) {
+    if (!font_main) return;
+
+    int active_enemies_count = enemy_pool.count;
+
+    ui_ustaw(&ui.hud[HUD_LIVES], p->lives);
+    ui_ustaw(&ui.hud[HUD_SCORE], p->score);
+    ui_ustaw(&ui.hud[HUD_ENEMIES], active_enemies_count);
+    ui_ustaw(&ui.hud[HUD_BOMBS], p->current_max_bombs);
+    ui_ustaw(&ui.hud[HUD_POWER], p->current_bomb_radius);
+
+    if (!ui.hud_layer) {
+        char text_buffer[UI_TEXT_MAX];
+        for (int i = 0; i < HUD_WIDGET_COUNT; i++) {
+            snprintf(text_buffer, sizeof(text_buffer), ui.hud[i].format, ui.hud[i].value);
+            rysuj_licz();
+            al_draw_text(font_main, al_map_rgb(255, 255, 255), ui.hud[i].x, ui.hud[i].y, ui.hud[i].align, text_buffer);
+        }
+        return;
+    }
+
+    if (!ui.hud_valid) {
+        for (int i = 0; i < HUD_WIDGET_COUNT; i++) {
+            if (!ui.hud[i].valid) ui_renderuj_kontrolke(&ui.hud[i]);
+        }
+        ALLEGRO_BITMAP* target = al_get_target_bitmap();
+        al_set_target_bitmap(ui.hud_layer);
+        rysuj_licz();
+        al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+        for (int i = 0; i < HUD_WIDGET_COUNT; i++) {
+            rysuj_licz();
+            al_draw_bitmap(ui.hud[i].bitmap, ui.hud[i].x - ui_zaczepienie(&ui.hud[i]), ui.hud[i].y, 0);
+        }
+        al_set_target_bitmap(target);
+        ui.hud_valid = true;
+    }
+    rysuj_licz();
+    al_draw_bitmap(ui.hud_layer, 0, 0, 0);
+}
+
+/**
+ * @brief Rysuje widoczne kafelki mapy gry (ściany, puste pola).
+ * * Gdy dostępne są bufory GPU, każdy fragment mapy nachodzący na widok to jedno wywołanie
+ * al_draw_indexed_buffer (przy widoku mniejszym od fragmentu - najwyżej cztery); zmienione od
+ * ostatniej klatki kafelki są wcześniej dopisywane do siatek. Kafelki poza widokiem odcina
+ * prostokąt przycinania. W przeciwnym razie kafelki z zakresu `view_range` są rysowane pojedynczo.
+ * @param game_map_arr Wskaźnik do mapy gry.
+ */
+void rysuj_mape(WorldMap* game_map_arr) {
+    if (terrain.indices) {
+        teren_synchronizuj(game_map_arr);
+        terrain.frame++;
+        for (int cy = view_range.y0 >> CHUNK_SHIFT; cy <= (view_range.y1 - 1) >> CHUNK_SHIFT; cy++) {
+            for (int cx = view_range.x0 >> CHUNK_SHIFT; cx <= (view_range.x1 - 1) >> CHUNK_SHIFT; cx++) {
+                TerrainMesh* mesh = teren_siatka_fragmentu(game_map_arr, cy * game_map_arr->chunks_x + cx);
+                if (mesh) {
+                    rysuj_licz();
+                    al_draw_indexed_buffer(mesh->vertices, terrain.atlas, terrain.indices, 0, CHUNK_TILES * 6, ALLEGRO_PRIM_TRIANGLE_LIST);
                 }
             }
         }
+        return;
     }
 
-    if (!found_spawn) {
-        printf("Warning: Ideal spawn point not found. Searching for any empty cell...\n");
-        for (int y = 0; y < MAP_HEIGHT && !found_spawn; y++) {
-            for (int x = 0; x < MAP_WIDTH && !found_spawn; x++) {
-                if (map[y][x] == EMPTY) {
-                    p_player->x = x; p_player->y = y; found_spawn = true;
+    for (int y_map = view_range.y0; y_map < view_range.y1; y_map++) {
+        for (int x_map = view_range.x0; x_map < view_range.x1; x_map++) {
+            int tile_x_pos = x_map * TILE_SIZE;
+            int tile_y_pos = y_map * TILE_SIZE + HUD_HEIGHT;
+            int tile = mapa_kafelek(game_map_arr, x_map, y_map);
+
+            if (tile == SOLID_WALL) {
+                rysuj_licz();
+                al_draw_filled_rectangle(tile_x_pos, tile_y_pos, tile_x_pos + TILE_SIZE, tile_y_pos + TILE_SIZE, al_map_rgb(80, 80, 80));
+            }
+            else if (tile == DESTRUCTIBLE_WALL) {
+                if (destructible_wall_sprite) {
+                    rysuj_licz();
+                    al_draw_bitmap(destructible_wall_sprite, tile_x_pos, tile_y_pos, 0);
+                }
+                else {
+                    rysuj_licz();
+                    al_draw_filled_rectangle(tile_x_pos, tile_y_pos, tile_x_pos + TILE_SIZE, tile_y_pos + TILE_SIZE, al_map_rgb(150, 75, 0));
                 }
             }
+            else {
+                rysuj_licz();
+                al_draw_filled_rectangle(tile_x_pos, tile_y_pos, tile_x_pos + TILE_SIZE, tile_y_pos + TILE_SIZE, al_map_rgb(0, 0, 0));
+            }
         }
     }
+}
 
-    if (!found_spawn) {
-        p_player->x = 1;
-        p_player->y = 1;
-        map[1][1] = EMPTY;
-        if (map[1][2] == SOLID_WALL) map[1][2] = EMPTY;
-        if (map[2][1] == SOLID_WALL) map[2][1] = EMPTY;
-        printf("CRITICAL: No empty spawn point found. Defaulting to (1,1) and forcing empty.\n");
+/**
+ * @brief Rysuje pulsujący portal wyjścia prymitywami w kafelku o lewym górnym rogu (x, y).
+ * @param x Współrzędna X kafelka w pikselach.
+ * @param y Współrzędna Y kafelka w pikselach.
+ * @param pulse_factor Faza pulsowania, od 0 do 1.
+ * @param spark Czy rysować migającą iskrę w środku.
+ */
+void rysuj_sprite_wyjscia(float x, float y, float pulse_factor, bool spark) {
+    float center_x = x + TILE_SIZE / 2.0f;
+    float center_y = y + TILE_SIZE / 2.0f;
+
+    rysuj_licz();
+    al_draw_filled_rectangle(x, y, x + TILE_SIZE, y + TILE_SIZE, al_map_rgb(30, 0, 50));
+
+    float outer_radius = TILE_SIZE * 0.4f * (0.8f + pulse_factor * 0.2f);
+    unsigned char r_outer = 100 + (unsigned char)(pulse_factor * 50);
+    unsigned char g_outer = 50 + (unsigned char)(pulse_factor * 50);
+    rysuj_licz();
+    al_draw_filled_circle(center_x, center_y, outer_radius, al_map_rgb(r_outer, g_outer, 200));
+
+    float inner_radius = TILE_SIZE * 0.25f * (0.7f + pulse_factor * 0.3f);
+    unsigned char r_inner = 200 + (unsigned char)(pulse_factor * 55);
+    unsigned char g_inner = 180 + (unsigned char)(pulse_factor * 75);
+    rysuj_licz();
+    al_draw_filled_circle(center_x, center_y, inner_radius, al_map_rgb(r_inner, g_inner, 255));
+
+    if (spark) {
+        rysuj_licz();
+        al_draw_filled_circle(center_x, center_y, TILE_SIZE * 0.05f, al_map_rgb(255, 255, 255));
     }
-    map[p_player->y][p_player->x] = EMPTY;
-    printf("Player spawned at (%d, %d)\n", p_player->x, p_player->y);
 }
 
 /**
- * @brief Umożliwia graczowi podłożenie bomby.
- * * Sprawdza, czy gracz nie przekroczył swojego limitu aktywnych bomb
- * oraz czy na danym polu nie znajduje się już inna bomba. Jeśli warunki są spełnione,
- * nowa bomba jest aktywowana na pozycji gracza.
- * @param p Wskaźnik do struktury gracza.
+ * @brief Rysuje wyjście z poziomu, jeśli zostało odkryte.
+ * * Jeśli dostępny jest sprite wyjścia (`exit_sprite`), używa go.
+ * W przeciwnym razie rysuje pulsujący efekt portalu: najbliższą fazie klatkę z atlasu
+ * jednym wywołaniem, a bez atlasu - prymitywami.
+ * @param exit_rev Flaga wskazująca, czy wyjście jest odkryte.
+ * @param ex_x Współrzędna X wyjścia.
+ * @param ex_y Współrzędna Y wyjścia.
  */
-void try_plant_bomb(Player* p) {
-    int active_player_bombs = 0;
-    for (int i = 0; i < MAX_BOMBS; i++) {
-        if (bombs[i].active) {
-            active_player_bombs++;
+void rysuj_wyjscie(bool exit_rev, int ex_x, int ex_y) {
+    if (exit_rev && kafelek_widoczny(ex_x, ex_y)) {
+        float x = (float)(ex_x * TILE_SIZE);
+        float y = (float)(ex_y * TILE_SIZE + HUD_HEIGHT);
+        if (exit_sprite) {
+            rysuj_licz();
+            al_draw_bitmap(exit_sprite, x, y, 0);
+            return;
+        }
+
+        double time_now = czas_animacji();
+        bool spark = ((int)(time_now * 10)) % 2 == 0;
+        if (terrain.atlas) {
+            double phase = fmod(time_now * 5.0, 2.0 * ALLEGRO_PI) / (2.0 * ALLEGRO_PI);
+            int frame = (int)(phase * EXIT_PULSE_FRAMES + 0.5) % EXIT_PULSE_FRAMES;
+            int row = spark ? ATLAS_ROW_EXIT : ATLAS_ROW_EXIT + 1;
+            rysuj_licz();
+            al_draw_bitmap_region(terrain.atlas, frame * TILE_SIZE, row * TILE_SIZE, TILE_SIZE, TILE_SIZE, x, y, 0);
+        }
+        else {
+            rysuj_sprite_wyjscia(x, y, (sin(time_now * 5.0) + 1.0) / 2.0, spark);
         }
     }
+}
 
-    if (active_player_bombs >= p->current_max_bombs) {
-        printf("Bomb limit reached (%d)!\n", p->current_max_bombs);
-        return;
+/**
+ * @brief Rysuje aktywne power-upy na mapie.
+ * @param powerups_arr Tablica power-upów.
+ */
+void rysuj_powerupy(Powerup powerups_arr[]) {
+    for (int i = 0; i < powerup_pool.used; i++) {
+        if (powerups_arr[i].is_active && kafelek_widoczny(powerups_arr[i].x, powerups_arr[i].y)) {
+            rysuj_licz();
+            al_draw_filled_rectangle(powerups_arr[i].x * TILE_SIZE + TILE_SIZE / 4,
+                powerups_arr[i].y * TILE_SIZE + TILE_SIZE / 4 + HUD_HEIGHT,
+                powerups_arr[i].x * TILE_SIZE + (TILE_SIZE * 3) / 4,
+                powerups_arr[i].y * TILE_SIZE + (TILE_SIZE * 3) / 4 + HUD_HEIGHT,
+                powerups_arr[i].color);
+            rysuj_licz();
+            al_draw_rectangle(powerups_arr[i].x * TILE_SIZE + TILE_SIZE / 4,
+                powerups_arr[i].y * TILE_SIZE + TILE_SIZE / 4 + HUD_HEIGHT,
+                powerups_arr[i].x * TILE_SIZE + (TILE_SIZE * 3) / 4,
+                powerups_arr[i].y * TILE_SIZE + (TILE_SIZE * 3) / 4 + HUD_HEIGHT,
+                al_map_rgb(255, 255, 255), 2);
+        }
     }
+}
 
-    for (int i = 0; i < MAX_BOMBS; i++) {
-        if (!bombs[i].active) {
-            bool already_bomb_here = false;
-            for (int j = 0; j < MAX_BOMBS; j++) {
-                if (bombs[j].active && bombs[j].x == p->x && bombs[j].y == p->y) {
-                    already_bomb_here = true;
-                    break;
+/**
+ * @brief Rysuje tykające bomby. Eksplozje są rysowane przez system cząsteczek (rysuj_czasteczki).
+ * @param bombs_arr Tablica bomb.
+ */
+void rysuj_bomby_i_eksplozje(Bomb bombs_arr[]) {
+    for (int i = 0; i < bomb_pool.used; i++) {
+        if (bombs_arr[i].active && kafelek_widoczny(bombs_arr[i].x, bombs_arr[i].y)) {
+            if (!bombs_arr[i].exploding) {
+                if (dynamite_sprite) {
+                    int fuse_left = (int)(bombs_arr[i].fuse_tick - timers.now);
+                    float scale = 1.0f;
+                    if (fuse_left < 45) {
+                        int fuse_burnt = active_rules->bomb_fuse_ticks - fuse_left;
+                        scale = 1.0f + ((fuse_burnt % 12 < 6) ? 0.1f * sinf(fuse_burnt * 0.5f) : -0.1f * sinf(fuse_burnt * 0.5f));
+                    }
+                    rysuj_licz();
+                    al_draw_scaled_bitmap(dynamite_sprite,
+                        0, 0, al_get_bitmap_width(dynamite_sprite), al_get_bitmap_height(dynamite_sprite),
+                        bombs_arr[i].x * TILE_SIZE + TILE_SIZE / 2.0f * (1.0f - scale),
+                        bombs_arr[i].y * TILE_SIZE + HUD_HEIGHT + TILE_SIZE / 2.0f * (1.0f - scale),
+                        TILE_SIZE * scale, TILE_SIZE * scale, 0);
+
+                    if (fuse_left > 0) {
+                        float fuse_length_factor = (float)fuse_left / active_rules->bomb_fuse_ticks;
+                        float fuse_x_start = bombs_arr[i].x * TILE_SIZE + TILE_SIZE * 0.7f;
+                        float fuse_y_start = bombs_arr[i].y * TILE_SIZE + HUD_HEIGHT + TILE_SIZE * 0.2f;
+                        float fuse_x_end = fuse_x_start + (TILE_SIZE / 6.0f) * fuse_length_factor;
+                        float fuse_y_end = fuse_y_start - (TILE_SIZE / 12.0f) * (1.0f - fuse_length_factor);
+                        rysuj_licz();
+                        al_draw_line(fuse_x_start, fuse_y_start, fuse_x_end, fuse_y_end, al_map_rgb(60, 60, 60), 3.0f);
+                        if ((fuse_left / 6) % 2 == 0) {
+                            rysuj_licz();
+                            al_draw_filled_circle(fuse_x_end, fuse_y_end, TILE_SIZE / 9.0f, al_map_rgb(255, 100 + (fuse_left * 37) % 100, 0));
+                        }
+                    }
                 }
+                else { /* Fallback rysowania bomby */ }
             }
+        }
+    }
+}
 
-            if (!already_bomb_here) {
-                bombs[i].active = true;
-                bombs[i].x = p->x;
-                bombs[i].y = p->y;
-                bombs[i].timer = BOMB_TIMER_DURATION;
-                bombs[i].radius = p->current_bomb_radius;
-                bombs[i].exploding = false;
-                bombs[i].explosion_timer = 0;
-                bombs[i].num_affected_explosion_cells = 0;
-                printf("Bomb (radius %d) planted at (%d, %d)!\n", bombs[i].radius, bombs[i].x, bombs[i].y);
-                break;
+/**
+ * @brief Rysuje wszystkie widoczne iskry eksplozji jednym wywołaniem al_draw_indexed_prim.
+ * * Wypełnia bufor wierzchołków czworokątami teksturowanymi sprite'em iskier; rozmiar
+ * i przezroczystość maleją wraz z czasem życia. Kolor jest przemnożony przez alfę,
+ * zgodnie z domyślnym trybem mieszania Allegro. Bez sprite'a rysowane są kolorowe kwadraty.
+ */
+void rysuj_czasteczki() {
+    int n = particles.count;
+    if (n == 0) return;
+
+    float tex_w = sparks_sprite ? (float)al_get_bitmap_width(sparks_sprite) : 0.0f;
+    float tex_h = sparks_sprite ? (float)al_get_bitmap_height(sparks_sprite) : 0.0f;
+    float view_x0 = camera.x - PARTICLE_SIZE;
+    float view_y0 = camera.y - PARTICLE_SIZE;
+    float view_x1 = camera.x + VIEW_WIDTH * TILE_SIZE + PARTICLE_SIZE;
+    float view_y1 = camera.y + VIEW_HEIGHT * TILE_SIZE + PARTICLE_SIZE;
+    int visible = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (particles.x[i] < view_x0 || particles.x[i] > view_x1 || particles.y[i] < view_y0 || particles.y[i] > view_y1) continue;
+
+        float a = particles.life[i];
+        float half = PARTICLE_SIZE * (0.4f + 0.6f * a) * 0.5f;
+        float cx = particles.x[i];
+        float cy = particles.y[i] + HUD_HEIGHT;
+        ALLEGRO_COLOR color = al_map_rgba_f(particles.r[i] * a, particles.g[i] * a, particles.b[i] * a, a);
+        ALLEGRO_VERTEX* v = &particle_vertices[visible * 4];
+        visible++;
+
+        v[0].x = cx - half; v[0].y = cy - half; v[0].z = 0; v[0].u = 0;     v[0].v = 0;     v[0].color = color;
+        v[1].x = cx + half; v[1].y = cy - half; v[1].z = 0; v[1].u = tex_w; v[1].v = 0;     v[1].color = color;
+        v[2].x = cx + half; v[2].y = cy + half; v[2].z = 0; v[2].u = tex_w; v[2].v = tex_h; v[2].color = color;
+        v[3].x = cx - half; v[3].y = cy + half; v[3].z = 0; v[3].u = 0;     v[3].v = tex_h; v[3].color = color;
+    }
+
+    if (visible > 0) {
+        rysuj_licz();
+        al_draw_indexed_prim(particle_vertices, NULL, sparks_sprite, particle_indices, visible * 6, ALLEGRO_PRIM_TRIANGLE_LIST);
+    }
+}
+
+/**
+ * @brief Rysuje wroga prymitywami w kafelku o lewym górnym rogu (x, y).
+ * @param x Współrzędna X kafelka w pikselach.
+ * @param y Współrzędna Y kafelka w pikselach.
+ * @param color Kolor ciała wroga.
+ * @param direction Kierunek, w którym patrzą oczy.
+ */
+void rysuj_sprite_wroga(float x, float y, ALLEGRO_COLOR color, ENEMY_DIRECTION direction) {
+    rysuj_licz();
+    al_draw_filled_rectangle(x + TILE_SIZE * 0.1f, y + TILE_SIZE * 0.1f,
+        x + TILE_SIZE * 0.9f, y + TILE_SIZE - TILE_SIZE * 0.1f, color);
+
+    float eye_base_x_l = x + TILE_SIZE * 0.3f;
+    float eye_base_x_r = x + TILE_SIZE * 0.7f;
+    float eye_base_y = y + TILE_SIZE * 0.35f;
+    float pupil_offset_x = 0;
+    float pupil_offset_y = 0;
+    float eye_radius_outer = TILE_SIZE * 0.12f;
+    float eye_radius_inner = TILE_SIZE * 0.07f;
+
+    switch (direction) {
+    case DIR_UP: pupil_offset_y = -TILE_SIZE * 0.035f; break;
+    case DIR_DOWN: pupil_offset_y = TILE_SIZE * 0.035f; break;
+    case DIR_LEFT: pupil_offset_x = -TILE_SIZE * 0.035f; break;
+    case DIR_RIGHT: pupil_offset_x = TILE_SIZE * 0.035f; break;
+    default: break;
+    }
+    rysuj_licz();
+    al_draw_filled_circle(eye_base_x_l, eye_base_y, eye_radius_outer, al_map_rgb(255, 255, 255));
+    rysuj_licz();
+    al_draw_filled_circle(eye_base_x_r, eye_base_y, eye_radius_outer, al_map_rgb(255, 255, 255));
+    rysuj_licz();
+    al_draw_filled_circle(eye_base_x_l + pupil_offset_x, eye_base_y + pupil_offset_y, eye_radius_inner, al_map_rgb(10, 10, 10));
+    rysuj_licz();
+    al_draw_filled_circle(eye_base_x_r + pupil_offset_x, eye_base_y + pupil_offset_y, eye_radius_inner, al_map_rgb(10, 10, 10));
+}
+
+/**
+ * @brief Rysuje wrogów na mapie.
+ * * Każdy wróg to jeden wycinek atlasu (kolor skryptu i kierunek), a wstrzymane rysowanie
+ * bitmap pozwala Allegro złączyć wszystkie wycinki w jedną partię. Bez atlasu wrogowie
+ * są rysowani prymitywami.
+ * @param enemies_arr Tablica wrogów.
+ */
+void rysuj_wrogow(Enemy enemies_arr[]) {
+    if (terrain.atlas) al_hold_bitmap_drawing(true);
+    for (int i = 0; i < enemy_pool.used; i++) {
+        if (enemies_arr[i].is_alive && kafelek_widoczny(enemies_arr[i].x, enemies_arr[i].y)) {
+            float x = (float)(enemies_arr[i].x * TILE_SIZE);
+            float y = (float)(enemies_arr[i].y * TILE_SIZE + HUD_HEIGHT);
+            if (terrain.atlas) {
+                int column = enemies_arr[i].script * DIR_COUNT + enemies_arr[i].direction;
+                rysuj_licz();
+                al_draw_bitmap_region(terrain.atlas, column * TILE_SIZE, ATLAS_ROW_ENEMIES * TILE_SIZE, TILE_SIZE, TILE_SIZE, x, y, 0);
+            }
+            else {
+                rysuj_sprite_wroga(x, y, enemies_arr[i].color, enemies_arr[i].direction);
+            }
+        }
+    }
+    if (terrain.atlas) al_hold_bitmap_drawing(false);
+}
+
+/**
+ * @brief Rysuje gracza na mapie.
+ * Wybiera odpowiedni sprite w zależności od kierunku, w którym gracz jest zwrócony.
+ * Obsługuje również efekt migotania podczas nietykalności.
+ * @param p Wskaźnik do struktury gracza.
+ */
+void rysuj_gracza(Player* p) {
+    if (p->is_alive) {
+        ALLEGRO_BITMAP* sprite_to_draw = player_sprite_front;
+        switch (p->direction) {
+        case PLAYER_DIR_UP:    sprite_to_draw = player_sprite_back;  break;
+        case PLAYER_DIR_DOWN:  sprite_to_draw = player_sprite_front; break;
+        case PLAYER_DIR_LEFT:  sprite_to_draw = player_sprite_left;  break;
+        case PLAYER_DIR_RIGHT: sprite_to_draw = player_sprite_right; break;
+        }
+
+        if (sprite_to_draw) {
+            if (p->invincible) {
+                if ((int)(p->invincible_until - timers.now) / 4 % 2 == 0) {
+                    rysuj_licz();
+                    al_draw_bitmap(sprite_to_draw, p->x * TILE_SIZE, p->y * TILE_SIZE + HUD_HEIGHT, 0);
+                }
             }
             else {
-                printf("Another bomb is already here!\n");
-                break;
+                rysuj_licz();
+                al_draw_bitmap(sprite_to_draw, p->x * TILE_SIZE, p->y * TILE_SIZE + HUD_HEIGHT, 0);
             }
         }
+        else { /* Fallback, jeśli sprite gracza nie jest załadowany */ }
     }
 }
 
 /**
- * @brief Przygotowuje nową grę, resetując stan wszystkich elementów gry.
- * * Wywołuje funkcje inicjalizujące mapę, wyjście, gracza i wrogów.
- * Resetuje również stan bomb i power-upów oraz uruchamia muzykę w tle.
+ * @brief Główna funkcja rysująca całą grę.
+ * * W zależności od aktualnego stanu gry, wywołuje odpowiednie funkcje rysujące
+ * poszczególne elementy (ekran startowy, HUD, mapę, obiekty, gracza, ekran końca gry).
+ * Elementy mapy są rysowane z przesunięciem kamery i przycięte do obszaru gry;
+ * obiekty spoza widocznego zakresu kafelków są pomijane. Funkcja nie odświeża ekranu -
+ * cel może być buforem okna (wtedy wywołujący woła al_flip_display) albo bitmapą poza ekranem.
+ * @param target Bitmapa docelowa (bufor okna lub bitmapa testu wydajności rysowania).
+ * @param p Wskaźnik do struktury gracza.
+ * @param bombs_arr Tablica bomb.
+ * @param enemies_arr Tablica wrogów.
+ * @param powerups_arr Tablica power-upów.
+ * @param game_map_arr Wskaźnik do mapy gry.
+ * @param current_s Aktualny stan gry.
+ * @param exit_rev Flaga odkrycia wyjścia.
+ * @param ex_x Współrzędna X wyjścia.
+ * @param ex_y Współrzędna Y wyjścia.
  */
-void setup_new_game() {
-    initialize_map();
+void rysuj_gre(ALLEGRO_BITMAP* target, Player* p, Bomb bombs_arr[], Enemy enemies_arr[], Powerup powerups_arr[], WorldMap* game_map_arr, GAME_STATE current_s, bool exit_rev, int ex_x, int ex_y) {
+    al_set_target_bitmap(target);
+    rysuj_licz();
+    al_clear_to_color(al_map_rgb(0, 0, 0));
 
-    exit_x = -1;
-    exit_y = -1;
-    exit_revealed = false;
-    hide_exit_randomly();
+    if (current_s == START_SCREEN) {
+        rysuj_ekran_startowy();
+    }
+    else if (current_s == PLAYING || current_s == GAME_OVER) {
+        aktualizuj_kamere(p);
 
-    find_and_set_player_spawn(&player, game_map);
+        ALLEGRO_TRANSFORM world_transform;
+        al_identity_transform(&world_transform);
+        al_translate_transform(&world_transform, -camera.x, -camera.y);
+        al_use_transform(&world_transform);
+        al_set_clipping_rectangle(0, HUD_HEIGHT, VIEW_WIDTH * TILE_SIZE, VIEW_HEIGHT * TILE_SIZE);
 
-    player.lives = PLAYER_MAX_LIVES;
-    player.score = 0;
-    player.is_alive = true;
-    player.invincible = false;
-    player.invincibility_timer = 0;
-    player.current_max_bombs = 1;
-    player.current_bomb_radius = 1;
-    player.direction = PLAYER_DIR_DOWN;
+        rysuj_mape(game_map_arr);
+        rysuj_wyjscie(exit_rev, ex_x, ex_y);
+        rysuj_powerupy(powerups_arr);
+        rysuj_bomby_i_eksplozje(bombs_arr);
+        rysuj_czasteczki();
+        rysuj_wrogow(enemies_arr);
+        rysuj_gracza(p);
 
-    initialize_enemies(game_map, &player);
+        al_reset_clipping_rectangle();
+        al_identity_transform(&world_transform);
+        al_use_transform(&world_transform);
+        rysuj_hud(p);
 
-    for (int i = 0; i < MAX_BOMBS; i++) {
-        bombs[i].active = false;
-        bombs[i].exploding = false;
-        bombs[i].explosion_timer = 0;
-        bombs[i].num_affected_explosion_cells = 0;
+        if (current_s == GAME_OVER) {
+            rysuj_ekran_konca_gry(p, exit_rev, ex_x, ex_y);
+        }
     }
+}
 
-    for (int i = 0; i < MAX_POWERUPS; i++) {
-        powerups[i].is_active = false;
-    }
 
-    if (background_music_instance) {
-        if (al_get_sample_instance_playing(background_music_instance)) {
-            al_stop_sample_instance(background_music_instance);
-        }
-        al_play_sample_instance(background_music_instance);
-        printf("Background music started.\n");
-    }
+// --- Funkcje testu wydajności rysowania ---
 
-    current_game_state = PLAYING;
-    printf("New game started!\n");
+/**
+ * @brief Zlicza jedno wywołanie rysujące Allegro (wywoływana przed każdym z nich w ścieżce rysuj_gre).
+ * * Licznik rośnie tylko w trybie testu (--render-bench), poza nim funkcja nic nie robi.
+ */
+void rysuj_licz() {
+    if (render_bench.enabled) render_bench.draw_calls++;
 }
 
-// --- Funkcje obsługi logiki gry ---
-
 /**
- * @brief Obsługuje wejście z klawiatury.
- * * Reaguje na wciśnięcia klawiszy w zależności od aktualnego stanu gry (START_SCREEN, PLAYING, GAME_OVER).
- * Umożliwia ruch gracza, podkładanie bomb oraz nawigację w menu.
- * @param event Zdarzenie Allegro (oczekiwane jest zdarzenie klawiatury).
- * @param p Wskaźnik do struktury gracza.
- * @param current_s Wskaźnik do aktualnego stanu gry.
+ * @brief Buduje scenę testu wydajności rysowania zwykłymi funkcjami gry.
+ * * Każda scena startuje od nowej gry klasycznej ze stałym ziarnem obu generatorów,
+ * więc jej zawartość (i obraz) jest za każdym razem taka sama, niezależnie od --map i --endurance.
+ * @param scene Scena do zbudowania.
  */
-void obsluz_wejscie(ALLEGRO_EVENT event, Player* p, GAME_STATE* current_s) {
-    if (event.type == ALLEGRO_EVENT_KEY_DOWN) {
-        if (*current_s == START_SCREEN) {
-            if (event.keyboard.keycode == ALLEGRO_KEY_ENTER) {
-                setup_new_game();
+void test_rysowania_scena(RENDER_SCENE scene) {
+    game_mode = &game_modes[GAME_MODE_CLASSIC];
+    world_width = game_mode->map_width;
+    world_height = game_mode->map_height;
+    rng_state = RENDER_BENCH_SEED;
+    srand(RENDER_BENCH_SEED);
+    setup_new_game();
+
+    int spawn_x = player.x;
+    int spawn_y = player.y;
+    int placed = 0;
+
+    switch (scene) {
+    case RENDER_SCENE_MAX_EXPLOSIONS:
+        player.current_max_bombs = game_map->width * game_map->height;
+        player.current_bomb_radius = active_rules->max_bomb_radius;
+        for (int y = 0; y < game_map->height; y++) {
+            for (int x = 0; x < game_map->width; x++) {
+                if (mapa_kafelek(game_map, x, y) != EMPTY) continue;
+                player.x = x;
+                player.y = y;
+                try_plant_bomb(active_rules, &player);
             }
         }
-        else if (*current_s == PLAYING && p->is_alive) {
-            int next_x = p->x;
-            int next_y = p->y;
-            bool moved = false;
-
-            if (event.keyboard.keycode == ALLEGRO_KEY_UP || event.keyboard.keycode == ALLEGRO_KEY_W) {
-                next_y--; p->direction = PLAYER_DIR_UP; moved = true;
-            }
-            else if (event.keyboard.keycode == ALLEGRO_KEY_DOWN || event.keyboard.keycode == ALLEGRO_KEY_S) {
-                next_y++; p->direction = PLAYER_DIR_DOWN; moved = true;
-            }
-            else if (event.keyboard.keycode == ALLEGRO_KEY_LEFT || event.keyboard.keycode == ALLEGRO_KEY_A) {
-                next_x--; p->direction = PLAYER_DIR_LEFT; moved = true;
-            }
-            else if (event.keyboard.keycode == ALLEGRO_KEY_RIGHT || event.keyboard.keycode == ALLEGRO_KEY_D) {
-                next_x++; p->direction = PLAYER_DIR_RIGHT; moved = true;
+        player.x = spawn_x;
+        player.y = spawn_y;
+        for (int i = 0; i < bomb_pool.used; i++) {
+            if (bombs[i].active && !bombs[i].exploding) {
+                zdetonuj_bombe(active_rules, &bombs[i], &player, enemies, game_map, &current_game_state, &exit_revealed, exit_x, exit_y);
             }
-            else if (event.keyboard.keycode == ALLEGRO_KEY_SPACE) {
-                try_plant_bomb(p);
-            }
-
-            if (moved) {
-                if (next_x >= 0 && next_x < MAP_WIDTH &&
-                    next_y >= 0 && next_y < MAP_HEIGHT &&
-                    game_map[next_y][next_x] != SOLID_WALL &&
-                    game_map[next_y][next_x] != DESTRUCTIBLE_WALL) {
-                    p->x = next_x;
-                    p->y = next_y;
-
-                    for (int i = 0; i < MAX_POWERUPS; i++) {
-                        if (powerups[i].is_active && powerups[i].x == p->x && powerups[i].y == p->y) {
-                            powerups[i].is_active = false;
-                            printf("Player picked up power-up type %d!\n", powerups[i].type);
-                            if (powerups[i].type == POWERUP_BOMB_CAP) {
-                                if (p->current_max_bombs < MAX_BOMBS) { p->current_max_bombs++; }
-                            }
-                            else if (powerups[i].type == POWERUP_RADIUS_INC) {
-                                if (p->current_bomb_radius < 7) { p->current_bomb_radius++; }
-                            }
-                            else if (powerups[i].type == POWERUP_EXTRA_LIFE) {
-                                if (p->lives < PLAYER_MAX_LIVES) { p->lives++; }
-                            }
-                            break;
-                        }
-                    }
+        }
+        break;
+    case RENDER_SCENE_ALL_ENTITIES:
+        if (exit_x >= 0) {
+            ustaw_kafelek(game_map, exit_x, exit_y, EMPTY);
+            exit_revealed = true;
+        }
+        player.current_max_bombs = game_map->width * game_map->height;
+        for (int y = 0; y < game_map->height; y++) {
+            for (int x = 0; x < game_map->width; x++) {
+                if (mapa_kafelek(game_map, x, y) != EMPTY || (x == spawn_x && y == spawn_y) || (x == exit_x && y == exit_y)) continue;
+                if (placed++ % 2 == 0) {
+                    upusc_powerup(x, y);
+                }
+                else {
+                    player.x = x;
+                    player.y = y;
+                    try_plant_bomb(active_rules, &player);
                 }
             }
         }
-        else if (*current_s == GAME_OVER) {
-            if (event.keyboard.keycode == ALLEGRO_KEY_ENTER) {
-                setup_new_game();
-            }
+        player.x = spawn_x;
+        player.y = spawn_y;
+        // Bomby na różnych etapach lontu (pulsowanie i iskra zależą od czasu do wybuchu).
+        for (int i = 0; i < bomb_pool.used; i++) {
+            if (bombs[i].active) bombs[i].fuse_tick = timers.now + 1 + (uint32_t)(i * 13) % active_rules->bomb_fuse_ticks;
         }
+        break;
+    case RENDER_SCENE_GAME_OVER:
+        if (exit_x >= 0) {
+            ustaw_kafelek(game_map, exit_x, exit_y, EMPTY);
+            exit_revealed = true;
+        }
+        current_game_state = GAME_OVER;
+        break;
+    default:
+        break;
     }
 }
 
 /**
- * @brief Aktualizuje stan nietykalności gracza.
- * * Jeśli gracz jest nietykalny, dekrementuje licznik nietykalności.
- * Gdy licznik osiągnie zero, nietykalność jest wyłączana.
- * @param p Wskaźnik do struktury gracza.
+ * @brief Porównuje klatkę z obrazem wzorcowym `<katalog>/<nazwa>.png`.
+ * * Gdy wzorca nie ma, klatka jest zapisywana jako nowy wzorzec. Piksel różni się od wzorca,
+ * jeśli którakolwiek składowa odbiega o więcej niż RENDER_BENCH_TOLERANCE; wtedy klatka
+ * jest zapisywana obok wzorca jako `<nazwa>.actual.png`.
+ * @param frame Wyrenderowana klatka.
+ * @param name Nazwa sceny.
+ * @return true, jeśli klatka zgadza się ze wzorcem (lub wzorzec został właśnie utworzony).
  */
-void aktualizuj_nietykalnosc_gracza(Player* p) {
-    if (p->invincible) {
-        p->invincibility_timer--;
-        if (p->invincibility_timer <= 0) {
-            p->invincible = false;
+bool test_rysowania_porownaj(ALLEGRO_BITMAP* frame, const char* name) {
+    char path[RENDER_BENCH_PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/%s.png", render_bench.golden_dir, name);
+
+    ALLEGRO_BITMAP* golden = al_load_bitmap(path);
+    if (!golden) {
+        al_make_directory(render_bench.golden_dir);
+        if (!al_save_bitmap(path, frame)) {
+            fprintf(stderr, "Failed to save golden image %s\n", path);
+            return false;
         }
+        printf("  %s: no golden image, saved %s\n", name, path);
+        return true;
     }
-}
-
-/**
- * @brief Aktualizuje stan wszystkich bomb na mapie oraz obsługuje ich eksplozje.
- * * Dla każdej aktywnej bomby dekrementuje jej timer. Jeśli timer osiągnie zero,
- * bomba wybucha. Funkcja oblicza zasięg eksplozji, niszczy zniszczalne ściany
- * (przyznając punkty i potencjalnie odkrywając wyjście), zadaje obrażenia graczowi
- * i wrogom oraz obsługuje wypadanie power-upów z pokonanych wrogów.
- * @param bombs_arr Tablica bomb.
- * @param p Wskaźnik do struktury gracza.
- * @param enemies_arr Tablica wrogów.
- * @param powerups_arr Tablica power-upów.
- * @param game_map_arr Tablica mapy gry.
- * @param current_s Wskaźnik do aktualnego stanu gry.
- * @param exit_rev Wskaźnik do flagi odkrycia wyjścia.
- * @param ex_x Współrzędna X wyjścia.
- * @param ex_y Współrzędna Y wyjścia.
- */
-void aktualizuj_bomby(Bomb bombs_arr[], Player* p, Enemy enemies_arr[], Powerup powerups_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH], GAME_STATE* current_s, bool* exit_rev, int ex_x, int ex_y) {
-    for (int i = 0; i < MAX_BOMBS; i++) {
-        if (bombs_arr[i].active) {
-            if (!bombs_arr[i].exploding) {
-                bombs_arr[i].timer--;
-                if (bombs_arr[i].timer <= 0) {
-                    bombs_arr[i].exploding = true;
-                    bombs_arr[i].explosion_timer = EXPLOSION_DURATION;
-                    bombs_arr[i].num_affected_explosion_cells = 0;
-
-                    if (game_map_arr[bombs_arr[i].y][bombs_arr[i].x] != SOLID_WALL) {
-                        bombs_arr[i].affected_explosion_cells_x[bombs_arr[i].num_affected_explosion_cells] = bombs_arr[i].x;
-                        bombs_arr[i].affected_explosion_cells_y[bombs_arr[i].num_affected_explosion_cells] = bombs_arr[i].y;
-                        if (game_map_arr[bombs_arr[i].y][bombs_arr[i].x] == DESTRUCTIBLE_WALL) {
-                            game_map_arr[bombs_arr[i].y][bombs_arr[i].x] = EMPTY;
-                            p->score += POINTS_PER_WALL;
-                            if (bombs_arr[i].x == ex_x && bombs_arr[i].y == ex_y) {
-                                *exit_rev = true;
-                                printf("Exit revealed at (%d, %d)!\n", ex_x, ex_y);
-                            }
-                        }
-                        bombs_arr[i].num_affected_explosion_cells++;
-                    }
-
-                    int dx[] = { 0, 0, -1, 1 };
-                    int dy[] = { -1, 1, 0, 0 };
-                    for (int dir = 0; dir < 4; dir++) {
-                        for (int r = 1; r <= bombs_arr[i].radius; r++) {
-                            int cur_x = bombs_arr[i].x + dx[dir] * r;
-                            int cur_y = bombs_arr[i].y + dy[dir] * r;
-
-                            if (cur_x < 0 || cur_x >= MAP_WIDTH || cur_y < 0 || cur_y >= MAP_HEIGHT) break;
 
-                            if (bombs_arr[i].num_affected_explosion_cells < MAX_EXPLOSION_CELLS) {
-                                bombs_arr[i].affected_explosion_cells_x[bombs_arr[i].num_affected_explosion_cells] = cur_x;
-                                bombs_arr[i].affected_explosion_cells_y[bombs_arr[i].num_affected_explosion_cells] = cur_y;
-                                bombs_arr[i].num_affected_explosion_cells++;
-                            }
-                            else break;
-
-                            if (game_map_arr[cur_y][cur_x] == SOLID_WALL) break;
-
-                            if (game_map_arr[cur_y][cur_x] == DESTRUCTIBLE_WALL) {
-                                game_map_arr[cur_y][cur_x] = EMPTY;
-                                p->score += POINTS_PER_WALL;
-                                if (cur_x == ex_x && cur_y == ex_y) {
-                                    *exit_rev = true;
-                                    printf("Exit revealed at (%d, %d)!\n", ex_x, ex_y);
-                                }
-                                break;
-                            }
-                        }
-                    }
-
-                    bool player_hit_this_explosion = false;
-                    for (int k = 0; k < bombs_arr[i].num_affected_explosion_cells; k++) {
-                        int ex_coord = bombs_arr[i].affected_explosion_cells_x[k];
-                        int ey_coord = bombs_arr[i].affected_explosion_cells_y[k];
-                        if (p->is_alive && !p->invincible && !player_hit_this_explosion && p->x == ex_coord && p->y == ey_coord) {
-                            p->lives--;
-                            player_hit_this_explosion = true;
-                            printf("Player hit by explosion! Lives left: %d\n", p->lives);
-                            if (p->lives <= 0) {
-                                p->is_alive = false; *current_s = GAME_OVER;
-                                if (background_music_instance) al_stop_sample_instance(background_music_instance);
-                            }
-                            else {
-                                p->invincible = true; p->invincibility_timer = INVINCIBILITY_DURATION;
-                            }
-                        }
-                        for (int e_idx = 0; e_idx < MAX_ENEMIES; e_idx++) {
-                            if (enemies_arr[e_idx].is_alive && enemies_arr[e_idx].x == ex_coord && enemies_arr[e_idx].y == ey_coord) {
-                                enemies_arr[e_idx].is_alive = false;
-                                p->score += POINTS_PER_ENEMY;
-                                printf("Enemy %d at (%d, %d) destroyed by explosion! Player score: %d\n", e_idx, ex_coord, ey_coord, p->score);
-                                if (rand() % POWERUP_DROP_CHANCE == 0) {
-                                    for (int p_idx = 0; p_idx < MAX_POWERUPS; p_idx++) {
-                                        if (!powerups_arr[p_idx].is_active) {
-                                            powerups_arr[p_idx].is_active = true;
-                                            powerups_arr[p_idx].x = enemies_arr[e_idx].x;
-                                            powerups_arr[p_idx].y = enemies_arr[e_idx].y;
-                                            powerups_arr[p_idx].type = (POWERUP_TYPE)(rand() % POWERUP_TYPE_COUNT);
-                                            if (powerups_arr[p_idx].type == POWERUP_BOMB_CAP) powerups_arr[p_idx].color = al_map_rgb(0, 0, 255);
-                                            else if (powerups_arr[p_idx].type == POWERUP_RADIUS_INC) powerups_arr[p_idx].color = al_map_rgb(255, 165, 0);
-                                            else if (powerups_arr[p_idx].type == POWERUP_EXTRA_LIFE) powerups_arr[p_idx].color = al_map_rgb(255, 20, 147);
-                                            printf("Enemy dropped power-up type %d at (%d,%d)!\n", powerups_arr[p_idx].type, powerups_arr[p_idx].x, powerups_arr[p_idx].y);
-                                            break;
-                                        }
-                                    }
-                                }
-                            }
+    int width = al_get_bitmap_width(frame);
+    int height = al_get_bitmap_height(frame);
+    int differing = -1;
+    if (al_get_bitmap_width(golden) == width && al_get_bitmap_height(golden) == height) {
+        ALLEGRO_LOCKED_REGION* actual = al_lock_bitmap(frame, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READONLY);
+        ALLEGRO_LOCKED_REGION* expected = al_lock_bitmap(golden, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READONLY);
+        if (actual && expected) {
+            differing = 0;
+            for (int y = 0; y < height; y++) {
+                const unsigned char* a = (const unsigned char*)actual->data + y * actual->pitch;
+                const unsigned char* e = (const unsigned char*)expected->data + y * expected->pitch;
+                for (int x = 0; x < width * 4; x += 4) {
+                    for (int c = 0; c < 4; c++) {
+                        if (abs(a[x + c] - e[x + c]) > RENDER_BENCH_TOLERANCE) {
+                            differing++;
+                            break;
                         }
                     }
                 }
             }
-            else {
-                bombs_arr[i].explosion_timer--;
-                if (bombs_arr[i].explosion_timer <= 0) {
-                    bombs_arr[i].active = false;
-                    bombs_arr[i].exploding = false;
-                }
-            }
         }
+        if (actual) al_unlock_bitmap(frame);
+        if (expected) al_unlock_bitmap(golden);
+    }
+    al_destroy_bitmap(golden);
+    if (differing == 0) return true;
+
+    char actual_path[RENDER_BENCH_PATH_MAX + 32];
+    snprintf(actual_path, sizeof(actual_path), "%s/%s.actual.png", render_bench.golden_dir, name);
+    al_save_bitmap(actual_path, frame);
+    if (differing < 0) {
+        fprintf(stderr, "  %s: frame does not match the size of %s (saved %s)\n", name, path, actual_path);
+    }
+    else {
+        fprintf(stderr, "  %s: %d pixels differ from %s (saved %s)\n", name, differing, path, actual_path);
     }
+    return false;
 }
 
 /**
- * @brief Aktualizuje stan wrogów, zarządzając ich ruchem i zmianą kierunku.
- * * Dla każdego żywego wroga dekrementuje licznik ruchu. Gdy licznik osiągnie zero,
- * wróg próbuje się poruszyć w aktualnym kierunku. Jeśli ruch jest zablokowany
- * (przez ścianę, bombę, innego wroga lub odkryte wyjście), wróg próbuje zmienić kierunek.
- * @param enemies_arr Tablica wrogów.
- * @param p Wskaźnik do struktury gracza (nieużywany bezpośrednio w tej funkcji, ale może być potrzebny w przyszłości).
- * @param bombs_arr Tablica bomb (do sprawdzania kolizji).
- * @param game_map_arr Tablica mapy gry.
- * @param exit_rev Flaga odkrycia wyjścia.
- * @param ex_x Współrzędna X wyjścia.
- * @param ex_y Współrzędna Y wyjścia.
+ * @brief Uruchamia test wydajności rysowania (--render-bench).
+ * * Dla każdej sceny rysuje `render_bench.frames` klatek do bitmapy poza ekranem (czas animacji
+ * rośnie o jedną klatkę symulacji, stan gry stoi w miejscu) i wypisuje liczbę klatek na sekundę
+ * oraz wywołań rysujących na klatkę. Pomiar kończy odczyt bitmapy, więc obejmuje też pracę
+ * zaległą w sterowniku. Następnie klatka z czasem 0 jest porównywana z obrazem wzorcowym.
+ * @return 0, jeśli wszystkie sceny zgadzają się ze wzorcami, w przeciwnym razie -1.
  */
-void aktualizuj_wrogow(Enemy enemies_arr[], Player* p, Bomb bombs_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH], bool exit_rev, int ex_x, int ex_y) {
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        if (enemies_arr[i].is_alive) {
-            enemies_arr[i].move_timer--;
-            if (enemies_arr[i].move_timer <= 0) {
-                enemies_arr[i].move_timer = ENEMY_MOVE_DELAY + (rand() % (ENEMY_MOVE_DELAY / 2));
-
-                int next_ex = enemies_arr[i].x;
-                int next_ey = enemies_arr[i].y;
-                ENEMY_DIRECTION original_direction = enemies_arr[i].direction;
-                int attempts_to_move = 0;
-                bool moved_this_turn = false;
-
-                while (attempts_to_move < DIR_COUNT * 2 && !moved_this_turn) {
-                    next_ex = enemies_arr[i].x;
-                    next_ey = enemies_arr[i].y;
-
-                    if (attempts_to_move > 0 && attempts_to_move % DIR_COUNT == 0) {
-                        enemies_arr[i].direction = (ENEMY_DIRECTION)(rand() % DIR_COUNT);
-                    }
+int test_rysowania_uruchom() {
+    int width = VIEW_WIDTH * TILE_SIZE;
+    int height = VIEW_HEIGHT * TILE_SIZE + HUD_HEIGHT;
+    ALLEGRO_BITMAP* frame = al_create_bitmap(width, height);
+    if (!frame) {
+        fprintf(stderr, "Failed to create render benchmark target.\n");
+        return -1;
+    }
 
-                    if (enemies_arr[i].direction == DIR_UP) next_ey--;
-                    else if (enemies_arr[i].direction == DIR_DOWN) next_ey++;
-                    else if (enemies_arr[i].direction == DIR_LEFT) next_ex--;
-                    else if (enemies_arr[i].direction == DIR_RIGHT) next_ex++;
+    render_bench.fixed_clock = true;
+    printf("Render benchmark: %d frames per scene, %s target %dx%d, golden images in %s\n",
+        render_bench.frames, render_bench.gpu ? "video bitmap" : "memory bitmap", width, height, render_bench.golden_dir);
 
-                    bool can_move = true;
-                    if (next_ex <= 0 || next_ex >= MAP_WIDTH - 1 || next_ey <= 0 || next_ey >= MAP_HEIGHT - 1 ||
-                        game_map_arr[next_ey][next_ex] == SOLID_WALL ||
-                        game_map_arr[next_ey][next_ex] == DESTRUCTIBLE_WALL) {
-                        can_move = false;
-                    }
-                    for (int b = 0; b < MAX_BOMBS; b++) {
-                        if (bombs_arr[b].active && bombs_arr[b].x == next_ex && bombs_arr[b].y == next_ey) {
-                            can_move = false; break;
-                        }
-                    }
-                    for (int other_enemy_idx = 0; other_enemy_idx < MAX_ENEMIES; other_enemy_idx++) {
-                        if (i == other_enemy_idx) continue;
-                        if (enemies_arr[other_enemy_idx].is_alive && enemies_arr[other_enemy_idx].x == next_ex && enemies_arr[other_enemy_idx].y == next_ey) {
-                            can_move = false; break;
-                        }
-                    }
-                    if (exit_rev && next_ex == ex_x && next_ey == ex_y) {
-                        can_move = false;
-                    }
+    int failures = 0;
+    for (int scene = 0; scene < RENDER_SCENE_COUNT; scene++) {
+        test_rysowania_scena((RENDER_SCENE)scene);
 
-                    if (can_move) {
-                        enemies_arr[i].x = next_ex;
-                        enemies_arr[i].y = next_ey;
-                        moved_this_turn = true;
-                    }
-                    else {
-                        if (attempts_to_move < DIR_COUNT) {
-                            enemies_arr[i].direction = (ENEMY_DIRECTION)((original_direction + attempts_to_move + 1) % DIR_COUNT);
-                        }
-                        else {
-                            enemies_arr[i].direction = (ENEMY_DIRECTION)(rand() % DIR_COUNT);
-                        }
-                        attempts_to_move++;
-                    }
-                }
-                if (!moved_this_turn) {
-                    enemies_arr[i].direction = original_direction;
-                }
-            }
+        uint64_t calls_before = render_bench.draw_calls;
+        double start = al_get_time();
+        for (int f = 0; f < render_bench.frames; f++) {
+            render_bench.clock = (double)f / TICK_RATE;
+            rysuj_gre(frame, &player, bombs, enemies, powerups, game_map, current_game_state, exit_revealed, exit_x, exit_y);
         }
+        if (al_lock_bitmap(frame, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY)) al_unlock_bitmap(frame);
+        double elapsed = al_get_time() - start;
+        uint64_t calls = render_bench.draw_calls - calls_before;
+
+        printf("  %-15s %9.1f frames/s  %7.1f draw calls/frame\n", render_scene_names[scene],
+            elapsed > 0.0 ? render_bench.frames / elapsed : 0.0,
+            render_bench.frames > 0 ? (double)calls / render_bench.frames : 0.0);
+
+        render_bench.clock = 0.0;
+        rysuj_gre(frame, &player, bombs, enemies, powerups, game_map, current_game_state, exit_revealed, exit_x, exit_y);
+        if (!test_rysowania_porownaj(frame, render_scene_names[scene])) failures++;
+    }
+
+    al_destroy_bitmap(frame);
+    render_bench.fixed_clock = false;
+    if (failures > 0) {
+        fprintf(stderr, "Render benchmark: %d of %d scenes differ from golden images.\n", failures, RENDER_SCENE_COUNT);
+        return -1;
     }
+    printf("Render benchmark: all scenes match golden images.\n");
+    return 0;
 }
 
+
+// --- Funkcje powtórek ---
+
 /**
- * @brief Sprawdza kolizję gracza z wrogami.
- * * Jeśli gracz nie jest nietykalny i wejdzie na pole zajmowane przez żywego wroga,
- * traci życie. Jeśli liczba żyć spadnie do zera, gra się kończy.
- * Po kolizji gracz staje się na chwilę nietykalny.
- * @param p Wskaźnik do struktury gracza.
- * @param enemies_arr Tablica wrogów.
- * @param current_s Wskaźnik do aktualnego stanu gry.
+ * @brief Zaczyna nagrywanie powtórki gry, jeśli podano --record=PLIK (wywoływana na końcu setup_new_game).
+ * * Zapisuje wszystko, czego potrzeba do odtworzenia gry: stan generatora sprzed setup_new_game,
+ * tryb i rozmiar mapy, poziom paczki i wartości reguł. Gry środowisk treningowych nie są nagrywane.
+ * @param start_rng Stan generatora symulacji sprzed setup_new_game.
  */
-void sprawdz_kolizje_gracz_wrog(Player* p, Enemy enemies_arr[], GAME_STATE* current_s) {
-    if (p->is_alive && !p->invincible) {
-        for (int i = 0; i < MAX_ENEMIES; i++) {
-            if (enemies_arr[i].is_alive && p->x == enemies_arr[i].x && p->y == enemies_arr[i].y) {
-                p->lives--;
-                printf("Player collided with enemy! Lives left: %d\n", p->lives);
-                if (p->lives <= 0) {
-                    p->is_alive = false; *current_s = GAME_OVER;
-                    if (background_music_instance) al_stop_sample_instance(background_music_instance);
-                }
-                else {
-                    p->invincible = true; p->invincibility_timer = INVINCIBILITY_DURATION;
-                }
-                break;
-            }
-        }
+void powtorka_nagrywaj(uint32_t start_rng) {
+    if (!replay_recorder.path[0] || game_map != &main_map) return;
+
+    ReplayHeader* h = &replay_recorder.header;
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, REPLAY_MAGIC, 4);
+    h->version = REPLAY_VERSION;
+    h->rng_state = start_rng;
+    h->width = (uint32_t)world_width;
+    h->height = (uint32_t)world_height;
+    h->game_mode = (uint8_t)(game_mode - game_modes);
+    h->ruleset = (uint8_t)active_rules->id;
+    h->level = (int16_t)(level_terrain ? level_pack.current : -1);
+    for (int k = 0; k < RULE_FIELD_COUNT; k++) {
+        h->rules[k] = *(const int*)((const char*)active_rules + rule_fields[k].offset);
     }
+    replay_recorder.count = 0;
+    replay_recorder.active = true;
 }
 
 /**
- * @brief Sprawdza, czy warunki zwycięstwa zostały spełnione.
- * * Warunki zwycięstwa: gracz żyje, wszyscy wrogowie są pokonani, wyjście jest odkryte,
- * a gracz znajduje się na polu wyjścia.
- * @param p Wskaźnik do struktury gracza.
- * @param enemies_arr Tablica wrogów.
- * @param exit_rev Flaga odkrycia wyjścia.
- * @param ex_x Współrzędna X wyjścia.
- * @param ex_y Współrzędna Y wyjścia.
- * @param current_s Wskaźnik do aktualnego stanu gry.
+ * @brief Dopisuje do nagrania ostateczne wejście klatki.
+ * * Klatki muszą przychodzić po kolei; wejście klatki już zapisanej jest pomijane.
+ * @param tick Numer klatki.
+ * @param input Wejście użyte w klatce.
  */
-void sprawdz_warunek_wygranej(Player* p, Enemy enemies_arr[], bool exit_rev, int ex_x, int ex_y, GAME_STATE* current_s) {
-    if (p->is_alive && *current_s == PLAYING) {
-        bool all_enemies_defeated_now = true;
-        for (int k = 0; k < MAX_ENEMIES; k++) {
-            if (enemies_arr[k].is_alive) {
-                all_enemies_defeated_now = false;
-                break;
-            }
-        }
-        if (all_enemies_defeated_now && exit_rev && p->x == ex_x && p->y == ex_y) {
-            printf("CONGRATULATIONS! LEVEL COMPLETED!\n");
-            *current_s = GAME_OVER;
-            if (background_music_instance) al_stop_sample_instance(background_music_instance);
+void powtorka_dopisz(int tick, unsigned char input) {
+    if (!replay_recorder.active || tick != replay_recorder.count) return;
+    if (replay_recorder.count == replay_recorder.capacity) {
+        int capacity = replay_recorder.capacity ? replay_recorder.capacity * 2 : TICK_RATE * 60;
+        unsigned char* inputs = realloc(replay_recorder.inputs, capacity);
+        if (!inputs) {
+            fprintf(stderr, "Out of memory for replay inputs, recording stopped.\n");
+            replay_recorder.active = false;
+            return;
         }
+        replay_recorder.inputs = inputs;
+        replay_recorder.capacity = capacity;
     }
+    replay_recorder.inputs[replay_recorder.count++] = input;
 }
 
 /**
- * @brief Główna funkcja aktualizująca logikę gry.
- * * Wywoływana w każdej klatce gry (jeśli stan gry to PLAYING).
- * Odpowiada za aktualizację stanu nietykalności gracza, bomb, wrogów
- * oraz sprawdzanie kolizji i warunków zwycięstwa.
- * @param p Wskaźnik do struktury gracza.
- * @param bombs_arr Tablica bomb.
- * @param enemies_arr Tablica wrogów.
- * @param powerups_arr Tablica power-upów.
- * @param game_map_arr Tablica mapy gry.
- * @param current_s Wskaźnik do aktualnego stanu gry.
- * @param exit_rev Wskaźnik do flagi odkrycia wyjścia.
- * @param ex_x Współrzędna X wyjścia.
- * @param ex_y Współrzędna Y wyjścia.
+ * @brief Kończy nagrywanie: dopisuje wejścia z okna rollbacku i zapisuje plik powtórki.
+ * * Wywoływana po zakończeniu gry i przy wyjściu z programu (nagrana jest wtedy przerwana gra).
  */
-void aktualizuj_gre(Player* p, Bomb bombs_arr[], Enemy enemies_arr[], Powerup powerups_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH], GAME_STATE* current_s, bool* exit_rev, int ex_x, int ex_y) {
-    if (*current_s == PLAYING) {
-        aktualizuj_nietykalnosc_gracza(p);
-        aktualizuj_bomby(bombs_arr, p, enemies_arr, powerups_arr, game_map_arr, current_s, exit_rev, ex_x, ex_y);
-        aktualizuj_wrogow(enemies_arr, p, bombs_arr, game_map_arr, *exit_rev, ex_x, ex_y);
-        sprawdz_kolizje_gracz_wrog(p, enemies_arr, current_s);
-        sprawdz_warunek_wygranej(p, enemies_arr, *exit_rev, ex_x, ex_y, current_s);
+void powtorka_zakoncz() {
+    if (!replay_recorder.active) return;
+    for (int t = replay_recorder.count; t < rollback.tick; t++) {
+        powtorka_dopisz(t, rollback.inputs[t % ROLLBACK_RING_SIZE]);
+    }
+    if (!replay_recorder.active) return;
+    replay_recorder.active = false;
+
+    ReplayHeader* h = &replay_recorder.header;
+    h->tick_count = (uint32_t)replay_recorder.count;
+    h->final_hash = stan_skrot();
+
+    FILE* f = plik_otworz(replay_recorder.path, "wb");
+    bool ok = f && fwrite(h, sizeof(*h), 1, f) == 1 &&
+        fwrite(replay_recorder.inputs, 1, replay_recorder.count, f) == (size_t)replay_recorder.count;
+    if (f && fclose(f) != 0) ok = false;
+    if (ok) {
+        printf("Replay saved to %s (%d ticks)\n", replay_recorder.path, replay_recorder.count);
+    }
+    else {
+        fprintf(stderr, "Failed to save replay %s\n", replay_recorder.path);
     }
 }
 
+/**
+ * @brief Wczytuje i sprawdza plik powtórki.
+ * @param path Ścieżka pliku.
+ * @param header Nagłówek do wypełnienia.
+ * @param inputs Wynik: bufor `tick_count` wejść przydzielony przez malloc (zwalnia wywołujący).
+ * @return false, jeśli pliku nie da się odczytać albo jest niepoprawny (błąd został wypisany).
+ */
+bool powtorka_wczytaj(const char* path, ReplayHeader* header, unsigned char** inputs) {
+    *inputs = NULL;
+    FILE* f = plik_otworz(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Failed to open replay %s\n", path);
+        return false;
+    }
 
-// --- Funkcje rysowania ---
+    bool ok = fread(header, sizeof(*header), 1, f) == 1 && memcmp(header->magic, REPLAY_MAGIC, 4) == 0 &&
+        header->version == REPLAY_VERSION && header->game_mode < GAME_MODE_COUNT && header->ruleset <= RULESET_CUSTOM &&
+        header->width >= 5 && header->height >= 5;
+    for (int k = 0; ok && header->ruleset == RULESET_CUSTOM && k < RULE_FIELD_COUNT; k++) {
+        ok = header->rules[k] >= rule_fields[k].min && header->rules[k] <= rule_fields[k].max;
+    }
+    if (ok) {
+        *inputs = malloc(header->tick_count ? header->tick_count : 1);
+        ok = *inputs && fread(*inputs, 1, header->tick_count, f) == header->tick_count && fgetc(f) == EOF;
+    }
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "Invalid replay file %s\n", path);
+        free(*inputs);
+        *inputs = NULL;
+    }
+    return ok;
+}
 
 /**
- * @brief Rysuje ekran startowy gry.
- * @param display Wskaźnik do ekranu Allegro.
+ * @brief Koduje jedną klatkę eksportu: plik `<katalog>/frame_NNNNNN.png` albo surowe piksele dopisane do strumienia.
+ * * Surowa klatka to wiersze FRAME_WIDTH pikseli po 4 bajty (ALLEGRO_PIXEL_FORMAT_ABGR_8888, czyli
+ * R, G, B, A na procesorach little-endian), bez nagłówka - np. wejście `ffmpeg -f rawvideo -pixel_format rgba`.
+ * @param frame Wyrenderowana klatka.
+ * @param number Numer klatki.
+ * @return false, jeśli zapis się nie udał.
  */
-void rysuj_ekran_startowy(ALLEGRO_DISPLAY* display) {
-    if (font_main) {
-        float display_w = al_get_display_width(display);
-        float display_h = al_get_display_height(display);
-        al_draw_text(font_main, al_map_rgb(255, 255, 0), display_w / 2, display_h / 4, ALLEGRO_ALIGN_CENTER, "Bomberman");
-        al_draw_text(font_main, al_map_rgb(200, 200, 200), display_w / 2, display_h / 2, ALLEGRO_ALIGN_CENTER, "Press ENTER to start");
-        al_draw_text(font_main, al_map_rgb(150, 150, 150), display_w / 2, display_h / 2 + al_get_font_line_height(font_main) * 1.5f, ALLEGRO_ALIGN_CENTER, "ESC to exit");
+bool eksport_koduj(ALLEGRO_BITMAP* frame, int number) {
+    if (replay_export.raw) {
+        ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(frame, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READONLY);
+        if (!region) return false;
+        int width = al_get_bitmap_width(frame);
+        int height = al_get_bitmap_height(frame);
+        bool ok = true;
+        for (int y = 0; y < height && ok; y++) {
+            ok = fwrite((const unsigned char*)region->data + y * region->pitch, 4, width, replay_export.raw) == (size_t)width;
+        }
+        al_unlock_bitmap(frame);
+        return ok;
     }
+
+    char path[REPLAY_PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/frame_%06d.png", replay_export.png_dir, number);
+    return al_save_bitmap(path, frame);
 }
 
 /**
- * @brief Rysuje ekran końca gry (informację o wygranej lub przegranej oraz wynik).
- * @param display Wskaźnik do ekranu Allegro.
- * @param p Wskaźnik do struktury gracza.
- * @param enemies_arr Tablica wrogów (do sprawdzenia warunku wygranej).
- * @param exit_rev Flaga odkrycia wyjścia.
- * @param ex_x Współrzędna X wyjścia.
- * @param ex_y Współrzędna Y wyjścia.
+ * @brief Pętla wątku kodującego: pobiera kolejne gotowe klatki z pierścienia, koduje je i zwalnia bufory.
+ * * Klatki są pobierane w kolejności numerów, więc przy jednym wątku zapis surowy jest uporządkowany.
+ * Po ustawieniu `quit` wątek koduje jeszcze zaległe klatki i kończy pracę.
+ * @param thread Wątek Allegro.
+ * @param arg Nieużywany.
+ * @return Zawsze NULL.
  */
-void rysuj_ekran_konca_gry(ALLEGRO_DISPLAY* display, Player* p, Enemy enemies_arr[], bool exit_rev, int ex_x, int ex_y) {
-    if (font_main) {
-        float display_w = al_get_display_width(display);
-        float display_h = al_get_display_height(display);
-        float game_area_h = display_h - HUD_HEIGHT;
-        float center_y_game_area = HUD_HEIGHT + game_area_h / 2;
-        char score_text[50];
+void* eksport_watek(ALLEGRO_THREAD* thread, void* arg) {
+    (void)thread;
+    (void)arg;
+    for (;;) {
+        al_lock_mutex(replay_export.mutex);
+        int slot = replay_export.next_encode;
+        while (!replay_export.quit && (replay_export.frame_number[slot] < 0 || replay_export.taken[slot])) {
+            al_wait_cond(replay_export.ready_cond, replay_export.mutex);
+            slot = replay_export.next_encode;
+        }
+        if (replay_export.frame_number[slot] < 0 || replay_export.taken[slot]) {
+            al_unlock_mutex(replay_export.mutex);
+            break;
+        }
+        replay_export.taken[slot] = true;
+        replay_export.next_encode = (slot + 1) % replay_export.slots;
+        int number = replay_export.frame_number[slot];
+        al_unlock_mutex(replay_export.mutex);
+
+        bool ok = eksport_koduj(replay_export.frames[slot], number);
+
+        al_lock_mutex(replay_export.mutex);
+        if (!ok) replay_export.failures++;
+        replay_export.frame_number[slot] = -1;
+        replay_export.taken[slot] = false;
+        al_broadcast_cond(replay_export.free_cond);
+        al_unlock_mutex(replay_export.mutex);
+    }
+    return NULL;
+}
 
-        bool all_enemies_defeated_final_check = true;
-        for (int k = 0; k < MAX_ENEMIES; k++) {
-            if (enemies_arr[k].is_alive) {
-                all_enemies_defeated_final_check = false; break;
-            }
+/**
+ * @brief Odtwarza powtórkę bez okna i zapisuje każdą jej klatkę (--replay=PLIK).
+ * * Konfiguruje grę z nagłówka powtórki, a potem dla każdej klatki symulacji wykonuje krok_symulacji
+ * z nagranym wejściem i rysuje obraz tymi samymi funkcjami co gra (rysuj_gre) do wolnego bufora pierścienia.
+ * Wątki kodujące (eksport_watek) zapisują gotowe klatki równolegle z rysowaniem kolejnych. Czas animacji
+ * to czas klatki (numer / TICK_RATE), więc eksport wygląda tak samo przy każdym uruchomieniu.
+ * Na końcu skrót stanu jest porównywany z zapisanym w powtórce, a wynik wypisywany w klatkach na sekundę.
+ * Przy --hash-log=PLIK zapisuje skróty klatek tak jak gra, więc dziennik można porównać z nagraniem.
+ * @return 0 po udanym eksporcie, -1 w przypadku błędu albo rozbieżności powtórki.
+ */
+int powtorka_eksportuj() {
+    ReplayHeader header;
+    unsigned char* inputs = NULL;
+    if (!powtorka_wczytaj(replay_export.replay_path, &header, &inputs)) return -1;
+
+    if (header.level >= 0) {
+        if (!level_pack.data || header.level >= level_pack.count) {
+            fprintf(stderr, "Replay %s was recorded on level %d of a level pack; pass the same --level-pack=FILE.\n",
+                replay_export.replay_path, header.level + 1);
+            free(inputs);
+            return -1;
+        }
+        level_pack.current = header.level;
+    }
+    else if (level_pack.data) {
+        paczka_zamknij();
+    }
+    if (header.ruleset < RULESET_CUSTOM) {
+        rules_override = shipped_rules[header.ruleset];
+    }
+    else {
+        rules_custom = rules_classic;
+        rules_custom.id = RULESET_CUSTOM;
+        rules_custom.name = "custom";
+        for (int k = 0; k < RULE_FIELD_COUNT; k++) {
+            *(int*)((char*)&rules_custom + rule_fields[k].offset) = header.rules[k];
+        }
+        rules_override = &rules_custom;
+    }
+    game_mode = &game_modes[header.game_mode];
+    world_width = (int)header.width;
+    world_height = (int)header.height;
+    rng_state = header.rng_state;
+    srand(header.rng_state);
+    setup_new_game();
+
+    int workers = replay_export.workers > 0 ? replay_export.workers : al_get_cpu_count() - 1;
+    if (replay_export.raw) workers = 1;
+    if (workers < 1) workers = 1;
+    if (workers > EXPORT_MAX_WORKERS) workers = EXPORT_MAX_WORKERS;
+
+    if (!replay_export.raw) al_make_directory(replay_export.png_dir);
+    replay_export.mutex = al_create_mutex();
+    replay_export.ready_cond = al_create_cond();
+    replay_export.free_cond = al_create_cond();
+    replay_export.slots = 0;
+    for (int i = 0; i < workers * EXPORT_FRAMES_PER_WORKER; i++) {
+        replay_export.frames[i] = al_create_bitmap(FRAME_WIDTH, FRAME_HEIGHT);
+        if (!replay_export.frames[i]) break;
+        replay_export.frame_number[i] = -1;
+        replay_export.taken[i] = false;
+        replay_export.slots++;
+    }
+    replay_export.next_encode = 0;
+    replay_export.quit = false;
+    replay_export.failures = 0;
+    replay_export.thread_count = 0;
+    if (replay_export.mutex && replay_export.ready_cond && replay_export.free_cond && replay_export.slots > 0) {
+        for (int i = 0; i < workers; i++) {
+            replay_export.threads[i] = al_create_thread(eksport_watek, NULL);
+            if (!replay_export.threads[i]) break;
+            replay_export.thread_count++;
+        }
+        for (int i = 0; i < replay_export.thread_count; i++) {
+            al_start_thread(replay_export.threads[i]);
+        }
+    }
+    if (replay_export.slots == 0) {
+        fprintf(stderr, "Failed to create export frame buffers.\n");
+        free(inputs);
+        return -1;
+    }
+
+    int frame_count = (int)header.tick_count + 1;
+    printf("Replay export: %d frames (%.1f s of play), %dx%d, %d encoder threads, %s %s\n", frame_count,
+        (double)header.tick_count / TICK_RATE, FRAME_WIDTH, FRAME_HEIGHT, replay_export.thread_count,
+        replay_export.raw ? "raw RGBA to" : "PNG files in", replay_export.raw ? "stream" : replay_export.png_dir);
+
+    render_bench.fixed_clock = true;
+    double start = al_get_time();
+    double stalled = 0.0;
+    for (int f = 0; f < frame_count; f++) {
+        if (f > 0) {
+            if (hash_log) skrot_zapisz_klatke(f - 1, stan_skrot());
+            krok_symulacji(inputs[f - 1]);
+            mapa_przytnij_dziennik(game_map, game_map->journal_head);
+            czasteczki_aktualizuj();
         }
-        al_draw_filled_rectangle(0, HUD_HEIGHT, display_w, display_h, al_map_rgba(0, 0, 0, 150));
 
-        snprintf(score_text, sizeof(score_text), "Score: %d", p->score);
-        float score_y_offset = al_get_font_line_height(font_main) * 1.5f;
+        int slot = f % replay_export.slots;
+        if (replay_export.thread_count > 0) {
+            double wait_start = al_get_time();
+            al_lock_mutex(replay_export.mutex);
+            while (replay_export.frame_number[slot] >= 0) {
+                al_wait_cond(replay_export.free_cond, replay_export.mutex);
+            }
+            al_unlock_mutex(replay_export.mutex);
+            stalled += al_get_time() - wait_start;
+        }
 
+        render_bench.clock = (double)f / TICK_RATE;
+        rysuj_gre(replay_export.frames[slot], &player, bombs, enemies, powerups, game_map, current_game_state, exit_revealed, exit_x, exit_y);
 
-        if (p->is_alive && all_enemies_defeated_final_check && exit_rev && p->x == ex_x && p->y == ex_y) {
-            al_draw_text(font_main, al_map_rgb(0, 255, 0),
-                display_w / 2, center_y_game_area - (al_get_font_line_height(font_main) * 2),
-                ALLEGRO_ALIGN_CENTER, "VICTORY!");
-            al_draw_text(font_main, al_map_rgb(255, 255, 0), display_w / 2, center_y_game_area - score_y_offset + al_get_font_line_height(font_main), ALLEGRO_ALIGN_CENTER, score_text);
+        if (replay_export.thread_count > 0) {
+            al_lock_mutex(replay_export.mutex);
+            replay_export.frame_number[slot] = f;
+            al_broadcast_cond(replay_export.ready_cond);
+            al_unlock_mutex(replay_export.mutex);
         }
-        else {
-            al_draw_text(font_main, al_map_rgb(255, 0, 0),
-                display_w / 2, center_y_game_area - (al_get_font_line_height(font_main) * 2),
-                ALLEGRO_ALIGN_CENTER, "GAME OVER");
-            al_draw_text(font_main, al_map_rgb(255, 255, 255), display_w / 2, center_y_game_area - score_y_offset + al_get_font_line_height(font_main), ALLEGRO_ALIGN_CENTER, score_text);
+        else if (!eksport_koduj(replay_export.frames[slot], f)) {
+            replay_export.failures++;
+        }
+
+        if ((f + 1) % EXPORT_REPORT_INTERVAL == 0) {
+            printf("  %d/%d frames, %.1f frames/s\n", f + 1, frame_count, (f + 1) / (al_get_time() - start));
         }
-        al_draw_text(font_main, al_map_rgb(200, 200, 200),
-            display_w / 2, center_y_game_area + (al_get_font_line_height(font_main) * 1.5f),
-            ALLEGRO_ALIGN_CENTER, "Press ENTER to restart");
+    }
+    uint64_t final_hash = stan_skrot();
+
+    if (replay_export.mutex) {
+        al_lock_mutex(replay_export.mutex);
+        replay_export.quit = true;
+        al_broadcast_cond(replay_export.ready_cond);
+        al_unlock_mutex(replay_export.mutex);
+    }
+    for (int i = 0; i < replay_export.thread_count; i++) {
+        al_join_thread(replay_export.threads[i], NULL);
+        al_destroy_thread(replay_export.threads[i]);
+    }
+    replay_export.thread_count = 0;
+    if (replay_export.raw) fflush(replay_export.raw);
+    double elapsed = al_get_time() - start;
+    render_bench.fixed_clock = false;
+
+    for (int i = 0; i < replay_export.slots; i++) {
+        al_destroy_bitmap(replay_export.frames[i]);
+        replay_export.frames[i] = NULL;
+    }
+    replay_export.slots = 0;
+    if (replay_export.free_cond) al_destroy_cond(replay_export.free_cond);
+    if (replay_export.ready_cond) al_destroy_cond(replay_export.ready_cond);
+    if (replay_export.mutex) al_destroy_mutex(replay_export.mutex);
+    replay_export.free_cond = NULL;
+    replay_export.ready_cond = NULL;
+    replay_export.mutex = NULL;
+    free(inputs);
+
+    printf("Replay export: %d frames in %.2f s - %.1f frames/s (%.1fx real time), simulate and draw %.2f ms/frame, waited for encoders %.2f ms/frame\n",
+        frame_count, elapsed, elapsed > 0.0 ? frame_count / elapsed : 0.0,
+        elapsed > 0.0 ? frame_count / (double)TICK_RATE / elapsed : 0.0,
+        (elapsed - stalled) * 1e3 / frame_count, stalled * 1e3 / frame_count);
+
+    int ret = 0;
+    if (replay_export.failures > 0) {
+        fprintf(stderr, "Replay export: %d frames could not be written.\n", replay_export.failures);
+        ret = -1;
+    }
+    if (final_hash != header.final_hash) {
+        fprintf(stderr, "Replay export: final state hash %016llx differs from the recorded %016llx - the replay diverged.\n",
+            (unsigned long long)final_hash, (unsigned long long)header.final_hash);
+        ret = -1;
+    }
+    return ret;
+}
+
+// --- Funkcje pętli gry ---
+
+/**
+ * @brief Sprawdza, czy obraz zmienia się bez udziału gracza.
+ * * Tak jest w trakcie rozgrywki, dopóki żyją iskry eksplozji oraz gdy na ekranie końca gry
+ * pulsuje odkryte wyjście rysowane bez sprite'a. Ekran startowy i nieruchomy ekran końca gry
+ * nie wymagają ani klatek symulacji, ani odświeżania.
+ * @return true, jeśli potrzebne są kolejne klatki.
+ */
+bool scena_animowana() {
+    if (current_game_state == PLAYING) return true;
+    if (particles.count > 0) return true;
+    return current_game_state == GAME_OVER && exit_revealed && !exit_sprite;
+}
+
+/**
+ * @brief Zatrzymuje timer klatek, gdy nic się nie animuje, i uruchamia go ponownie, gdy jest potrzebny.
+ * * Przy zatrzymanym timerze pętla główna śpi w al_wait_for_event aż do zdarzenia wejścia
+ * lub okna, więc bezczynny ekran nie zużywa CPU ani GPU.
+ * @param timer Timer klatek symulacji.
+ */
+void dostosuj_zegar(ALLEGRO_TIMER* timer) {
+    bool needed = scena_animowana();
+    bool running = al_get_timer_started(timer);
+    if (needed && !running) {
+        al_start_timer(timer);
+    }
+    else if (!needed && running) {
+        al_stop_timer(timer);
     }
 }
 
 /**
- * @brief Rysuje interfejs użytkownika (HUD) na górze ekranu.
- * Wyświetla informacje takie jak liczba żyć, wynik, liczba pozostałych wrogów,
- * aktualna liczba bomb i moc eksplozji.
- * @param p Wskaźnik do struktury gracza.
+ * @brief Rysuje bieżący stan gry, pokazuje go w oknie i mierzy czas klatki.
+ * @param display Wskaźnik do ekranu.
  */
-void rysuj_hud(Player* p) {
-    if (font_main) {
-        char text_buffer[50];
-
-        snprintf(text_buffer, sizeof(text_buffer), "Lives: %d", p->lives);
-        al_draw_text(font_main, al_map_rgb(255, 255, 255), 10, 5, ALLEGRO_ALIGN_LEFT, text_buffer);
-
-        snprintf(text_buffer, sizeof(text_buffer), "Score: %d", p->score);
-        al_draw_text(font_main, al_map_rgb(255, 255, 255), al_get_display_width(al_get_current_display()) / 2, 5, ALLEGRO_ALIGN_CENTER, text_buffer);
-
-        int active_enemies_count = 0;
-        for (int i = 0; i < MAX_ENEMIES; ++i) if (enemies[i].is_alive) active_enemies_count++;
-        snprintf(text_buffer, sizeof(text_buffer), "Enemies: %d", active_enemies_count);
-        al_draw_text(font_main, al_map_rgb(255, 255, 255), al_get_display_width(al_get_current_display()) - 10, 5, ALLEGRO_ALIGN_RIGHT, text_buffer);
+void narysuj_klatke(ALLEGRO_DISPLAY* display) {
+    double frame_start = metrics.enabled ? al_get_time() : 0.0;
+    rysuj_gre(presenter.frame ? presenter.frame : al_get_backbuffer(display), &player, bombs, enemies, powerups, game_map, current_game_state, exit_revealed, exit_x, exit_y);
+    if (presenter.frame) prezentacja_pokaz(display);
+    al_flip_display();
+    opoznienie_po_flipie();
+    if (metrics.enabled) metryki_histogram_dodaj(&metrics.frame_time, al_get_time() - frame_start);
+}
 
-        float second_line_y = 5 + al_get_font_line_height(font_main) + 2;
 
-        snprintf(text_buffer, sizeof(text_buffer), "Bombs: %d", p->current_max_bombs);
-        al_draw_text(font_main, al_map_rgb(255, 255, 255), 10, second_line_y, ALLEGRO_ALIGN_LEFT, text_buffer);
+// --- Funkcje środowisk treningowych ---
 
-        snprintf(text_buffer, sizeof(text_buffer), "Power: %d", p->current_bomb_radius);
-        al_draw_text(font_main, al_map_rgb(255, 255, 255), al_get_display_width(al_get_current_display()) - 10, second_line_y, ALLEGRO_ALIGN_RIGHT, text_buffer);
-    }
+/**
+ * @brief Przygotowuje stan globalny do kroków środowisk: zapamiętuje mapę gry i rozmiar nowej mapy
+ * oraz wycisza efekty uboczne symulacji.
+ * @param batch Wskaźnik do zestawu środowisk.
+ */
+void trening_wejdz(TrainingBatch* batch) {
+    batch->saved_map = game_map;
+    batch->saved_width = world_width;
+    batch->saved_height = world_height;
+    batch->saved_quiet = rollback_resymulacja;
+    world_width = batch->width;
+    world_height = batch->height;
+    rollback_resymulacja = true;
 }
 
 /**
- * @brief Rysuje kafelki mapy gry (ściany, puste pola).
- * @param game_map_arr Tablica mapy gry.
+ * @brief Przywraca stan globalny zapamiętany przez trening_wejdz.
+ * @param batch Wskaźnik do zestawu środowisk.
  */
-void rysuj_mape(int game_map_arr[MAP_HEIGHT][MAP_WIDTH]) {
-    for (int y_map = 0; y_map < MAP_HEIGHT; y_map++) {
-        for (int x_map = 0; x_map < MAP_WIDTH; x_map++) {
-            int tile_x_pos = x_map * TILE_SIZE;
-            int tile_y_pos = y_map * TILE_SIZE + HUD_HEIGHT;
+void trening_wyjdz(TrainingBatch* batch) {
+    game_map = batch->saved_map;
+    world_width = batch->saved_width;
+    world_height = batch->saved_height;
+    rollback_resymulacja = batch->saved_quiet;
+}
 
-            if (game_map_arr[y_map][x_map] == SOLID_WALL) {
-                al_draw_filled_rectangle(tile_x_pos, tile_y_pos, tile_x_pos + TILE_SIZE, tile_y_pos + TILE_SIZE, al_map_rgb(80, 80, 80));
-            }
-            else if (game_map_arr[y_map][x_map] == DESTRUCTIBLE_WALL) {
-                if (destructible_wall_sprite) {
-                    al_draw_bitmap(destructible_wall_sprite, tile_x_pos, tile_y_pos, 0);
-                }
-                else {
-                    al_draw_filled_rectangle(tile_x_pos, tile_y_pos, tile_x_pos + TILE_SIZE, tile_y_pos + TILE_SIZE, al_map_rgb(150, 75, 0));
-                }
-            }
-            else {
-                al_draw_filled_rectangle(tile_x_pos, tile_y_pos, tile_x_pos + TILE_SIZE, tile_y_pos + TILE_SIZE, al_map_rgb(0, 0, 0));
-            }
-        }
-    }
+/**
+ * @brief Zaczyna nowy epizod w środowisku (zwykłe setup_new_game na mapie środowiska).
+ * * Generator liczb losowych nie jest resetowany, więc kolejne epizody mają różne mapy.
+ * @param env Wskaźnik do środowiska; jego stan musi być aktywny (przywrócony).
+ */
+void trening_nowa_gra(TrainingEnv* env) {
+    game_map = &env->map;
+    setup_new_game();
+    env->episode_ticks = 0;
 }
 
 /**
- * @brief Rysuje wyjście z poziomu, jeśli zostało odkryte.
- * * Jeśli dostępny jest sprite wyjścia (`exit_sprite`), używa go.
- * W przeciwnym razie rysuje domyślny, pulsujący efekt portalu.
- * @param exit_rev Flaga wskazująca, czy wyjście jest odkryte.
- * @param ex_x Współrzędna X wyjścia.
- * @param ex_y Współrzędna Y wyjścia.
+ * @brief Zapisuje płaszczyzny cech aktywnego środowiska.
+ * @param batch Wskaźnik do zestawu środowisk.
+ * @param out Bufor na TRAIN_PLANES * width * height liczb.
  */
-void rysuj_wyjscie(bool exit_rev, int ex_x, int ex_y) {
-    if (exit_rev) {
-        if (exit_sprite) {
-            al_draw_bitmap(exit_sprite, ex_x * TILE_SIZE, ex_y * TILE_SIZE + HUD_HEIGHT, 0);
+void trening_obserwuj(const TrainingBatch* batch, float* out) {
+    int width = batch->width;
+    int plane = width * batch->height;
+    memset(out, 0, sizeof(float) * TRAIN_PLANES * plane);
+
+    // Kafelki są czytane wierszami prosto z fragmentów (cała mapa środowiska jest w pamięci).
+    for (int y = 0; y < batch->height; y++) {
+        for (int x0 = 0; x0 < width; x0 += CHUNK_SIZE) {
+            const MapChunk* c = mapa_fragment(game_map, x0 >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+            const unsigned char* row = &c->tiles[(y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT];
+            int n = (width - x0 < CHUNK_SIZE) ? width - x0 : CHUNK_SIZE;
+            float* solid = out + TRAIN_PLANE_SOLID * plane + y * width + x0;
+            float* box = out + TRAIN_PLANE_BOX * plane + y * width + x0;
+            for (int i = 0; i < n; i++) {
+                solid[i] = (float)(row[i] == SOLID_WALL);
+                box[i] = (float)(row[i] == DESTRUCTIBLE_WALL);
+            }
         }
-        else {
-            float center_x = ex_x * TILE_SIZE + TILE_SIZE / 2.0f;
-            float center_y = ex_y * TILE_SIZE + HUD_HEIGHT + TILE_SIZE / 2.0f;
-
-            al_draw_filled_rectangle(ex_x * TILE_SIZE, ex_y * TILE_SIZE + HUD_HEIGHT,
-                ex_x * TILE_SIZE + TILE_SIZE, ex_y * TILE_SIZE + HUD_HEIGHT + TILE_SIZE,
-                al_map_rgb(30, 0, 50));
-
-            double time_now = al_get_time();
-            float pulse_factor = (sin(time_now * 5.0) + 1.0) / 2.0;
-
-            float outer_radius = TILE_SIZE * 0.4f * (0.8f + pulse_factor * 0.2f);
-            unsigned char r_outer = 100 + (unsigned char)(pulse_factor * 50);
-            unsigned char g_outer = 50 + (unsigned char)(pulse_factor * 50);
-            al_draw_filled_circle(center_x, center_y, outer_radius, al_map_rgb(r_outer, g_outer, 200));
-
-            float inner_radius = TILE_SIZE * 0.25f * (0.7f + pulse_factor * 0.3f);
-            unsigned char r_inner = 200 + (unsigned char)(pulse_factor * 55);
-            unsigned char g_inner = 180 + (unsigned char)(pulse_factor * 75);
-            al_draw_filled_circle(center_x, center_y, inner_radius, al_map_rgb(r_inner, g_inner, 255));
+    }
 
-            if (((int)(time_now * 10)) % 2 == 0) {
-                al_draw_filled_circle(center_x, center_y, TILE_SIZE * 0.05f, al_map_rgb(255, 255, 255));
+    for (int i = 0; i < bomb_pool.used; i++) {
+        const Bomb* b = &bombs[i];
+        if (!bomb_pool.live[i] || !b->active) continue;
+        if (!b->exploding) {
+            out[TRAIN_PLANE_BOMB * plane + b->y * width + b->x] = (float)(b->fuse_tick - timers.now) / active_rules->bomb_fuse_ticks;
+            continue;
+        }
+        float* blast = out + TRAIN_PLANE_BLAST * plane;
+        if (b->blast_centre) blast[b->y * width + b->x] = 1.0f;
+        for (int dir = 0; dir < BLAST_DIRECTIONS; dir++) {
+            for (int k = 1; k <= b->blast_len[dir]; k++) {
+                blast[(b->y + blast_dy[dir] * k) * width + b->x + blast_dx[dir] * k] = 1.0f;
             }
         }
     }
+    for (int i = 0; i < enemy_pool.used; i++) {
+        if (enemy_pool.live[i] && enemies[i].is_alive) {
+            out[TRAIN_PLANE_ENEMY * plane + enemies[i].y * width + enemies[i].x] += 1.0f;
+        }
+    }
+    for (int i = 0; i < powerup_pool.used; i++) {
+        if (powerup_pool.live[i] && powerups[i].is_active) {
+            out[TRAIN_PLANE_POWERUP * plane + powerups[i].y * width + powerups[i].x] = (float)(powerups[i].type + 1) / POWERUP_TYPE_COUNT;
+        }
+    }
+    if (player.is_alive) out[TRAIN_PLANE_PLAYER * plane + player.y * width + player.x] = 1.0f;
+    if (exit_revealed && exit_x >= 0) out[TRAIN_PLANE_EXIT * plane + exit_y * width + exit_x] = 1.0f;
 }
 
-
 /**
- * @brief Rysuje aktywne power-upy na mapie.
- * @param powerups_arr Tablica power-upów.
+ * @brief Tworzy zestaw niezależnych środowisk treningowych i zaczyna w każdym nową grę.
+ * * Środowiska używają bieżącego trybu gry i reguł (jak setup_new_game). Mapa musi mieścić się
+ * w pamięci w całości (najwyżej MAP_MAX_RESIDENT_CHUNKS fragmentów), bo środowiska nie mają plików wymiany.
+ * Środowisko `i` dostaje ziarno pochodne od `seed` i `i`, więc zestaw jest powtarzalny.
+ * @param count Liczba środowisk.
+ * @param width Szerokość map w kafelkach (co najmniej 5).
+ * @param height Wysokość map w kafelkach (co najmniej 5).
+ * @param seed Ziarno zestawu.
+ * @return Wskaźnik do zestawu albo NULL przy błędnych parametrach lub braku pamięci.
  */
-void rysuj_powerupy(Powerup powerups_arr[]) {
-    for (int i = 0; i < MAX_POWERUPS; i++) {
-        if (powerups_arr[i].is_active) {
-            al_draw_filled_rectangle(powerups_arr[i].x * TILE_SIZE + TILE_SIZE / 4,
-                powerups_arr[i].y * TILE_SIZE + TILE_SIZE / 4 + HUD_HEIGHT,
-                powerups_arr[i].x * TILE_SIZE + (TILE_SIZE * 3) / 4,
-                powerups_arr[i].y * TILE_SIZE + (TILE_SIZE * 3) / 4 + HUD_HEIGHT,
-                powerups_arr[i].color);
-            al_draw_rectangle(powerups_arr[i].x * TILE_SIZE + TILE_SIZE / 4,
-                powerups_arr[i].y * TILE_SIZE + TILE_SIZE / 4 + HUD_HEIGHT,
-                powerups_arr[i].x * TILE_SIZE + (TILE_SIZE * 3) / 4,
-                powerups_arr[i].y * TILE_SIZE + (TILE_SIZE * 3) / 4 + HUD_HEIGHT,
-                al_map_rgb(255, 255, 255), 2);
-        }
+TRAIN_API TrainingBatch* trening_utworz(int count, int width, int height, uint32_t seed) {
+    int chunks = ((width + CHUNK_SIZE - 1) >> CHUNK_SHIFT) * ((height + CHUNK_SIZE - 1) >> CHUNK_SHIFT);
+    if (count <= 0 || width < 5 || height < 5 || chunks > MAP_MAX_RESIDENT_CHUNKS) {
+        fprintf(stderr, "Training: invalid batch %d x %dx%d (maps must fit in %d chunks)\n", count, width, height, MAP_MAX_RESIDENT_CHUNKS);
+        return NULL;
+    }
+    if (!al_is_system_installed() && !al_init()) {
+        fprintf(stderr, "Training: failed to initialize Allegro!\n");
+        return NULL;
+    }
+
+    TrainingBatch* batch = (TrainingBatch*)calloc(1, sizeof(TrainingBatch));
+    if (!batch) return NULL;
+    batch->envs = (TrainingEnv*)calloc((size_t)count, sizeof(TrainingEnv));
+    if (!batch->envs) {
+        free(batch);
+        return NULL;
     }
+    batch->count = count;
+    batch->width = width;
+    batch->height = height;
+
+    trening_wejdz(batch);
+    uint32_t saved_rng = rng_state;
+    for (int i = 0; i < count; i++) {
+        rng_state = (seed ^ ((uint32_t)i * 0x9E3779B9u)) | 1u;
+        trening_nowa_gra(&batch->envs[i]);
+        zapisz_stan_gry(&batch->envs[i].state);
+        mapa_przytnij_dziennik(game_map, batch->envs[i].state.map_journal);
+    }
+    rng_state = saved_rng;
+    trening_wyjdz(batch);
+    return batch;
 }
 
 /**
- * @brief Rysuje bomby (tykające) oraz efekty ich eksplozji.
- * @param bombs_arr Tablica bomb.
- * @param game_map_arr Tablica mapy gry (do sprawdzania, czy nie rysować eksplozji na ścianach).
- */
-void rysuj_bomby_i_eksplozje(Bomb bombs_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH]) {
-    for (int i = 0; i < MAX_BOMBS; i++) {
-        if (bombs_arr[i].active) {
-            if (bombs_arr[i].exploding) {
-                if (sparks_sprite) {
-                    for (int k = 0; k < bombs_arr[i].num_affected_explosion_cells; k++) {
-                        int ex_coord = bombs_arr[i].affected_explosion_cells_x[k];
-                        int ey_coord = bombs_arr[i].affected_explosion_cells_y[k];
-                        if (game_map_arr[ey_coord][ex_coord] != SOLID_WALL) {
-                            al_draw_tinted_scaled_rotated_bitmap_region(
-                                sparks_sprite,
-                                0, 0, al_get_bitmap_width(sparks_sprite), al_get_bitmap_height(sparks_sprite),
-                                al_map_rgba(255, 255, 255, 200 - (EXPLOSION_DURATION - bombs_arr[i].explosion_timer) * (200 / (EXPLOSION_DURATION + 1))),
-                                al_get_bitmap_width(sparks_sprite) / 2, al_get_bitmap_height(sparks_sprite) / 2,
-                                ex_coord * TILE_SIZE + TILE_SIZE / 2,
-                                ey_coord * TILE_SIZE + HUD_HEIGHT + TILE_SIZE / 2,
-                                (float)TILE_SIZE / al_get_bitmap_width(sparks_sprite),
-                                (float)TILE_SIZE / al_get_bitmap_height(sparks_sprite),
-                                (float)(rand() % 360) * ALLEGRO_PI / 180.0f,
-                                0
-                            );
-                        }
-                    }
-                }
-                else { /* Fallback rysowania eksplozji */ }
-            }
-            else {
-                if (dynamite_sprite) {
-                    float scale = 1.0f;
-                    if (bombs_arr[i].timer < 45) {
-                        scale = 1.0f + (((BOMB_TIMER_DURATION - bombs_arr[i].timer) % 12 < 6) ? 0.1f * sinf((BOMB_TIMER_DURATION - bombs_arr[i].timer) * 0.5f) : -0.1f * sinf((BOMB_TIMER_DURATION - bombs_arr[i].timer) * 0.5f));
-                    }
-                    al_draw_scaled_bitmap(dynamite_sprite,
-                        0, 0, al_get_bitmap_width(dynamite_sprite), al_get_bitmap_height(dynamite_sprite),
-                        bombs_arr[i].x * TILE_SIZE + TILE_SIZE / 2.0f * (1.0f - scale),
-                        bombs_arr[i].y * TILE_SIZE + HUD_HEIGHT + TILE_SIZE / 2.0f * (1.0f - scale),
-                        TILE_SIZE * scale, TILE_SIZE * scale, 0);
-
-                    if (bombs_arr[i].timer > 0) {
-                        float fuse_length_factor = (float)bombs_arr[i].timer / BOMB_TIMER_DURATION;
-                        float fuse_x_start = bombs_arr[i].x * TILE_SIZE + TILE_SIZE * 0.7f;
-                        float fuse_y_start = bombs_arr[i].y * TILE_SIZE + HUD_HEIGHT + TILE_SIZE * 0.2f;
-                        float fuse_x_end = fuse_x_start + (TILE_SIZE / 6.0f) * fuse_length_factor;
-                        float fuse_y_end = fuse_y_start - (TILE_SIZE / 12.0f) * (1.0f - fuse_length_factor);
-                        al_draw_line(fuse_x_start, fuse_y_start, fuse_x_end, fuse_y_end, al_map_rgb(60, 60, 60), 3.0f);
-                        if ((bombs_arr[i].timer / 6) % 2 == 0) {
-                            al_draw_filled_circle(fuse_x_end, fuse_y_end, TILE_SIZE / 9.0f, al_map_rgb(255, (rand() % 100) + 100, 0));
-                        }
-                    }
-                }
-                else { /* Fallback rysowania bomby */ }
-            }
-        }
-    }
+ * @brief Zwraca liczbę liczb float obserwacji jednego środowiska.
+ * @param batch Wskaźnik do zestawu środowisk.
+ * @return TRAIN_PLANES * width * height.
+ */
+TRAIN_API int trening_rozmiar_obserwacji(const TrainingBatch* batch) {
+    return TRAIN_PLANES * batch->width * batch->height;
 }
 
 /**
- * @brief Rysuje wrogów na mapie.
- * @param enemies_arr Tablica wrogów.
+ * @brief Zapisuje obserwacje wszystkich środowisk bez wykonywania kroku (np. po utworzeniu zestawu).
+ * @param batch Wskaźnik do zestawu środowisk.
+ * @param obs Bufor na count * trening_rozmiar_obserwacji liczb.
  */
-void rysuj_wrogow(Enemy enemies_arr[]) {
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        if (enemies_arr[i].is_alive) {
-            al_draw_filled_rectangle(enemies_arr[i].x * TILE_SIZE + TILE_SIZE * 0.1f,
-                enemies_arr[i].y * TILE_SIZE + HUD_HEIGHT + TILE_SIZE * 0.1f,
-                enemies_arr[i].x * TILE_SIZE + TILE_SIZE * 0.9f,
-                enemies_arr[i].y * TILE_SIZE + TILE_SIZE + HUD_HEIGHT - TILE_SIZE * 0.1f,
-                enemies_arr[i].color);
-
-            float eye_base_x_l = enemies_arr[i].x * TILE_SIZE + TILE_SIZE * 0.3f;
-            float eye_base_x_r = enemies_arr[i].x * TILE_SIZE + TILE_SIZE * 0.7f;
-            float eye_base_y = enemies_arr[i].y * TILE_SIZE + HUD_HEIGHT + TILE_SIZE * 0.35f;
-            float pupil_offset_x = 0;
-            float pupil_offset_y = 0;
-            float eye_radius_outer = TILE_SIZE * 0.12f;
-            float eye_radius_inner = TILE_SIZE * 0.07f;
-
-            switch (enemies_arr[i].direction) {
-            case DIR_UP: pupil_offset_y = -TILE_SIZE * 0.035f; break;
-            case DIR_DOWN: pupil_offset_y = TILE_SIZE * 0.035f; break;
-            case DIR_LEFT: pupil_offset_x = -TILE_SIZE * 0.035f; break;
-            case DIR_RIGHT: pupil_offset_x = TILE_SIZE * 0.035f; break;
-            default: break;
-            }
-            al_draw_filled_circle(eye_base_x_l, eye_base_y, eye_radius_outer, al_map_rgb(255, 255, 255));
-            al_draw_filled_circle(eye_base_x_r, eye_base_y, eye_radius_outer, al_map_rgb(255, 255, 255));
-            al_draw_filled_circle(eye_base_x_l + pupil_offset_x, eye_base_y + pupil_offset_y, eye_radius_inner, al_map_rgb(10, 10, 10));
-            al_draw_filled_circle(eye_base_x_r + pupil_offset_x, eye_base_y + pupil_offset_y, eye_radius_inner, al_map_rgb(10, 10, 10));
-        }
+TRAIN_API void trening_obserwacje(TrainingBatch* batch, float* obs) {
+    int stride = trening_rozmiar_obserwacji(batch);
+    trening_wejdz(batch);
+    for (int i = 0; i < batch->count; i++) {
+        game_map = &batch->envs[i].map;
+        przywroc_stan_gry(&batch->envs[i].state);
+        trening_obserwuj(batch, obs + (size_t)i * stride);
     }
+    trening_wyjdz(batch);
 }
 
 /**
- * @brief Rysuje gracza na mapie.
- * Wybiera odpowiedni sprite w zależności od kierunku, w którym gracz jest zwrócony.
- * Obsługuje również efekt migotania podczas nietykalności.
- * @param p Wskaźnik do struktury gracza.
+ * @brief Wykonuje jedną klatkę symulacji w każdym środowisku zestawu.
+ * * Dla środowiska `i` akcja `actions[i]` (maska GAME_INPUT) przechodzi przez krok_symulacji.
+ * Nagroda to zmiana wyniku razy TRAIN_REWARD_PER_POINT, TRAIN_REWARD_LIFE_LOST za każde stracone
+ * życie i TRAIN_REWARD_WIN za ukończenie planszy. Epizod kończy się końcem gry albo po
+ * TRAIN_MAX_EPISODE_TICKS klatkach; środowisko od razu zaczyna wtedy nową grę, a `obs` zawiera
+ * już jej pierwszą obserwację.
+ * @param batch Wskaźnik do zestawu środowisk.
+ * @param actions Akcje, po jednej na środowisko.
+ * @param obs Bufor na count * trening_rozmiar_obserwacji liczb.
+ * @param rewards Bufor na count nagród.
+ * @param dones Bufor na count flag końca epizodu.
  */
-void rysuj_gracza(Player* p) {
-    if (p->is_alive) {
-        ALLEGRO_BITMAP* sprite_to_draw = player_sprite_front;
-        switch (p->direction) {
-        case PLAYER_DIR_UP:    sprite_to_draw = player_sprite_back;  break;
-        case PLAYER_DIR_DOWN:  sprite_to_draw = player_sprite_front; break;
-        case PLAYER_DIR_LEFT:  sprite_to_draw = player_sprite_left;  break;
-        case PLAYER_DIR_RIGHT: sprite_to_draw = player_sprite_right; break;
+TRAIN_API void trening_krok(TrainingBatch* batch, const unsigned char* actions, float* obs, float* rewards, unsigned char* dones) {
+    int stride = trening_rozmiar_obserwacji(batch);
+    trening_wejdz(batch);
+    for (int i = 0; i < batch->count; i++) {
+        TrainingEnv* env = &batch->envs[i];
+        game_map = &env->map;
+        przywroc_stan_gry(&env->state);
+
+        int score = player.score;
+        int lives = player.lives;
+        krok_symulacji(actions[i]);
+        env->episode_ticks++;
+
+        float reward = (float)(player.score - score) * TRAIN_REWARD_PER_POINT;
+        if (player.lives < lives) reward += (float)(lives - player.lives) * TRAIN_REWARD_LIFE_LOST;
+        if (current_game_state == GAME_OVER && player.is_alive) reward += TRAIN_REWARD_WIN;
+        bool done = current_game_state != PLAYING || env->episode_ticks >= TRAIN_MAX_EPISODE_TICKS;
+        if (done) {
+            trening_nowa_gra(env);
+            batch->stat_episodes++;
         }
 
-        if (sprite_to_draw) {
-            if (p->invincible) {
-                if ((p->invincibility_timer / 4) % 2 == 0) {
-                    al_draw_bitmap(sprite_to_draw, p->x * TILE_SIZE, p->y * TILE_SIZE + HUD_HEIGHT, 0);
-                }
-            }
-            else {
-                al_draw_bitmap(sprite_to_draw, p->x * TILE_SIZE, p->y * TILE_SIZE + HUD_HEIGHT, 0);
-            }
-        }
-        else { /* Fallback, jeśli sprite gracza nie jest załadowany */ }
+        rewards[i] = reward;
+        dones[i] = (unsigned char)done;
+        trening_obserwuj(batch, obs + (size_t)i * stride);
+        zapisz_stan_gry(&env->state);
+        mapa_przytnij_dziennik(game_map, env->state.map_journal);
     }
+    batch->stat_steps += (uint64_t)batch->count;
+    trening_wyjdz(batch);
 }
 
 /**
- * @brief Główna funkcja rysująca całą grę.
- * * W zależności od aktualnego stanu gry, wywołuje odpowiednie funkcje rysujące
- * poszczególne elementy (ekran startowy, HUD, mapę, obiekty, gracza, ekran końca gry).
- * Na końcu odświeża ekran.
- * @param display Wskaźnik do ekranu Allegro.
- * @param p Wskaźnik do struktury gracza.
- * @param bombs_arr Tablica bomb.
- * @param enemies_arr Tablica wrogów.
- * @param powerups_arr Tablica power-upów.
- * @param game_map_arr Tablica mapy gry.
- * @param current_s Aktualny stan gry.
- * @param exit_rev Flaga odkrycia wyjścia.
- * @param ex_x Współrzędna X wyjścia.
- * @param ex_y Współrzędna Y wyjścia.
+ * @brief Zwalnia zestaw środowisk.
+ * @param batch Wskaźnik do zestawu środowisk (może być NULL).
  */
-void rysuj_gre(ALLEGRO_DISPLAY* display, Player* p, Bomb bombs_arr[], Enemy enemies_arr[], Powerup powerups_arr[], int game_map_arr[MAP_HEIGHT][MAP_WIDTH], GAME_STATE current_s, bool exit_rev, int ex_x, int ex_y) {
-    al_clear_to_color(al_map_rgb(0, 0, 0));
+TRAIN_API void trening_zwolnij(TrainingBatch* batch) {
+    if (!batch) return;
+    for (int i = 0; i < batch->count; i++) {
+        mapa_zwolnij(&batch->envs[i].map);
+        migawka_zwolnij(&batch->envs[i].state);
+    }
+    free(batch->envs);
+    free(batch);
+}
 
-    if (current_s == START_SCREEN) {
-        rysuj_ekran_startowy(display);
+/**
+ * @brief Uruchamia test wydajności środowisk treningowych (--train-bench).
+ * * Krokuje `count` środowisk o rozmiarze nowej mapy gry przez TRAIN_BENCH_STEPS kroków
+ * z losowymi akcjami i wypisuje liczbę kroków środowisk na sekundę.
+ * @param count Liczba środowisk.
+ * @return 0 po udanym teście, -1 przy błędzie.
+ */
+int trening_test(int count) {
+    uint32_t seed = seed_override ? seed_override : TRAIN_BENCH_SEED;
+    TrainingBatch* batch = trening_utworz(count, world_width, world_height, seed);
+    int stride = batch ? trening_rozmiar_obserwacji(batch) : 0;
+    float* obs = batch ? (float*)malloc(sizeof(float) * (size_t)count * stride) : NULL;
+    float* rewards = (float*)malloc(sizeof(float) * (size_t)count);
+    unsigned char* actions = (unsigned char*)calloc((size_t)count, 1);
+    unsigned char* dones = (unsigned char*)malloc((size_t)count);
+    if (!batch || !obs || !rewards || !actions || !dones) {
+        fprintf(stderr, "Failed to create training benchmark.\n");
+        free(obs); free(rewards); free(actions); free(dones);
+        trening_zwolnij(batch);
+        return -1;
     }
-    else if (current_s == PLAYING || current_s == GAME_OVER) {
-        rysuj_hud(p);
-        rysuj_mape(game_map_arr);
-        rysuj_wyjscie(exit_rev, ex_x, ex_y);
-        rysuj_powerupy(powerups_arr);
-        rysuj_bomby_i_eksplozje(bombs_arr, game_map_arr);
-        rysuj_wrogow(enemies_arr);
-        rysuj_gracza(p);
 
-        if (current_s == GAME_OVER) {
-            rysuj_ekran_konca_gry(display, p, enemies_arr, exit_rev, ex_x, ex_y);
-        }
+    static const unsigned char choices[] = { INPUT_NONE, INPUT_UP, INPUT_DOWN, INPUT_LEFT, INPUT_RIGHT, INPUT_BOMB };
+    srand(seed);
+    double total_reward = 0.0;
+    double start = al_get_time();
+    for (int step = 0; step < TRAIN_BENCH_STEPS; step++) {
+        for (int i = 0; i < count; i++) actions[i] = choices[rand() % (int)sizeof(choices)];
+        trening_krok(batch, actions, obs, rewards, dones);
+        for (int i = 0; i < count; i++) total_reward += rewards[i];
     }
-    al_flip_display();
-}
+    double elapsed = al_get_time() - start;
 
+    printf("Training benchmark: %d envs %dx%d, %d planes, %d steps: %.0f env steps/s, %llu episodes, mean reward %.4f per step\n",
+        count, batch->width, batch->height, TRAIN_PLANES, TRAIN_BENCH_STEPS,
+        elapsed > 0.0 ? batch->stat_steps / elapsed : 0.0, (unsigned long long)batch->stat_episodes,
+        batch->stat_steps ? total_reward / batch->stat_steps : 0.0);
+
+    free(obs); free(rewards); free(actions); free(dones);
+    trening_zwolnij(batch);
+    return 0;
+}
 
+#ifndef BOMBERMAN_LIBRARY
 /**
  * @brief Główna funkcja programu.
  * * Odpowiada za inicjalizację biblioteki Allegro i jej dodatków, ładowanie zasobów,
  * tworzenie okna, timera i kolejki zdarzeń. Zawiera główną pętlę gry, która obsługuje
  * zdarzenia, aktualizuje logikę gry i rysuje klatki. Na końcu zwalnia wszystkie
  * zaalokowane zasoby.
+ * * Klatka jest rysowana tylko wtedy, gdy coś się zmieniło (klatka symulacji, wejście w menu,
+ * odsłonięcie lub zmiana rozmiaru okna). Timer działa wyłącznie, gdy scena się animuje
+ * (dostosuj_zegar), a gdy okno traci fokus, zwalnia do BACKGROUND_TICK_RATE.
+ * * Obsługiwane argumenty wiersza poleceń:
+ * - `--rollback-test[=N]` - wejście z klawiatury trafia do gry jak od zdalnego peera,
+ *   opóźnione o N klatek (domyślnie 4), co wymusza przewidywanie i rollback.
+ * - `--low-latency` - próbkowanie klawiatury przed każdą klatką symulacji (ruch z przytrzymanego
+ *   klawisza) i renderowanie wyłącznie najnowszej klatki, gdy kolejka zdarzeń jest zaległa.
+ * - `--repeat=N` - odstęp w klatkach między ruchami przy przytrzymanym klawiszu (domyślnie KEY_REPEAT_TICKS).
+ * - `--no-vsync` - wyłącza synchronizację pionową, aby al_flip_display nie czekało na odświeżenie ekranu.
+ * - `--fullscreen` - okno pełnoekranowe; klatka FRAME_WIDTH x FRAME_HEIGHT jest skalowana do ekranu.
+ * - `--window-scale=N` - początkowy rozmiar okna jako N-krotność klatki (okno można potem dowolnie zmieniać).
+ * - `--smooth` - klatka dopasowana do okna z filtrowaniem liniowym zamiast skalowania całkowitego (PRESENT_FIT).
+ * - `--map=WxH` - rozmiar mapy w kafelkach (co najmniej 5 x 5).
+ * - `--endurance` - tryb wytrzymałościowy (GAME_MODE_ENDURANCE) na mapie ENDURANCE_MAP_WIDTH x ENDURANCE_MAP_HEIGHT
+ *   z większą liczbą wrogów (fragmenty poza gorącym obszarem trafiają do pliku wymiany MAP_SWAP_FILE).
+ * - `--rules=NAZWA` - wbudowany zestaw reguł: classic, large-arena lub chaos (domyślnie zależy od trybu gry).
+ * - `--rule=KLUCZ=WARTOŚĆ` - zmienia pojedynczą regułę (np. `--rule=fuse=90`); gra używa wtedy
+ *   symulacji czytającej reguły w czasie działania zamiast wyspecjalizowanej kopii.
+ * - `--metrics=PLIK` - co METRICS_EXPORT_INTERVAL sekund dopisuje metryki jako linię JSON do PLIKU
+ *   i zapisuje je w formacie Prometheusa do PLIK.prom.
+ * - `--render-bench[=KATALOG]` - zamiast gry uruchamia test wydajności rysowania bez ekranu (bitmapy w pamięci)
+ *   i porównuje klatki z obrazami wzorcowymi z KATALOGU (domyślnie `golden`; brakujące wzorce są tworzone).
+ * - `--render-bench-gpu` - jak `--render-bench`, ale rysuje do bitmapy karty graficznej (tworzy okno).
+ * - `--render-frames=N` - liczba klatek na scenę testu wydajności rysowania (domyślnie RENDER_BENCH_FRAMES).
+ * - `--seed=N` - stałe ziarno generatora symulacji zamiast ziarna z zegara.
+ * - `--hash-log=PLIK` - zapisuje do PLIKU skrót stanu gry każdej klatki (skrot_zapisz_klatke), aby dwa
+ *   uruchomienia można było porównać i znaleźć pierwszą rozbieżną klatkę.
+ * - `--train-bench[=N]` - zamiast gry mierzy wydajność N środowisk treningowych (domyślnie TRAIN_BENCH_ENVS)
+ *   na mapach o rozmiarze z `--map`.
+ * - `--record=PLIK` - nagrywa powtórkę gry (ziarno, konfiguracja i wejście każdej klatki) do PLIKU po jej zakończeniu.
+ * - `--replay=PLIK` - zamiast gry eksportuje klatki powtórki bez okna (powtorka_eksportuj); wymaga
+ *   `--export-png=KATALOG` (sekwencja PNG) albo `--export-raw=PLIK` (surowe klatki RGBA, np. potok nazwany dla ffmpeg).
+ * - `--export-workers=N` - liczba wątków kodujących PNG (domyślnie liczba rdzeni bez jednego).
+ * @param argc Liczba argumentów wiersza poleceń.
+ * @param argv Tablica argumentów wiersza poleceń.
  * @return Zwraca 0 w przypadku pomyślnego zakończenia, lub wartość ujemną w przypadku błędu.
  */
-int main() {
+int main(int argc, char** argv) {
     ALLEGRO_DISPLAY* display = NULL;
     ALLEGRO_EVENT_QUEUE* event_queue = NULL;
     ALLEGRO_TIMER* timer = NULL;
+    ALLEGRO_TIMER* metrics_timer = NULL;
     bool keyboard_installed = false;
     bool audio_installed = false;
     int ret_val = 0;
+    int level_start = 1;
+    const char* pack_build = NULL;
 
     font_main = NULL;
     player_sprite_front = NULL; player_sprite_back = NULL; player_sprite_left = NULL; player_sprite_right = NULL;
     destructible_wall_sprite = NULL; dynamite_sprite = NULL; sparks_sprite = NULL; exit_sprite = NULL;
-    background_music_sample = NULL; background_music_instance = NULL;
+    background_music_stream = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--rollback-test", 15) == 0) {
+            int delay = (argv[i][15] == '=') ? atoi(argv[i] + 16) : 4;
+            if (delay < 1) delay = 1;
+            if (delay > ROLLBACK_MAX_TICKS) delay = ROLLBACK_MAX_TICKS;
+            rollback.remote_player = true;
+            rollback.loopback_delay = delay;
+            printf("Rollback test: local input delayed by %d ticks and predicted.\n", delay);
+        }
+        else if (strcmp(argv[i], "--low-latency") == 0) {
+            latency.enabled = true;
+        }
+        else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            latency.repeat_ticks = atoi(argv[i] + 9);
+            if (latency.repeat_ticks < 1) latency.repeat_ticks = 1;
+        }
+        else if (strcmp(argv[i], "--no-vsync") == 0) {
+            latency.vsync_off = true;
+        }
+        else if (strcmp(argv[i], "--fullscreen") == 0) {
+            presenter.fullscreen = true;
+        }
+        else if (strncmp(argv[i], "--window-scale=", 15) == 0) {
+            presenter.window_scale = atoi(argv[i] + 15);
+            if (presenter.window_scale < 1) presenter.window_scale = 1;
+        }
+        else if (strcmp(argv[i], "--smooth") == 0) {
+            presenter.mode = PRESENT_FIT;
+        }
+        else if (strncmp(argv[i], "--map=", 6) == 0) {
+            char* end = NULL;
+            long w = strtol(argv[i] + 6, &end, 10);
+            long h = (*end == 'x') ? strtol(end + 1, &end, 10) : 0;
+            if (*end == '\0' && w >= 5 && h >= 5 && w <= INT_MAX && h <= INT_MAX) {
+                world_width = (int)w;
+                world_height = (int)h;
+            }
+            else {
+                fprintf(stderr, "Invalid map size: %s (expected --map=WxH, at least 5x5)\n", argv[i] + 6);
+            }
+        }
+        else if (strncmp(argv[i], "--rules=", 8) == 0) {
+            const GameRules* chosen = NULL;
+            for (int k = 0; k < RULESET_CUSTOM; k++) {
+                if (strcmp(argv[i] + 8, shipped_rules[k]->name) == 0) chosen = shipped_rules[k];
+            }
+            if (chosen) {
+                rules_override = chosen;
+            }
+            else {
+                fprintf(stderr, "Unknown rule set: %s (expected classic, large-arena or chaos)\n", argv[i] + 8);
+            }
+        }
+        else if (strncmp(argv[i], "--rule=", 7) == 0) {
+            if (!reguly_ustaw_pole(argv[i] + 7)) {
+                fprintf(stderr, "Invalid rule: %s (expected --rule=KEY=VALUE, keys: fuse, explosion, enemy-delay, drop-chance, invincibility, max-radius, lives, enemy-points, wall-points)\n", argv[i] + 7);
+            }
+        }
+        else if (strncmp(argv[i], "--metrics=", 10) == 0) {
+            if (!metryki_init(argv[i] + 10)) {
+                fprintf(stderr, "Invalid metrics path: %s\n", argv[i] + 10);
+            }
+        }
+        else if (strcmp(argv[i], "--render-bench") == 0 || strncmp(argv[i], "--render-bench=", 15) == 0) {
+            render_bench.enabled = true;
+            if (argv[i][14] == '=') snprintf(render_bench.golden_dir, sizeof(render_bench.golden_dir), "%s", argv[i] + 15);
+        }
+        else if (strcmp(argv[i], "--render-bench-gpu") == 0) {
+            render_bench.enabled = true;
+            render_bench.gpu = true;
+        }
+        else if (strncmp(argv[i], "--render-frames=", 16) == 0) {
+            render_bench.frames = atoi(argv[i] + 16);
+            if (render_bench.frames < 1) render_bench.frames = 1;
+        }
+        else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            seed_override = (uint32_t)strtoul(argv[i] + 7, NULL, 10);
+        }
+        else if (strncmp(argv[i], "--hash-log=", 11) == 0) {
+            if (hash_log) fclose(hash_log);
+            hash_log = plik_otworz(argv[i] + 11, "w");
+            if (!hash_log) {
+                fprintf(stderr, "Failed to open hash log %s\n", argv[i] + 11);
+            }
+        }
+        else if (strcmp(argv[i], "--train-bench") == 0 || strncmp(argv[i], "--train-bench=", 14) == 0) {
+            train_bench_envs = (argv[i][13] == '=') ? atoi(argv[i] + 14) : TRAIN_BENCH_ENVS;
+            if (train_bench_envs < 1) train_bench_envs = 1;
+        }
+        else if (strncmp(argv[i], "--level-pack=", 13) == 0) {
+            paczka_otworz(argv[i] + 13);
+        }
+        else if (strncmp(argv[i], "--level=", 8) == 0) {
+            level_start = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "--pack-build=", 13) == 0) {
+            pack_build = argv[i] + 13;
+        }
+        else if (strncmp(argv[i], "--record=", 9) == 0) {
+            snprintf(replay_recorder.path, sizeof(replay_recorder.path), "%s", argv[i] + 9);
+        }
+        else if (strncmp(argv[i], "--replay=", 9) == 0) {
+            snprintf(replay_export.replay_path, sizeof(replay_export.replay_path), "%s", argv[i] + 9);
+        }
+        else if (strncmp(argv[i], "--export-png=", 13) == 0) {
+            snprintf(replay_export.png_dir, sizeof(replay_export.png_dir), "%s", argv[i] + 13);
+        }
+        else if (strncmp(argv[i], "--export-raw=", 13) == 0) {
+            if (replay_export.raw) fclose(replay_export.raw);
+            replay_export.raw = plik_otworz(argv[i] + 13, "wb");
+            if (!replay_export.raw) {
+                fprintf(stderr, "Failed to open raw export output %s\n", argv[i] + 13);
+            }
+        }
+        else if (strncmp(argv[i], "--export-workers=", 17) == 0) {
+            replay_export.workers = atoi(argv[i] + 17);
+        }
+        else if (strcmp(argv[i], "--endurance") == 0) {
+            game_mode = &game_modes[GAME_MODE_ENDURANCE];
+            world_width = game_mode->map_width;
+            world_height = game_mode->map_height;
+        }
+        else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+        }
+    }
 
+    bool exporting = replay_export.replay_path[0] != '\0';
+    if (exporting && !replay_export.raw && !replay_export.png_dir[0]) {
+        fprintf(stderr, "--replay needs --export-png=DIR or --export-raw=FILE\n");
+        return -1;
+    }
+    if (render_bench.enabled || exporting) {
+        // Nagrywane są tylko gry w oknie, nie sceny testu ani odtwarzana powtórka.
+        replay_recorder.path[0] = '\0';
+    }
 
     if (!al_init()) {
         fprintf(stderr, "Failed to initialize Allegro!\n");
         return -1;
     }
 
-    if (!al_install_keyboard()) {
-        fprintf(stderr, "Failed to install keyboard...\n");
-        ret_val = -1;
+    if (pack_build) {
+        char source_path[1024];
+        const char* comma = strchr(pack_build, ',');
+        if (!comma || (size_t)(comma - pack_build) >= sizeof(source_path)) {
+            fprintf(stderr, "Invalid pack build: %s (expected --pack-build=SOURCE,PACK)\n", pack_build);
+            ret_val = -1;
+        }
+        else {
+            snprintf(source_path, sizeof(source_path), "%.*s", (int)(comma - pack_build), pack_build);
+            ret_val = paczka_zbuduj(source_path, comma + 1);
+        }
+        goto cleanup;
+    }
+    if (level_pack.data) {
+        if (level_start < 1 || level_start > level_pack.count) {
+            fprintf(stderr, "Invalid level %d (the pack has %d levels), starting from level 1.\n", level_start, level_pack.count);
+            level_start = 1;
+        }
+        level_pack.current = level_start - 1;
+    }
+
+    if (train_bench_envs > 0) {
+        ret_val = trening_test(train_bench_envs);
         goto cleanup;
     }
-    keyboard_installed = true;
+
+    // Test wydajności rysowania i eksport powtórki nie potrzebują klawiatury ani dźwięku.
+    if (!render_bench.enabled && !exporting) {
+        if (!al_install_keyboard()) {
+            fprintf(stderr, "Failed to install keyboard...\n");
+            ret_val = -1;
+            goto cleanup;
+        }
+        keyboard_installed = true;
+    }
 
     if (!al_init_primitives_addon()) { fprintf(stderr, "Failed to initialize primitives addon!\n"); ret_val = -1; goto cleanup; }
     if (!al_init_image_addon()) { fprintf(stderr, "Failed to initialize image addon!\n"); ret_val = -1; goto cleanup; }
     if (!al_init_font_addon()) { fprintf(stderr, "Failed to initialize font addon!\n"); ret_val = -1; goto cleanup; }
     if (!al_init_ttf_addon()) { fprintf(stderr, "Failed to initialize TTF addon!\n"); ret_val = -1; goto cleanup; }
 
-    if (!al_install_audio()) {
-        fprintf(stderr, "Failed to initialize audio!\n");
-        ret_val = -1;
-        goto cleanup;
-    }
-    audio_installed = true;
+    if (!render_bench.enabled && !exporting) {
+        if (!al_install_audio()) {
+            fprintf(stderr, "Failed to initialize audio!\n");
+            ret_val = -1;
+            goto cleanup;
+        }
+        audio_installed = true;
 
-    if (!al_init_acodec_addon()) {
-        fprintf(stderr, "Failed to initialize audio codecs! (OGG support might be missing)\n");
-    }
+        if (!al_init_acodec_addon()) {
+            fprintf(stderr, "Failed to initialize audio codecs! (OGG support might be missing)\n");
+        }
 
-    if (!al_reserve_samples(1)) {
-        fprintf(stderr, "Failed to reserve samples!\n");
+        // Domyślny mikser bez zarezerwowanych próbek - efekty mają własną pulę głosów (dzwieki_init).
+        if (!al_reserve_samples(0)) {
+            fprintf(stderr, "Failed to create the default mixer!\n");
+        }
     }
 
 
@@ -1327,13 +7489,24 @@ int main() {
         fprintf(stderr, "Failed to load font! (arial.ttf)\n");
     }
 
-    display = al_create_display(MAP_WIDTH * TILE_SIZE, (MAP_HEIGHT * TILE_SIZE) + HUD_HEIGHT);
-    if (!display) {
-        fprintf(stderr, "Failed to create display!\n");
-        ret_val = -1;
-        goto cleanup;
+    if ((render_bench.enabled && !render_bench.gpu) || exporting) {
+        // Bez ekranu: sprite'y, warstwy interfejsu i klatki testu lub eksportu są bitmapami w pamięci.
+        al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+    }
+    else {
+        if (latency.vsync_off) {
+            al_set_new_display_option(ALLEGRO_VSYNC, 2, ALLEGRO_SUGGEST);
+        }
+        al_set_new_display_flags(al_get_new_display_flags() | ALLEGRO_GENERATE_EXPOSE_EVENTS |
+            (presenter.fullscreen ? ALLEGRO_FULLSCREEN_WINDOW : ALLEGRO_RESIZABLE));
+        display = al_create_display(FRAME_WIDTH * presenter.window_scale, FRAME_HEIGHT * presenter.window_scale);
+        if (!display) {
+            fprintf(stderr, "Failed to create display!\n");
+            ret_val = -1;
+            goto cleanup;
+        }
+        al_set_window_title(display, "Bomberman");
     }
-    al_set_window_title(display, "Bomberman");
 
     player_sprite_front = al_load_bitmap("player-front.png");
     if (!player_sprite_front) { fprintf(stderr, "Failed to load player-front.png!\n"); ret_val = -1; goto cleanup; }
@@ -1358,25 +7531,31 @@ int main() {
         fprintf(stderr, "Failed to load exit.png! Using default exit drawing.\n");
     }
 
-    background_music_sample = al_load_sample("Background_Music.ogg");
-    if (!background_music_sample) {
-        fprintf(stderr, "Failed to load Background_Music.ogg!\n");
-    }
-    else {
-        background_music_instance = al_create_sample_instance(background_music_sample);
-        if (!background_music_instance) {
-            fprintf(stderr, "Failed to create background music instance!\n");
-            al_destroy_sample(background_music_sample);
-            background_music_sample = NULL;
-        }
-        else {
-            al_set_sample_instance_playmode(background_music_instance, ALLEGRO_PLAYMODE_LOOP);
-            al_attach_sample_instance_to_mixer(background_music_instance, al_get_default_mixer());
-            al_set_sample_instance_gain(background_music_instance, 0.05f);
+    if (audio_installed && al_get_default_mixer()) {
+        muzyka_zaladuj(al_get_default_mixer());
+        if (!dzwieki_init(al_get_default_mixer())) {
+            dzwieki_zwolnij();
         }
     }
 
 
+    czasteczki_init();
+    wybuchy_init(al_get_cpu_count() - 1);
+    teren_init();
+    if (display && !render_bench.enabled) {
+        prezentacja_init(display);
+    }
+    ui_uklad(FRAME_WIDTH, FRAME_HEIGHT);
+
+    if (render_bench.enabled) {
+        ret_val = test_rysowania_uruchom();
+        goto cleanup;
+    }
+    if (exporting) {
+        ret_val = powtorka_eksportuj();
+        goto cleanup;
+    }
+
     event_queue = al_create_event_queue();
     if (!event_queue) {
         fprintf(stderr, "Failed to create event queue.\n");
@@ -1386,18 +7565,37 @@ int main() {
     al_register_event_source(event_queue, al_get_display_event_source(display));
     al_register_event_source(event_queue, al_get_keyboard_event_source());
 
-    srand(time(NULL));
+    uint32_t seed = seed_override ? seed_override : (uint32_t)time(NULL);
+    srand(seed);
+    rng_state = seed | 1u;
 
-    timer = al_create_timer(1.0 / 60.0);
+    timer = al_create_timer(1.0 / TICK_RATE);
     if (!timer) {
         fprintf(stderr, "Failed to create timer.\n");
         ret_val = -1;
         goto cleanup;
     }
     al_register_event_source(event_queue, al_get_timer_event_source(timer));
-    al_start_timer(timer);
+
+    if (metrics.enabled) {
+        metrics_timer = al_create_timer(METRICS_EXPORT_INTERVAL);
+        if (metrics_timer) {
+            al_register_event_source(event_queue, al_get_timer_event_source(metrics_timer));
+            al_start_timer(metrics_timer);
+        }
+        else {
+            fprintf(stderr, "Failed to create metrics timer, metrics disabled.\n");
+            metrics.enabled = false;
+        }
+    }
+
+    // Pierwsza klatka jest rysowana od razu - przy zatrzymanym timerze na ekranie startowym
+    // pętla mogłaby czekać na zdarzenie wejścia lub okna, które nie nadejdzie.
+    dostosuj_zegar(timer);
+    narysuj_klatke(display);
 
     bool done = false;
+    bool redraw = false;
     // Główna pętla gry
     while (!done) {
         ALLEGRO_EVENT event;
@@ -1406,21 +7604,83 @@ int main() {
         if (event.type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
             done = true;
         }
+        else if (event.type == ALLEGRO_EVENT_DISPLAY_RESIZE) {
+            al_acknowledge_resize(display);
+            prezentacja_uklad(al_get_display_width(display), al_get_display_height(display));
+            redraw = true;
+        }
+        else if (event.type == ALLEGRO_EVENT_DISPLAY_EXPOSE) {
+            redraw = true;
+        }
+        else if (event.type == ALLEGRO_EVENT_DISPLAY_SWITCH_OUT) {
+            al_set_timer_speed(timer, 1.0 / BACKGROUND_TICK_RATE);
+        }
+        else if (event.type == ALLEGRO_EVENT_DISPLAY_SWITCH_IN) {
+            al_set_timer_speed(timer, 1.0 / TICK_RATE);
+            redraw = true;
+        }
         else if (event.type == ALLEGRO_EVENT_KEY_DOWN && event.keyboard.keycode == ALLEGRO_KEY_ESCAPE) {
             done = true;
         }
         else if (event.type == ALLEGRO_EVENT_KEY_DOWN) {
+            if (current_game_state != PLAYING) redraw = true;
             obsluz_wejscie(event, &player, &current_game_state);
         }
+        else if (event.type == ALLEGRO_EVENT_TIMER && metrics_timer && event.timer.source == al_get_timer_event_source(metrics_timer)) {
+            metryki_eksportuj();
+        }
         else if (event.type == ALLEGRO_EVENT_TIMER) {
-            aktualizuj_gre(&player, bombs, enemies, powerups, game_map, &current_game_state, &exit_revealed, exit_x, exit_y);
-            rysuj_gre(display, &player, bombs, enemies, powerups, game_map, current_game_state, exit_revealed, exit_x, exit_y);
+            if (current_game_state == PLAYING) {
+                if (latency.enabled) {
+                    probkuj_klawiature(&pending_input);
+                }
+                if (latency.in_flight_ts < 0) {
+                    latency.in_flight_ts = latency.probe_ts;
+                }
+                latency.probe_ts = -1.0;
+
+                double tick_start = metrics.enabled ? al_get_time() : 0.0;
+                rollback_krok(pending_input);
+                pending_input = INPUT_NONE;
+                if (metrics.enabled) metryki_histogram_dodaj(&metrics.tick_time, al_get_time() - tick_start);
+                dzwieki_odtworz_zgloszone();
+                if (rollback.tick % MAP_REPORT_INTERVAL == 0) {
+                    mapa_raport(game_map);
+                    pula_raport(&enemy_pool);
+                    pula_raport(&bomb_pool);
+                    pula_raport(&powerup_pool);
+                    dzwieki_raport();
+                }
+                if (current_game_state == GAME_OVER) {
+                    muzyka_odtwarzaj(false);
+                    powtorka_zakoncz();
+                }
+            }
+
+            czasteczki_aktualizuj();
+            redraw = true;
+        }
+
+        dostosuj_zegar(timer);
+        metryki_zdarzenie(event_queue);
+
+        if (redraw) {
+            // W trybie niskich opóźnień zaległe klatki są tylko symulowane - rysowana jest najnowsza.
+            ALLEGRO_EVENT next_event;
+            bool stale_frame = latency.enabled && al_peek_next_event(event_queue, &next_event) && next_event.type == ALLEGRO_EVENT_TIMER &&
+                next_event.timer.source == al_get_timer_event_source(timer);
+            if (!stale_frame) {
+                narysuj_klatke(display);
+                redraw = false;
+            }
         }
     }
 
 cleanup:
+    metryki_eksportuj();
     // Zwalnianie wszystkich załadowanych zasobów Allegro
     if (timer) al_destroy_timer(timer);
+    if (metrics_timer) al_destroy_timer(metrics_timer);
 
     if (player_sprite_front) al_destroy_bitmap(player_sprite_front);
     if (player_sprite_back) al_destroy_bitmap(player_sprite_back);
@@ -1430,9 +7690,21 @@ cleanup:
     if (dynamite_sprite) al_destroy_bitmap(dynamite_sprite);
     if (sparks_sprite) al_destroy_bitmap(sparks_sprite);
     if (exit_sprite) al_destroy_bitmap(exit_sprite);
-
-    if (background_music_instance) al_destroy_sample_instance(background_music_instance);
-    if (background_music_sample) al_destroy_sample(background_music_sample);
+    teren_zwolnij();
+    ui_zwolnij();
+    prezentacja_zwolnij();
+    powtorka_zakoncz();
+    free(replay_recorder.inputs);
+    if (replay_export.raw) fclose(replay_export.raw);
+    mapa_zwolnij(game_map);
+    paczka_zamknij();
+    zajete_zwolnij(&spawn_taken);
+    if (hash_log) fclose(hash_log);
+    wybuchy_zwolnij();
+    pule_zwolnij();
+
+    dzwieki_zwolnij();
+    if (background_music_stream) al_destroy_audio_stream(background_music_stream);
 
 
     if (font_main) al_destroy_font(font_main);
@@ -1449,3 +7721,4 @@ cleanup:
 
     return ret_val;
 }
+#endif